@@ -20,6 +20,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-chain-training.h"
+#include "nnet3/nnet-example-loader.h"
 #include "cudamatrix/cu-allocator.h"
 
 int main(int argc, char *argv[]) {
@@ -33,17 +34,27 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Train nnet3+chain neural network parameters with backprop and stochastic\n"
         "gradient descent.  Minibatches are to be created by nnet3-chain-merge-egs in\n"
-        "the input pipeline.  This training program is single-threaded (best to\n"
-        "use it with a GPU).\n"
+        "the input pipeline, or by this program if --merge=true.  The examples\n"
+        "are read, merged and decompressed in background threads (see\n"
+        "--loader-threads).  The training itself is single-threaded (best to\n"
+        "use it with a GPU).  Several copies of this program, e.g. on several\n"
+        "machines, can train one model together, averaging their parameter\n"
+        "changes after each minibatch (see the --allreduce.* options).\n"
         "\n"
         "Usage:  nnet3-chain-train [options] <raw-nnet-in> <denominator-fst-in> <chain-training-examples-in> <raw-nnet-out>\n"
         "\n"
-        "nnet3-chain-train 1.raw den.fst 'ark:nnet3-merge-egs 1.cegs ark:-|' 2.raw\n";
+        "nnet3-chain-train 1.raw den.fst 'ark:nnet3-merge-egs 1.cegs ark:-|' 2.raw\n"
+        "or:\n"
+        "nnet3-chain-train --merge=true --merge.minibatch-size=64 1.raw den.fst \\\n"
+        "   ark:1.cegs 2.raw\n";
 
     int32 srand_seed = 0;
     bool binary_write = true;
     std::string use_gpu = "yes";
     NnetChainTrainingOptions opts;
+    ExampleLoaderOptions loader_opts;
+    // the same default as nnet3-chain-merge-egs.
+    loader_opts.merge_config.minibatch_size = "64";
 
     ParseOptions po(usage);
     po.Register("srand", &srand_seed, "Seed for random number generator ");
@@ -52,6 +63,7 @@ int main(int argc, char *argv[]) {
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
 
     opts.Register(&po);
+    loader_opts.Register(&po);
 #if HAVE_CUDA==1
     CuDevice::RegisterDeviceOptions(&po);
 #endif
@@ -86,11 +98,12 @@ int main(int argc, char *argv[]) {
 
       NnetChainTrainer trainer(opts, den_fst, &nnet);
 
-      SequentialNnetChainExampleReader example_reader(examples_rspecifier);
+      NnetChainExampleLoader example_loader(loader_opts, examples_rspecifier);
 
-      for (; !example_reader.Done(); example_reader.Next())
-        trainer.Train(example_reader.Value());
+      for (; !example_loader.Done(); example_loader.Next())
+        trainer.Train(example_loader.Value());
 
+      example_loader.PrintStats();
       ok = trainer.PrintTotalStats();
     }
 
@@ -475,6 +475,115 @@ static void UnitTestBackpropLstmNonlinearity() {
   }
 }
 
+// Checks the float versions of the CPU LSTM functions, which use fast
+// approximations of sigmoid and tanh, against the double versions, and
+// measures their speed.  This always runs on the CPU.
+static void UnitTestCpuLstmNonlinearity() {
+  for (int32 i = 0; i < 3; i++) {
+    int32 num_rows = 1 + Rand() % 100,
+        cell_dim = 1 + Rand() % 500,
+        dropout_dim = (RandInt(0, 1) == 0 ? 0 : 3);
+    Matrix<double> input(num_rows, 5 * cell_dim + dropout_dim),
+        params(3, cell_dim), output_deriv(num_rows, 2 * cell_dim),
+        deriv_sum_in(5, cell_dim);
+    Vector<double> self_repair_config(10);
+    input.SetRandn();
+    params.SetRandn();
+    output_deriv.SetRandn();
+    deriv_sum_in.SetRandn();
+    self_repair_config.SetRandn();
+    double count_in = Rand() % num_rows;
+
+    Matrix<double> output(num_rows, 2 * cell_dim);
+    cu::CpuComputeLstmNonlinearity(input, params, &output);
+    Matrix<float> input_f(input), params_f(params),
+        output_f(num_rows, 2 * cell_dim);
+    cu::CpuComputeLstmNonlinearity(input_f, params_f, &output_f);
+    Matrix<double> output_f_double(output_f);
+    output_f_double.AddMat(-1.0, output);
+    KALDI_ASSERT(output_f_double.LargestAbsElem() < 1.0e-04);
+
+    Matrix<double> input_deriv(num_rows, 5 * cell_dim + dropout_dim),
+        params_deriv(3, cell_dim), value_sum(5, cell_dim),
+        deriv_sum(5, cell_dim), self_repair_sum(5, cell_dim);
+    cu::CpuBackpropLstmNonlinearity(input, params, output_deriv, deriv_sum_in,
+                                    self_repair_config, count_in, &input_deriv,
+                                    &params_deriv, &value_sum, &deriv_sum,
+                                    &self_repair_sum);
+    Matrix<float> output_deriv_f(output_deriv),
+        input_deriv_f(num_rows, 5 * cell_dim + dropout_dim),
+        params_deriv_f(3, cell_dim), self_repair_sum_f(5, cell_dim);
+    Vector<float> self_repair_config_f(self_repair_config);
+    Matrix<double> value_sum_f(5, cell_dim), deriv_sum_f(5, cell_dim);
+    cu::CpuBackpropLstmNonlinearity(input_f, params_f, output_deriv_f,
+                                    deriv_sum_in, self_repair_config_f,
+                                    count_in, &input_deriv_f, &params_deriv_f,
+                                    &value_sum_f, &deriv_sum_f,
+                                    &self_repair_sum_f);
+    AssertEqual(Matrix<double>(input_deriv_f), input_deriv, 0.001);
+    AssertEqual(Matrix<double>(params_deriv_f), params_deriv, 0.001);
+    AssertEqual(value_sum_f, value_sum, 0.001);
+    AssertEqual(deriv_sum_f, deriv_sum, 0.001);
+  }
+
+  for (int32 dim = 128; dim <= 1024; dim *= 2) {
+    BaseFloat time_in_secs = 0.05;
+    int32 num_rows = 256, cell_dim = dim;
+    Matrix<BaseFloat> input(num_rows, 5 * cell_dim), params(3, cell_dim),
+        output(num_rows, 2 * cell_dim), output_deriv(num_rows, 2 * cell_dim),
+        input_deriv(num_rows, 5 * cell_dim), params_deriv(3, cell_dim),
+        self_repair_sum(5, cell_dim);
+    Matrix<double> deriv_sum_in(5, cell_dim), value_sum(5, cell_dim),
+        deriv_sum(5, cell_dim);
+    Vector<BaseFloat> self_repair_config(10);
+    input.SetRandn();
+    params.SetRandn();
+    output_deriv.SetRandn();
+
+    Timer tim;
+    int32 iter = 0;
+    for (; tim.Elapsed() < time_in_secs; iter++)
+      cu::CpuComputeLstmNonlinearity(input, params, &output);
+    BaseFloat melems = (BaseFloat(num_rows) * cell_dim * iter) /
+        (tim.Elapsed() * 1.0e+06);
+    KALDI_LOG << "For CpuComputeLstmNonlinearity, for cell-dim = " << dim
+              << ", speed was " << melems << " million cells per second";
+
+    tim.Reset();
+    iter = 0;
+    for (; tim.Elapsed() < time_in_secs; iter++)
+      cu::CpuBackpropLstmNonlinearity(input, params, output_deriv,
+                                      deriv_sum_in, self_repair_config, 0.0,
+                                      &input_deriv, &params_deriv, &value_sum,
+                                      &deriv_sum, &self_repair_sum);
+    melems = (BaseFloat(num_rows) * cell_dim * iter) /
+        (tim.Elapsed() * 1.0e+06);
+    KALDI_LOG << "For CpuBackpropLstmNonlinearity, for cell-dim = " << dim
+              << ", speed was " << melems << " million cells per second";
+  }
+}
+
+template<typename Real>
+static void UnitTestCuMathComputeGruOutput() {
+  for (int32 i = 0; i < 3; i++) {
+    int32 num_rows = 1 + Rand() % 100, dim = 1 + Rand() % 500;
+    CuMatrix<Real> z_t(num_rows, dim), c_t1(num_rows, dim),
+        h_t(num_rows, dim), c_t(num_rows, dim);
+    z_t.SetRandn();
+    c_t1.SetRandn();
+    h_t.SetRandn();
+    CuMatrix<Real> h_t_ref(num_rows, dim), c_t_ref(num_rows, dim);
+    h_t_ref.Tanh(h_t);
+    c_t_ref.CopyFromMat(h_t_ref);
+    c_t_ref.AddMatMatElements(-1.0, z_t, h_t_ref, 1.0);
+    c_t_ref.AddMatMatElements(1.0, z_t, c_t1, 1.0);
+
+    cu::ComputeGruOutput(z_t, c_t1, &h_t, &c_t);
+    AssertEqual(h_t, h_t_ref);
+    AssertEqual(c_t, c_t_ref);
+  }
+}
+
 template<typename Real>
 static void UnitTestCuMathNormalizePerRow() {
 
@@ -703,6 +812,8 @@ template<typename Real> void CudaMathUnitTest() {
   UnitTestLstmNonlinearity();
   UnitTestEnsureNonzero<Real>();
   UnitTestBackpropLstmNonlinearity<Real>();
+  UnitTestCpuLstmNonlinearity();
+  UnitTestCuMathComputeGruOutput<Real>();
   UnitTestCuMathNormalizePerRow<Real>();
   UnitTestCuMathNormalizePerRow_v2<Real>();
   UnitTestCuDiffNormalizePerRow<Real>();
@@ -23,6 +23,7 @@
 #include "cudamatrix/cu-matrix.h"
 #include "cudamatrix/cu-device.h"
 #include "cudamatrix/cu-kernels.h"
+#include "matrix/simd-math.h"
 
 namespace kaldi {
 
@@ -419,28 +420,6 @@ void DiffNormalizePerRow(const CuMatrixBase<double> &in_value,
                          CuMatrixBase<double>* in_deriv);
 
 
-// not calling this Sigmoid to reduce the chance of future collisions.
-template<typename Real>
-static inline Real ScalarSigmoid(Real a) {
-  if (a > Real(0)) {
-    return Real(1) / (Real(1) + Exp(-a));
-  } else {
-    Real x = Exp(a);
-    return x / (x + Real(1));
-  }
-}
-
-template<typename Real>
-static inline Real ScalarTanh(Real a) {
-  if (a > Real(0)) {
-    Real inv_expa = Exp(-a);
-    return -Real(1) + Real(2) / (Real(1) + inv_expa * inv_expa);
-  } else {
-    Real expa = Exp(a);
-    return Real(1) - Real(2) / (Real(1) + expa * expa);
-  }
-}
-
 template<typename Real>
 void CpuComputeLstmNonlinearity(const MatrixBase<Real> &input_mat,
                                 const MatrixBase<Real> &params_mat,
@@ -455,33 +434,47 @@ void CpuComputeLstmNonlinearity(const MatrixBase<Real> &input_mat,
   KALDI_ASSERT(output->NumCols() == 2 * cell_dim);
 
   MatrixBase<Real> &output_mat = *output;
-  const Real *params_data = params_mat.Data();
-  int32 params_stride = params_mat.Stride();
+  const Real *w_ic = params_mat.RowData(0),
+      *w_fc = params_mat.RowData(1),
+      *w_oc = params_mat.RowData(2);
+  // We work a row at a time, computing each nonlinearity for the whole row
+  // at once (with VecSigmoid() and VecTanh()) so that it can be
+  // vectorized.  'temp' holds i_t, f_t, tanh(c_part) and o_t for the current
+  // row; i_t and f_t have to be contiguous.
+  Vector<Real> temp(4 * cell_dim, kUndefined);
+  Real *i_t = temp.Data(),
+      *f_t = i_t + cell_dim,
+      *tanh_c_part = f_t + cell_dim,
+      *o_t = tanh_c_part + cell_dim;
   for (int32 r = 0; r < num_rows; r++) {
     const Real *input_row = input_mat.RowData(r);
     // i_scale and f_scale relate to dropout, they will normally be 1.0.
     Real i_scale = (input_cols == cell_dim*5 ? 1.0:input_row[cell_dim*5]),
          f_scale = (input_cols == cell_dim*5 ? 1.0:input_row[cell_dim*5 + 1]),
          o_scale = (input_cols == cell_dim*5 ? 1.0:input_row[cell_dim*5 + 2]);
+    const Real *i_part = input_row,
+        *f_part = input_row + cell_dim,
+        *c_part = input_row + 2 * cell_dim,
+        *o_part = input_row + 3 * cell_dim,
+        *c_prev = input_row + 4 * cell_dim;
+    Real *c_t = output_mat.RowData(r),
+        *m_t = c_t + cell_dim;
 
-    Real *output_row = output_mat.RowData(r);
     for (int32 c = 0; c < cell_dim; c++) {
-      Real i_part = input_row[c];
-      Real f_part = input_row[c + cell_dim];
-      Real c_part = input_row[c + 2 * cell_dim];
-      Real o_part = input_row[c + 3 * cell_dim];
-      Real c_prev = input_row[c + 4 * cell_dim];
-      Real w_ic = params_data[c];
-      Real w_fc = params_data[c + params_stride];
-      Real w_oc = params_data[c + params_stride * 2];
-      Real i_t = ScalarSigmoid(i_part + w_ic * c_prev);
-      Real f_t = ScalarSigmoid(f_part + w_fc * c_prev);
-      Real c_t = f_t * f_scale * c_prev + i_t * i_scale * ScalarTanh(c_part);
-      Real o_t = ScalarSigmoid(o_part + w_oc * c_t);
-      Real m_t = o_t * o_scale * ScalarTanh(c_t);
-      output_row[c] = c_t;
-      output_row[c + cell_dim] = m_t;
+      i_t[c] = i_part[c] + w_ic[c] * c_prev[c];
+      f_t[c] = f_part[c] + w_fc[c] * c_prev[c];
     }
+    VecSigmoid(2 * cell_dim, i_t, i_t);  // does i_t and f_t.
+    VecTanh(cell_dim, c_part, tanh_c_part);
+    for (int32 c = 0; c < cell_dim; c++) {
+      c_t[c] = f_t[c] * f_scale * c_prev[c] +
+          i_t[c] * i_scale * tanh_c_part[c];
+      o_t[c] = o_part[c] + w_oc[c] * c_t[c];
+    }
+    VecSigmoid(cell_dim, o_t, o_t);
+    VecTanh(cell_dim, c_t, m_t);
+    for (int32 c = 0; c < cell_dim; c++)
+      m_t[c] *= o_t[c] * o_scale;
   }
 }
 
@@ -604,90 +597,100 @@ void CpuBackpropLstmNonlinearity(const MatrixBase<Real> &input,
 
   // We add 1.0 (i.e. a small value) to the count to avoid division by zero.
   Real count = 1.0 + count_in;
-  for (int32 c = 0; c < cell_dim; c++) {
-    // parameters
-    Real w_ic = params_mat(0, c);
-    Real w_fc = params_mat(1, c);
-    Real w_oc = params_mat(2, c);
-    // derivative sums w.r.t. parameters.
-    Real w_ic_deriv_sum = 0.0;
-    Real w_fc_deriv_sum = 0.0;
-    Real w_oc_deriv_sum = 0.0;
-
-    // average derivatives, for self-repair.
-    // The 5 nonlinearities that are subject to self-repair are written as:
-    //  Sigmoid(i_t_input), Sigmoid(f_t_input),
-    //  Tanh(c_part), Sigmoid(o_t_input),  Tanh(c_t)
-    Real i_t_self_repair = (
-        deriv_sum_in_mat(0, c) / count < sr_config(0) ? sr_config(5) : 0.0);
-    Real f_t_self_repair = (
-        deriv_sum_in_mat(1, c) / count < sr_config(1) ? sr_config(6) : 0.0);
-    Real c_part_self_repair = (
-        deriv_sum_in_mat(2, c) / count < sr_config(2) ? sr_config(7) : 0.0);
-    Real o_t_self_repair = (
-        deriv_sum_in_mat(3, c) / count < sr_config(3) ? sr_config(8) : 0.0);
-    Real c_t_self_repair = (
-        deriv_sum_in_mat(4, c) / count < sr_config(4) ? sr_config(9) : 0.0);
-    // Note on how we add self-repair for sigmoids/tanh's.  If self-repair
-    // is activated for this unit, then...
-    // For sigmoids we'd add -self_repair_scale * (2 * sigmoid(x) - 1.0)
-    // ... to the input-deriv;
-    // For tanh's we'd add -self_repair_scale * tanh(x)
-    // If self-repair is not activated, the 'self_repair' scales are set to zero.
-
-    // The following variables are for the accumulation of stats on the
-    // sigmoid and tanh units.
-    Real i_t_value_sum = 0.0, i_t_deriv_sum = 0.0;
-    Real f_t_value_sum = 0.0, f_t_deriv_sum = 0.0;
-    Real c_part_value_sum = 0.0, c_part_deriv_sum = 0.0;
-    Real o_t_value_sum = 0.0, o_t_deriv_sum = 0.0;
-    Real c_t_value_sum = 0.0, c_t_deriv_sum = 0.0;
-
-
-    for (int32 r = 0; r < num_rows; r++) {
-      Real i_part = input_mat(r, c),
-          f_part = input_mat(r, c + cell_dim),
-          c_part = input_mat(r, c + 2 * cell_dim),
-          o_part = input_mat(r, c + 3 * cell_dim),
-          c_prev = input_mat(r, c + 4 * cell_dim);
-
-      Real i_scale = (input_cols == cell_dim * 5 ? 1.0 :
-                      input_mat(r, cell_dim * 5)),
-           f_scale = (input_cols == cell_dim * 5 ? 1.0 :
-                      input_mat(r, cell_dim * 5 + 1)),
-           o_scale = (input_cols == cell_dim * 5 ? 1.0 :
-                      input_mat(r, cell_dim * 5 + 2));
-
-      // For greater clarity, we give some of the quantities in the
-      // forward equations their own names.
-      Real i_t_input = i_part + w_ic * c_prev,
-          i_t = ScalarSigmoid(i_t_input),
-          f_t_input = f_part + w_fc * c_prev,
-          f_t = ScalarSigmoid(f_t_input),
-          tanh_c_part = ScalarTanh(c_part),
-          c_t = f_t * f_scale * c_prev + i_t * i_scale * tanh_c_part,
-          o_t_input = o_part + w_oc * c_t,
-          o_t = ScalarSigmoid(o_t_input),
-          tanh_c_t = ScalarTanh(c_t);
-      // we'd also compute, in the forward pass,
-      //   m_t = o_t * tanh_c_t;
-      // but this variable is not needed.
+  const Real *w_ic = params_mat.RowData(0),
+      *w_fc = params_mat.RowData(1),
+      *w_oc = params_mat.RowData(2);
+
+  // The self-repair scales for the 5 nonlinearities that are subject to
+  // self-repair, which are written as:
+  //  Sigmoid(i_t_input), Sigmoid(f_t_input),
+  //  Tanh(c_part), Sigmoid(o_t_input),  Tanh(c_t)
+  // Note on how we add self-repair for sigmoids/tanh's.  If self-repair
+  // is activated for this unit, then...
+  // For sigmoids we'd add -self_repair_scale * (2 * sigmoid(x) - 1.0)
+  // ... to the input-deriv;
+  // For tanh's we'd add -self_repair_scale * tanh(x)
+  // If self-repair is not activated, the 'self_repair' scales are set to zero.
+  Matrix<Real> self_repair(5, cell_dim, kUndefined);
+  for (int32 i = 0; i < 5; i++)
+    for (int32 c = 0; c < cell_dim; c++)
+      self_repair(i, c) = (deriv_sum_in_mat(i, c) / count < sr_config(i) ?
+                           sr_config(i + 5) : 0.0);
+  const Real *i_t_self_repair = self_repair.RowData(0),
+      *f_t_self_repair = self_repair.RowData(1),
+      *c_part_self_repair = self_repair.RowData(2),
+      *o_t_self_repair = self_repair.RowData(3),
+      *c_t_self_repair = self_repair.RowData(4);
+
+  // Sums over the rows: rows 0, 1, 2 are the derivatives w.r.t. w_ic, w_fc
+  // and w_oc; rows 3 to 7 are the values, and rows 8 to 12 the derivatives, of
+  // the 5 nonlinearities in the order given above.
+  Matrix<Real> sums(13, cell_dim);
+
+  // As in CpuComputeLstmNonlinearity(), we work a row at a time so that the
+  // nonlinearities can be vectorized; 'temp' holds the forward quantities for
+  // the current row, and i_t and f_t must be contiguous.
+  Vector<Real> temp(6 * cell_dim, kUndefined);
+  Real *i_t = temp.Data(),
+      *f_t = i_t + cell_dim,
+      *tanh_c_part = f_t + cell_dim,
+      *c_t = tanh_c_part + cell_dim,
+      *o_t = c_t + cell_dim,
+      *tanh_c_t = o_t + cell_dim;
 
+  for (int32 r = 0; r < num_rows; r++) {
+    const Real *input_row = input_mat.RowData(r),
+        *i_part = input_row,
+        *f_part = input_row + cell_dim,
+        *c_part = input_row + 2 * cell_dim,
+        *o_part = input_row + 3 * cell_dim,
+        *c_prev = input_row + 4 * cell_dim;
+    Real i_scale = (input_cols == cell_dim * 5 ? 1.0 :
+                    input_row[cell_dim * 5]),
+         f_scale = (input_cols == cell_dim * 5 ? 1.0 :
+                    input_row[cell_dim * 5 + 1]),
+         o_scale = (input_cols == cell_dim * 5 ? 1.0 :
+                    input_row[cell_dim * 5 + 2]);
+
+    // The forward computation; see CpuComputeLstmNonlinearity().  Until the
+    // sigmoids are applied, i_t, f_t and o_t contain their inputs.
+    for (int32 c = 0; c < cell_dim; c++) {
+      i_t[c] = i_part[c] + w_ic[c] * c_prev[c];
+      f_t[c] = f_part[c] + w_fc[c] * c_prev[c];
+    }
+    VecSigmoid(2 * cell_dim, i_t, i_t);
+    VecTanh(cell_dim, c_part, tanh_c_part);
+    for (int32 c = 0; c < cell_dim; c++) {
+      c_t[c] = f_t[c] * f_scale * c_prev[c] +
+          i_t[c] * i_scale * tanh_c_part[c];
+      o_t[c] = o_part[c] + w_oc[c] * c_t[c];
+    }
+    VecSigmoid(cell_dim, o_t, o_t);
+    VecTanh(cell_dim, c_t, tanh_c_t);
+    // we'd also compute, in the forward pass,
+    //   m_t = o_t * tanh_c_t;
+    // but this variable is not needed.
+
+    const Real *output_deriv_row = output_deriv_mat.RowData(r);
+    Real *input_deriv_row = (input_deriv_mat == NULL ? NULL :
+                             input_deriv_mat->RowData(r));
+    for (int32 c = 0; c < cell_dim; c++) {
+      Real i = i_t[c], f = f_t[c], o = o_t[c],
+          tc_part = tanh_c_part[c], tc_t = tanh_c_t[c];
       // Accumulate nonlinearity value and derivative stats.
       // Note:
       //    tanh'(x)  = sech^2(x) = -(tanh(x)+1) (tanh(x)-1) = 1 - tanh^2(x)
       //  sigmoid'(x) = sigmoid(x) * (1 - sigmoid(x)).
-      i_t_value_sum += i_t;
-      i_t_deriv_sum += i_t * (1.0F - i_t);
-      f_t_value_sum += f_t;
-      f_t_deriv_sum += f_t * (1.0F - f_t);
-      c_part_value_sum += tanh_c_part;
-      c_part_deriv_sum += 1.0F - tanh_c_part * tanh_c_part;
-      o_t_value_sum += o_t;
-      o_t_deriv_sum += o_t * (1.0F - o_t);
-      c_t_value_sum += tanh_c_t;
-      c_t_deriv_sum += 1.0F - tanh_c_t * tanh_c_t;
-
+      sums(3, c) += i;
+      sums(4, c) += f;
+      sums(5, c) += tc_part;
+      sums(6, c) += o;
+      sums(7, c) += tc_t;
+      sums(8, c) += i * (1.0F - i);
+      sums(9, c) += f * (1.0F - f);
+      sums(10, c) += 1.0F - tc_part * tc_part;
+      sums(11, c) += o * (1.0F - o);
+      sums(12, c) += 1.0F - tc_t * tc_t;
 
       // the derivative of the objective function w.r.t. a particular quantity
       // will be written by prepending "d" to the name.
@@ -695,73 +698,96 @@ void CpuBackpropLstmNonlinearity(const MatrixBase<Real> &input,
       // we computed the original quantities.
       // dc_t_out is the part of the derivative w.r.t. c_t that
       // comes directly from the output of this function.
-      Real dc_t_out = output_deriv_mat(r, c);
-      Real dm_t = output_deriv_mat(r, c + cell_dim);
-      Real dtanh_c_t = o_t * o_scale * dm_t;
-      Real do_t = o_scale * tanh_c_t * dm_t;
-      Real do_t_input = (o_t * (1.0F - o_t) * do_t
-          - (2.0F * o_t - 1.0F) * o_t_self_repair);
-      Real dc_t = ((1.0F - tanh_c_t * tanh_c_t) * dtanh_c_t + dc_t_out
-          + do_t_input * w_oc) - tanh_c_t * c_t_self_repair;
-      Real dtanh_c_part = i_t * i_scale * dc_t;
-      Real df_t = dc_t * f_scale * c_prev;
-      Real df_t_input = ((df_t * f_t * (1.0F - f_t)
-                          - (2.0F * f_t - 1.0F) * f_t_self_repair));
-      Real di_t = dc_t * i_scale * tanh_c_part;
-      Real di_t_input = ((di_t * i_t * (1.0F - i_t)
-                          - (2.0F * i_t - 1.0F) * i_t_self_repair));
-
-      w_ic_deriv_sum += c_prev * di_t_input;
-      w_fc_deriv_sum += c_prev * df_t_input;
-      w_oc_deriv_sum += c_t * do_t_input;
-
-      Real dc_prev = w_ic * di_t_input + w_fc * df_t_input + f_t * f_scale * dc_t;
-      Real do_part = do_t_input;
-      Real dc_part = ((1.0F - tanh_c_part * tanh_c_part) * dtanh_c_part
-          - tanh_c_part * c_part_self_repair);
-      Real df_part = df_t_input;
-      Real di_part = di_t_input;
-
-      if (input_deriv_mat != NULL) {
-        (*input_deriv_mat)(r, c) = di_part;
-        (*input_deriv_mat)(r, c + cell_dim) = df_part;
-        (*input_deriv_mat)(r, c + 2 * cell_dim) = dc_part;
-        (*input_deriv_mat)(r, c + 3 * cell_dim) = do_part;
-        (*input_deriv_mat)(r, c + 4 * cell_dim) = dc_prev;
+      Real dc_t_out = output_deriv_row[c];
+      Real dm_t = output_deriv_row[c + cell_dim];
+      Real dtanh_c_t = o * o_scale * dm_t;
+      Real do_t = o_scale * tc_t * dm_t;
+      Real do_t_input = (o * (1.0F - o) * do_t
+          - (2.0F * o - 1.0F) * o_t_self_repair[c]);
+      Real dc_t = ((1.0F - tc_t * tc_t) * dtanh_c_t + dc_t_out
+          + do_t_input * w_oc[c]) - tc_t * c_t_self_repair[c];
+      Real dtanh_c_part = i * i_scale * dc_t;
+      Real df_t = dc_t * f_scale * c_prev[c];
+      Real df_t_input = ((df_t * f * (1.0F - f)
+                          - (2.0F * f - 1.0F) * f_t_self_repair[c]));
+      Real di_t = dc_t * i_scale * tc_part;
+      Real di_t_input = ((di_t * i * (1.0F - i)
+                          - (2.0F * i - 1.0F) * i_t_self_repair[c]));
+
+      sums(0, c) += c_prev[c] * di_t_input;
+      sums(1, c) += c_prev[c] * df_t_input;
+      sums(2, c) += c_t[c] * do_t_input;
+
+      if (input_deriv_row != NULL) {
+        Real dc_prev = w_ic[c] * di_t_input + w_fc[c] * df_t_input +
+            f * f_scale * dc_t;
+        Real dc_part = ((1.0F - tc_part * tc_part) * dtanh_c_part
+                        - tc_part * c_part_self_repair[c]);
+        input_deriv_row[c] = di_t_input;
+        input_deriv_row[c + cell_dim] = df_t_input;
+        input_deriv_row[c + 2 * cell_dim] = dc_part;
+        input_deriv_row[c + 3 * cell_dim] = do_t_input;
+        input_deriv_row[c + 4 * cell_dim] = dc_prev;
       }
     }
+  }
 
-    if (params_deriv != NULL) {
-      // note: for optimizing things you can assume that params_deriv and
-      // input_deriv_mat are non-NULL (i.e. all the output matrices are
-      // non-NULL).  The situations when some of the output matrices are NULL
-      // does not happen often (mainly only in testing code).
-
-      (*params_deriv_mat)(0, c) = w_ic_deriv_sum;
-      (*params_deriv_mat)(1, c) = w_fc_deriv_sum;
-      (*params_deriv_mat)(2, c) = w_oc_deriv_sum;
-
-      (*value_sum_out_mat)(0, c) += i_t_value_sum;
-      (*value_sum_out_mat)(1, c) += f_t_value_sum;
-      (*value_sum_out_mat)(2, c) += c_part_value_sum;
-      (*value_sum_out_mat)(3, c) += o_t_value_sum;
-      (*value_sum_out_mat)(4, c) += c_t_value_sum;
-
-      // need to update self_repair_sum_out before deriv_sum_out, because
-      // deriv_sum_out and deriv_sum_in might point to the same memory.
-      for (int32 i = 0; i < 5; i++)
+  if (params_deriv != NULL) {
+    params_deriv_mat->CopyFromMat(sums.RowRange(0, 3));
+    // need to update self_repair_sum_out before deriv_sum_out, because
+    // deriv_sum_out and deriv_sum_in might point to the same memory.
+    for (int32 i = 0; i < 5; i++)
+      for (int32 c = 0; c < cell_dim; c++)
         (*self_repair_sum_out_mat)(i, c) =
             (deriv_sum_in_mat(i, c) / count < sr_config(i) ? num_rows : 0);
+    for (int32 i = 0; i < 5; i++) {
+      for (int32 c = 0; c < cell_dim; c++) {
+        (*value_sum_out_mat)(i, c) += sums(i + 3, c);
+        (*deriv_sum_out_mat)(i, c) += sums(i + 8, c);
+      }
+    }
+  }
+}
+
+
 
-      (*deriv_sum_out_mat)(0, c) += i_t_deriv_sum;
-      (*deriv_sum_out_mat)(1, c) += f_t_deriv_sum;
-      (*deriv_sum_out_mat)(2, c) += c_part_deriv_sum;
-      (*deriv_sum_out_mat)(3, c) += o_t_deriv_sum;
-      (*deriv_sum_out_mat)(4, c) += c_t_deriv_sum;
+template<typename Real>
+void ComputeGruOutput(const CuMatrixBase<Real> &z_t,
+                      const CuMatrixBase<Real> &c_t1,
+                      CuMatrixBase<Real> *h_t,
+                      CuMatrixBase<Real> *c_t) {
+  KALDI_ASSERT(SameDim(z_t, c_t1) && SameDim(z_t, *h_t) &&
+               SameDim(z_t, *c_t));
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    h_t->Tanh(*h_t);
+    c_t->CopyFromMat(*h_t);
+    c_t->AddMatMatElements(-1.0, z_t, *h_t, 1.0);
+    c_t->AddMatMatElements(1.0, z_t, c_t1, 1.0);
+  } else
+#endif
+  {
+    int32 num_rows = z_t.NumRows(), dim = z_t.NumCols();
+    for (int32 r = 0; r < num_rows; r++) {
+      const Real *z_row = z_t.RowData(r), *c_t1_row = c_t1.RowData(r);
+      Real *h_row = h_t->RowData(r), *c_row = c_t->RowData(r);
+      VecTanh(dim, h_row, h_row);
+      for (int32 i = 0; i < dim; i++)
+        c_row[i] = h_row[i] + z_row[i] * (c_t1_row[i] - h_row[i]);
     }
   }
 }
 
+template
+void ComputeGruOutput(const CuMatrixBase<float> &z_t,
+                      const CuMatrixBase<float> &c_t1,
+                      CuMatrixBase<float> *h_t,
+                      CuMatrixBase<float> *c_t);
+template
+void ComputeGruOutput(const CuMatrixBase<double> &z_t,
+                      const CuMatrixBase<double> &c_t1,
+                      CuMatrixBase<double> *h_t,
+                      CuMatrixBase<double> *c_t);
 
 
 template<typename Real>
@@ -256,6 +256,22 @@ void CpuBackpropLstmNonlinearity(const MatrixBase<Real> &input,
                                  MatrixBase<double> *deriv_sum_out,
                                  MatrixBase<Real> *self_repair_sum_out);
 
+/**
+   This function is used in the forward pass of GruNonlinearityComponent and
+   OutputGruNonlinearityComponent in ../nnet3/nnet-combined-component.h.  It
+   does, in-place on h_t,
+        h_t := Tanh(h_t)
+   and then sets
+        c_t := (1 - z_t) \dot h_t  +  z_t \dot c_{t-1}.
+   All the matrices must have the same dimension.  On CPU this is done in one
+   pass over the data, with a fast vectorized approximation of tanh().
+ */
+template<typename Real>
+void ComputeGruOutput(const CuMatrixBase<Real> &z_t,
+                      const CuMatrixBase<Real> &c_t1,
+                      CuMatrixBase<Real> *h_t,
+                      CuMatrixBase<Real> *c_t);
+
 /// Normalize nonlinearity modifies the vector of activations
 /// by scaling it so that the root-mean-square equals 1.0.
 ///
@@ -46,7 +46,9 @@ DecodeUtteranceLatticeFasterClass::DecodeUtteranceLatticeFasterClass(
     int64 *frame_sum, // on success, adds #frames to this.
     int32 *num_done, // on success (including partial decode), increments this.
     int32 *num_err,  // on failure, increments this.
-    int32 *num_partial):  // If partial decode (final-state not reached), increments this.
+    int32 *num_partial,  // If partial decode (final-state not reached), increments this.
+    DecodingResultCache *cache,
+    DecodingResultKey cache_key):
     decoder_(decoder), decodable_(decodable), trans_model_(&trans_model),
     word_syms_(word_syms), utt_(utt), acoustic_scale_(acoustic_scale),
     determinize_(determinize), allow_partial_(allow_partial),
@@ -56,15 +58,43 @@ DecodeUtteranceLatticeFasterClass::DecodeUtteranceLatticeFasterClass(
     lattice_writer_(lattice_writer),
     like_sum_(like_sum), frame_sum_(frame_sum),
     num_done_(num_done), num_err_(num_err),
-    num_partial_(num_partial),
+    num_partial_(num_partial), cache_(cache), cache_key_(cache_key),
+    cached_result_(NULL),
     computed_(false), success_(false), partial_(false),
     clat_(NULL), lat_(NULL) { }
 
+DecodeUtteranceLatticeFasterClass::DecodeUtteranceLatticeFasterClass(
+    const DecodingResult &cached_result,
+    const fst::SymbolTable *word_syms,
+    const std::string &utt,
+    Int32VectorWriter *alignments_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_sum,
+    int64 *frame_sum,
+    int32 *num_done):
+    decoder_(NULL), decodable_(NULL), trans_model_(NULL),
+    word_syms_(word_syms), utt_(utt), acoustic_scale_(0.0),
+    determinize_(cached_result.is_compact), allow_partial_(false),
+    alignments_writer_(alignments_writer),
+    words_writer_(words_writer),
+    compact_lattice_writer_(compact_lattice_writer),
+    lattice_writer_(lattice_writer),
+    like_sum_(like_sum), frame_sum_(frame_sum),
+    num_done_(num_done), num_err_(NULL), num_partial_(NULL),
+    cache_(NULL), cache_key_(),
+    cached_result_(new DecodingResult(cached_result)),
+    computed_(false), success_(true), partial_(false),
+    clat_(NULL), lat_(NULL) { }
+
 
 void DecodeUtteranceLatticeFasterClass::operator () () {
   // Decoding and lattice determinization happens here.
   computed_ = true; // Just means this function was called-- a check on the
   // calling code.
+  if (cached_result_ != NULL)
+    return;  // Nothing to do.
   success_ = true;
   using fst::VectorFst;
   if (!decoder_->Decode(decodable_)) {
@@ -117,6 +147,17 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
   if (!computed_)
     KALDI_ERR << "Destructor called without operator (), error in calling code.";
 
+  if (cached_result_ != NULL) {
+    OutputDecodingResult(utt_, *cached_result_, word_syms_,
+                         alignments_writer_, words_writer_,
+                         compact_lattice_writer_, lattice_writer_);
+    if (like_sum_ != NULL) *like_sum_ += cached_result_->likelihood;
+    if (frame_sum_ != NULL) *frame_sum_ += cached_result_->alignment.size();
+    if (num_done_ != NULL) (*num_done_)++;
+    delete cached_result_;
+    return;
+  }
+
   if (!success_) {
     if (num_err_ != NULL) (*num_err_)++;
   } else { // successful decode.
@@ -126,6 +167,7 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
     double likelihood;
     LatticeWeight weight;
     int32 num_frames;
+    DecodingResult result;  // only used if cache_ != NULL.
     { // First do some stuff with word-level traceback...
       // This is basically for diagnostics.
       fst::VectorFst<LatticeArc> decoded;
@@ -138,6 +180,10 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
       std::vector<int32> words;
       GetLinearSymbolSequence(decoded, &alignment, &words, &weight);
       num_frames = alignment.size();
+      if (cache_ != NULL) {
+        result.words = words;
+        result.alignment = alignment;
+      }
       if (words_writer_->IsOpen())
         words_writer_->Write(utt_, words);
       if (alignments_writer_->IsOpen())
@@ -163,6 +209,8 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
       } else {
         compact_lattice_writer_->Write(utt_, *clat_);
       }
+      if (cache_ != NULL)
+        result.SetLattice(*clat_);
       delete clat_;
       clat_ = NULL;
     } else {
@@ -172,6 +220,8 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
       } else {
         lattice_writer_->Write(utt_, *lat_);
       }
+      if (cache_ != NULL)
+        result.SetLattice(*lat_);
       delete lat_;
       lat_ = NULL;
     }
@@ -183,6 +233,11 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
     KALDI_VLOG(2) << "Cost for utterance " << utt_ << " is "
                   << weight.Value1() << " + " << weight.Value2();
 
+    if (cache_ != NULL) {
+      result.likelihood = likelihood;
+      cache_->Insert(cache_key_, result);
+    }
+
     // Now output the various diagnostic variables.
     if (like_sum_ != NULL) *like_sum_ += likelihood;
     if (frame_sum_ != NULL) *frame_sum_ += num_frames;
@@ -297,7 +352,8 @@ bool DecodeUtteranceLatticeFaster(
     Int32VectorWriter *words_writer,
     CompactLatticeWriter *compact_lattice_writer,
     LatticeWriter *lattice_writer,
-    double *like_ptr) { // puts utterance's like in like_ptr on success.
+    double *like_ptr, // puts utterance's like in like_ptr on success.
+    DecodingResult *result) {
   using fst::VectorFst;
 
   if (!decoder.Decode(&decodable)) {
@@ -329,6 +385,10 @@ bool DecodeUtteranceLatticeFaster(
     std::vector<int32> words;
     GetLinearSymbolSequence(decoded, &alignment, &words, &weight);
     num_frames = alignment.size();
+    if (result != NULL) {
+      result->words = words;
+      result->alignment = alignment;
+    }
     if (words_writer->IsOpen())
       words_writer->Write(utt, words);
     if (alignment_writer->IsOpen())
@@ -366,11 +426,15 @@ bool DecodeUtteranceLatticeFaster(
     if (acoustic_scale != 0.0)
       fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale), &clat);
     compact_lattice_writer->Write(utt, clat);
+    if (result != NULL)
+      result->SetLattice(clat);
   } else {
     // We'll write the lattice without acoustic scaling.
     if (acoustic_scale != 0.0)
       fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale), &lat);
     lattice_writer->Write(utt, lat);
+    if (result != NULL)
+      result->SetLattice(lat);
   }
   KALDI_LOG << "Log-like per frame for utterance " << utt << " is "
             << (likelihood / num_frames) << " over "
@@ -378,6 +442,8 @@ bool DecodeUtteranceLatticeFaster(
   KALDI_VLOG(2) << "Cost for utterance " << utt << " is "
                 << weight.Value1() << " + " << weight.Value2();
   *like_ptr = likelihood;
+  if (result != NULL)
+    result->likelihood = likelihood;
   return true;
 }
 
@@ -426,7 +492,8 @@ template bool DecodeUtteranceLatticeFaster(
     Int32VectorWriter *words_writer,
     CompactLatticeWriter *compact_lattice_writer,
     LatticeWriter *lattice_writer,
-    double *like_ptr);
+    double *like_ptr,
+    DecodingResult *result);
 
 template bool DecodeUtteranceLatticeFaster(
     LatticeFasterDecoderTpl<fst::GrammarFst> &decoder,
@@ -441,7 +508,24 @@ template bool DecodeUtteranceLatticeFaster(
     Int32VectorWriter *words_writer,
     CompactLatticeWriter *compact_lattice_writer,
     LatticeWriter *lattice_writer,
-    double *like_ptr);
+    double *like_ptr,
+    DecodingResult *result);
+
+template bool DecodeUtteranceLatticeFaster(
+    LatticeFasterDecoderTpl<fst::HclLmComposeFst> &decoder,
+    DecodableInterface &decodable,
+    const TransitionModel &trans_model,
+    const fst::SymbolTable *word_syms,
+    std::string utt,
+    double acoustic_scale,
+    bool determinize,
+    bool allow_partial,
+    Int32VectorWriter *alignment_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_ptr,
+    DecodingResult *result);
 
 
 // Takes care of output.  Returns true on success.
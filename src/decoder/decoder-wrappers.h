@@ -21,6 +21,7 @@
 #define KALDI_DECODER_DECODER_WRAPPERS_H_
 
 #include "itf/options-itf.h"
+#include "decoder/decoding-result-cache.h"
 #include "decoder/lattice-faster-decoder.h"
 #include "decoder/lattice-incremental-decoder.h"
 #include "decoder/lattice-simple-decoder.h"
@@ -112,7 +113,9 @@ bool DecodeUtteranceLatticeIncremental(
 /// involves table readers and writers; we've just put it here as there is no
 /// other obvious place to put it.  If determinize == false, it writes to
 /// lattice_writer, else to compact_lattice_writer.  The writers for
-/// alignments and words will only be written to if they are open.
+/// alignments and words will only be written to if they are open.  If
+/// 'result' is non-NULL, on success the outputs are also stored there (e.g.
+/// for DecodingResultCache).
 ///
 /// Caution: this will only link correctly if FST is either fst::Fst<fst::StdArc>,
 /// or fst::GrammarFst, as the template function is defined in the .cc file and
@@ -131,7 +134,8 @@ bool DecodeUtteranceLatticeFaster(
     Int32VectorWriter *words_writer,
     CompactLatticeWriter *compact_lattice_writer,
     LatticeWriter *lattice_writer,
-    double *like_ptr);  // puts utterance's likelihood in like_ptr on success.
+    double *like_ptr,  // puts utterance's likelihood in like_ptr on success.
+    DecodingResult *result = NULL);
 
 
 /// This class basically does the same job as the function
@@ -161,7 +165,24 @@ class DecodeUtteranceLatticeFasterClass {
       int64 *frame_sum, // on success, adds #frames to this.
       int32 *num_done, // on success (including partial decode), increments this.
       int32 *num_err,  // on failure, increments this.
-      int32 *num_partial);  // If partial decode (final-state not reached), increments this.
+      int32 *num_partial,  // If partial decode (final-state not reached), increments this.
+      // If non-NULL, on success the output is added to this cache with key
+      // 'cache_key'.
+      DecodingResultCache *cache = NULL,
+      DecodingResultKey cache_key = DecodingResultKey());
+  // This version is for a result that was found in a DecodingResultCache:
+  // operator () does nothing, and the destructor outputs the result.
+  DecodeUtteranceLatticeFasterClass(
+      const DecodingResult &cached_result,
+      const fst::SymbolTable *word_syms,
+      const std::string &utt,
+      Int32VectorWriter *alignments_writer,
+      Int32VectorWriter *words_writer,
+      CompactLatticeWriter *compact_lattice_writer,
+      LatticeWriter *lattice_writer,
+      double *like_sum,
+      int64 *frame_sum,
+      int32 *num_done);
   void operator () (); // The decoding happens here.
   ~DecodeUtteranceLatticeFasterClass(); // Output happens here.
  private:
@@ -183,6 +204,10 @@ class DecodeUtteranceLatticeFasterClass {
   int32 *num_done_;
   int32 *num_err_;
   int32 *num_partial_;
+  DecodingResultCache *cache_;
+  DecodingResultKey cache_key_;
+  DecodingResult *cached_result_;  // Non-NULL if we are outputting a cached
+                                   // result.
 
   // The following variables are stored by the computation.
   bool computed_; // operator ()  was called.
@@ -0,0 +1,235 @@
+// decoder/decoding-result-cache-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+
+#include "decoder/decoding-result-cache.h"
+
+namespace kaldi {
+
+// Returns a result whose fields are derived from 'i', with an 'extra' string
+// of 'extra_bytes' bytes so that we can control its size.
+static DecodingResult MakeResult(int32 i, size_t extra_bytes) {
+  DecodingResult result;
+  result.words.push_back(i);
+  result.words.push_back(i + 1);
+  result.alignment.resize(i % 10 + 1, i);
+  result.likelihood = -10.0 * i;
+  CompactLattice clat;
+  clat.AddState();
+  clat.SetStart(0);
+  clat.SetFinal(0, CompactLatticeWeight::One());
+  result.SetLattice(clat);
+  result.extra = std::string(extra_bytes, static_cast<char>('a' + i % 26));
+  return result;
+}
+
+static void AssertEqual(const DecodingResult &a, const DecodingResult &b) {
+  KALDI_ASSERT(a.words == b.words && a.alignment == b.alignment &&
+               a.likelihood == b.likelihood &&
+               a.is_compact == b.is_compact && a.lattice == b.lattice &&
+               a.extra == b.extra);
+}
+
+static DecodingResultKey FeatureKey(const DecodingResultCache &cache,
+                                    int32 i) {
+  Matrix<BaseFloat> feats(10 + i, 13);
+  feats.Set(i);
+  return cache.Key(feats, NULL, NULL);
+}
+
+// Tests that the least recently used entries are removed when the cache is
+// full, and that Lookup() counts as a use.
+void UnitTestDecodingResultCacheEviction() {
+  DecodingResultCacheOptions opts;
+  opts.cache_mb = 1;
+  DecodingResultCache cache(opts, 1234);
+  KALDI_ASSERT(cache.Enabled());
+  // Each result is about 0.4 MB, so the cache holds two of them.
+  size_t extra_bytes = 400000;
+  DecodingResult result;
+  cache.Insert(FeatureKey(cache, 0), MakeResult(0, extra_bytes));
+  cache.Insert(FeatureKey(cache, 1), MakeResult(1, extra_bytes));
+  KALDI_ASSERT(cache.NumEntries() == 2);
+  // This makes 0 the most recently used, so 1 is removed next.
+  KALDI_ASSERT(cache.Lookup(FeatureKey(cache, 0), &result));
+  AssertEqual(result, MakeResult(0, extra_bytes));
+  cache.Insert(FeatureKey(cache, 2), MakeResult(2, extra_bytes));
+  KALDI_ASSERT(cache.NumEntries() == 2);
+  KALDI_ASSERT(cache.Lookup(FeatureKey(cache, 0), &result));
+  KALDI_ASSERT(!cache.Lookup(FeatureKey(cache, 1), &result));
+  KALDI_ASSERT(cache.Lookup(FeatureKey(cache, 2), &result));
+  AssertEqual(result, MakeResult(2, extra_bytes));
+  // A result bigger than the whole cache is not kept.
+  cache.Insert(FeatureKey(cache, 3), MakeResult(3, 2 * 1048576));
+  KALDI_ASSERT(!cache.Lookup(FeatureKey(cache, 3), &result));
+}
+
+// Tests the keys: different inputs and identities give different keys, and a
+// hash that matches an entry with different sizes is not a hit.
+void UnitTestDecodingResultCacheKey() {
+  DecodingResultCacheOptions opts;
+  opts.cache_mb = 10;
+  DecodingResultCache cache(opts, 1234), other_cache(opts, 5678);
+  Matrix<BaseFloat> feats(20, 13);
+  feats.SetRandn();
+  Vector<BaseFloat> ivector(10);
+  ivector.SetRandn();
+  DecodingResultKey key = cache.Key(feats, &ivector, NULL);
+  KALDI_ASSERT(key.num_frames == 20 && key.feature_dim == 13 &&
+               key.ivector_dim == 10);
+  KALDI_ASSERT(key.hash == cache.Key(feats, &ivector, NULL).hash);
+  KALDI_ASSERT(key.hash != other_cache.Key(feats, &ivector, NULL).hash);
+  KALDI_ASSERT(key.hash != cache.Key(feats, NULL, NULL).hash);
+  feats(3, 4) += 0.01;
+  KALDI_ASSERT(key.hash != cache.Key(feats, &ivector, NULL).hash);
+
+  // With quantization, small changes don't change the key.
+  opts.quantization = 0.1;
+  feats.Set(1.0);
+  DecodingResultKey quantized_key = cache.Key(feats, NULL, NULL);
+  feats(3, 4) += 0.001;
+  KALDI_ASSERT(quantized_key.hash == cache.Key(feats, NULL, NULL).hash);
+  opts.quantization = 0.0;
+
+  Vector<BaseFloat> waveform(1000);
+  waveform.SetRandn();
+  DecodingResultKey wave_key = cache.Key(waveform, 16000, "");
+  KALDI_ASSERT(wave_key.num_frames == 1000 && wave_key.feature_dim == 1);
+  KALDI_ASSERT(wave_key.hash != cache.Key(waveform, 8000, "").hash);
+  KALDI_ASSERT(wave_key.hash != cache.Key(waveform, 16000, "x").hash);
+
+  DecodingResult result;
+  cache.Insert(key, MakeResult(0, 10));
+  KALDI_ASSERT(cache.Lookup(key, &result));
+  // Simulate a hash collision with an input of a different size.
+  DecodingResultKey colliding_key = key;
+  colliding_key.num_frames++;
+  KALDI_ASSERT(!cache.Lookup(colliding_key, &result));
+  cache.Insert(colliding_key, MakeResult(1, 10));
+  KALDI_ASSERT(cache.Lookup(key, &result));
+  AssertEqual(result, MakeResult(0, 10));
+}
+
+// Tests that Save() and loading in the constructor give the same entries in
+// the same order, and that a file with a different identity is ignored.
+void UnitTestDecodingResultCacheSaveLoad() {
+  DecodingResultCacheOptions opts;
+  opts.cache_mb = 10;
+  opts.cache_file = "tmp.decoding-result-cache";
+  unlink(opts.cache_file.c_str());
+  int32 num_results = RandInt(1, 10);
+  std::vector<DecodingResult> results;
+  {
+    DecodingResultCache cache(opts, 1234);
+    KALDI_ASSERT(cache.NumEntries() == 0);
+    for (int32 i = 0; i < num_results; i++) {
+      results.push_back(MakeResult(i, RandInt(0, 100)));
+      cache.Insert(FeatureKey(cache, i), results.back());
+    }
+    cache.Save();
+  }
+  {
+    DecodingResultCache cache(opts, 1234);
+    KALDI_ASSERT(cache.NumEntries() == num_results);
+    DecodingResult result;
+    for (int32 i = 0; i < num_results; i++) {
+      KALDI_ASSERT(cache.Lookup(FeatureKey(cache, i), &result));
+      AssertEqual(result, results[i]);
+    }
+    // The sizes were saved with the hashes.
+    DecodingResultKey colliding_key = FeatureKey(cache, 0);
+    colliding_key.feature_dim++;
+    KALDI_ASSERT(!cache.Lookup(colliding_key, &result));
+  }
+  {
+    DecodingResultCache cache(opts, 5678);
+    KALDI_ASSERT(cache.NumEntries() == 0);
+  }
+  // With a smaller limit, the least recently used entries are dropped when
+  // the file is read.
+  unlink(opts.cache_file.c_str());
+  {
+    DecodingResultCache cache(opts, 1234);
+    for (int32 i = 0; i < 3; i++)
+      cache.Insert(FeatureKey(cache, i), MakeResult(i, 400000));
+    DecodingResult result;
+    // Now 1 is the least recently used.
+    KALDI_ASSERT(cache.Lookup(FeatureKey(cache, 0), &result));
+    cache.Save();
+    DecodingResultCacheOptions small_opts(opts);
+    small_opts.cache_mb = 1;
+    DecodingResultCache small_cache(small_opts, 1234);
+    KALDI_ASSERT(small_cache.NumEntries() == 2);
+    KALDI_ASSERT(small_cache.Lookup(FeatureKey(cache, 0), &result));
+    KALDI_ASSERT(!small_cache.Lookup(FeatureKey(cache, 1), &result));
+    KALDI_ASSERT(small_cache.Lookup(FeatureKey(cache, 2), &result));
+  }
+  unlink(opts.cache_file.c_str());
+}
+
+void UnitTestHashingOstream() {
+  std::string data;
+  int32 size = RandInt(0, 1000);
+  for (int32 i = 0; i < size; i++)
+    data.push_back(static_cast<char>(Rand() % 256));
+
+  HashingOstream whole;
+  whole.write(data.data(), data.size());
+  KALDI_ASSERT(static_cast<int32>(whole.tellp()) == size);
+
+  // Writing it in pieces, one of which goes through operator <<, gives the
+  // same hash.
+  HashingOstream pieces;
+  int32 split1 = RandInt(0, size), split2 = RandInt(split1, size);
+  pieces.write(data.data(), split1);
+  pieces << data.substr(split1, split2 - split1);
+  for (int32 i = split2; i < size; i++)
+    pieces.put(data[i]);
+  KALDI_ASSERT(pieces.Hash() == whole.Hash());
+  KALDI_ASSERT(static_cast<int32>(pieces.tellp()) == size);
+
+  HashingOstream other;
+  other.write(data.data(), data.size());
+  other.put('x');
+  KALDI_ASSERT(other.Hash() != whole.Hash());
+
+  // Objects can write themselves to it.
+  Matrix<BaseFloat> mat(3, 4);
+  mat.SetRandn();
+  HashingOstream mat_hash1, mat_hash2, mat_hash3;
+  mat.Write(mat_hash1, true);
+  mat.Write(mat_hash2, true);
+  KALDI_ASSERT(mat_hash1.Hash() == mat_hash2.Hash());
+  mat(1, 1) += 1.0;
+  mat.Write(mat_hash3, true);
+  KALDI_ASSERT(mat_hash1.Hash() != mat_hash3.Hash());
+}
+
+}  // end namespace kaldi.
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 5; i++) {
+    UnitTestDecodingResultCacheEviction();
+    UnitTestDecodingResultCacheKey();
+    UnitTestDecodingResultCacheSaveLoad();
+    UnitTestHashingOstream();
+  }
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,435 @@
+// decoder/decoding-result-cache.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fstream>
+#include <sstream>
+
+#include "decoder/decoding-result-cache.h"
+
+namespace kaldi {
+
+
+// 64-bit FNV-1a hash of 'num_bytes' bytes, continuing from 'hash'.
+static uint64 HashBytes(const void *data, size_t num_bytes, uint64 hash) {
+  const unsigned char *p = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < num_bytes; i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static uint64 HashInt(int32 i, uint64 hash) {
+  return HashBytes(&i, sizeof(i), hash);
+}
+
+// Hashes the elements of 'data', rounded to multiples of 'quantization' if it
+// is >0.
+static uint64 HashData(const BaseFloat *data, int32 dim,
+                       BaseFloat quantization, uint64 hash) {
+  if (quantization <= 0.0)
+    return HashBytes(data, dim * sizeof(BaseFloat), hash);
+  BaseFloat inv_quantization = 1.0 / quantization;
+  for (int32 i = 0; i < dim; i++)
+    hash = HashInt(RoundToInt(data[i] * inv_quantization), hash);
+  return hash;
+}
+
+static uint64 HashMatrix(const MatrixBase<BaseFloat> &mat,
+                         BaseFloat quantization, uint64 hash) {
+  hash = HashInt(mat.NumRows(), hash);
+  hash = HashInt(mat.NumCols(), hash);
+  for (int32 r = 0; r < mat.NumRows(); r++)
+    hash = HashData(mat.RowData(r), mat.NumCols(), quantization, hash);
+  return hash;
+}
+
+
+void DecodingResult::SetLattice(const CompactLattice &clat) {
+  std::ostringstream os;
+  if (!WriteCompactLattice(os, true, clat))
+    KALDI_ERR << "Error writing lattice to cache.";
+  is_compact = true;
+  lattice = os.str();
+}
+
+void DecodingResult::SetLattice(const Lattice &lat) {
+  std::ostringstream os;
+  if (!WriteLattice(os, true, lat))
+    KALDI_ERR << "Error writing lattice to cache.";
+  is_compact = false;
+  lattice = os.str();
+}
+
+void DecodingResult::GetLattice(CompactLattice *clat) const {
+  KALDI_ASSERT(is_compact);
+  std::istringstream is(lattice);
+  CompactLattice *ans = NULL;
+  if (!ReadCompactLattice(is, true, &ans))
+    KALDI_ERR << "Error reading lattice from cache.";
+  *clat = *ans;
+  delete ans;
+}
+
+void DecodingResult::GetLattice(Lattice *lat) const {
+  KALDI_ASSERT(!is_compact);
+  std::istringstream is(lattice);
+  Lattice *ans = NULL;
+  if (!ReadLattice(is, true, &ans))
+    KALDI_ERR << "Error reading lattice from cache.";
+  *lat = *ans;
+  delete ans;
+}
+
+size_t DecodingResult::SizeInBytes() const {
+  return sizeof(*this) + (words.size() + alignment.size()) * sizeof(int32) +
+      lattice.size() + extra.size();
+}
+
+void DecodingResult::Write(std::ostream &os) const {
+  WriteToken(os, true, "<DecodingResult>");
+  WriteIntegerVector(os, true, words);
+  WriteIntegerVector(os, true, alignment);
+  WriteBasicType(os, true, likelihood);
+  WriteBasicType(os, true, is_compact);
+  int64 size = lattice.size();
+  WriteBasicType(os, true, size);
+  os.write(lattice.data(), size);
+  size = extra.size();
+  WriteBasicType(os, true, size);
+  os.write(extra.data(), size);
+  WriteToken(os, true, "</DecodingResult>");
+}
+
+void DecodingResult::Read(std::istream &is) {
+  ExpectToken(is, true, "<DecodingResult>");
+  ReadIntegerVector(is, true, &words);
+  ReadIntegerVector(is, true, &alignment);
+  ReadBasicType(is, true, &likelihood);
+  ReadBasicType(is, true, &is_compact);
+  int64 size;
+  ReadBasicType(is, true, &size);
+  lattice.resize(size);
+  if (size > 0)
+    is.read(&(lattice[0]), size);
+  ReadBasicType(is, true, &size);
+  extra.resize(size);
+  if (size > 0)
+    is.read(&(extra[0]), size);
+  if (!is.good())
+    KALDI_ERR << "Error reading decoding result.";
+  ExpectToken(is, true, "</DecodingResult>");
+}
+
+
+void DecodingResultKey::Write(std::ostream &os) const {
+  WriteBasicType(os, true, hash);
+  WriteBasicType(os, true, num_frames);
+  WriteBasicType(os, true, feature_dim);
+  WriteBasicType(os, true, ivector_dim);
+}
+
+void DecodingResultKey::Read(std::istream &is) {
+  ReadBasicType(is, true, &hash);
+  ReadBasicType(is, true, &num_frames);
+  ReadBasicType(is, true, &feature_dim);
+  ReadBasicType(is, true, &ivector_dim);
+}
+
+
+DecodingResultCache::DecodingResultCache(
+    const DecodingResultCacheOptions &opts,
+    uint64 identity):
+    opts_(opts), identity_hash_(identity), num_bytes_(0), num_lookups_(0),
+    num_hits_(0) {
+  if (Enabled() && !opts_.cache_file.empty())
+    Load();
+}
+
+DecodingResultKey DecodingResultCache::Key(
+    const MatrixBase<BaseFloat> &features,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors) const {
+  DecodingResultKey key;
+  key.num_frames = features.NumRows();
+  key.feature_dim = features.NumCols();
+  uint64 hash = HashInt(0, identity_hash_);  // 0 means feature input.
+  hash = HashMatrix(features, opts_.quantization, hash);
+  if (ivector != NULL) {
+    key.ivector_dim = ivector->Dim();
+    hash = HashInt(ivector->Dim(), hash);
+    hash = HashData(ivector->Data(), ivector->Dim(), opts_.quantization,
+                    hash);
+  }
+  if (online_ivectors != NULL) {
+    key.ivector_dim = online_ivectors->NumCols();
+    hash = HashMatrix(*online_ivectors, opts_.quantization, hash);
+  }
+  key.hash = hash;
+  return key;
+}
+
+DecodingResultKey DecodingResultCache::Key(
+    const VectorBase<BaseFloat> &waveform, BaseFloat samp_freq,
+    const std::string &state) const {
+  DecodingResultKey key;
+  key.num_frames = waveform.Dim();
+  key.feature_dim = 1;
+  uint64 hash = HashInt(1, identity_hash_);  // 1 means waveform input.
+  hash = HashBytes(&samp_freq, sizeof(samp_freq), hash);
+  hash = HashInt(waveform.Dim(), hash);
+  hash = HashData(waveform.Data(), waveform.Dim(), 0.0, hash);
+  key.hash = HashBytes(state.data(), state.size(), hash);
+  return key;
+}
+
+bool DecodingResultCache::Lookup(const DecodingResultKey &key,
+                                 DecodingResult *result) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  num_lookups_++;
+  std::unordered_map<uint64, ListType::iterator>::iterator iter =
+      map_.find(key.hash);
+  if (iter == map_.end())
+    return false;
+  if (!iter->second->first.SameSizes(key)) {
+    KALDI_WARN << "Hash collision in result cache between inputs of "
+               << "different sizes; decoding the utterance.";
+    return false;
+  }
+  num_hits_++;
+  // Move the entry to the front of the list.
+  entries_.splice(entries_.begin(), entries_, iter->second);
+  *result = iter->second->second;
+  return true;
+}
+
+void DecodingResultCache::Insert(const DecodingResultKey &key,
+                                 const DecodingResult &result) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unordered_map<uint64, ListType::iterator>::iterator iter =
+      map_.find(key.hash);
+  if (iter != map_.end()) {
+    // Another thread decoded the same input at the same time, or (if the
+    // sizes differ) the hashes collided; either way we keep the old entry.
+    return;
+  }
+  entries_.push_front(std::pair<DecodingResultKey, DecodingResult>(key,
+                                                                   result));
+  map_[key.hash] = entries_.begin();
+  num_bytes_ += result.SizeInBytes();
+  Prune();
+}
+
+size_t DecodingResultCache::NumEntries() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+void DecodingResultCache::Prune() {
+  size_t max_bytes = static_cast<size_t>(opts_.cache_mb) * 1048576;
+  while (num_bytes_ > max_bytes && !entries_.empty()) {
+    num_bytes_ -= entries_.back().second.SizeInBytes();
+    map_.erase(entries_.back().first.hash);
+    entries_.pop_back();
+  }
+}
+
+void DecodingResultCache::Load() {
+  std::ifstream is(opts_.cache_file.c_str(),
+                   std::ios_base::in | std::ios_base::binary);
+  if (!is.is_open()) {
+    KALDI_LOG << "Result cache file " << opts_.cache_file
+              << " does not exist yet; starting with an empty cache.";
+    return;
+  }
+  ExpectToken(is, true, "<DecodingResultCache>");
+  uint64 identity_hash;
+  ReadBasicType(is, true, &identity_hash);
+  if (identity_hash != identity_hash_) {
+    KALDI_WARN << "Result cache file " << opts_.cache_file << " was written "
+               << "with a different model, graph or options; ignoring it.";
+    return;
+  }
+  int64 num_entries;
+  ReadBasicType(is, true, &num_entries);
+  // The entries were written from most to least recently used.
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (int64 i = 0; i < num_entries; i++) {
+    DecodingResultKey key;
+    key.Read(is);
+    entries_.push_back(std::pair<DecodingResultKey, DecodingResult>(
+        key, DecodingResult()));
+    entries_.back().second.Read(is);
+    map_[key.hash] = --entries_.end();
+    num_bytes_ += entries_.back().second.SizeInBytes();
+  }
+  ExpectToken(is, true, "</DecodingResultCache>");
+  Prune();
+  KALDI_LOG << "Read " << entries_.size() << " entries from result cache "
+            << opts_.cache_file;
+}
+
+void DecodingResultCache::Save() const {
+  if (!Enabled() || opts_.cache_file.empty())
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::ofstream os(opts_.cache_file.c_str(),
+                   std::ios_base::out | std::ios_base::binary);
+  if (!os.is_open())
+    KALDI_ERR << "Could not open result cache file " << opts_.cache_file
+              << " for writing.";
+  WriteToken(os, true, "<DecodingResultCache>");
+  WriteBasicType(os, true, identity_hash_);
+  WriteBasicType(os, true, static_cast<int64>(entries_.size()));
+  for (ListType::const_iterator iter = entries_.begin();
+       iter != entries_.end(); ++iter) {
+    iter->first.Write(os);
+    iter->second.Write(os);
+  }
+  WriteToken(os, true, "</DecodingResultCache>");
+  if (!os.good())
+    KALDI_ERR << "Error writing result cache file " << opts_.cache_file;
+  KALDI_LOG << "Wrote " << entries_.size() << " entries to result cache "
+            << opts_.cache_file;
+}
+
+void DecodingResultCache::PrintStats() const {
+  if (!Enabled())
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  KALDI_LOG << "Result cache: " << num_hits_ << " hits out of "
+            << num_lookups_ << " lookups (hit rate "
+            << (num_hits_ / (num_lookups_ + 1.0e-10)) << "); the cache has "
+            << entries_.size() << " entries using "
+            << (num_bytes_ / 1048576.0) << " MB.";
+}
+
+
+HashingOstream::HashingStreambuf::HashingStreambuf():
+    hash_(14695981039346656037ULL), num_bytes_(0) { }
+
+HashingOstream::HashingStreambuf::int_type
+HashingOstream::HashingStreambuf::overflow(int_type c) {
+  if (traits_type::eq_int_type(c, traits_type::eof()))
+    return traits_type::not_eof(c);
+  char ch = traits_type::to_char_type(c);
+  hash_ = HashBytes(&ch, 1, hash_);
+  num_bytes_++;
+  return c;
+}
+
+std::streamsize HashingOstream::HashingStreambuf::xsputn(const char *s,
+                                                         std::streamsize n) {
+  hash_ = HashBytes(s, n, hash_);
+  num_bytes_ += n;
+  return n;
+}
+
+HashingOstream::HashingStreambuf::pos_type
+HashingOstream::HashingStreambuf::seekoff(off_type off,
+                                          std::ios_base::seekdir dir,
+                                          std::ios_base::openmode which) {
+  if (off == 0 && dir == std::ios_base::cur && (which & std::ios_base::out))
+    return pos_type(num_bytes_);
+  return pos_type(off_type(-1));
+}
+
+// buf_ is not constructed yet when the base class is, so we set the buffer
+// afterwards.
+HashingOstream::HashingOstream(): std::ostream(NULL) {
+  rdbuf(&buf_);
+}
+
+uint64 HashingOstream::Hash() {
+  flush();
+  return buf_.Hash();
+}
+
+
+void WriteFileContents(const std::string &rxfilename, std::ostream &os) {
+  if (rxfilename.empty())
+    return;
+  Input ki(rxfilename);
+  std::ostringstream contents;
+  contents << ki.Stream().rdbuf();
+  std::string str = contents.str();
+  WriteBasicType(os, true, static_cast<int64>(str.size()));
+  os.write(str.data(), str.size());
+}
+
+
+std::string OptionValuesForCache(ParseOptions *po) {
+  std::ostringstream config;
+  config.precision(9);  // so that float-valued options are not rounded.
+  po->PrintConfig(config);
+  std::istringstream is(config.str());
+  std::string line, ans;
+  while (std::getline(is, line)) {
+    if (line.compare(0, 13, "result-cache-") == 0 ||
+        line.compare(0, 9, "config = ") == 0 ||
+        line.compare(0, 7, "help = ") == 0 ||
+        line.compare(0, 13, "print-args = ") == 0 ||
+        line.compare(0, 10, "verbose = ") == 0)
+      continue;
+    ans += line;
+    ans += '\n';
+  }
+  return ans;
+}
+
+
+void OutputDecodingResult(const std::string &utt,
+                          const DecodingResult &result,
+                          const fst::SymbolTable *word_syms,
+                          Int32VectorWriter *alignments_writer,
+                          Int32VectorWriter *words_writer,
+                          CompactLatticeWriter *compact_lattice_writer,
+                          LatticeWriter *lattice_writer) {
+  if (words_writer->IsOpen())
+    words_writer->Write(utt, result.words);
+  if (alignments_writer->IsOpen())
+    alignments_writer->Write(utt, result.alignment);
+  if (word_syms != NULL) {
+    std::cerr << utt << ' ';
+    for (size_t i = 0; i < result.words.size(); i++) {
+      std::string s = word_syms->Find(result.words[i]);
+      if (s == "")
+        KALDI_ERR << "Word-id " << result.words[i] << " not in symbol table.";
+      std::cerr << s << ' ';
+    }
+    std::cerr << '\n';
+  }
+  if (result.is_compact) {
+    CompactLattice clat;
+    result.GetLattice(&clat);
+    compact_lattice_writer->Write(utt, clat);
+  } else {
+    Lattice lat;
+    result.GetLattice(&lat);
+    lattice_writer->Write(utt, lat);
+  }
+  int32 num_frames = result.alignment.size();
+  if (num_frames == 0)
+    KALDI_WARN << "Cached result for utterance " << utt << " has no frames.";
+  else
+    KALDI_LOG << "Log-like per frame for utterance " << utt << " is "
+              << (result.likelihood / num_frames) << " over "
+              << num_frames << " frames (from result cache).";
+}
+
+
+}  // end namespace kaldi.
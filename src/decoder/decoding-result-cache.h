@@ -0,0 +1,287 @@
+// decoder/decoding-result-cache.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_DECODING_RESULT_CACHE_H_
+#define KALDI_DECODER_DECODING_RESULT_CACHE_H_
+
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "hmm/transition-model.h"
+#include "itf/options-itf.h"
+#include "lat/kaldi-lattice.h"
+#include "matrix/kaldi-matrix.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+
+
+struct DecodingResultCacheOptions {
+  int32 cache_mb;
+  BaseFloat quantization;
+  std::string cache_file;
+
+  DecodingResultCacheOptions(): cache_mb(0), quantization(0.0) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("result-cache-mb", &cache_mb, "If >0, the size in MB of a "
+                   "cache of decoding results, keyed by a hash of the input; "
+                   "utterances whose input is identical to an earlier one are "
+                   "not decoded again.  0 disables the cache.");
+    opts->Register("result-cache-quantization", &quantization, "If >0, the "
+                   "input features are rounded to multiples of this value "
+                   "before hashing them, so that near-identical inputs share "
+                   "cache entries.  Not used for waveform input.");
+    opts->Register("result-cache-file", &cache_file, "If set, a filename "
+                   "from which the result cache is read at startup (if it "
+                   "exists) and to which it is written at exit, so it is "
+                   "shared between runs with the same model, graph and "
+                   "options.");
+  }
+};
+
+
+/// The outputs of decoding one utterance, as stored in DecodingResultCache.
+struct DecodingResult {
+  std::vector<int32> words;
+  std::vector<int32> alignment;
+  double likelihood;
+  // The lattice in Kaldi's binary format; it is a CompactLattice if
+  // 'is_compact' is true, else a Lattice.  This is much smaller than the FST
+  // object.
+  bool is_compact;
+  std::string lattice;
+  // Any other data that the caller needs to restore on a cache hit, e.g. the
+  // speaker-adaptation state after the utterance.
+  std::string extra;
+
+  DecodingResult(): likelihood(0.0), is_compact(true) { }
+
+  void SetLattice(const CompactLattice &clat);
+  void SetLattice(const Lattice &lat);
+  void GetLattice(CompactLattice *clat) const;
+  void GetLattice(Lattice *lat) const;
+
+  // Approximate memory used by this object.
+  size_t SizeInBytes() const;
+
+  // These only support binary mode, as the lattice is stored in binary.
+  void Write(std::ostream &os) const;
+  void Read(std::istream &is);
+};
+
+
+/// The key of an utterance in DecodingResultCache: a 64-bit hash of its input,
+/// and the sizes of the input.  The sizes are stored with the result and
+/// checked when it is looked up, so that a collision between the hashes of
+/// inputs of different sizes cannot give the wrong result.
+struct DecodingResultKey {
+  uint64 hash;
+  int32 num_frames;  // The number of frames of features, or of samples.
+  int32 feature_dim;  // The feature dimension, or 1 for a waveform.
+  int32 ivector_dim;  // The i-vector dimension, or 0 if there are none.
+
+  DecodingResultKey(): hash(0), num_frames(0), feature_dim(0),
+                       ivector_dim(0) { }
+
+  /// Returns true if the sizes are the same (not the hash).
+  bool SameSizes(const DecodingResultKey &other) const {
+    return num_frames == other.num_frames &&
+        feature_dim == other.feature_dim && ivector_dim == other.ivector_dim;
+  }
+
+  void Write(std::ostream &os) const;
+  void Read(std::istream &is);
+};
+
+
+/**
+   DecodingResultCache is an LRU cache of decoding results, keyed by a 64-bit
+   hash of the input of the utterance (the features and i-vectors, or the
+   waveform), together with the sizes of the input (see DecodingResultKey).
+   It is for workloads with many exact or near-exact duplicate utterances,
+   e.g. prompts or re-submitted files, which can then skip feature
+   extraction, the neural net and the search altogether.
+
+   The hash also covers an 'identity' hash given to the constructor, which
+   should capture everything else that affects the results: the model, the
+   graph, the decoding options and any files they refer to (see
+   GetDecodingResultCacheIdentity()).  If opts.cache_file is set the cache
+   persists between runs, and entries written with a different identity are
+   discarded when it is read.
+
+   Lookup() and Insert() may be called from multiple threads.
+ */
+class DecodingResultCache {
+ public:
+  DecodingResultCache(const DecodingResultCacheOptions &opts,
+                      uint64 identity);
+
+  bool Enabled() const { return opts_.cache_mb > 0; }
+
+  /// Returns the key for an utterance with the given features and (if
+  /// non-NULL) i-vectors.  If opts.quantization > 0 the features are
+  /// quantized before hashing.
+  DecodingResultKey Key(const MatrixBase<BaseFloat> &features,
+                        const VectorBase<BaseFloat> *ivector,
+                        const MatrixBase<BaseFloat> *online_ivectors) const;
+
+  /// Returns the key for an utterance with the given waveform; 'state' may
+  /// encode other things that the result depends on, e.g. the adaptation
+  /// state carried over from previous utterances of the speaker.
+  DecodingResultKey Key(const VectorBase<BaseFloat> &waveform,
+                        BaseFloat samp_freq,
+                        const std::string &state) const;
+
+  /// Returns true and outputs the result if 'key' is in the cache.  If its
+  /// hash is there but with different sizes, it warns and returns false.
+  bool Lookup(const DecodingResultKey &key, DecodingResult *result);
+
+  /// Adds a result to the cache, removing the least recently used entries
+  /// if it exceeds opts.cache_mb.
+  void Insert(const DecodingResultKey &key, const DecodingResult &result);
+
+  /// Returns the number of results in the cache.
+  size_t NumEntries() const;
+
+  /// Writes the cache to opts.cache_file, if set.
+  void Save() const;
+
+  /// Logs the hit rate.
+  void PrintStats() const;
+
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodingResultCache);
+
+  typedef std::list<std::pair<DecodingResultKey, DecodingResult> > ListType;
+
+  // Reads opts_.cache_file if it exists.
+  void Load();
+
+  // Removes entries until the size is within the limit; requires the lock.
+  void Prune();
+
+  const DecodingResultCacheOptions &opts_;
+  uint64 identity_hash_;
+
+  mutable std::mutex mutex_;
+  // Most recently used entries are at the front.
+  ListType entries_;
+  // Indexed by the hash of the key.
+  std::unordered_map<uint64, ListType::iterator> map_;
+  size_t num_bytes_;
+
+  int64 num_lookups_;
+  int64 num_hits_;
+};
+
+
+/// HashingOstream is an output stream that computes a 64-bit hash of
+/// everything written to it, without storing it.  It is for computing the
+/// 'identity' given to DecodingResultCache from large objects such as the
+/// model and the graph, e.g. trans_model.Write(os, true), without holding a
+/// serialized copy of them in memory.
+class HashingOstream: public std::ostream {
+ public:
+  HashingOstream();
+  /// Returns the hash of everything written so far.
+  uint64 Hash();
+ private:
+  class HashingStreambuf: public std::streambuf {
+   public:
+    HashingStreambuf();
+    uint64 Hash() const { return hash_; }
+   protected:
+    virtual int_type overflow(int_type c);
+    virtual std::streamsize xsputn(const char *s, std::streamsize n);
+    // Only supports querying the position (for tellp()).
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which);
+   private:
+    uint64 hash_;
+    int64 num_bytes_;
+  };
+  HashingStreambuf buf_;
+};
+
+
+/// Returns the values of all the options registered with 'po', one per line,
+/// except for the --result-cache-* options and the standard options that
+/// don't affect the output (--config, --help, --print-args, --verbose).  Call
+/// it after po->Read(), so that it reflects the defaults and any --config
+/// files as well as the command line.  This is for use in the 'identity' given
+/// to DecodingResultCache.
+std::string OptionValuesForCache(ParseOptions *po);
+
+
+/// Writes the contents of the file 'rxfilename' to 'os', preceded by its size;
+/// this is for use with HashingOstream, so that files named by options (e.g.
+/// feature configs and the iVector extractor) are identified by their
+/// contents rather than their names.  Does nothing if rxfilename is empty.
+void WriteFileContents(const std::string &rxfilename, std::ostream &os);
+
+
+/// Returns the 'identity' to give to DecodingResultCache for a decoding
+/// program, or 0 if 'opts' does not enable the cache.  It is a hash of the
+/// values of the options registered with 'po' (see OptionValuesForCache()),
+/// of the models, of the graph, and of the contents of the files in
+/// 'rxfilenames' (see WriteFileContents()).  'AmModel' may be any type with
+/// a function Write(std::ostream &os, bool binary), e.g. nnet3::AmNnetSimple.
+template<class AmModel>
+uint64 GetDecodingResultCacheIdentity(
+    const DecodingResultCacheOptions &opts, ParseOptions *po,
+    const TransitionModel &trans_model, const AmModel &am_model,
+    const fst::Fst<fst::StdArc> &fst,
+    const std::vector<std::string> &rxfilenames) {
+  if (opts.cache_mb <= 0)
+    return 0;
+  // HashingOstream avoids making a serialized copy of the model and graph.
+  HashingOstream identity;
+  identity << OptionValuesForCache(po);
+  trans_model.Write(identity, true);
+  am_model.Write(identity, true);
+  if (!fst.Write(identity, fst::FstWriteOptions()))
+    KALDI_ERR << "Error hashing the decoding graph.";
+  for (size_t i = 0; i < rxfilenames.size(); i++)
+    WriteFileContents(rxfilenames[i], identity);
+  return identity.Hash();
+}
+
+
+/// Outputs a cached decoding result for an utterance in the same way as
+/// DecodeUtteranceLatticeFaster(): the writers for alignments and words are
+/// only written to if they are open, and the lattice goes to
+/// compact_lattice_writer or lattice_writer depending on its type.
+void OutputDecodingResult(const std::string &utt,
+                          const DecodingResult &result,
+                          const fst::SymbolTable *word_syms,
+                          Int32VectorWriter *alignments_writer,
+                          Int32VectorWriter *words_writer,
+                          CompactLatticeWriter *compact_lattice_writer,
+                          LatticeWriter *lattice_writer);
+
+
+}  // end namespace kaldi.
+
+#endif  // KALDI_DECODER_DECODING_RESULT_CACHE_H_
@@ -0,0 +1,196 @@
+// decoder/grammar-fst-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/grammar-fst.h"
+#include "fstext/fstext-lib.h"
+#include "fstext/grammar-context-fst.h"
+
+namespace fst {
+
+// The symbols used in the toy grammars: phones 1..9 are real phones, so
+// #nonterm_bos is 10, and #nonterm:foo is the first user-defined nonterminal.
+// Transition-ids are 1..5 and words are 1..100.
+static const int32 kNontermPhonesOffset = 10,
+    kNontermFoo = kNontermPhonesOffset + kNontermUserDefined;
+
+// Returns the ilabel that encodes (nonterminal, left-context phone).
+static int32 EncodeSymbol(int32 nonterminal, int32 phone) {
+  return kNontermBigNumber +
+      nonterminal * GetEncodingMultiple(kNontermPhonesOffset) + phone;
+}
+
+static std::shared_ptr<const ConstFst<StdArc> > PrepareAndConvert(
+    VectorFst<StdArc> *fst) {
+  PrepareForGrammarFst(kNontermPhonesOffset, fst);
+  return std::make_shared<const ConstFst<StdArc> >(*fst);
+}
+
+// Creates a top-level FST that has a word, then invokes #nonterm:foo with
+// left-context phone 1, and then has another word; it allows #nonterm:foo to
+// end with left-context phones 2 or 3.
+static std::shared_ptr<const ConstFst<StdArc> > CreateTopFst() {
+  VectorFst<StdArc> fst;
+  for (int32 s = 0; s < 5; s++)
+    fst.AddState();
+  fst.SetStart(0);
+  fst.AddArc(0, StdArc(1, kaldi::RandInt(1, 100), kaldi::RandUniform(), 1));
+  fst.AddArc(1, StdArc(EncodeSymbol(kNontermFoo, 1), 0,
+                       kaldi::RandUniform(), 2));
+  int32 reenter = kNontermPhonesOffset + kNontermReenter;
+  fst.AddArc(2, StdArc(EncodeSymbol(reenter, 2), 0, kaldi::RandUniform(), 3));
+  fst.AddArc(2, StdArc(EncodeSymbol(reenter, 3), 0, kaldi::RandUniform(), 3));
+  fst.AddArc(3, StdArc(2, kaldi::RandInt(1, 100), kaldi::RandUniform(), 4));
+  fst.SetFinal(4, TropicalWeight(kaldi::RandUniform()));
+  return PrepareAndConvert(&fst);
+}
+
+// Creates an FST for #nonterm:foo with a random sequence of words, that can be
+// entered with left-context phone 1 and ends with left-context phone 2 or 3.
+static std::shared_ptr<const ConstFst<StdArc> > CreateFooFst() {
+  VectorFst<StdArc> fst;
+  fst.AddState();
+  fst.SetStart(0);
+  fst.AddState();
+  fst.AddArc(0, StdArc(EncodeSymbol(kNontermPhonesOffset + kNontermBegin, 1),
+                       0, kaldi::RandUniform(), 1));
+  int32 cur_state = 1, num_words = kaldi::RandInt(1, 3);
+  for (int32 i = 0; i < num_words; i++) {
+    int32 next_state = fst.AddState();
+    fst.AddArc(cur_state, StdArc(kaldi::RandInt(3, 5), kaldi::RandInt(1, 100),
+                                 kaldi::RandUniform(), next_state));
+    cur_state = next_state;
+  }
+  int32 final_state = fst.AddState();
+  fst.AddArc(cur_state, StdArc(
+      EncodeSymbol(kNontermPhonesOffset + kNontermEnd, kaldi::RandInt(2, 3)),
+      0, kaldi::RandUniform(), final_state));
+  fst.SetFinal(final_state, TropicalWeight::One());
+  return PrepareAndConvert(&fst);
+}
+
+static GrammarFst *CreateGrammarFst(
+    std::shared_ptr<const ConstFst<StdArc> > top_fst,
+    std::shared_ptr<const ConstFst<StdArc> > foo_fst) {
+  std::vector<std::pair<int32, std::shared_ptr<const ConstFst<StdArc> > > >
+      ifsts;
+  ifsts.push_back(std::make_pair(kNontermFoo, foo_fst));
+  return new GrammarFst(kNontermPhonesOffset, top_fst, ifsts);
+}
+
+// Returns true if expanding the two GrammarFsts gives the same FST.
+// CopyToVectorFst() numbers the states in the order it visits them, so
+// equivalent expansions give identical FSTs.
+static bool SameExpansion(GrammarFst *fst1, GrammarFst *fst2) {
+  VectorFst<StdArc> vfst1, vfst2;
+  CopyToVectorFst(fst1, &vfst1);
+  CopyToVectorFst(fst2, &vfst2);
+  return Equal(vfst1, vfst2);
+}
+
+// Tests that ReplaceFst() on a copy of a GrammarFst does not affect the
+// original or other copies, and that the copies can be destroyed in any
+// order.
+void UnitTestGrammarFstReplaceFst() {
+  std::shared_ptr<const ConstFst<StdArc> > top_fst = CreateTopFst(),
+      foo_fst1 = CreateFooFst(), foo_fst2;
+  do {
+    foo_fst2 = CreateFooFst();
+  } while (Equal(*foo_fst1, *foo_fst2));
+
+  GrammarFst *master = CreateGrammarFst(top_fst, foo_fst1),
+      *reference1 = CreateGrammarFst(top_fst, foo_fst1),
+      *reference2 = CreateGrammarFst(top_fst, foo_fst2);
+  KALDI_ASSERT(!SameExpansion(reference1, reference2));
+  if (kaldi::RandInt(0, 1) == 0) {
+    // Expand the states of the master before copying it.
+    KALDI_ASSERT(SameExpansion(master, reference1));
+  }
+
+  GrammarFst *copy1 = new GrammarFst(*master),
+      *copy2 = new GrammarFst(kNontermPhonesOffset, top_fst,
+                              std::vector<std::pair<int32,
+                              std::shared_ptr<const ConstFst<StdArc> > > >());
+  *copy2 = *master;  // the assignment operator.
+  if (kaldi::RandInt(0, 1) == 0) {
+    // Expand the states of copy1 before replacing, so that they are
+    // discarded.
+    KALDI_ASSERT(SameExpansion(copy1, reference1));
+  }
+  copy1->ReplaceFst(kNontermFoo, foo_fst2);
+  KALDI_ASSERT(SameExpansion(copy1, reference2));
+  KALDI_ASSERT(SameExpansion(copy2, reference1));
+  KALDI_ASSERT(SameExpansion(master, reference1));
+
+  // Replacing it back gives the original.
+  copy2->ReplaceFst(kNontermFoo, foo_fst2);
+  copy2->ReplaceFst(kNontermFoo, foo_fst1);
+  KALDI_ASSERT(SameExpansion(copy2, reference1));
+
+  if (kaldi::RandInt(0, 1) == 0) {
+    delete copy1;
+    delete copy2;
+  } else {
+    delete copy2;
+    delete copy1;
+  }
+  // The master still works, and the FSTs were not freed while it
+  // needed them.
+  KALDI_ASSERT(SameExpansion(master, reference1));
+  delete master;
+  delete reference1;
+  delete reference2;
+}
+
+// Tests that the states expanded by PrecomputeExpandedStates() are the same
+// as those expanded on demand, including when it runs out of memory part of
+// the way through, for copies that share them, and after ReplaceFst().
+void UnitTestGrammarFstPrecompute() {
+  std::shared_ptr<const ConstFst<StdArc> > top_fst = CreateTopFst(),
+      foo_fst1 = CreateFooFst(), foo_fst2 = CreateFooFst();
+  GrammarFst *on_demand = CreateGrammarFst(top_fst, foo_fst1),
+      *precomputed = CreateGrammarFst(top_fst, foo_fst1);
+  size_t max_bytes = (kaldi::RandInt(0, 1) == 0 ? 1000000 :
+                      kaldi::RandInt(0, 200));
+  size_t num_bytes = precomputed->PrecomputeExpandedStates(max_bytes);
+  KALDI_ASSERT(num_bytes <= max_bytes + 1000);
+
+  GrammarFst *copy = new GrammarFst(*precomputed);
+  KALDI_ASSERT(SameExpansion(on_demand, precomputed));
+  KALDI_ASSERT(SameExpansion(on_demand, copy));
+  delete copy;
+  // The copy shared the precomputed states; they must still be valid.
+  KALDI_ASSERT(SameExpansion(on_demand, precomputed));
+
+  GrammarFst *reference2 = CreateGrammarFst(top_fst, foo_fst2);
+  precomputed->ReplaceFst(kNontermFoo, foo_fst2);
+  KALDI_ASSERT(SameExpansion(reference2, precomputed));
+  delete on_demand;
+  delete precomputed;
+  delete reference2;
+}
+
+}  // end namespace fst
+
+int main() {
+  using namespace fst;
+  for (int32 i = 0; i < 20; i++) {
+    UnitTestGrammarFstReplaceFst();
+    UnitTestGrammarFstPrecompute();
+  }
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -49,10 +49,78 @@ void GrammarFst::Init() {
   InitInstances();
 }
 
+GrammarFst::GrammarFst(const GrammarFst &other) {
+  CopyFrom(other);
+}
+
+GrammarFst &GrammarFst::operator = (const GrammarFst &other) {
+  if (this != &other) {
+    Destroy();
+    CopyFrom(other);
+  }
+  return *this;
+}
+
+void GrammarFst::CopyFrom(const GrammarFst &other) {
+  nonterm_phones_offset_ = other.nonterm_phones_offset_;
+  top_fst_ = other.top_fst_;
+  ifsts_ = other.ifsts_;
+  nonterminal_map_ = other.nonterminal_map_;
+  entry_arcs_ = other.entry_arcs_;
+  instances_ = other.instances_;
+  // The ExpandedState objects belong to 'other'; we'll expand the states again
+  // as we need them.  The instance-ids and the child_instances maps stay
+  // valid, as they don't depend on which states were expanded.
+  for (size_t i = 0; i < instances_.size(); i++)
+    instances_[i].expanded_states.clear();
+  flat_ = other.flat_;
+}
+
 GrammarFst::~GrammarFst() {
   Destroy();
 }
 
+void GrammarFst::ReplaceFst(int32 nonterminal,
+                            std::shared_ptr<const ConstFst<StdArc> > fst) {
+  KALDI_ASSERT(top_fst_ != NULL && fst != NULL);
+  int32 ifst_index;
+  std::unordered_map<int32, int32>::const_iterator iter =
+      nonterminal_map_.find(nonterminal);
+  if (iter != nonterminal_map_.end()) {
+    ifst_index = iter->second;
+    ifsts_[ifst_index].second = fst;
+    entry_arcs_[ifst_index].clear();
+  } else {
+    if (nonterminal < GetPhoneSymbolFor(kNontermUserDefined))
+      KALDI_ERR << "Nonterminal symbol " << nonterminal
+                << " was expected to be >= "
+                << GetPhoneSymbolFor(kNontermUserDefined);
+    ifst_index = ifsts_.size();
+    ifsts_.push_back(std::pair<int32, std::shared_ptr<const ConstFst<StdArc> > >(
+        nonterminal, fst));
+    nonterminal_map_[nonterminal] = ifst_index;
+    entry_arcs_.resize(ifsts_.size());
+  }
+  // We call this so that problems with the new FST are detected now rather
+  // than in the middle of decoding.
+  InitEntryArcs(ifst_index);
+  ResetInstances();
+}
+
+void GrammarFst::ResetInstances() {
+  for (size_t i = 0; i < instances_.size(); i++) {
+    FstInstance &instance = instances_[i];
+    std::unordered_map<BaseStateId, ExpandedState*>::const_iterator
+        iter = instance.expanded_states.begin(),
+        end = instance.expanded_states.end();
+    for (; iter != end; ++iter)
+      delete iter->second;
+  }
+  instances_.clear();
+  flat_.reset();
+  InitInstances();
+}
+
 void GrammarFst::Destroy() {
   for (size_t i = 0; i < instances_.size(); i++) {
     FstInstance &instance = instances_[i];
@@ -69,6 +137,7 @@ void GrammarFst::Destroy() {
   nonterminal_map_.clear();
   entry_arcs_.clear();
   instances_.clear();
+  flat_.reset();
 }
 
 
@@ -380,6 +449,63 @@ GrammarFst::ExpandedState *GrammarFst::ExpandStateUserDefined(
 }
 
 
+size_t GrammarFst::PrecomputeExpandedStates(size_t max_bytes) {
+  KALDI_ASSERT(flat_ == nullptr && "PrecomputeExpandedStates() called "
+               "twice?");
+  std::shared_ptr<FlatExpandedStates> flat(new FlatExpandedStates);
+  std::vector<FlatState> &flat_states = flat->states;
+  std::vector<StdArc> &flat_arcs = flat->arcs;
+  size_t num_bytes = 0;
+  bool budget_exceeded = false;
+  // Note: GetExpandedState() may add new instances as we go, so
+  // instances_.size() changes during the loop, and we must not keep
+  // references to elements of instances_.
+  size_t instance_id = 0;
+  for (; instance_id < instances_.size() && !budget_exceeded; instance_id++) {
+    const ConstFst<StdArc> &fst = *(instances_[instance_id].fst);
+    BaseStateId num_states = fst.NumStates();
+    size_t index_bytes = num_states * sizeof(int32);
+    if (num_bytes + index_bytes > max_bytes)
+      break;
+    num_bytes += index_bytes;
+    std::shared_ptr<std::vector<int32> > flat_index(
+        new std::vector<int32>(num_states, -1));
+    for (BaseStateId s = 0; s < num_states; s++) {
+      if (fst.Final(s).Value() != KALDI_GRAMMAR_FST_SPECIAL_WEIGHT)
+        continue;
+      ExpandedState *expanded_state = GetExpandedState(instance_id, s);
+      FlatState flat_state;
+      flat_state.dest_fst_instance = expanded_state->dest_fst_instance;
+      flat_state.num_arcs = expanded_state->arcs.size();
+      flat_state.arc_offset = flat_arcs.size();
+      flat_arcs.insert(flat_arcs.end(), expanded_state->arcs.begin(),
+                       expanded_state->arcs.end());
+      (*flat_index)[s] = flat_states.size();
+      flat_states.push_back(flat_state);
+      // The ExpandedState is no longer needed, as the ArcIterator will
+      // find this state in flat_->states.
+      instances_[instance_id].expanded_states.erase(s);
+      delete expanded_state;
+      num_bytes += sizeof(FlatState) + flat_state.num_arcs * sizeof(StdArc);
+      if (num_bytes > max_bytes) {
+        budget_exceeded = true;
+        break;
+      }
+    }
+    instances_[instance_id].flat_index = flat_index;
+  }
+  flat_states.shrink_to_fit();
+  flat_arcs.shrink_to_fit();
+  flat_ = flat;
+  KALDI_LOG << "Precomputed " << flat_states.size() << " expanded states in "
+            << instance_id << " of " << instances_.size()
+            << " FST instances, using " << (num_bytes / 1048576.0) << " MB"
+            << (budget_exceeded || instance_id < instances_.size() ?
+                "; the rest will be expanded on demand." : ".");
+  return num_bytes;
+}
+
+
 void GrammarFst::Write(std::ostream &os, bool binary) const {
   using namespace kaldi;
   if (!binary)
@@ -92,6 +92,16 @@ template<> class ArcIterator<GrammarFst>;
    create lightweight copies of this object using the copy constructor,
    e.g. `new GrammarFst(this_grammar_fst)`, if you want to decode from multiple
    threads using the same GrammarFst.
+
+   UPDATING SUB-FSTS: the FSTs for individual nonterminals can be replaced or
+   added at runtime (e.g. for personalized contact lists) with ReplaceFst().
+   The FSTs are held by shared_ptr and copies of a GrammarFst share them, so
+   the way to do this without disturbing decoding that is in progress is
+   copy-on-write: keep a 'master' GrammarFst that is not itself used for
+   decoding, make a copy of it, call ReplaceFst() on the copy, and start new
+   decodes from copies of the updated object.  Decoders that are already
+   running keep the version they were started with.  Per-user grammars made
+   this way share the top-level FST and all the other sub-FSTs.
 */
 class GrammarFst {
  public:
@@ -147,8 +157,15 @@ class GrammarFst {
 
   /// Copy constructor.  Useful because this object is not thread safe so cannot
   /// be used by multiple parallel decoder threads, but it is lightweight and
-  /// can copy it without causing the stored FSTs to be copied.
-  GrammarFst(const GrammarFst &other) = default;
+  /// can copy it without causing the stored FSTs to be copied.  The states
+  /// precomputed by PrecomputeExpandedStates() are shared with 'other'; the
+  /// states it expanded on demand are not copied, and will be re-expanded as
+  /// needed.  'other' must not be in use by another thread while it is being
+  /// copied.
+  GrammarFst(const GrammarFst &other);
+
+  /// Assignment operator; see the copy constructor.
+  GrammarFst &operator = (const GrammarFst &other);
 
   ///  This constructor should only be used prior to calling Read().
   GrammarFst() { }
@@ -162,6 +179,42 @@ class GrammarFst {
   // Reads the format that Write() outputs.  Will crash if binary == false.
   void Read(std::istream &os, bool binary);
 
+  /**
+     Normally the states that need expansion (the ones at which we enter or
+     leave sub-FSTs) are expanded lazily, as the decoder reaches them, and are
+     looked up in a hash map each time they are visited.  This function
+     instead expands them in advance, visiting the FST instances in the order
+     in which they are created, and stores them in contiguous arrays with a
+     per-instance index, so that the ArcIterator does not need any hash
+     lookups.  This helps decoding speed for grammars with many sub-FSTs
+     (e.g. class-based grammars of names).
+
+     It stops when the memory used exceeds 'max_bytes' (which also prevents
+     it from running forever on recursive grammars); the states it did not
+     get to are expanded lazily, as usual.  It must be called before
+     decoding, i.e. before any ArcIterator is created, and at most once.
+     Returns the number of bytes used.
+  */
+  size_t PrecomputeExpandedStates(size_t max_bytes);
+
+  /**
+     Replaces the FST for nonterminal 'nonterminal' (e.g. the index of
+     #nonterm:contact_list in phones.txt) with 'fst', or adds it if this
+     GrammarFst has no FST for that nonterminal yet.  'fst' should have been
+     prepared in the same way as the FSTs given to make-grammar-fst (i.e. an
+     HCLG compiled with #nonterm_begin and #nonterm_end and processed with
+     PrepareForGrammarFst()).
+
+     This discards all expanded states, including those from
+     PrecomputeExpandedStates(), since they may refer to the old FST; they
+     will be expanded again on demand, or you can call
+     PrecomputeExpandedStates() again.  It must not be called while this
+     object is being used for decoding; see "UPDATING SUB-FSTS" in the
+     documentation of this class.
+   */
+  void ReplaceFst(int32 nonterminal,
+                  std::shared_ptr<const ConstFst<StdArc> > fst);
+
   StateId Start() const {
     // the top 32 bits of the 64-bit state-id will be zero, because the
     // top FST instance has instance-id = 0.
@@ -232,6 +285,14 @@ class GrammarFst {
   // clears everything.
   void Destroy();
 
+  // Deletes the expanded states and the FST instances, and sets up
+  // instances_ again with just the top-level instance.
+  void ResetInstances();
+
+  // Called from the copy constructor and assignment operator; expects this
+  // object to be empty.
+  void CopyFrom(const GrammarFst &other);
+
   /*
     This utility function sets up a map from "left-context phone", meaning
     either a phone index or the index of the symbol #nonterm_bos, to
@@ -392,6 +453,22 @@ class GrammarFst {
     std::vector<StdArc> arcs;
   };
 
+  // FlatState is the form in which states expanded by
+  // PrecomputeExpandedStates() are stored: it is like ExpandedState except
+  // that the arcs are a range in the array FlatExpandedStates::arcs.
+  struct FlatState {
+    int32 dest_fst_instance;
+    int32 num_arcs;
+    size_t arc_offset;
+  };
+
+  // The states expanded by PrecomputeExpandedStates(), and their arcs.  This
+  // is never changed once created, so it is shared between copies.
+  struct FlatExpandedStates {
+    std::vector<FlatState> states;
+    std::vector<StdArc> arcs;
+  };
+
 
   // An FstInstance is a copy of an FST.  The instance numbered zero is for
   // top_fst_, and (to state it approximately) whenever any FST instance invokes
@@ -450,6 +527,13 @@ class GrammarFst {
     // leading to final-states, which signal a return to the parent
     // FST-instance.
     std::unordered_map<int32, int32> parent_reentry_arcs;
+
+    // 'flat_index' is NULL unless this instance was visited by
+    // PrecomputeExpandedStates(), in which case it is indexed by state and
+    // contains the index into flat_->states of the expanded state, or -1 if
+    // the state was not precomputed (e.g. it did not need expansion).  It is
+    // shared between copies of the GrammarFst.
+    std::shared_ptr<const std::vector<int32> > flat_index;
   };
 
   // The integer id of the symbol #nonterm_bos in phones.txt.
@@ -483,6 +567,9 @@ class GrammarFst {
   // representing top_fst_, and it will be populated with more elements on
   // demand.  An instance_id refers to an index into this vector.
   std::vector<FstInstance> instances_;
+
+  // The states expanded by PrecomputeExpandedStates(), or NULL.
+  std::shared_ptr<const FlatExpandedStates> flat_;
 };
 
 
@@ -518,6 +605,15 @@ class ArcIterator<GrammarFst> {
       dest_instance_ = instance_id;
       base_fst->InitArcIterator(s, &data_);
       i_ = 0;
+    } else if (instance.flat_index != nullptr &&
+               (*instance.flat_index)[base_state] >= 0) {
+      // A special state that was expanded by PrecomputeExpandedStates().
+      const GrammarFst::FlatState &flat_state =
+          fst.flat_->states[(*instance.flat_index)[base_state]];
+      dest_instance_ = flat_state.dest_fst_instance;
+      data_.arcs = fst.flat_->arcs.data() + flat_state.arc_offset;
+      data_.narcs = flat_state.num_arcs;
+      i_ = 0;
     } else {
       // A special state
       ExpandedState *expanded_state = fst.GetExpandedState(instance_id,
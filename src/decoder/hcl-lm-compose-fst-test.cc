@@ -0,0 +1,154 @@
+// decoder/hcl-lm-compose-fst-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unordered_map>
+
+#include "decoder/hcl-lm-compose-fst.h"
+#include "fstext/fstext-lib.h"
+
+namespace fst {
+
+// The labels used in the toy graphs.
+static const int32 kNumTransitionIds = 10, kNumWords = 4,
+    kPhoneDisambig = 100,  // the phone-level #0, on the input side of HCL.
+    kWordDisambig = kNumWords + 1;  // the word #0, on the output side.
+
+// Creates a random HCL graph with transition-ids 1..kNumTransitionIds and
+// the phone disambiguation symbol on the input side and words
+// 1..kNumWords on the output side, with the self-loop #0:#0 that
+// L_disambig.fst has.
+static void CreateHcl(VectorFst<StdArc> *hcl) {
+  hcl->DeleteStates();
+  int32 num_states = kaldi::RandInt(2, 6);
+  for (int32 s = 0; s < num_states; s++)
+    hcl->AddState();
+  hcl->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    if (kaldi::Rand() % 2 == 0)
+      hcl->SetFinal(s, TropicalWeight(kaldi::RandUniform()));
+    int32 num_arcs = kaldi::RandInt(1, 4);
+    for (int32 i = 0; i < num_arcs; i++) {
+      int32 ilabel = (kaldi::Rand() % 5 == 0 ? 0 :
+                      kaldi::RandInt(1, kNumTransitionIds)),
+          olabel = (kaldi::Rand() % 2 == 0 ? 0 : kaldi::RandInt(1, kNumWords));
+      hcl->AddArc(s, StdArc(ilabel, olabel, kaldi::RandUniform(),
+                            kaldi::RandInt(0, num_states - 1)));
+    }
+  }
+  hcl->SetFinal(num_states - 1, TropicalWeight::One());
+  hcl->AddArc(0, StdArc(kPhoneDisambig, 0, 0.5, num_states - 1));
+  hcl->AddArc(0, StdArc(kPhoneDisambig, kWordDisambig, 0.0, 0));
+}
+
+// Creates a deterministic, epsilon-free bigram "language model" G whose state
+// is the previous word.  It deliberately has arcs for the label of the word
+// #0 too (as ConstArpaLm would map it to <unk>), so that the test fails if
+// HclLmComposeFst passes it to the LM.
+static void CreateLm(VectorFst<StdArc> *lm) {
+  lm->DeleteStates();
+  for (int32 s = 0; s <= kWordDisambig; s++) {
+    lm->AddState();
+    lm->SetFinal(s, TropicalWeight(kaldi::RandUniform()));
+  }
+  lm->SetStart(0);
+  for (int32 s = 0; s <= kWordDisambig; s++)
+    for (int32 w = 1; w <= kWordDisambig; w++)
+      lm->AddArc(s, StdArc(w, w, 2.0 * kaldi::RandUniform(), w));
+  ArcSort(lm, ILabelCompare<StdArc>());
+}
+
+// Expands the reachable part of 'fst' into 'ans'.
+static void ExpandHclLmComposeFst(HclLmComposeFst *fst,
+                                  VectorFst<StdArc> *ans) {
+  typedef HclLmComposeFst::Arc Arc;
+  ans->DeleteStates();
+  std::unordered_map<Arc::StateId, StdArc::StateId> state_map;
+  std::vector<Arc::StateId> queue;
+  state_map[fst->Start()] = ans->AddState();
+  ans->SetStart(0);
+  queue.push_back(fst->Start());
+  while (!queue.empty()) {
+    Arc::StateId s = queue.back();
+    queue.pop_back();
+    StdArc::StateId ans_s = state_map[s];
+    ans->SetFinal(ans_s, fst->Final(s));
+    // Copy the arcs first, as only one ArcIterator may exist at a time.
+    std::vector<Arc> arcs;
+    for (ArcIterator<HclLmComposeFst> aiter(*fst, s); !aiter.Done();
+         aiter.Next())
+      arcs.push_back(aiter.Value());
+    for (size_t i = 0; i < arcs.size(); i++) {
+      const Arc &arc = arcs[i];
+      if (state_map.count(arc.nextstate) == 0) {
+        state_map[arc.nextstate] = ans->AddState();
+        queue.push_back(arc.nextstate);
+      }
+      ans->AddArc(ans_s, StdArc(arc.ilabel, arc.olabel, arc.weight,
+                                state_map[arc.nextstate]));
+    }
+  }
+}
+
+// Checks that HclLmComposeFst is equivalent to HCL o G, computed explicitly,
+// with the disambiguation symbols replaced by epsilons.
+void TestHclLmComposeFst(bool lm_lookahead) {
+  VectorFst<StdArc> hcl, lm;
+  CreateHcl(&hcl);
+  CreateLm(&lm);
+  ConstFst<StdArc> hcl_const(hcl);
+  BackoffDeterministicOnDemandFst<StdArc> lm_fst(lm);
+
+  HclLmComposeFstOptions opts;
+  opts.lm_lookahead = lm_lookahead;
+  std::vector<int32> disambig_syms(1, kPhoneDisambig),
+      word_disambig_syms(1, kWordDisambig);
+  std::vector<float> word_costs(kNumWords + 1);
+  for (int32 w = 1; w <= kNumWords; w++)
+    word_costs[w] = kaldi::RandUniform();
+  HclLmComposeFst compose_fst(opts, hcl_const, &lm_fst, disambig_syms,
+                              word_disambig_syms, word_costs);
+  VectorFst<StdArc> expanded;
+  ExpandHclLmComposeFst(&compose_fst, &expanded);
+  Connect(&expanded);
+
+  std::vector<std::pair<int32, int32> > in_pairs, out_pairs;
+  in_pairs.push_back(std::pair<int32, int32>(kPhoneDisambig, 0));
+  out_pairs.push_back(std::pair<int32, int32>(kWordDisambig, 0));
+  Relabel(&hcl, in_pairs, out_pairs);
+  ArcSort(&hcl, OLabelCompare<StdArc>());
+  VectorFst<StdArc> composed;
+  Compose(hcl, lm, &composed);
+  Connect(&composed);
+
+  KALDI_ASSERT((expanded.NumStates() == 0) == (composed.NumStates() == 0));
+  if (composed.NumStates() == 0)
+    return;
+  KALDI_ASSERT(RandEquivalent(expanded, composed, 20 /*paths*/,
+                              0.01 /*delta*/, kaldi::Rand() /*seed*/,
+                              50 /*path length, max*/));
+}
+
+}  // namespace fst
+
+int main() {
+  for (int32 i = 0; i < 100; i++) {
+    fst::TestHclLmComposeFst(false);
+    fst::TestHclLmComposeFst(true);
+  }
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
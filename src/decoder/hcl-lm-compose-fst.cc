@@ -0,0 +1,206 @@
+// decoder/hcl-lm-compose-fst.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <functional>
+#include <limits>
+#include <queue>
+
+#include "decoder/hcl-lm-compose-fst.h"
+
+namespace fst {
+
+
+HclLmComposeFst::HclLmComposeFst(const HclLmComposeFstOptions &opts,
+                                 const ConstFst<StdArc> &hcl,
+                                 DeterministicOnDemandFst<StdArc> *lm,
+                                 const std::vector<int32> &disambig_syms,
+                                 const std::vector<int32> &word_disambig_syms,
+                                 const std::vector<float> &word_costs):
+    opts_(opts), hcl_(hcl), lm_(lm), cache_bytes_(0), num_expanded_(0),
+    num_cache_hits_(0), num_cache_clears_(0) {
+  KALDI_ASSERT(opts_.cache_mb > 0);
+  if (hcl_.Start() == kNoStateId)
+    KALDI_ERR << "HCL graph is empty.";
+  for (size_t i = 0; i < disambig_syms.size(); i++) {
+    int32 sym = disambig_syms[i];
+    KALDI_ASSERT(sym > 0);
+    if (static_cast<size_t>(sym) >= is_disambig_.size())
+      is_disambig_.resize(sym + 1, false);
+    is_disambig_[sym] = true;
+  }
+  for (size_t i = 0; i < word_disambig_syms.size(); i++) {
+    int32 sym = word_disambig_syms[i];
+    KALDI_ASSERT(sym > 0);
+    if (static_cast<size_t>(sym) >= is_word_disambig_.size())
+      is_word_disambig_.resize(sym + 1, false);
+    is_word_disambig_[sym] = true;
+  }
+  ComputeLookaheadCosts(word_costs);
+  BaseStateId lm_start = lm_->Start();
+  KALDI_ASSERT(lm_start >= 0);
+  start_state_ = (static_cast<int64>(lm_start) << 32) | hcl_.Start();
+}
+
+
+void HclLmComposeFst::ComputeLookaheadCosts(
+    const std::vector<float> &word_costs) {
+  const float inf = std::numeric_limits<float>::infinity();
+  BaseStateId num_states = hcl_.NumStates();
+  num_input_epsilons_.resize(num_states);
+  phi_.resize(num_states, opts_.lm_lookahead ? inf : 0.0);
+
+  // For each state, the states that have an output-epsilon arc to it (a
+  // reversed adjacency list, stored as offsets into 'preds').
+  std::vector<int32> pred_offsets(num_states + 1, 0);
+  std::vector<int32> preds;
+  if (opts_.lm_lookahead) {
+    for (BaseStateId s = 0; s < num_states; s++) {
+      for (ArcIterator<ConstFst<StdArc> > aiter(hcl_, s); !aiter.Done();
+           aiter.Next()) {
+        if (WordLabel(aiter.Value().olabel) == 0)
+          pred_offsets[aiter.Value().nextstate + 1]++;
+      }
+    }
+    for (BaseStateId s = 0; s < num_states; s++)
+      pred_offsets[s + 1] += pred_offsets[s];
+    preds.resize(pred_offsets[num_states]);
+  }
+  std::vector<int32> num_preds_added(opts_.lm_lookahead ? num_states : 0, 0);
+
+  for (BaseStateId s = 0; s < num_states; s++) {
+    int32 num_eps = 0;
+    for (ArcIterator<ConstFst<StdArc> > aiter(hcl_, s); !aiter.Done();
+         aiter.Next()) {
+      const StdArc &arc = aiter.Value();
+      if (arc.ilabel == 0 ||
+          (static_cast<size_t>(arc.ilabel) < is_disambig_.size() &&
+           is_disambig_[arc.ilabel]))
+        num_eps++;
+      if (!opts_.lm_lookahead)
+        continue;
+      Label word = WordLabel(arc.olabel);
+      if (word == 0) {
+        BaseStateId t = arc.nextstate;
+        preds[pred_offsets[t] + num_preds_added[t]++] = s;
+      } else {
+        float cost = (static_cast<size_t>(word) < word_costs.size() ?
+                      word_costs[word] : 0.0);
+        if (cost < phi_[s])
+          phi_[s] = cost;
+      }
+    }
+    num_input_epsilons_[s] = num_eps;
+    if (opts_.lm_lookahead && hcl_.Final(s) != Weight::Zero() &&
+        phi_[s] > 0.0)
+      phi_[s] = 0.0;
+  }
+  if (!opts_.lm_lookahead)
+    return;
+
+  // Propagate the minimum backwards over output-epsilon arcs, processing the
+  // states in increasing order of cost as in Dijkstra's algorithm.
+  typedef std::pair<float, BaseStateId> QueueElem;
+  std::priority_queue<QueueElem, std::vector<QueueElem>,
+                      std::greater<QueueElem> > queue;
+  for (BaseStateId s = 0; s < num_states; s++)
+    if (phi_[s] != inf)
+      queue.push(QueueElem(phi_[s], s));
+  while (!queue.empty()) {
+    QueueElem elem = queue.top();
+    queue.pop();
+    BaseStateId t = elem.second;
+    if (elem.first > phi_[t])
+      continue;  // a stale entry.
+    for (int32 i = pred_offsets[t]; i < pred_offsets[t + 1]; i++) {
+      BaseStateId s = preds[i];
+      if (phi_[t] < phi_[s]) {
+        phi_[s] = phi_[t];
+        queue.push(QueueElem(phi_[s], s));
+      }
+    }
+  }
+  if (phi_[hcl_.Start()] == inf)
+    KALDI_WARN << "No word or final state is reachable from the start state "
+               << "of the HCL graph.";
+}
+
+
+const std::vector<HclLmComposeFst::Arc> *HclLmComposeFst::GetArcs(
+    StateId s) {
+  std::unordered_map<StateId, std::vector<Arc> >::iterator iter =
+      cache_.find(s);
+  if (iter != cache_.end()) {
+    num_cache_hits_++;
+    return &(iter->second);
+  }
+  if (cache_bytes_ > static_cast<size_t>(opts_.cache_mb) * 1048576) {
+    cache_.clear();
+    cache_bytes_ = 0;
+    num_cache_clears_++;
+  }
+  num_expanded_++;
+  std::vector<Arc> &arcs = cache_[s];
+
+  const float inf = std::numeric_limits<float>::infinity();
+  BaseStateId hcl_state = static_cast<int32>(s),
+      lm_state = static_cast<BaseStateId>(s >> 32);
+  float phi_cur = phi_[hcl_state];
+  arcs.reserve(hcl_.NumArcs(hcl_state));
+  for (ArcIterator<ConstFst<StdArc> > aiter(hcl_, hcl_state); !aiter.Done();
+       aiter.Next()) {
+    const StdArc &hcl_arc = aiter.Value();
+    float phi_next = phi_[hcl_arc.nextstate];
+    if (phi_next == inf)
+      continue;  // Dead state: no word or final state is reachable.
+    Label ilabel = hcl_arc.ilabel;
+    if (static_cast<size_t>(ilabel) < is_disambig_.size() &&
+        is_disambig_[ilabel])
+      ilabel = 0;
+    Label olabel = WordLabel(hcl_arc.olabel);
+    BaseStateId next_lm_state = lm_state;
+    float cost = hcl_arc.weight.Value() + phi_next - phi_cur;
+    if (olabel != 0) {
+      StdArc lm_arc;
+      if (!lm_->GetArc(lm_state, olabel, &lm_arc))
+        continue;
+      next_lm_state = lm_arc.nextstate;
+      cost += lm_arc.weight.Value();
+    } else if (ilabel == 0 && hcl_arc.nextstate == hcl_state) {
+      continue;  // An epsilon self-loop, e.g. that of the word #0.
+    }
+    arcs.push_back(Arc(ilabel, olabel, Weight(cost),
+                       (static_cast<int64>(next_lm_state) << 32) |
+                       hcl_arc.nextstate));
+  }
+  // The second term is a rough estimate of the overhead of a hash entry.
+  cache_bytes_ += arcs.capacity() * sizeof(Arc) +
+      sizeof(std::pair<StateId, std::vector<Arc> >) + 2 * sizeof(void*);
+  return &arcs;
+}
+
+
+void HclLmComposeFst::PrintStats() const {
+  double hit_rate = num_cache_hits_ /
+      static_cast<double>(num_cache_hits_ + num_expanded_ + 1.0e-10);
+  KALDI_LOG << "HclLmComposeFst: expanded " << num_expanded_
+            << " states, cache hit rate " << hit_rate << ", cache cleared "
+            << num_cache_clears_ << " times; current cache size is "
+            << (cache_bytes_ / 1048576.0) << " MB.";
+}
+
+
+}  // namespace fst
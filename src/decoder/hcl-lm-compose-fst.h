@@ -0,0 +1,272 @@
+// decoder/hcl-lm-compose-fst.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_HCL_LM_COMPOSE_FST_H_
+#define KALDI_DECODER_HCL_LM_COMPOSE_FST_H_
+
+/**
+   This header implements a special FST type, HclLmComposeFst, which is the
+   composition of an HCL graph (i.e. HCLG without the G) with a language model
+   that is only accessed on demand, via the DeterministicOnDemandFst interface
+   (e.g. ConstArpaLmDeterministicFst).  It is intended for language models
+   that are too large to compile into a static HCLG.  Like GrammarFst, it does
+   not inherit from fst::Fst; it only has the interface that the decoder code
+   needs, so that LatticeFasterDecoderTpl can be templated on it.
+ */
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "fst/fstlib.h"
+#include "fstext/deterministic-fst.h"
+#include "itf/options-itf.h"
+
+namespace fst {
+
+
+// HclLmComposeFstArc is like StdArc except that the state-id is 64 bits: the
+// higher 32 bits are the state in the language model and the lower 32 bits
+// the state in the HCL graph.  The decoder code stores states in hashes, not
+// arrays, so the very large state indexes are not a problem.
+struct HclLmComposeFstArc {
+  typedef fst::TropicalWeight Weight;
+  typedef int Label;  // OpenFst's StdArc uses int; this is for compatibility.
+  typedef int64 StateId;
+
+  Label ilabel;
+  Label olabel;
+  Weight weight;
+  StateId nextstate;
+
+  HclLmComposeFstArc() {}
+
+  HclLmComposeFstArc(Label ilabel, Label olabel, Weight weight,
+                     StateId nextstate)
+      : ilabel(ilabel),
+        olabel(olabel),
+        weight(std::move(weight)),
+        nextstate(nextstate) {}
+};
+
+
+struct HclLmComposeFstOptions {
+  bool lm_lookahead;
+  int32 cache_mb;
+
+  HclLmComposeFstOptions(): lm_lookahead(true), cache_mb(512) { }
+
+  void Register(kaldi::OptionsItf *opts) {
+    opts->Register("lm-lookahead", &lm_lookahead, "If true, push the "
+                   "unigram LM cost of the best word reachable from each HCL "
+                   "state towards the start of the word, so that word-internal "
+                   "states are pruned using (an estimate of) their LM cost.");
+    opts->Register("compose-cache-mb", &cache_mb, "Memory limit, in MB, for "
+                   "the cache of expanded arcs of the composed FST; the cache "
+                   "is cleared when it exceeds this size.");
+  }
+};
+
+
+class HclLmComposeFst;
+
+// Declare that we'll be overriding class ArcIterator for class
+// HclLmComposeFst.
+template<> class ArcIterator<HclLmComposeFst>;
+
+
+/**
+   HclLmComposeFst represents the composition of an HCL graph with a language
+   model G, expanding the states of the composed FST as the decoder visits
+   them.
+
+   The HCL graph must have the words on its output labels and the
+   disambiguation symbols (on its input labels) not removed, i.e. it is as
+   produced for nnet3-latgen-faster-lookahead; the disambiguation symbols are
+   replaced with epsilons here.  If HCL was built from L_disambig.fst, it also
+   has the word-level disambiguation symbol #0 on the output side (on the
+   self-loop that would match the backoff arcs of a static G); these
+   'word_disambig_syms' are treated as epsilons too, and not passed to the
+   language model.  The language model must be deterministic and
+   epsilon-free (backoff is handled internally by the
+   DeterministicOnDemandFst).
+
+   If opts.lm_lookahead is true we do "LM lookahead" by weight pushing: for
+   each HCL state s we precompute phi(s), the lowest unigram cost (from
+   'word_costs') of any word that can be output from s before the next word
+   boundary (or zero if a final state can be reached), and each arc from s to
+   t gets phi(t) - phi(s) added to its weight.  These terms telescope, and the
+   final-probs correct for them, so the total cost of any successful path is
+   unchanged; but the LM cost is seen at the start of the word instead of at
+   the word label, which lets the decoder prune with much tighter beams.  We
+   don't need label lookahead (filtering the arcs by the words reachable
+   through them) because a backoff language model accepts all words.
+
+   The expanded arcs are cached, and the cache is cleared whenever it grows
+   larger than opts.cache_mb.  Because of this, only one ArcIterator may be
+   in use at a time (which is how the decoders use it), and this class is
+   not thread-safe.  Note that the language model may have its own caches
+   (for instance ConstArpaLmDeterministicFst keeps a map of the histories it
+   has seen), which are not bounded by this class.
+ */
+class HclLmComposeFst {
+ public:
+  typedef HclLmComposeFstArc Arc;
+  typedef TropicalWeight Weight;
+  typedef Arc::StateId StateId;  // int64
+  typedef StdArc::StateId BaseStateId;  // int
+  typedef Arc::Label Label;
+
+  /**
+     Constructor.  Does not take ownership of any of the pointers or
+     references, which must outlive this object.
+
+      @param [in] opts   Options
+      @param [in] hcl    The HCL graph, with words on the output side.
+      @param [in] lm     The language model; it is accessed via GetArc() and
+                         Final(), with the word labels of 'hcl'.
+      @param [in] disambig_syms  The disambiguation symbols on the input
+                         side of 'hcl', which are treated as epsilons.
+      @param [in] word_disambig_syms  The disambiguation symbols on the
+                         output side of 'hcl' (e.g. the word #0), which are
+                         treated as epsilons.
+      @param [in] word_costs  Indexed by word-id, a cost for each word that
+                         is used for the LM lookahead (normally the negated
+                         unigram log-probability); words beyond the end of
+                         the vector get cost zero.  Ignored if
+                         !opts.lm_lookahead.
+  */
+  HclLmComposeFst(const HclLmComposeFstOptions &opts,
+                  const ConstFst<StdArc> &hcl,
+                  DeterministicOnDemandFst<StdArc> *lm,
+                  const std::vector<int32> &disambig_syms,
+                  const std::vector<int32> &word_disambig_syms,
+                  const std::vector<float> &word_costs);
+
+  StateId Start() const { return start_state_; }
+
+  Weight Final(StateId s) const {
+    BaseStateId hcl_state = static_cast<int32>(s);
+    Weight hcl_final = hcl_.Final(hcl_state);
+    if (hcl_final == Weight::Zero())
+      return hcl_final;
+    BaseStateId lm_state = static_cast<BaseStateId>(s >> 32);
+    Weight lm_final = lm_->Final(lm_state);
+    if (lm_final == Weight::Zero())
+      return lm_final;
+    return Weight(hcl_final.Value() + lm_final.Value() - phi_[hcl_state] +
+                  phi_[hcl_.Start()]);
+  }
+
+  // This is an upper bound on the number of input-epsilon arcs leaving
+  // state s (some of them may be blocked by the language model).
+  inline size_t NumInputEpsilons(StateId s) const {
+    return num_input_epsilons_[static_cast<int32>(s)];
+  }
+
+  inline std::string Type() const { return "hcl-lm-compose"; }
+
+  /// Logs statistics about the expansion and the cache.
+  void PrintStats() const;
+
+  ~HclLmComposeFst() { }
+
+ private:
+  friend class ArcIterator<HclLmComposeFst>;
+
+  // Returns the arcs leaving state s, expanding the state if it is not in
+  // the cache.  The returned pointer is only valid until the next call to
+  // this function.
+  const std::vector<Arc> *GetArcs(StateId s);
+
+  // Returns the label that arc's output label should be replaced with: 0 if it
+  // is a word disambiguation symbol.
+  inline Label WordLabel(Label olabel) const {
+    return (static_cast<size_t>(olabel) < is_word_disambig_.size() &&
+            is_word_disambig_[olabel] ? 0 : olabel);
+  }
+
+  // Computes the array phi_, used for LM lookahead.
+  void ComputeLookaheadCosts(const std::vector<float> &word_costs);
+
+  const HclLmComposeFstOptions &opts_;
+  const ConstFst<StdArc> &hcl_;
+  DeterministicOnDemandFst<StdArc> *lm_;
+
+  // is_disambig_[i] is true if i is a disambiguation symbol.
+  std::vector<bool> is_disambig_;
+  // is_word_disambig_[i] is true if i is a word disambiguation symbol.
+  std::vector<bool> is_word_disambig_;
+  // Indexed by HCL state, the number of arcs with input epsilons or
+  // disambiguation symbols.
+  std::vector<int32> num_input_epsilons_;
+  // Indexed by HCL state, the lookahead cost (all zeros if
+  // !opts_.lm_lookahead); infinity for states from which neither a word nor
+  // a final state can be reached.
+  std::vector<float> phi_;
+
+  StateId start_state_;
+
+  std::unordered_map<StateId, std::vector<Arc> > cache_;
+  size_t cache_bytes_;
+
+  // Statistics.
+  int64 num_expanded_;
+  int64 num_cache_hits_;
+  int64 num_cache_clears_;
+};
+
+
+/**
+   This is the overridden template for class ArcIterator for HclLmComposeFst.
+   As with GrammarFst, we only implement the functionality that the decoders
+   need.  Only one of these may exist at a time for a given HclLmComposeFst,
+   because creating one may clear the cache that the others point into.
+ */
+template <>
+class ArcIterator<HclLmComposeFst> {
+ public:
+  using Arc = typename HclLmComposeFst::Arc;
+  using StateId = typename Arc::StateId;  // int64
+
+  // Caution: uses const_cast to evade const rules on HclLmComposeFst, as
+  // GrammarFst's ArcIterator does.
+  inline ArcIterator(const HclLmComposeFst &fst_in, StateId s) {
+    HclLmComposeFst &fst = const_cast<HclLmComposeFst&>(fst_in);
+    const std::vector<Arc> *arcs = fst.GetArcs(s);
+    arcs_ = arcs->empty() ? NULL : &((*arcs)[0]);
+    narcs_ = arcs->size();
+    i_ = 0;
+  }
+
+  inline bool Done() const { return i_ >= narcs_; }
+
+  inline void Next() { i_++; }
+
+  inline const Arc &Value() const { return arcs_[i_]; }
+
+ private:
+  const Arc *arcs_;
+  size_t narcs_;
+  size_t i_;
+};
+
+
+}  // namespace fst
+
+#endif  // KALDI_DECODER_HCL_LM_COMPOSE_FST_H_
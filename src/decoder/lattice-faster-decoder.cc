@@ -997,11 +997,13 @@ template class LatticeFasterDecoderTpl<fst::Fst<fst::StdArc>, decoder::StdToken>
 template class LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>, decoder::StdToken >;
 template class LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, decoder::StdToken >;
 template class LatticeFasterDecoderTpl<fst::GrammarFst, decoder::StdToken>;
+template class LatticeFasterDecoderTpl<fst::HclLmComposeFst, decoder::StdToken>;
 
 template class LatticeFasterDecoderTpl<fst::Fst<fst::StdArc> , decoder::BackpointerToken>;
 template class LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>, decoder::BackpointerToken >;
 template class LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, decoder::BackpointerToken >;
 template class LatticeFasterDecoderTpl<fst::GrammarFst, decoder::BackpointerToken>;
+template class LatticeFasterDecoderTpl<fst::HclLmComposeFst, decoder::BackpointerToken>;
 
 
 } // end namespace kaldi.
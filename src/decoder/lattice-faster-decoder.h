@@ -32,6 +32,7 @@
 #include "lat/determinize-lattice-pruned.h"
 #include "lat/kaldi-lattice.h"
 #include "decoder/grammar-fst.h"
+#include "decoder/hcl-lm-compose-fst.h"
 
 namespace kaldi {
 
@@ -219,8 +220,8 @@ struct BackpointerToken {
    quick lookup of the current best path (see lattice-faster-online-decoder.h)
 
    The FST you invoke this decoder which is expected to equal
-   Fst::Fst<fst::StdArc>, a.k.a. StdFst, or GrammarFst.  If you invoke it with
-   FST == StdFst and it notices that the actual FST type is
+   Fst::Fst<fst::StdArc>, a.k.a. StdFst, GrammarFst or HclLmComposeFst.  If
+   you invoke it with FST == StdFst and it notices that the actual FST type is
    fst::VectorFst<fst::StdArc> or fst::ConstFst<fst::StdArc>, the decoder object
    will internally cast itself to one that is templated on those more specific
    types; this is an optimization for speed.
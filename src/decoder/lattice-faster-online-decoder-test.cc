@@ -0,0 +1,136 @@
+// decoder/lattice-faster-online-decoder-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/decodable-matrix.h"
+#include "decoder/lattice-faster-online-decoder.h"
+#include "fstext/fstext-lib.h"
+#include "hmm/hmm-test-utils.h"
+#include "lat/lattice-functions.h"
+
+namespace kaldi {
+
+// Creates a random decoding graph with transition-ids of 'trans_model' on the
+// input side and words 1..10 on the output side.  Every state has an arc to
+// the next one, so that any number of frames can be decoded; input-epsilon
+// arcs only go to higher-numbered states, so there are no epsilon cycles.
+static void CreateGraph(const TransitionModel &trans_model,
+                        fst::VectorFst<fst::StdArc> *fst) {
+  typedef fst::StdArc Arc;
+  fst->DeleteStates();
+  int32 num_states = RandInt(1, 10), num_words = 10;
+  for (int32 s = 0; s < num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    if (s == num_states - 1 || RandInt(0, 1) == 0)
+      fst->SetFinal(s, fst::TropicalWeight(RandUniform()));
+    int32 num_arcs = RandInt(1, 4);
+    for (int32 i = 0; i <= num_arcs; i++) {
+      int32 ilabel = RandInt(1, trans_model.NumTransitionIds()),
+          olabel = (RandInt(0, 1) == 0 ? 0 : RandInt(1, num_words)),
+          nextstate = (i == 0 ? (s + 1) % num_states :
+                       RandInt(0, num_states - 1));
+      fst->AddArc(s, Arc(ilabel, olabel, RandUniform(), nextstate));
+    }
+    if (s + 1 < num_states && RandInt(0, 2) == 0)
+      fst->AddArc(s, Arc(0, RandInt(1, num_words), RandUniform(),
+                         RandInt(s + 1, num_states - 1)));
+  }
+}
+
+// Gets the best path of 'clat' as the alignment, words and total cost.
+static void GetBestPath(const CompactLattice &clat,
+                        std::vector<int32> *alignment,
+                        std::vector<int32> *words, double *cost) {
+  CompactLattice best_path_clat;
+  CompactLatticeShortestPath(clat, &best_path_clat);
+  Lattice best_path;
+  ConvertLattice(best_path_clat, &best_path);
+  LatticeWeight weight;
+  KALDI_ASSERT(fst::GetLinearSymbolSequence(best_path, alignment, words,
+                                            &weight));
+  *cost = weight.Value1() + weight.Value2();
+}
+
+// Tests that the lattice from GetLatticeIncremental(), called at random
+// points during decoding, matches the one from GetLattice() after
+// FinalizeDecoding().
+void UnitTestGetLatticeIncremental() {
+  ContextDependency *ctx_dep = NULL;
+  TransitionModel *trans_model = GenRandTransitionModel(&ctx_dep);
+  fst::VectorFst<fst::StdArc> fst;
+  CreateGraph(*trans_model, &fst);
+
+  int32 num_frames = RandInt(1, 50);
+  Matrix<BaseFloat> loglikes(num_frames, trans_model->NumPdfs());
+  loglikes.SetRandn();
+  DecodableMatrixScaledMapped decodable(*trans_model, loglikes, 1.0);
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 20.0;
+  config.lattice_beam = RandInt(1, 8);
+  config.prune_interval = RandInt(1, 10);
+  LatticeFasterOnlineDecoder decoder(fst, config);
+  LatticeFasterOnlineIncrementalState state(*trans_model, config);
+
+  decoder.InitDecoding();
+  state.Init();
+  while (decoder.NumFramesDecoded() < num_frames) {
+    decoder.AdvanceDecoding(&decodable, RandInt(1, 10));
+    if (RandInt(0, 1) == 0) {
+      int32 num_frames_to_include = RandInt(state.NumFramesInLattice(),
+                                            decoder.NumFramesDecoded());
+      decoder.GetLatticeIncremental(num_frames_to_include, false, &state);
+      KALDI_ASSERT(state.NumFramesInLattice() == num_frames_to_include);
+    }
+  }
+  decoder.FinalizeDecoding();
+
+  CompactLattice clat;
+  KALDI_ASSERT(decoder.GetLattice(&clat, true));
+  const CompactLattice &incremental_clat = decoder.GetLatticeIncremental(
+      decoder.NumFramesDecoded(), true, &state);
+  KALDI_ASSERT(state.NumFramesInLattice() == num_frames);
+  KALDI_ASSERT(clat.NumStates() > 0 && incremental_clat.NumStates() > 0);
+
+  // The pruning of the two lattices can differ slightly, because the chunks
+  // are determinized with approximate final-costs, but the best paths
+  // should be the same.
+  std::vector<int32> alignment, words, incremental_alignment,
+      incremental_words;
+  double cost, incremental_cost;
+  GetBestPath(clat, &alignment, &words, &cost);
+  GetBestPath(incremental_clat, &incremental_alignment, &incremental_words,
+              &incremental_cost);
+  KALDI_ASSERT(alignment.size() == num_frames);
+  KALDI_ASSERT(alignment == incremental_alignment);
+  KALDI_ASSERT(words == incremental_words);
+  KALDI_ASSERT(ApproxEqual(cost, incremental_cost, 1.0e-04));
+
+  delete trans_model;
+  delete ctx_dep;
+}
+
+}  // end namespace kaldi.
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++)
+    UnitTestGetLatticeIncremental();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -266,6 +266,111 @@ bool LatticeFasterOnlineDecoderTpl<FST>::GetRawLatticePruned(
 
 
 
+LatticeFasterOnlineIncrementalState::LatticeFasterOnlineIncrementalState(
+    const TransitionModel &trans_model,
+    const LatticeFasterDecoderConfig &config):
+    determinizer_(trans_model, config_),
+    num_frames_in_lattice_(0),
+    next_token_label_(LatticeIncrementalDeterminizer::kTokenLabelOffset) {
+  config_.beam = config.beam;
+  config_.max_active = config.max_active;
+  config_.min_active = config.min_active;
+  config_.lattice_beam = config.lattice_beam;
+  config_.prune_interval = config.prune_interval;
+  config_.beam_delta = config.beam_delta;
+  config_.hash_ratio = config.hash_ratio;
+  config_.prune_scale = config.prune_scale;
+  config_.det_opts = config.det_opts;
+  config_.det_opts.minimize = false;
+  config_.Check();
+}
+
+void LatticeFasterOnlineIncrementalState::Init() {
+  determinizer_.Init();
+  num_frames_in_lattice_ = 0;
+  token2label_map_.clear();
+  next_token_label_ = LatticeIncrementalDeterminizer::kTokenLabelOffset;
+}
+
+// This is as LatticeIncrementalDecoderTpl::GetLattice() and
+// AppendLatticeChunk(); the comments there explain the details.
+template <typename FST>
+const CompactLattice &LatticeFasterOnlineDecoderTpl<FST>::GetLatticeIncremental(
+    int32 num_frames_to_include, bool use_final_probs,
+    LatticeFasterOnlineIncrementalState *state) {
+  LatticeIncrementalDeterminizer &determinizer = state->determinizer_;
+  int32 &num_frames_in_lattice = state->num_frames_in_lattice_;
+  KALDI_ASSERT(num_frames_to_include >= num_frames_in_lattice &&
+               num_frames_to_include <= this->NumFramesDecoded());
+
+  if (num_frames_in_lattice > 0 &&
+      determinizer.GetLattice().NumStates() == 0) {
+    // Something went wrong previously; the lattice will stay empty.
+    num_frames_in_lattice = num_frames_to_include;
+    return determinizer.GetLattice();
+  }
+  if (this->decoding_finalized_ && !use_final_probs)
+    KALDI_ERR << "You cannot get the lattice without final-probs after "
+        "calling FinalizeDecoding().";
+  if (use_final_probs && num_frames_to_include != this->NumFramesDecoded())
+    KALDI_ERR << "use-final-probs may not be true if you are not "
+        "getting a lattice for all frames decoded so far.";
+
+  if (num_frames_to_include > num_frames_in_lattice) {
+    // Make sure the token pruning is up to date; this does very little work
+    // if we pruned recently.
+    this->PruneActiveTokens(this->config_.lattice_beam *
+                            this->config_.prune_scale);
+
+    if (determinizer.GetLattice().NumStates() == 0 ||
+        determinizer.GetLattice().Final(0) != CompactLatticeWeight::Zero()) {
+      num_frames_in_lattice = 0;
+      determinizer.Init();
+    }
+
+    std::vector<Token*> &frame_toks(state->frame_toks_);
+    frame_toks.clear();
+    for (int32 frame = num_frames_in_lattice; frame <= num_frames_to_include;
+         frame++)
+      frame_toks.push_back(this->active_toks_[frame].toks);
+    RawLatticeChunk &chunk(state->chunk_);
+    if (!CreateRawLatticeChunk(
+            frame_toks, num_frames_in_lattice, this->cost_offsets_,
+            (this->decoding_finalized_ ? &(this->final_costs_) : NULL),
+            state->token2label_map_, &(state->next_token_label_),
+            &(state->token2label_map_temp_), &(state->token2state_map_),
+            &chunk)) {
+      KALDI_WARN << "No tokens exist on start frame";
+      return determinizer.GetLattice();  // will be empty.
+    }
+    state->token2label_map_.swap(state->token2label_map_temp_);
+
+    determinizer.AcceptRawLatticeChunk(chunk.lat, chunk.first_frame_states);
+    num_frames_in_lattice = num_frames_to_include;
+  }
+  if (determinizer.GetLattice().NumStates() == 0)
+    return determinizer.GetLattice();  // Something went wrong, or no frames.
+
+  unordered_map<Label, BaseFloat> token_label2final_cost;
+  if (use_final_probs) {
+    unordered_map<Token*, BaseFloat> token2final_cost;
+    if (this->decoding_finalized_)
+      token2final_cost = this->final_costs_;
+    else
+      this->ComputeFinalCosts(&token2final_cost, NULL, NULL);
+    for (const auto &p: token2final_cost) {
+      auto iter = state->token2label_map_.find(p.first);
+      // Some tokens may not have survived the pruned determinization.
+      if (iter != state->token2label_map_.end())
+        token_label2final_cost[iter->second] = p.second;
+    }
+  }
+  determinizer.SetFinalCosts(token_label2final_cost.empty() ? NULL :
+                             &token_label2final_cost);
+  return determinizer.GetLattice();
+}
+
+
 // Instantiate the template for the FST types that we'll need.
 template class LatticeFasterOnlineDecoderTpl<fst::Fst<fst::StdArc> >;
 template class LatticeFasterOnlineDecoderTpl<fst::VectorFst<fst::StdArc> >;
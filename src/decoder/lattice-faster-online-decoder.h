@@ -35,10 +35,67 @@
 #include "lat/determinize-lattice-pruned.h"
 #include "lat/kaldi-lattice.h"
 #include "decoder/lattice-faster-decoder.h"
+#include "decoder/lattice-incremental-decoder.h"
 
 namespace kaldi {
 
 
+template <typename FST> class LatticeFasterOnlineDecoderTpl;
+
+/**
+   This class holds the state of the incremental determinization of the
+   lattice of a LatticeFasterOnlineDecoderTpl object; see its function
+   GetLatticeIncremental().  It is kept outside the decoder so that the
+   decoder does not pay for it unless it is used.  It uses the same algorithm
+   as LatticeIncrementalDecoderTpl (see lattice-incremental-decoder.h): the
+   frames that have already been determinized are not determinized again,
+   only a few states at the end of the previously determinized part.
+ */
+class LatticeFasterOnlineIncrementalState {
+ public:
+  /// 'trans_model' must outlive this object.  The lattice beam and the
+  /// determinization options are taken from 'config'; det_opts.minimize is
+  /// ignored, as minimization is not compatible with incremental
+  /// determinization.
+  LatticeFasterOnlineIncrementalState(const TransitionModel &trans_model,
+                                      const LatticeFasterDecoderConfig &config);
+
+  /// Must be called whenever the decoder's InitDecoding() is called.
+  void Init();
+
+  /// Returns the number of frames that have been determinized so far.
+  int32 NumFramesInLattice() const { return num_frames_in_lattice_; }
+
+  /// Returns the lattice as of the last call to GetLatticeIncremental().
+  const CompactLattice &GetLattice() const {
+    return determinizer_.GetDeterminizedLattice();
+  }
+
+ private:
+  template <typename FST> friend class LatticeFasterOnlineDecoderTpl;
+  typedef LatticeArc::Label Label;
+
+  // config_ must come before determinizer_, which keeps a reference to it.
+  LatticeIncrementalDecoderConfig config_;
+  LatticeIncrementalDeterminizer determinizer_;
+
+  // The number of frames of the decoder that have been determinized.
+  int32 num_frames_in_lattice_;
+
+  // A map from the Tokens on frame num_frames_in_lattice_ to the token-labels
+  // that identify them in the determinizer (see the glossary in
+  // lattice-incremental-decoder.h).
+  unordered_map<decoder::BackpointerToken*, Label> token2label_map_;
+  // Temporaries used in GetLatticeIncremental(), kept to avoid reallocation.
+  unordered_map<decoder::BackpointerToken*, Label> token2label_map_temp_;
+  unordered_map<decoder::BackpointerToken*, LatticeArc::StateId> token2state_map_;
+  std::vector<decoder::BackpointerToken*> frame_toks_;
+  RawLatticeChunk chunk_;
+  Label next_token_label_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeFasterOnlineIncrementalState);
+};
+
 
 /** LatticeFasterOnlineDecoderTpl is as LatticeFasterDecoderTpl but also
     supports an efficient way to get the best path (see the function
@@ -136,6 +193,21 @@ class LatticeFasterOnlineDecoderTpl:
                            bool use_final_probs,
                            BaseFloat beam) const;
 
+  /// Gets the determinized lattice of the first 'num_frames_to_include'
+  /// frames, determinizing incrementally: only the frames decoded since the
+  /// previous call with the same 'state' (since the last call to
+  /// state->Init()) are determinized, so the cost is proportional to the
+  /// number of new frames rather than to the length of the utterance.  This
+  /// is as LatticeIncrementalDecoderTpl::GetLattice(); see its documentation.
+  /// 'num_frames_to_include' must not be less than in the previous call, and
+  /// if 'use_final_probs' is true it must equal NumFramesDecoded().  The
+  /// lattice has the same acoustic scale as the decoding; it will be empty
+  /// if something went wrong.  The returned reference is to a member of
+  /// 'state'.
+  const CompactLattice &GetLatticeIncremental(
+      int32 num_frames_to_include, bool use_final_probs,
+      LatticeFasterOnlineIncrementalState *state);
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeFasterOnlineDecoderTpl);
 };
 
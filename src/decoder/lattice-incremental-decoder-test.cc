@@ -0,0 +1,129 @@
+// decoder/lattice-incremental-decoder-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/decodable-matrix.h"
+#include "decoder/lattice-incremental-decoder.h"
+#include "fstext/fstext-lib.h"
+#include "hmm/hmm-test-utils.h"
+
+namespace kaldi {
+
+// Creates a random decoding graph with transition-ids of 'trans_model' on the
+// input side and words 1..10 on the output side.  Every state has an arc to
+// the next one, so that any number of frames can be decoded; input-epsilon
+// arcs only go to higher-numbered states, so there are no epsilon cycles.
+static void CreateGraph(const TransitionModel &trans_model,
+                        fst::VectorFst<fst::StdArc> *fst) {
+  typedef fst::StdArc Arc;
+  fst->DeleteStates();
+  int32 num_states = RandInt(1, 10), num_words = 10;
+  for (int32 s = 0; s < num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    if (s == num_states - 1 || RandInt(0, 1) == 0)
+      fst->SetFinal(s, fst::TropicalWeight(RandUniform()));
+    int32 num_arcs = RandInt(1, 4);
+    for (int32 i = 0; i <= num_arcs; i++) {
+      int32 ilabel = RandInt(1, trans_model.NumTransitionIds()),
+          olabel = (RandInt(0, 1) == 0 ? 0 : RandInt(1, num_words)),
+          nextstate = (i == 0 ? (s + 1) % num_states :
+                       RandInt(0, num_states - 1));
+      fst->AddArc(s, Arc(ilabel, olabel, RandUniform(), nextstate));
+    }
+    if (s + 1 < num_states && RandInt(0, 2) == 0)
+      fst->AddArc(s, Arc(0, RandInt(1, num_words), RandUniform(),
+                         RandInt(s + 1, num_states - 1)));
+  }
+}
+
+// Tests that with --determinize-in-background=true the lattices are the same
+// as when the chunks are determinized synchronously, both for the partial
+// lattices obtained during decoding and for the final one.  We use small
+// chunks, so that there are many of them and the decoder often has to wait
+// for the background thread.
+void UnitTestDeterminizeInBackground() {
+  ContextDependency *ctx_dep = NULL;
+  TransitionModel *trans_model = GenRandTransitionModel(&ctx_dep);
+  fst::VectorFst<fst::StdArc> fst;
+  CreateGraph(*trans_model, &fst);
+
+  int32 num_frames = RandInt(1, 200);
+  Matrix<BaseFloat> loglikes(num_frames, trans_model->NumPdfs());
+  loglikes.SetRandn();
+  DecodableMatrixScaledMapped decodable(*trans_model, loglikes, 1.0);
+
+  LatticeIncrementalDecoderConfig config;
+  config.beam = 20.0;
+  config.lattice_beam = RandInt(1, 8);
+  config.prune_interval = RandInt(1, 10);
+  config.determinize_min_chunk_size = RandInt(1, 5);
+  config.determinize_max_delay = config.determinize_min_chunk_size +
+      RandInt(1, 10);
+  LatticeIncrementalDecoderConfig background_config(config);
+  background_config.determinize_in_background = true;
+  background_config.determinize_max_pending_chunks = RandInt(1, 3);
+
+  LatticeIncrementalDecoder decoder(fst, *trans_model, config),
+      background_decoder(fst, *trans_model, background_config);
+
+  // Decode the same utterance more than once, to test that InitDecoding()
+  // works while the background thread exists.
+  int32 num_utts = RandInt(1, 2);
+  for (int32 utt = 0; utt < num_utts; utt++) {
+    decoder.InitDecoding();
+    background_decoder.InitDecoding();
+    while (decoder.NumFramesDecoded() < num_frames) {
+      int32 max_num_frames = RandInt(1, 20);
+      decoder.AdvanceDecoding(&decodable, max_num_frames);
+      background_decoder.AdvanceDecoding(&decodable, max_num_frames);
+      KALDI_ASSERT(decoder.NumFramesDecoded() ==
+                   background_decoder.NumFramesDecoded());
+      if (RandInt(0, 3) == 0) {
+        int32 num_frames_to_include = RandInt(
+            std::max(decoder.NumFramesInLattice(),
+                     background_decoder.NumFramesInLattice()),
+            decoder.NumFramesDecoded());
+        const CompactLattice
+            &clat = decoder.GetLattice(num_frames_to_include, false),
+            &background_clat = background_decoder.GetLattice(
+                num_frames_to_include, false);
+        KALDI_ASSERT(fst::Equal(clat, background_clat));
+      }
+    }
+    decoder.FinalizeDecoding();
+    background_decoder.FinalizeDecoding();
+    const CompactLattice
+        &clat = decoder.GetLattice(num_frames, true),
+        &background_clat = background_decoder.GetLattice(num_frames, true);
+    KALDI_ASSERT(clat.NumStates() > 0);
+    KALDI_ASSERT(fst::Equal(clat, background_clat));
+  }
+
+  delete trans_model;
+  delete ctx_dep;
+}
+
+}  // end namespace kaldi.
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++)
+    UnitTestDeterminizeInBackground();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -32,7 +32,10 @@ LatticeIncrementalDecoderTpl<FST, Token>::LatticeIncrementalDecoderTpl(
       delete_fst_(false),
       num_toks_(0),
       config_(config),
-      determinizer_(trans_model, config) {
+      determinizer_(trans_model, config),
+      num_chunks_pending_(0),
+      restart_needed_(false),
+      determinize_thread_exit_(false) {
   config.Check();
   toks_.SetSize(1000); // just so on the first frame we do something reasonable.
 }
@@ -45,13 +48,24 @@ LatticeIncrementalDecoderTpl<FST, Token>::LatticeIncrementalDecoderTpl(
       delete_fst_(true),
       num_toks_(0),
       config_(config),
-      determinizer_(trans_model, config) {
+      determinizer_(trans_model, config),
+      num_chunks_pending_(0),
+      restart_needed_(false),
+      determinize_thread_exit_(false) {
   config.Check();
   toks_.SetSize(1000); // just so on the first frame we do something reasonable.
 }
 
 template <typename FST, typename Token>
 LatticeIncrementalDecoderTpl<FST, Token>::~LatticeIncrementalDecoderTpl() {
+  if (determinize_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(chunk_mutex_);
+      determinize_thread_exit_ = true;
+    }
+    chunk_ready_cv_.notify_one();
+    determinize_thread_.join();  // it finishes the pending chunks first.
+  }
   DeleteElems(toks_.Clear());
   ClearActiveTokens();
   if (delete_fst_) delete fst_;
@@ -75,6 +89,8 @@ void LatticeIncrementalDecoderTpl<FST, Token>::InitDecoding() {
   toks_.Insert(start_state, start_tok);
   num_toks_++;
 
+  WaitForLatticeChunks();
+  restart_needed_ = false;
   determinizer_.Init();
   num_frames_in_lattice_ = 0;
   token2label_map_.clear();
@@ -110,9 +126,7 @@ void LatticeIncrementalDecoderTpl<FST, Token>::UpdateLatticeDeterminization() {
   }
   /* OK, determinize the chunk that spans from num_frames_in_lattice_ to
      best_frame. */
-  bool use_final_probs = false;
-  GetLattice(best_frame, use_final_probs);
-  return;
+  AppendLatticeChunk(best_frame);
 }
 // Returns true if any kind of traceback is available (not necessarily from
 // a final state).  It should only very rarely return false; this indicates
@@ -873,16 +887,6 @@ const CompactLattice& LatticeIncrementalDecoderTpl<FST, Token>::GetLattice(
   KALDI_ASSERT(num_frames_to_include >= num_frames_in_lattice_ &&
                num_frames_to_include <= NumFramesDecoded());
 
-
-  if (num_frames_in_lattice_ > 0 &&
-      determinizer_.GetLattice().NumStates() == 0) {
-    /* Something went wrong, lattice is empty and will continue to be empty.
-       User-level code should detect and deal with this.
-     */
-    num_frames_in_lattice_ = num_frames_to_include;
-    return determinizer_.GetLattice();
-  }
-
   if (decoding_finalized_ && !use_final_probs) {
     // This is not supported
     KALDI_ERR << "You cannot get the lattice without final-probs after "
@@ -895,198 +899,316 @@ const CompactLattice& LatticeIncrementalDecoderTpl<FST, Token>::GetLattice(
         "getting a lattice for all frames decoded so far.";
   }
 
+  if (num_frames_to_include > num_frames_in_lattice_)
+    AppendLatticeChunk(num_frames_to_include);
+  WaitForLatticeChunks();
+  if (restart_needed_) {
+    // The background thread could not append a chunk, so we have to
+    // determinize everything again from the start (AppendLatticeChunk() will
+    // reset determinizer_).
+    num_frames_in_lattice_ = 0;
+    AppendLatticeChunk(num_frames_to_include);
+    WaitForLatticeChunks();
+  }
 
-  if (num_frames_to_include > num_frames_in_lattice_) {
-    /* Make sure the token-pruning is up to date.   If we just pruned the tokens,
-       this will do very little work. */
-    PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+  if (determinizer_.GetLattice().NumStates() == 0)
+    return determinizer_.GetLattice();   // Something went wrong, lattice is empty.
 
-    if (determinizer_.GetLattice().NumStates() == 0 ||
-        determinizer_.GetLattice().Final(0) != CompactLatticeWeight::Zero()) {
-      num_frames_in_lattice_ = 0;
-      determinizer_.Init();
+  unordered_map<Token*, BaseFloat> token2final_cost;
+  unordered_map<Label, BaseFloat> token_label2final_cost;
+  if (use_final_probs) {
+    ComputeFinalCosts(&token2final_cost, NULL, NULL);
+    for (const auto &p: token2final_cost) {
+      Token *tok = p.first;
+      BaseFloat cost = p.second;
+      auto iter = token2label_map_.find(tok);
+      if (iter != token2label_map_.end()) {
+        /* Some tokens may not have survived the pruned determinization. */
+        Label token_label = iter->second;
+        bool ret = token_label2final_cost.insert({token_label, cost}).second;
+        KALDI_ASSERT(ret); /* Make sure it was inserted. */
+      }
     }
+  }
+  /* Note: these final-probs won't affect the next chunk, only the lattice
+     returned from GetLattice().  They are kind of temporaries. */
+  determinizer_.SetFinalCosts(token_label2final_cost.empty() ? NULL :
+                              &token_label2final_cost);
 
-    Lattice chunk_lat;
+  return determinizer_.GetLattice();
+}
 
-    unordered_map<Label, LatticeArc::StateId> token_label2state;
-    if (num_frames_in_lattice_ != 0) {
-      determinizer_.InitializeRawLatticeChunk(&chunk_lat,
-                                              &token_label2state);
-    }
 
-    // tok_map will map from Token* to state-id in chunk_lat.
-    // The cur and prev versions alternate on different frames.
-    unordered_map<Token*, StateId> &tok2state_map(temp_token_map_);
-    tok2state_map.clear();
-
-    unordered_map<Token*, Label> &next_token2label_map(token2label_map_temp_);
-    next_token2label_map.clear();
-
-    { // Deal with the last frame in the chunk, the one numbered `num_frames_to_include`.
-      // (Yes, this is backwards).   We allocate token labels, and set tokens as
-      // final, but don't add any transitions.  This may leave some states
-      // disconnected (e.g. due to chains of nonemitting arcs), but it's OK; we'll
-      // fix it when we generate the next chunk of lattice.
-      int32 frame = num_frames_to_include;
-      // Allocate state-ids for all tokens on this frame.
-
-      for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
-        /* If we included the final-costs at this stage, they will cause
-           non-final states to be pruned out from the end of the lattice. */
-        BaseFloat final_cost;
-        {  // This block computes final_cost
-          if (decoding_finalized_) {
-            if (final_costs_.empty()) {
-              final_cost = 0.0;  /* No final-state survived, so treat all as final
-                                  * with probability One(). */
-            } else {
-              auto iter = final_costs_.find(tok);
-              if (iter == final_costs_.end())
-                final_cost = std::numeric_limits<BaseFloat>::infinity();
-              else
-                final_cost = iter->second;
-            }
+template <typename Token>
+bool CreateRawLatticeChunk(
+    const std::vector<Token*> &frame_toks,
+    int32 first_frame,
+    const std::vector<BaseFloat> &cost_offsets,
+    const unordered_map<Token*, BaseFloat> *final_costs,
+    const unordered_map<Token*, LatticeArc::Label> &token2label_map,
+    LatticeArc::Label *next_token_label,
+    unordered_map<Token*, LatticeArc::Label> *next_token2label_map,
+    unordered_map<Token*, LatticeArc::StateId> *tok2state_map,
+    RawLatticeChunk *chunk) {
+  typedef LatticeArc::StateId StateId;
+  typedef typename Token::ForwardLinkT ForwardLinkT;
+  KALDI_ASSERT(frame_toks.size() >= 2);
+  int32 num_frames_to_include = first_frame + frame_toks.size() - 1;
+  Lattice &chunk_lat = chunk->lat;
+  chunk_lat.DeleteStates();
+  chunk->first_frame_states.clear();
+  // tok2state_map will map from Token* to state-id in chunk_lat.
+  tok2state_map->clear();
+  next_token2label_map->clear();
+
+  { // Deal with the last frame in the chunk, the one numbered `num_frames_to_include`.
+    // (Yes, this is backwards).   We allocate token labels, and set tokens as
+    // final, but don't add any transitions.  This may leave some states
+    // disconnected (e.g. due to chains of nonemitting arcs), but it's OK; we'll
+    // fix it when we generate the next chunk of lattice.
+    // Allocate state-ids for all tokens on this frame.
+    for (Token *tok = frame_toks.back(); tok != NULL; tok = tok->next) {
+      /* If we included the final-costs at this stage, they will cause
+         non-final states to be pruned out from the end of the lattice. */
+      BaseFloat final_cost;
+      {  // This block computes final_cost
+        if (final_costs != NULL) {
+          if (final_costs->empty()) {
+            final_cost = 0.0;  /* No final-state survived, so treat all as final
+                                * with probability One(). */
           } else {
-            /* this is a `fake` final-cost used to guide pruning.  It's as if we
-               set the betas (backward-probs) on the final frame to the
-               negatives of the corresponding alphas, so all tokens on the last
-               frae will be on a best path..  the extra_cost for each token
-               always corresponds to its alpha+beta on this assumption.  We want
-               the final_cost here to correspond to the beta (backward-prob), so
-               we get that by final_cost = extra_cost - tot_cost.
-               [The tot_cost is the forward/alpha cost.]
-            */
-            final_cost = tok->extra_cost - tok->tot_cost;
+            auto iter = final_costs->find(tok);
+            if (iter == final_costs->end())
+              final_cost = std::numeric_limits<BaseFloat>::infinity();
+            else
+              final_cost = iter->second;
           }
+        } else {
+          /* this is a `fake` final-cost used to guide pruning.  It's as if we
+             set the betas (backward-probs) on the final frame to the
+             negatives of the corresponding alphas, so all tokens on the last
+             frae will be on a best path..  the extra_cost for each token
+             always corresponds to its alpha+beta on this assumption.  We want
+             the final_cost here to correspond to the beta (backward-prob), so
+             we get that by final_cost = extra_cost - tot_cost.
+             [The tot_cost is the forward/alpha cost.]
+          */
+          final_cost = tok->extra_cost - tok->tot_cost;
         }
+      }
 
-        StateId state = chunk_lat.AddState();
-        tok2state_map[tok] = state;
-        if (final_cost < std::numeric_limits<BaseFloat>::infinity()) {
-          next_token2label_map[tok] = AllocateNewTokenLabel();
-          StateId token_final_state = chunk_lat.AddState();
-          LatticeArc::Label ilabel = 0,
-              olabel = (next_token2label_map[tok] = AllocateNewTokenLabel());
-          chunk_lat.AddArc(state,
-                           LatticeArc(ilabel, olabel,
-                                      LatticeWeight::One(),
-                                      token_final_state));
-          chunk_lat.SetFinal(token_final_state, LatticeWeight(final_cost, 0.0));
-        }
+      StateId state = chunk_lat.AddState();
+      (*tok2state_map)[tok] = state;
+      if (final_cost < std::numeric_limits<BaseFloat>::infinity()) {
+        StateId token_final_state = chunk_lat.AddState();
+        LatticeArc::Label ilabel = 0,
+            olabel = ((*next_token2label_map)[tok] = (*next_token_label)++);
+        chunk_lat.AddArc(state,
+                         LatticeArc(ilabel, olabel,
+                                    LatticeWeight::One(),
+                                    token_final_state));
+        chunk_lat.SetFinal(token_final_state, LatticeWeight(final_cost, 0.0));
       }
     }
+  }
 
-    // Go in reverse order over the remaining frames so we can create arcs as we
-    // go, and their destination-states will already be in the map.
-    for (int32 frame = num_frames_to_include;
-         frame >= num_frames_in_lattice_; frame--) {
-      // The conditional below is needed for the last frame of the utterance.
-      BaseFloat cost_offset = (frame < cost_offsets_.size() ?
-                               cost_offsets_[frame] : 0.0);
-
-      // For the first frame of the chunk, we need to make sure the states are
-      // the ones created by InitializeRawLatticeChunk() (where not pruned away).
-      if (frame == num_frames_in_lattice_ && num_frames_in_lattice_ != 0) {
-        for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
-          auto iter = token2label_map_.find(tok);
-          KALDI_ASSERT(iter != token2label_map_.end());
-          Label token_label = iter->second;
-          auto iter2 = token_label2state.find(token_label);
-          if (iter2 != token_label2state.end()) {
-            StateId state = iter2->second;
-            tok2state_map[tok] = state;
-          } else {
-            // Some states may have been pruned out, but we should still allocate
-            // them.  They might have been part of chains of nonemitting arcs
-            // where the state became disconnected because the last chunk didn't
-            // include arcs starting at this frame.
-            StateId state = chunk_lat.AddState();
-            tok2state_map[tok] = state;
-          }
-        }
-      } else if (frame != num_frames_to_include) {  // We already created states
-                                                    // for the last frame.
-        for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
-          StateId state = chunk_lat.AddState();
-          tok2state_map[tok] = state;
-        }
+  // Go in reverse order over the remaining frames so we can create arcs as we
+  // go, and their destination-states will already be in the map.
+  for (int32 frame = num_frames_to_include; frame >= first_frame; frame--) {
+    Token *frame_head = frame_toks[frame - first_frame];
+    // The conditional below is needed for the last frame of the utterance.
+    BaseFloat cost_offset = (frame < cost_offsets.size() ?
+                             cost_offsets[frame] : 0.0);
+
+    // For the first frame of the chunk, we record the token-labels of the
+    // states so that they can be identified with the redeterminized-states
+    // created by InitializeRawLatticeChunk() (where not pruned away).
+    if (frame == first_frame && first_frame != 0) {
+      for (Token *tok = frame_head; tok != NULL; tok = tok->next) {
+        auto iter = token2label_map.find(tok);
+        KALDI_ASSERT(iter != token2label_map.end());
+        LatticeArc::Label token_label = iter->second;
+        // Some of these states may be pruned out by
+        // InitializeRawLatticeChunk(), but we should still allocate them.
+        // They might have been part of chains of nonemitting arcs where the
+        // state became disconnected because the last chunk didn't include
+        // arcs starting at this frame.
+        StateId state = chunk_lat.AddState();
+        (*tok2state_map)[tok] = state;
+        chunk->first_frame_states.push_back({token_label, state});
       }
-      for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
-        auto iter = tok2state_map.find(tok);
-        KALDI_ASSERT(iter != tok2state_map.end());
-        StateId cur_state = iter->second;
-        for (ForwardLinkT *l = tok->links; l != NULL; l = l->next) {
-          auto next_iter = tok2state_map.find(l->next_tok);
-          if (next_iter == tok2state_map.end()) {
-            // Emitting arcs from the last frame we're including -- ignore
-            // these.
-            KALDI_ASSERT(frame == num_frames_to_include);
-            continue;
-          }
-          StateId next_state = next_iter->second;
-          BaseFloat this_offset = (l->ilabel != 0 ? cost_offset : 0);
-          LatticeArc arc(l->ilabel, l->olabel,
-                         LatticeWeight(l->graph_cost, l->acoustic_cost - this_offset),
-                         next_state);
-          // Note: the epsilons get redundantly included at the end and beginning
-          // of successive chunks.  These will get removed in the determinization.
-          chunk_lat.AddArc(cur_state, arc);
-        }
+    } else if (frame != num_frames_to_include) {  // We already created states
+                                                  // for the last frame.
+      for (Token *tok = frame_head; tok != NULL; tok = tok->next) {
+        StateId state = chunk_lat.AddState();
+        (*tok2state_map)[tok] = state;
       }
     }
-    if (num_frames_in_lattice_ == 0) {
-      // This block locates the start token.  NOTE: we use the fact that in the
-      // linked list of tokens, things are added at the head, so the start state
-      // must be at the tail.  If this data structure is changed in future, we
-      // might need to explicitly store the start token as a class member.
-      Token *tok = active_toks_[0].toks;
-      if (tok == NULL) {
-        KALDI_WARN << "No tokens exist on start frame";
-        return determinizer_.GetLattice();  // will be empty.
+    for (Token *tok = frame_head; tok != NULL; tok = tok->next) {
+      auto iter = tok2state_map->find(tok);
+      KALDI_ASSERT(iter != tok2state_map->end());
+      StateId cur_state = iter->second;
+      for (ForwardLinkT *l = tok->links; l != NULL; l = l->next) {
+        auto next_iter = tok2state_map->find(l->next_tok);
+        if (next_iter == tok2state_map->end()) {
+          // Emitting arcs from the last frame we're including -- ignore
+          // these.
+          KALDI_ASSERT(frame == num_frames_to_include);
+          continue;
+        }
+        StateId next_state = next_iter->second;
+        BaseFloat this_offset = (l->ilabel != 0 ? cost_offset : 0);
+        LatticeArc arc(l->ilabel, l->olabel,
+                       LatticeWeight(l->graph_cost, l->acoustic_cost - this_offset),
+                       next_state);
+        // Note: the epsilons get redundantly included at the end and beginning
+        // of successive chunks.  These will get removed in the determinization.
+        chunk_lat.AddArc(cur_state, arc);
       }
-      while (tok->next != NULL)
-        tok = tok->next;
-      Token *start_token = tok;
-      auto iter = tok2state_map.find(start_token);
-      KALDI_ASSERT(iter != tok2state_map.end());
-      StateId start_state = iter->second;
-      chunk_lat.SetStart(start_state);
     }
-    token2label_map_.swap(next_token2label_map);
+  }
+  if (first_frame == 0) {
+    // This block locates the start token.  NOTE: we use the fact that in the
+    // linked list of tokens, things are added at the head, so the start state
+    // must be at the tail.  If this data structure is changed in future, we
+    // might need to explicitly store the start token as a class member.
+    Token *tok = frame_toks[0];
+    if (tok == NULL)
+      return false;
+    while (tok->next != NULL)
+      tok = tok->next;
+    Token *start_token = tok;
+    auto iter = tok2state_map->find(start_token);
+    KALDI_ASSERT(iter != tok2state_map->end());
+    StateId start_state = iter->second;
+    chunk_lat.SetStart(start_state);
+  }
+  return true;
+}
 
-    // bool finished_before_beam =
-    determinizer_.AcceptRawLatticeChunk(&chunk_lat);
-    // We are ignoring the return status, which say whether it finished before the beam.
 
-    num_frames_in_lattice_ = num_frames_to_include;
+template <typename FST, typename Token>
+void LatticeIncrementalDecoderTpl<FST, Token>::AppendLatticeChunk(
+    int32 num_frames_to_include) {
+  KALDI_ASSERT(num_frames_to_include > num_frames_in_lattice_);
+
+  if (NumChunksPending() == 0) {
+    // determinizer_ is not being used by the background thread, so we can
+    // look at it.
+    if (num_frames_in_lattice_ > 0 &&
+        determinizer_.GetLattice().NumStates() == 0) {
+      /* Something went wrong, lattice is empty and will continue to be empty.
+         User-level code should detect and deal with this.
+      */
+      num_frames_in_lattice_ = num_frames_to_include;
+      return;
+    }
+    if (determinizer_.GetLattice().NumStates() == 0 ||
+        determinizer_.GetLattice().Final(0) != CompactLatticeWeight::Zero() ||
+        restart_needed_) {
+      num_frames_in_lattice_ = 0;
+      restart_needed_ = false;
+      determinizer_.Init();
+    }
+  }
+  // Otherwise the checks above are done by DeterminizeLatticeChunk().
 
-    if (determinizer_.GetLattice().NumStates() == 0)
-      return determinizer_.GetLattice();   // Something went wrong, lattice is empty.
+  /* Make sure the token-pruning is up to date.   If we just pruned the tokens,
+     this will do very little work. */
+  PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+
+  RawLatticeChunk *chunk = new RawLatticeChunk;
+  std::vector<Token*> frame_toks;
+  frame_toks.reserve(num_frames_to_include - num_frames_in_lattice_ + 1);
+  for (int32 frame = num_frames_in_lattice_; frame <= num_frames_to_include;
+       frame++)
+    frame_toks.push_back(active_toks_[frame].toks);
+  if (!CreateRawLatticeChunk(frame_toks, num_frames_in_lattice_, cost_offsets_,
+                             (decoding_finalized_ ? &final_costs_ : NULL),
+                             token2label_map_, &next_token_label_,
+                             &token2label_map_temp_, &temp_token_map_,
+                             chunk)) {
+    KALDI_WARN << "No tokens exist on start frame";
+    delete chunk;
+    return;  // the lattice will be empty.
   }
+  token2label_map_.swap(token2label_map_temp_);
+  num_frames_in_lattice_ = num_frames_to_include;
 
-  unordered_map<Token*, BaseFloat> token2final_cost;
-  unordered_map<Label, BaseFloat> token_label2final_cost;
-  if (use_final_probs) {
-    ComputeFinalCosts(&token2final_cost, NULL, NULL);
-    for (const auto &p: token2final_cost) {
-      Token *tok = p.first;
-      BaseFloat cost = p.second;
-      auto iter = token2label_map_.find(tok);
-      if (iter != token2label_map_.end()) {
-        /* Some tokens may not have survived the pruned determinization. */
-        Label token_label = iter->second;
-        bool ret = token_label2final_cost.insert({token_label, cost}).second;
-        KALDI_ASSERT(ret); /* Make sure it was inserted. */
-      }
+  if (!config_.determinize_in_background) {
+    DeterminizeLatticeChunk(*chunk);
+    delete chunk;
+    return;
+  }
+  std::unique_lock<std::mutex> lock(chunk_mutex_);
+  if (!determinize_thread_.joinable())
+    determinize_thread_ = std::thread(
+        &LatticeIncrementalDecoderTpl<FST, Token>::DeterminizeLatticeChunksThread,
+        this);
+  while (num_chunks_pending_ >= config_.determinize_max_pending_chunks)
+    chunk_done_cv_.wait(lock);
+  pending_chunks_.push_back(chunk);
+  num_chunks_pending_++;
+  chunk_ready_cv_.notify_one();
+}
+
+
+template <typename FST, typename Token>
+void LatticeIncrementalDecoderTpl<FST, Token>::DeterminizeLatticeChunk(
+    const RawLatticeChunk &chunk) {
+  const CompactLattice &clat = determinizer_.GetLattice();
+  if (chunk.lat.Start() == fst::kNoStateId) {
+    // These are the checks that AppendLatticeChunk() does if no chunks are
+    // pending.
+    if (clat.NumStates() == 0)
+      return;  // Something went wrong; the lattice will stay empty.
+    if (clat.Final(0) != CompactLatticeWeight::Zero()) {
+      std::lock_guard<std::mutex> lock(chunk_mutex_);
+      restart_needed_ = true;
+      return;
     }
   }
-  /* Note: these final-probs won't affect the next chunk, only the lattice
-     returned from GetLattice().  They are kind of temporaries. */
-  determinizer_.SetFinalCosts(token_label2final_cost.empty() ? NULL :
-                              &token_label2final_cost);
+  // bool finished_before_beam =
+  determinizer_.AcceptRawLatticeChunk(chunk.lat, chunk.first_frame_states);
+  // We are ignoring the return status, which say whether it finished before
+  // the beam.
+  if (clat.NumStates() != 0)
+    determinizer_.SetFinalCosts(NULL);
+}
 
-  return determinizer_.GetLattice();
+
+template <typename FST, typename Token>
+int32 LatticeIncrementalDecoderTpl<FST, Token>::NumChunksPending() {
+  std::lock_guard<std::mutex> lock(chunk_mutex_);
+  return num_chunks_pending_;
+}
+
+
+template <typename FST, typename Token>
+void LatticeIncrementalDecoderTpl<FST, Token>::WaitForLatticeChunks() {
+  std::unique_lock<std::mutex> lock(chunk_mutex_);
+  while (num_chunks_pending_ > 0)
+    chunk_done_cv_.wait(lock);
+}
+
+
+template <typename FST, typename Token>
+void LatticeIncrementalDecoderTpl<FST, Token>::DeterminizeLatticeChunksThread() {
+  std::unique_lock<std::mutex> lock(chunk_mutex_);
+  while (true) {
+    while (pending_chunks_.empty() && !determinize_thread_exit_)
+      chunk_ready_cv_.wait(lock);
+    if (pending_chunks_.empty())
+      return;
+    RawLatticeChunk *chunk = pending_chunks_.front();
+    pending_chunks_.pop_front();
+    lock.unlock();
+    DeterminizeLatticeChunk(*chunk);
+    delete chunk;
+    lock.lock();
+    num_chunks_pending_--;
+    chunk_done_cv_.notify_all();
+  }
 }
 
 
@@ -1544,6 +1666,40 @@ void LatticeIncrementalDeterminizer::TransferArcsToClat(
 
 }
 
+bool LatticeIncrementalDeterminizer::AcceptRawLatticeChunk(
+    const Lattice &chunk,
+    const std::vector<std::pair<Label, LatticeArc::StateId> > &first_frame_states) {
+  using StateId = LatticeArc::StateId;
+  Lattice olat;
+  std::vector<StateId> state_map(chunk.NumStates(), fst::kNoStateId);
+  if (chunk.Start() == fst::kNoStateId) {
+    unordered_map<Label, StateId> token_label2state;
+    InitializeRawLatticeChunk(&olat, &token_label2state);
+    for (const auto &p: first_frame_states) {
+      auto iter = token_label2state.find(p.first);
+      if (iter != token_label2state.end())
+        state_map[p.second] = iter->second;
+    }
+  }
+  for (StateId s = 0; s < chunk.NumStates(); s++)
+    if (state_map[s] == fst::kNoStateId)
+      state_map[s] = olat.AddState();
+  if (chunk.Start() != fst::kNoStateId)
+    olat.SetStart(state_map[chunk.Start()]);
+  for (StateId s = 0; s < chunk.NumStates(); s++) {
+    StateId state = state_map[s];
+    for (fst::ArcIterator<Lattice> aiter(chunk, s); !aiter.Done(); aiter.Next()) {
+      LatticeArc arc = aiter.Value();
+      arc.nextstate = state_map[arc.nextstate];
+      olat.AddArc(state, arc);
+    }
+    LatticeWeight final_weight = chunk.Final(s);
+    if (final_weight != LatticeWeight::Zero())
+      olat.SetFinal(state, final_weight);
+  }
+  return AcceptRawLatticeChunk(&olat);
+}
+
 bool LatticeIncrementalDeterminizer::AcceptRawLatticeChunk(
     Lattice *raw_fst) {
   using Label = CompactLatticeArc::Label;
@@ -1699,6 +1855,30 @@ void LatticeIncrementalDeterminizer::SetFinalCosts(
 
 
 
+template bool CreateRawLatticeChunk<decoder::StdToken>(
+    const std::vector<decoder::StdToken*> &frame_toks,
+    int32 first_frame,
+    const std::vector<BaseFloat> &cost_offsets,
+    const unordered_map<decoder::StdToken*, BaseFloat> *final_costs,
+    const unordered_map<decoder::StdToken*, LatticeArc::Label> &token2label_map,
+    LatticeArc::Label *next_token_label,
+    unordered_map<decoder::StdToken*, LatticeArc::Label> *next_token2label_map,
+    unordered_map<decoder::StdToken*, LatticeArc::StateId> *tok2state_map,
+    RawLatticeChunk *chunk);
+template bool CreateRawLatticeChunk<decoder::BackpointerToken>(
+    const std::vector<decoder::BackpointerToken*> &frame_toks,
+    int32 first_frame,
+    const std::vector<BaseFloat> &cost_offsets,
+    const unordered_map<decoder::BackpointerToken*, BaseFloat> *final_costs,
+    const unordered_map<decoder::BackpointerToken*,
+                        LatticeArc::Label> &token2label_map,
+    LatticeArc::Label *next_token_label,
+    unordered_map<decoder::BackpointerToken*,
+                  LatticeArc::Label> *next_token2label_map,
+    unordered_map<decoder::BackpointerToken*,
+                  LatticeArc::StateId> *tok2state_map,
+    RawLatticeChunk *chunk);
+
 // Instantiate the template for the combination of token types and FST types
 // that we'll need.
 template class LatticeIncrementalDecoderTpl<fst::Fst<fst::StdArc>, decoder::StdToken>;
@@ -20,6 +20,10 @@
 #ifndef KALDI_DECODER_LATTICE_INCREMENTAL_DECODER_H_
 #define KALDI_DECODER_LATTICE_INCREMENTAL_DECODER_H_
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
 #include "fst/fstlib.h"
@@ -128,6 +132,10 @@ struct LatticeIncrementalDecoderConfig {
   // If you call
   int32 determinize_max_delay;
   int32 determinize_min_chunk_size;
+  // If true, the chunks are determinized in a background thread while
+  // decoding continues; see LatticeIncrementalDecoderTpl::GetLattice().
+  bool determinize_in_background;
+  int32 determinize_max_pending_chunks;
 
 
   LatticeIncrementalDecoderConfig()
@@ -140,7 +148,9 @@ struct LatticeIncrementalDecoderConfig {
         hash_ratio(2.0),
         prune_scale(0.01),
         determinize_max_delay(60),
-        determinize_min_chunk_size(20) {
+        determinize_min_chunk_size(20),
+        determinize_in_background(false),
+        determinize_max_pending_chunks(2) {
     det_opts.minimize = false;
   }
   void Register(OptionsItf *opts) {
@@ -168,6 +178,15 @@ struct LatticeIncrementalDecoderConfig {
                    "determinizing it");
     opts->Register("determinize-min-chunk-size", &determinize_min_chunk_size,
                    "Minimum chunk size used in determinization");
+    opts->Register("determinize-in-background", &determinize_in_background,
+                   "If true, determinize the lattice chunks in a background "
+                   "thread, so that decoding does not stop while a chunk is "
+                   "determinized.");
+    opts->Register("determinize-max-pending-chunks",
+                   &determinize_max_pending_chunks,
+                   "With --determinize-in-background=true, the maximum number "
+                   "of chunks waiting to be determinized; decoding blocks "
+                   "while there are this many.");
 
   }
   void Check() const {
@@ -176,7 +195,8 @@ struct LatticeIncrementalDecoderConfig {
           beam_delta > 0.0 && hash_ratio >= 1.0 &&
           prune_scale > 0.0 && prune_scale < 1.0 &&
           determinize_max_delay > determinize_min_chunk_size &&
-          determinize_min_chunk_size > 0))
+          determinize_min_chunk_size > 0 &&
+          determinize_max_pending_chunks > 0))
         KALDI_ERR << "Invalid options given to decoder";
     /* Minimization of the chunks is not compatible withour algorithm (or at
        least, would require additional complexity to implement.) */
@@ -256,6 +276,28 @@ class LatticeIncrementalDeterminizer {
   */
   bool AcceptRawLatticeChunk(Lattice *raw_fst);
 
+  /**
+     This is as AcceptRawLatticeChunk() above, except that the raw lattice
+     chunk does not have to have been started by InitializeRawLatticeChunk();
+     this is done here.  It means that the chunk can be created before the
+     previous chunk has been determinized (e.g. while it is being determinized
+     in another thread).
+
+       @param [in] chunk   The raw lattice chunk.  If it has a start state
+                  it is taken to be the first chunk of the lattice; otherwise
+                  its states for the Tokens on its first frame are listed in
+                  `first_frame_states`.
+       @param [in] first_frame_states  Pairs (token-label, state in `chunk`)
+                  for the Tokens on the first frame of the chunk, where the
+                  token-labels are those given to them as Tokens on the last
+                  frame of the previous chunk.  Such states are identified with
+                  the states for those token-labels that
+                  InitializeRawLatticeChunk() creates, where they exist.
+  */
+  bool AcceptRawLatticeChunk(
+      const Lattice &chunk,
+      const std::vector<std::pair<Label, LatticeArc::StateId> > &first_frame_states);
+
   /*
     Sets final-probs in `clat_`.  Must only be called if the final chunk
     has not been processed.  (The final chunk is whenever GetLattice() is
@@ -441,6 +483,62 @@ class LatticeIncrementalDeterminizer {
 };
 
 
+/* A raw lattice chunk that has not been connected to the determinized
+   lattice yet; see the 2nd form of
+   LatticeIncrementalDeterminizer::AcceptRawLatticeChunk(). */
+struct RawLatticeChunk {
+  Lattice lat;
+  std::vector<std::pair<LatticeArc::Label, LatticeArc::StateId> >
+      first_frame_states;
+};
+
+
+/**
+   Creates the raw lattice chunk for frames first_frame through
+   first_frame + frame_toks.size() - 1 of a decoder's token lists, for
+   LatticeIncrementalDeterminizer.  This is shared by
+   LatticeIncrementalDecoderTpl and by
+   LatticeFasterOnlineDecoderTpl::GetLatticeIncremental(), which keep their
+   tokens in the same way.
+
+     @param [in] frame_toks  frame_toks[i] is the head of the linked list of
+                  Tokens on frame first_frame + i.  The last of these frames
+                  is the last frame of the chunk.
+     @param [in] first_frame  The first frame of the chunk, i.e. the number of
+                  frames already in the lattice.  If 0, the chunk gets a start
+                  state; otherwise the states for the Tokens on that frame go
+                  to chunk->first_frame_states.
+     @param [in] cost_offsets  The decoder's cost offsets, indexed by frame.
+     @param [in] final_costs  If NULL, decoding is not finalized and the
+                  Tokens on the last frame get `fake` final-costs that guide
+                  the pruned determinization.  Otherwise it is the decoder's
+                  final_costs_ after FinalizeDecoding(); if empty, all Tokens
+                  on the last frame are treated as final.
+     @param [in] token2label_map  The token-labels of the Tokens on
+                  first_frame, as output in `next_token2label_map` by the
+                  previous call.  Not used if first_frame == 0.
+     @param [in,out] next_token_label  The next token-label to allocate.
+     @param [out] next_token2label_map  Outputs the token-labels given to the
+                  Tokens on the last frame of the chunk that may be final.
+     @param [out] tok2state_map  A temporary, output for the caller to
+                  avoid reallocation.
+     @param [out] chunk  The raw lattice chunk.
+     @return  Returns false if first_frame == 0 and there were no Tokens on
+              frame 0, in which case the lattice should be empty.
+*/
+template <typename Token>
+bool CreateRawLatticeChunk(
+    const std::vector<Token*> &frame_toks,
+    int32 first_frame,
+    const std::vector<BaseFloat> &cost_offsets,
+    const unordered_map<Token*, BaseFloat> *final_costs,
+    const unordered_map<Token*, LatticeArc::Label> &token2label_map,
+    LatticeArc::Label *next_token_label,
+    unordered_map<Token*, LatticeArc::Label> *next_token2label_map,
+    unordered_map<Token*, LatticeArc::StateId> *tok2state_map,
+    RawLatticeChunk *chunk);
+
+
 /** This is an extention to the "normal" lattice-generating decoder.
    See \ref lattices_generation \ref decoders_faster and \ref decoders_simple
     for more information.
@@ -553,6 +651,11 @@ class LatticeIncrementalDecoderTpl {
 
      CAUTION: the lattice may contain disconnnected states; you should
      call Connect() on the output before writing it out.
+
+     If config_.determinize_in_background is true, the chunks that
+     UpdateLatticeDeterminization() creates during AdvanceDecoding() are
+     determinized in a background thread, and this function waits until
+     they are all done.
   */
   const CompactLattice &GetLattice(int32 num_frames_to_include,
                                    bool use_final_probs = false);
@@ -681,8 +784,6 @@ class LatticeIncrementalDecoderTpl {
   // we allocate a unique id for each Token
   Label next_token_label_;
 
-  inline Label AllocateNewTokenLabel() { return next_token_label_++; }
-
 
   // There are various cleanup tasks... the the toks_ structure contains
   // singly linked lists of Token pointers, where Elem is the list type.
@@ -716,6 +817,41 @@ class LatticeIncrementalDecoderTpl {
   */
   void UpdateLatticeDeterminization();
 
+  /* Creates the raw lattice chunk from frame num_frames_in_lattice_ to frame
+     `num_frames_to_include` (which must be greater), and determinizes it, or
+     with config_.determinize_in_background, gives it to the background
+     thread.  Called from GetLattice() and UpdateLatticeDeterminization(). */
+  void AppendLatticeChunk(int32 num_frames_to_include);
+
+  /* Determinizes `chunk` and appends it to the lattice in determinizer_.
+     Called from AppendLatticeChunk() or from the background thread. */
+  void DeterminizeLatticeChunk(const RawLatticeChunk &chunk);
+
+  /* Returns the number of chunks given to the background thread that have not
+     been fully determinized; while it is nonzero, determinizer_ may only be
+     accessed by the background thread. */
+  int32 NumChunksPending();
+
+  /* Waits until the background thread has determinized all the chunks. */
+  void WaitForLatticeChunks();
+
+  /* The function run by determinize_thread_. */
+  void DeterminizeLatticeChunksThread();
+
+  /* Variables relating to the background determinization.  The following
+     are protected by chunk_mutex_. */
+  std::mutex chunk_mutex_;
+  std::condition_variable chunk_ready_cv_;  // signals the background thread
+  std::condition_variable chunk_done_cv_;   // signals the decoding thread
+  std::deque<RawLatticeChunk*> pending_chunks_;
+  int32 num_chunks_pending_;  // including the one being determinized.
+  // Set if a chunk could not be appended to the lattice (because the start
+  // state of the determinized lattice was final) so that the lattice has to be
+  // determinized again from the start.
+  bool restart_needed_;
+  bool determinize_thread_exit_;
+  std::thread determinize_thread_;  // started when first needed.
+
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeIncrementalDecoderTpl);
 };
@@ -195,6 +195,71 @@ void TestOnlineMfcc() {
   }
 }
 
+void TestOnlineMfccInt16() {
+  std::ifstream is("../feat/test_data/test.wav", std::ios_base::binary);
+  WaveData wave;
+  wave.Read(is);
+  KALDI_ASSERT(wave.Data().NumRows() == 1);
+  SubVector<BaseFloat> waveform(wave.Data(), 0);
+  std::vector<int16> samples(waveform.Dim());
+  for (int32 i = 0; i < waveform.Dim(); i++)
+    samples[i] = static_cast<int16>(waveform(i));
+
+  MfccOptions op;
+  op.frame_opts.dither = 0.0;
+  op.frame_opts.samp_freq = wave.SampFreq();
+  if (RandInt(0, 1) == 0)
+    op.frame_opts.snip_edges = false;
+  Mfcc mfcc(op);
+  Matrix<BaseFloat> mfcc_feats;
+  mfcc.Compute(waveform, 1.0, &mfcc_feats);
+
+  // The int16 version of AcceptWaveform() should give exactly the same
+  // output; we use many small pieces so that the buffer is reused.
+  int32 num_piece = RandInt(20, 100);
+  OnlineMfcc online_mfcc(op);
+  std::vector<int32> piece_length(num_piece, 0);
+  bool ret = RandomSplit(waveform.Dim(), &piece_length, num_piece);
+  KALDI_ASSERT(ret);
+  int32 offset_start = 0;
+  for (int32 i = 0; i < num_piece; i++) {
+    online_mfcc.AcceptWaveform(wave.SampFreq(), &(samples[offset_start]),
+                               piece_length[i]);
+    offset_start += piece_length[i];
+  }
+  online_mfcc.InputFinished();
+  Matrix<BaseFloat> online_mfcc_feats;
+  GetOutput(&online_mfcc, &online_mfcc_feats);
+  AssertEqual(mfcc_feats, online_mfcc_feats);
+
+  // Test the mu-law version against decoding the samples first.
+  KALDI_ASSERT(MuLawToLinear(0xFF) == 0 && MuLawToLinear(0x7F) == 0 &&
+               MuLawToLinear(0x00) == -32124 && MuLawToLinear(0x80) == 32124);
+  std::vector<uint8> mulaw(waveform.Dim());
+  Vector<BaseFloat> decoded(waveform.Dim());
+  for (int32 i = 0; i < waveform.Dim(); i++) {
+    mulaw[i] = RandInt(0, 255);
+    decoded(i) = MuLawToLinear(mulaw[i]);
+    if (i > 0 && mulaw[i] < 0x80 && mulaw[i - 1] < 0x80 &&
+        mulaw[i] < mulaw[i - 1])
+      KALDI_ASSERT(decoded(i) <= decoded(i - 1));
+  }
+  Matrix<BaseFloat> mulaw_feats;
+  mfcc.Compute(decoded, 1.0, &mulaw_feats);
+  OnlineMfcc online_mulaw_mfcc(op);
+  offset_start = 0;
+  for (int32 i = 0; i < num_piece; i++) {
+    online_mulaw_mfcc.AcceptWaveformMuLaw(wave.SampFreq(),
+                                          &(mulaw[offset_start]),
+                                          piece_length[i]);
+    offset_start += piece_length[i];
+  }
+  online_mulaw_mfcc.InputFinished();
+  Matrix<BaseFloat> online_mulaw_feats;
+  GetOutput(&online_mulaw_mfcc, &online_mulaw_feats);
+  AssertEqual(mulaw_feats, online_mulaw_feats);
+}
+
 void TestOnlinePlp() {
   std::ifstream is("../feat/test_data/test.wav", std::ios_base::binary);
   WaveData wave;
@@ -423,6 +488,7 @@ int main() {
     TestOnlineDeltaFeature();
     TestOnlineSpliceFrames();
     TestOnlineMfcc();
+    TestOnlineMfccInt16();
     TestOnlinePlp();
     TestOnlineTransform();
     TestOnlineAppendFeature();
@@ -71,7 +71,8 @@ OnlineGenericBaseFeature<C>::OnlineGenericBaseFeature(
     const typename C::Options &opts):
     computer_(opts), window_function_(computer_.GetFrameOptions()),
     features_(opts.frame_opts.max_feature_vectors),
-    input_finished_(false), waveform_offset_(0) {
+    input_finished_(false), waveform_offset_(0), waveform_begin_(0),
+    waveform_end_(0) {
   // RE the following assert: search for ONLINE_IVECTOR_LIMIT in
   // online-ivector-feature.cc.
   // Casting to uint32, an unsigned type, means that -1 would be treated
@@ -103,25 +104,59 @@ void OnlineGenericBaseFeature<C>::MaybeCreateResampler(
   }
 }
 
+template <class C>
+BaseFloat *OnlineGenericBaseFeature<C>::AppendSpace(int32 num_samples) {
+  int32 num_kept = waveform_end_ - waveform_begin_,
+      capacity = waveform_buffer_.Dim();
+  if (waveform_end_ + num_samples > capacity) {
+    if (num_kept + num_samples <= capacity) {
+      // Move the kept samples to the start of the buffer.
+      if (num_kept > 0)
+        memmove(waveform_buffer_.Data(),
+                waveform_buffer_.Data() + waveform_begin_,
+                num_kept * sizeof(BaseFloat));
+    } else {
+      // Grow the buffer geometrically, so that this happens rarely.
+      Vector<BaseFloat> new_buffer(std::max(2 * capacity,
+                                            num_kept + num_samples),
+                                   kUndefined);
+      if (num_kept > 0)
+        new_buffer.Range(0, num_kept).CopyFromVec(Remainder());
+      waveform_buffer_.Swap(&new_buffer);
+    }
+    waveform_begin_ = 0;
+    waveform_end_ = num_kept;
+  }
+  BaseFloat *ans = waveform_buffer_.Data() + waveform_end_;
+  waveform_end_ += num_samples;
+  return ans;
+}
+
+template <class C>
+void OnlineGenericBaseFeature<C>::AppendWaveform(
+    BaseFloat sampling_rate, const VectorBase<BaseFloat> &waveform) {
+  MaybeCreateResampler(sampling_rate);
+  const VectorBase<BaseFloat> *to_append = &waveform;
+  if (resampler_ != nullptr) {
+    resampler_->Resample(waveform, false, &resampled_wave_);
+    to_append = &resampled_wave_;
+  }
+  int32 dim = to_append->Dim();
+  if (dim != 0)
+    memcpy(AppendSpace(dim), to_append->Data(), dim * sizeof(BaseFloat));
+}
+
 template <class C>
 void OnlineGenericBaseFeature<C>::InputFinished() {
   if (resampler_ != nullptr) {
     // There may be a few samples left once we flush the resampler_ object, telling it
     // that the file has finished.  This should rarely make any difference.
-    Vector<BaseFloat> appended_wave;
-    Vector<BaseFloat> resampled_wave;
-    resampler_->Resample(appended_wave, true, &resampled_wave);
-
-    if (resampled_wave.Dim() != 0) {
-      appended_wave.Resize(waveform_remainder_.Dim() +
-                           resampled_wave.Dim());
-      if (waveform_remainder_.Dim() != 0)
-        appended_wave.Range(0, waveform_remainder_.Dim())
-            .CopyFromVec(waveform_remainder_);
-      appended_wave.Range(waveform_remainder_.Dim(), resampled_wave.Dim())
-          .CopyFromVec(resampled_wave);
-      waveform_remainder_.Swap(&appended_wave);
-    }
+    Vector<BaseFloat> empty_wave;
+    resampler_->Resample(empty_wave, true, &resampled_wave_);
+    int32 dim = resampled_wave_.Dim();
+    if (dim != 0)
+      memcpy(AppendSpace(dim), resampled_wave_.Data(),
+             dim * sizeof(BaseFloat));
   }
   input_finished_ = true;
   ComputeFeatures();
@@ -129,56 +164,82 @@ void OnlineGenericBaseFeature<C>::InputFinished() {
 
 template <class C>
 void OnlineGenericBaseFeature<C>::AcceptWaveform(
-    BaseFloat sampling_rate, const VectorBase<BaseFloat> &original_waveform) {
-  if (original_waveform.Dim() == 0)
+    BaseFloat sampling_rate, const VectorBase<BaseFloat> &waveform) {
+  if (waveform.Dim() == 0)
     return;  // Nothing to do.
   if (input_finished_)
     KALDI_ERR << "AcceptWaveform called after InputFinished() was called.";
+  AppendWaveform(sampling_rate, waveform);
+  ComputeFeatures();
+}
 
-  Vector<BaseFloat> appended_wave;
-  Vector<BaseFloat> resampled_wave;
-
-  const VectorBase<BaseFloat> *waveform;
-
+template <class C>
+void OnlineGenericBaseFeature<C>::AcceptWaveform(
+    BaseFloat sampling_rate, const int16 *samples, int32 num_samples) {
+  if (num_samples == 0)
+    return;  // Nothing to do.
+  if (input_finished_)
+    KALDI_ERR << "AcceptWaveform called after InputFinished() was called.";
   MaybeCreateResampler(sampling_rate);
+  BaseFloat *dest;
   if (resampler_ == nullptr) {
-    waveform = &original_waveform;
+    dest = AppendSpace(num_samples);
   } else {
-    resampler_->Resample(original_waveform, false, &resampled_wave);
-    waveform = &resampled_wave;
+    if (converted_wave_.Dim() != num_samples)
+      converted_wave_.Resize(num_samples, kUndefined);
+    dest = converted_wave_.Data();
   }
+  for (int32 i = 0; i < num_samples; i++)
+    dest[i] = samples[i];
+  if (resampler_ != nullptr)
+    AppendWaveform(sampling_rate, converted_wave_);
+  ComputeFeatures();
+}
 
-  appended_wave.Resize(waveform_remainder_.Dim() + waveform->Dim());
-  if (waveform_remainder_.Dim() != 0)
-    appended_wave.Range(0, waveform_remainder_.Dim())
-        .CopyFromVec(waveform_remainder_);
-  appended_wave.Range(waveform_remainder_.Dim(), waveform->Dim())
-      .CopyFromVec(*waveform);
-  waveform_remainder_.Swap(&appended_wave);
+template <class C>
+void OnlineGenericBaseFeature<C>::AcceptWaveformMuLaw(
+    BaseFloat sampling_rate, const uint8 *samples, int32 num_samples) {
+  if (num_samples == 0)
+    return;  // Nothing to do.
+  if (input_finished_)
+    KALDI_ERR << "AcceptWaveform called after InputFinished() was called.";
+  MaybeCreateResampler(sampling_rate);
+  BaseFloat *dest;
+  if (resampler_ == nullptr) {
+    dest = AppendSpace(num_samples);
+  } else {
+    if (converted_wave_.Dim() != num_samples)
+      converted_wave_.Resize(num_samples, kUndefined);
+    dest = converted_wave_.Data();
+  }
+  for (int32 i = 0; i < num_samples; i++)
+    dest[i] = MuLawToLinear(samples[i]);
+  if (resampler_ != nullptr)
+    AppendWaveform(sampling_rate, converted_wave_);
   ComputeFeatures();
 }
 
 template <class C>
 void OnlineGenericBaseFeature<C>::ComputeFeatures() {
   const FrameExtractionOptions &frame_opts = computer_.GetFrameOptions();
-  int64 num_samples_total = waveform_offset_ + waveform_remainder_.Dim();
+  SubVector<BaseFloat> remainder(Remainder());
+  int64 num_samples_total = waveform_offset_ + remainder.Dim();
   int32 num_frames_old = features_.Size(),
       num_frames_new = NumFrames(num_samples_total, frame_opts,
                                  input_finished_);
   KALDI_ASSERT(num_frames_new >= num_frames_old);
 
-  Vector<BaseFloat> window;
   bool need_raw_log_energy = computer_.NeedRawLogEnergy();
   for (int32 frame = num_frames_old; frame < num_frames_new; frame++) {
     BaseFloat raw_log_energy = 0.0;
-    ExtractWindow(waveform_offset_, waveform_remainder_, frame,
-                  frame_opts, window_function_, &window,
+    ExtractWindow(waveform_offset_, remainder, frame,
+                  frame_opts, window_function_, &window_,
                   need_raw_log_energy ? &raw_log_energy : NULL);
     Vector<BaseFloat> *this_feature = new Vector<BaseFloat>(computer_.Dim(),
                                                             kUndefined);
     // note: this online feature-extraction code does not support VTLN.
     BaseFloat vtln_warp = 1.0;
-    computer_.Compute(raw_log_energy, vtln_warp, &window, this_feature);
+    computer_.Compute(raw_log_energy, vtln_warp, &window_, this_feature);
     features_.PushBack(this_feature);
   }
   // OK, we will now discard any portion of the signal that will not be
@@ -188,18 +249,10 @@ void OnlineGenericBaseFeature<C>::ComputeFeatures() {
   int32 samples_to_discard = first_sample_of_next_frame - waveform_offset_;
   if (samples_to_discard > 0) {
     // discard the leftmost part of the waveform that we no longer need.
-    int32 new_num_samples = waveform_remainder_.Dim() - samples_to_discard;
-    if (new_num_samples <= 0) {
-      // odd, but we'll try to handle it.
-      waveform_offset_ += waveform_remainder_.Dim();
-      waveform_remainder_.Resize(0);
-    } else {
-      Vector<BaseFloat> new_remainder(new_num_samples);
-      new_remainder.CopyFromVec(waveform_remainder_.Range(samples_to_discard,
-                                                          new_num_samples));
-      waveform_offset_ += samples_to_discard;
-      waveform_remainder_.Swap(&new_remainder);
-    }
+    // (odd, but we'll try to handle it if it's more than we have).
+    samples_to_discard = std::min(samples_to_discard, remainder.Dim());
+    waveform_begin_ += samples_to_discard;
+    waveform_offset_ += samples_to_discard;
   }
 }
 
@@ -108,6 +108,13 @@ class OnlineGenericBaseFeature: public OnlineBaseFeature {
   virtual void AcceptWaveform(BaseFloat sampling_rate,
                               const VectorBase<BaseFloat> &waveform);
 
+  // These versions take 16-bit linear PCM or 8-bit mu-law samples, and (if
+  // no resampling is needed) convert them directly into the waveform buffer.
+  virtual void AcceptWaveform(BaseFloat sampling_rate,
+                              const int16 *samples, int32 num_samples);
+  virtual void AcceptWaveformMuLaw(BaseFloat sampling_rate,
+                                   const uint8 *samples, int32 num_samples);
+
 
   // InputFinished() tells the class you won't be providing any
   // more waveform.  This will help flush out the last frame or two
@@ -117,15 +124,31 @@ class OnlineGenericBaseFeature: public OnlineBaseFeature {
 
  private:
   // This function computes any additional feature frames that it is possible to
-  // compute from 'waveform_remainder_', which at this point may contain more
+  // compute from the buffered waveform, which at this point may contain more
   // than just a remainder-sized quantity (because AcceptWaveform() appends to
-  // waveform_remainder_ before calling this function).  It adds these feature
-  // frames to features_, and shifts off any now-unneeded samples of input from
-  // waveform_remainder_ while incrementing waveform_offset_ by the same amount.
+  // the buffer before calling this function).  It adds these feature frames to
+  // features_, and drops any now-unneeded samples of input from the start of
+  // the buffer while incrementing waveform_offset_ by the same amount.
   void ComputeFeatures();
 
   void MaybeCreateResampler(BaseFloat sampling_rate);
 
+  // Returns a pointer to space for 'num_samples' more samples at the end of
+  // the buffered waveform, which the caller must fill in.  The storage is
+  // only reallocated when the buffer has to grow, so in steady state this
+  // does no allocation.
+  BaseFloat *AppendSpace(int32 num_samples);
+
+  // Appends 'waveform' to the buffer, resampling it first if necessary.
+  void AppendWaveform(BaseFloat sampling_rate,
+                      const VectorBase<BaseFloat> &waveform);
+
+  // Returns the buffered waveform.
+  SubVector<BaseFloat> Remainder() const {
+    return SubVector<BaseFloat>(waveform_buffer_, waveform_begin_,
+                                waveform_end_ - waveform_begin_);
+  }
+
   C computer_;  // class that does the MFCC or PLP or filterbank computation
 
   // resampler in cases when the input sampling frequency is not equal to
@@ -146,13 +169,24 @@ class OnlineGenericBaseFeature: public OnlineBaseFeature {
   BaseFloat sampling_frequency_;
 
   // waveform_offset_ is the number of samples of waveform that we have
-  // already discarded, i.e. that were prior to 'waveform_remainder_'.
+  // already discarded, i.e. that were prior to the buffered waveform.
   int64 waveform_offset_;
 
-  // waveform_remainder_ is a short piece of waveform that we may need to keep
-  // after extracting all the whole frames we can (whatever length of feature
-  // will be required for the next phase of computation).
-  Vector<BaseFloat> waveform_remainder_;
+  // The buffered waveform is elements [waveform_begin_, waveform_end_) of
+  // waveform_buffer_: a short piece of waveform that we may need to keep after
+  // extracting all the whole frames we can (whatever length of feature will be
+  // required for the next phase of computation).  Discarding samples just
+  // advances waveform_begin_; the data is moved to the start of the buffer
+  // only when there is no room at the end.  We don't use a circular buffer
+  // because frame extraction needs each window to be contiguous.
+  Vector<BaseFloat> waveform_buffer_;
+  int32 waveform_begin_;
+  int32 waveform_end_;
+
+  // Temporaries kept to avoid reallocating them for every chunk.
+  Vector<BaseFloat> window_;
+  Vector<BaseFloat> converted_wave_;
+  Vector<BaseFloat> resampled_wave_;
 };
 
 typedef OnlineGenericBaseFeature<MfccComputer> OnlineMfcc;
@@ -315,6 +315,7 @@ class OnlinePitchFeature: public OnlineBaseFeature {
 
   virtual void AcceptWaveform(BaseFloat sampling_rate,
                               const VectorBase<BaseFloat> &waveform);
+  using OnlineBaseFeature::AcceptWaveform;  // the int16 version.
 
   virtual void InputFinished();
 
@@ -101,6 +101,17 @@ class OnlineFeatureInterface {
 };
 
 
+/// Decodes one G.711 mu-law sample to 16-bit linear PCM scale (range
+/// -32124..32124).
+inline int16 MuLawToLinear(uint8 mulaw) {
+  mulaw = ~mulaw;
+  int32 exponent = (mulaw >> 4) & 0x07,
+      mantissa = mulaw & 0x0F,
+      magnitude = (((mantissa << 3) + 0x84) << exponent) - 0x84;
+  return static_cast<int16>((mulaw & 0x80) ? -magnitude : magnitude);
+}
+
+
 /// Add a virtual class for "source" features such as MFCC or PLP or pitch
 /// features.
 class OnlineBaseFeature: public OnlineFeatureInterface {
@@ -111,6 +122,27 @@ class OnlineBaseFeature: public OnlineFeatureInterface {
   virtual void AcceptWaveform(BaseFloat sampling_rate,
                               const VectorBase<BaseFloat> &waveform) = 0;
 
+  /// As AcceptWaveform() above, but for 16-bit linear PCM samples, e.g. as
+  /// read from a socket.  The default implementation converts them to a
+  /// Vector; derived classes may convert them directly into their own buffers.
+  virtual void AcceptWaveform(BaseFloat sampling_rate,
+                              const int16 *samples, int32 num_samples) {
+    Vector<BaseFloat> waveform(num_samples, kUndefined);
+    for (int32 i = 0; i < num_samples; i++)
+      waveform(i) = samples[i];
+    AcceptWaveform(sampling_rate, waveform);
+  }
+
+  /// As AcceptWaveform() above, but for 8-bit mu-law samples (as used in
+  /// telephony), which are decoded to the same scale as 16-bit samples.
+  virtual void AcceptWaveformMuLaw(BaseFloat sampling_rate,
+                                   const uint8 *samples, int32 num_samples) {
+    Vector<BaseFloat> waveform(num_samples, kUndefined);
+    for (int32 i = 0; i < num_samples; i++)
+      waveform(i) = MuLawToLinear(samples[i]);
+    AcceptWaveform(sampling_rate, waveform);
+  }
+
   /// InputFinished() tells the class you won't be providing any
   /// more waveform.  This will help flush out the last few frames
   /// of delta or LDA features (it will typically affect the return value
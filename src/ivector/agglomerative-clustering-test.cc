@@ -0,0 +1,97 @@
+// ivector/agglomerative-clustering-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ivector/agglomerative-clustering.h"
+#include "base/timer.h"
+
+namespace kaldi {
+
+// Creates a symmetric cost matrix for points drawn around "num_centers"
+// random centers, with costs equal to squared distances.
+void GetRandomCosts(int32 num_points, int32 num_centers,
+                    Matrix<BaseFloat> *costs) {
+  int32 dim = 5;
+  Matrix<BaseFloat> centers(num_centers, dim), points(num_points, dim);
+  centers.SetRandn();
+  centers.Scale(4.0);
+  points.SetRandn();
+  for (int32 i = 0; i < num_points; i++)
+    points.Row(i).AddVec(1.0, centers.Row(RandInt(0, num_centers - 1)));
+  costs->Resize(num_points, num_points);
+  for (int32 i = 0; i < num_points; i++) {
+    for (int32 j = 0; j < num_points; j++) {
+      Vector<BaseFloat> diff(points.Row(i));
+      diff.AddVec(-1.0, points.Row(j));
+      (*costs)(i, j) = VecVec(diff, diff);
+    }
+  }
+}
+
+void UnitTestNnChainClustering() {
+  int32 num_points = RandInt(1, 300), num_centers = RandInt(1, 10);
+  Matrix<BaseFloat> costs;
+  GetRandomCosts(num_points, num_centers, &costs);
+
+  // Test with a threshold as the stopping criterion, and with a minimum
+  // number of clusters.
+  for (int32 i = 0; i < 2; i++) {
+    BaseFloat threshold = (i == 0 ? RandUniform() * 40.0 :
+                           std::numeric_limits<BaseFloat>::max());
+    int32 min_clusters = (i == 0 ? 1 : RandInt(1, num_points));
+    std::vector<int32> assignments, nn_chain_assignments;
+    AgglomerativeCluster(costs, threshold, min_clusters,
+                         std::numeric_limits<int16>::max(), 1.0,
+                         &assignments);
+    Matrix<BaseFloat> costs_copy(costs);
+    AgglomerativeClusterNnChain(threshold, min_clusters, &costs_copy,
+                                &nn_chain_assignments);
+    KALDI_ASSERT(assignments == nn_chain_assignments);
+  }
+}
+
+void UnitTestNnChainClusteringSpeed() {
+  int32 num_points = 3000;
+  Matrix<BaseFloat> costs;
+  GetRandomCosts(num_points, 8, &costs);
+  BaseFloat threshold = 20.0;
+  std::vector<int32> assignments, nn_chain_assignments;
+
+  Timer timer;
+  AgglomerativeCluster(costs, threshold, 1,
+                       std::numeric_limits<int16>::max(), 1.0, &assignments);
+  double queue_time = timer.Elapsed();
+  timer.Reset();
+  Matrix<BaseFloat> costs_copy(costs);
+  AgglomerativeClusterNnChain(threshold, 1, &costs_copy,
+                              &nn_chain_assignments);
+  double nn_chain_time = timer.Elapsed();
+  KALDI_ASSERT(assignments == nn_chain_assignments);
+  KALDI_LOG << "Clustering " << num_points << " points took " << queue_time
+            << " seconds with the priority queue and " << nn_chain_time
+            << " seconds with the nearest-neighbor chain.";
+}
+
+}  // end namespace kaldi.
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++)
+    UnitTestNnChainClustering();
+  UnitTestNnChainClusteringSpeed();
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -20,6 +20,7 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <limits>
 #include "ivector/agglomerative-clustering.h"
 
 namespace kaldi {
@@ -235,4 +236,146 @@ void AgglomerativeCluster(
   ac.Cluster();
 }
 
+namespace {
+
+// A merge found by the nearest-neighbor chain algorithm: the average cost
+// between the two clusters, and the slots (see below) that they occupied.
+struct AhcMerge {
+  BaseFloat cost;
+  int32 slot1, slot2;
+  AhcMerge(BaseFloat cost, int32 slot1, int32 slot2):
+      cost(cost), slot1(slot1), slot2(slot2) { }
+  bool operator < (const AhcMerge &other) const { return cost < other.cost; }
+};
+
+int32 FindRoot(std::vector<int32> *parent, int32 i) {
+  while ((*parent)[i] != i) {
+    (*parent)[i] = (*parent)[(*parent)[i]];  // path halving
+    i = (*parent)[i];
+  }
+  return i;
+}
+
+}  // end unnamed namespace
+
+void AgglomerativeClusterNnChain(
+    BaseFloat threshold,
+    int32 min_clusters,
+    Matrix<BaseFloat> *costs,
+    std::vector<int32> *assignments_out) {
+  KALDI_ASSERT(min_clusters >= 0);
+  KALDI_ASSERT(costs->NumRows() == costs->NumCols());
+  int32 num_points = costs->NumRows();
+  // Each cluster occupies the row and column of one of its points (its
+  // "slot"), which contain the sums of the pairwise costs between its points
+  // and the points of the other clusters.  We keep the matrix symmetric so
+  // that the nearest-neighbor search only reads rows.
+  costs->CopyUpperToLower();
+  BaseFloat *data = costs->Data();
+  MatrixIndexT stride = costs->Stride();
+
+  // "active" contains the slots of the clusters that may still be merged;
+  // position[i] is the index of slot i in "active".
+  std::vector<int32> size(num_points, 1), active(num_points),
+      position(num_points);
+  for (int32 i = 0; i < num_points; i++)
+    active[i] = position[i] = i;
+
+  std::vector<int32> chain;
+  std::vector<AhcMerge> merges;
+  merges.reserve(num_points);
+  while (active.size() > 1) {
+    if (chain.empty())
+      chain.push_back(active[0]);
+    int32 a = chain.back(),
+        prev = (chain.size() > 1 ? chain[chain.size() - 2] : -1);
+    const BaseFloat *row_a = data + static_cast<size_t>(a) * stride;
+    BaseFloat size_a = size[a];
+    // Find the nearest neighbor of "a"; on ties we prefer the previous
+    // element of the chain, which guarantees that the chain terminates.
+    int32 b = -1;
+    BaseFloat best_cost = std::numeric_limits<BaseFloat>::infinity();
+    if (prev != -1) {
+      b = prev;
+      best_cost = row_a[prev] / (size_a * size[prev]);
+    }
+    for (size_t n = 0; n < active.size(); n++) {
+      int32 c = active[n];
+      if (c == a) continue;
+      BaseFloat cost = row_a[c] / (size_a * size[c]);
+      if (cost < best_cost) {
+        best_cost = cost;
+        b = c;
+      }
+    }
+    if (!(best_cost <= threshold)) {
+      // "a" can never be merged: merging other clusters never brings them
+      // closer to "a" than the closer of the two was.  This can only happen
+      // when "a" is the only element of the chain.
+      KALDI_ASSERT(chain.size() == 1);
+      chain.pop_back();
+      int32 last = active.back();
+      active[position[a]] = last;
+      position[last] = position[a];
+      active.pop_back();
+      continue;
+    }
+    if (b != prev) {
+      chain.push_back(b);
+      continue;
+    }
+    // "a" and "b" are reciprocal nearest neighbors, so merge them.
+    chain.pop_back();
+    chain.pop_back();
+    int32 slot1 = std::min(a, b), slot2 = std::max(a, b);
+    merges.push_back(AhcMerge(best_cost, slot1, slot2));
+    int32 last = active.back();
+    active[position[slot2]] = last;
+    position[last] = position[slot2];
+    active.pop_back();
+    BaseFloat *row1 = data + static_cast<size_t>(slot1) * stride;
+    const BaseFloat *row2 = data + static_cast<size_t>(slot2) * stride;
+    for (size_t n = 0; n < active.size(); n++) {
+      int32 k = active[n];
+      if (k == slot1) continue;
+      row1[k] += row2[k];
+      data[static_cast<size_t>(k) * stride + slot1] = row1[k];
+    }
+    size[slot1] += size[slot2];
+  }
+
+  // Apply the merges in order of increasing cost, which is the order in
+  // which AgglomerativeClusterer would have done them, until we reach the
+  // stopping criteria.  The cluster IDs follow the same numbering scheme as
+  // AgglomerativeClusterer, so the labels come out the same.
+  std::stable_sort(merges.begin(), merges.end());
+  std::vector<int32> parent(num_points), cluster_id(num_points);
+  for (int32 i = 0; i < num_points; i++) {
+    parent[i] = i;
+    cluster_id[i] = i + 1;
+  }
+  int32 num_clusters = num_points, count = num_points;
+  for (size_t m = 0; m < merges.size(); m++) {
+    if (num_clusters <= min_clusters || merges[m].cost > threshold)
+      break;
+    int32 root1 = FindRoot(&parent, merges[m].slot1),
+        root2 = FindRoot(&parent, merges[m].slot2);
+    parent[root2] = root1;
+    cluster_id[root1] = ++count;
+    num_clusters--;
+  }
+
+  std::vector<std::pair<int32, int32> > ids_and_roots;
+  for (int32 i = 0; i < num_points; i++)
+    if (FindRoot(&parent, i) == i)
+      ids_and_roots.push_back(std::make_pair(cluster_id[i], i));
+  std::sort(ids_and_roots.begin(), ids_and_roots.end());
+  std::vector<int32> root_label(num_points);
+  for (size_t n = 0; n < ids_and_roots.size(); n++)
+    root_label[ids_and_roots[n].second] = n + 1;
+  assignments_out->resize(num_points);
+  for (int32 i = 0; i < num_points; i++)
+    (*assignments_out)[i] = root_label[FindRoot(&parent, i)];
+}
+
 }  // end namespace kaldi.
@@ -185,6 +185,31 @@ void AgglomerativeCluster(
     BaseFloat max_cluster_fraction,
     std::vector<int32> *assignments_out);
 
+/** This is an alternative to AgglomerativeCluster() for recordings with a
+ *  large number of segments.  It uses the nearest-neighbor chain algorithm
+ *  over the dense cost matrix, which takes O(N^2) time and, because the
+ *  cluster-to-cluster costs are updated in place in the upper triangle of
+ *  "costs", only O(N) extra memory (AgglomerativeCluster() stores all
+ *  pairwise costs in a hash map, and is limited to 65535 clusters per pass).
+ *
+ *  The average-linkage cost used here is "reducible", which means that the
+ *  nearest-neighbor chain finds the same merges as the greedy algorithm,
+ *  just in a different order; we sort the merges by cost before applying
+ *  the stopping criteria, so the assignments (including the label numbering)
+ *  are identical to those of single-pass AgglomerativeCluster() with
+ *  max_cluster_fraction = 1.0, except possibly where there are exactly tied
+ *  costs.  The max-cluster-size constraint is not supported, since it would
+ *  break reducibility.
+ *
+ *  Only the upper triangle of "costs" is read, and on exit its contents are
+ *  undefined.
+ */
+void AgglomerativeClusterNnChain(
+    BaseFloat threshold,
+    int32 min_clusters,
+    Matrix<BaseFloat> *costs,
+    std::vector<int32> *assignments_out);
+
 }  // end namespace kaldi.
 
 #endif  // KALDI_IVECTOR_AGGLOMERATIVE_CLUSTERING_H_
@@ -21,6 +21,7 @@
 #include "gmm/full-gmm-normal.h"
 #include "ivector/ivector-extractor.h"
 #include "util/kaldi-io.h"
+#include "base/timer.h"
 
 
 namespace kaldi {
@@ -116,12 +117,35 @@ void TestIvectorExtraction(const IvectorExtractor &extractor,
     online_stats.AccStats(extractor, feats.Row(t), post[t]);
   }
   
-  Vector<double> ivector1(ivector_dim), ivector2(ivector_dim);
+  // Accumulate the same stats with AccStatsDeferred(), in chunks of random
+  // size and flushing at random points.
+  OnlineIvectorEstimationStats deferred_stats(extractor.IvectorDim(),
+                                              extractor.PriorOffset(),
+                                              0.0);
+  for (int32 t = 0; t < num_frames; ) {
+    int32 chunk_size = std::min<int32>(RandInt(1, 20), num_frames - t);
+    std::vector<std::vector<std::pair<int32, BaseFloat> > > chunk_post(
+        post.begin() + t, post.begin() + t + chunk_size);
+    deferred_stats.AccStatsDeferred(extractor,
+                                    feats.RowRange(t, chunk_size),
+                                    chunk_post);
+    if (Rand() % 3 == 0)
+      deferred_stats.FlushDeferredStats(extractor);
+    t += chunk_size;
+  }
+  AssertEqual(deferred_stats.NumFrames(), online_stats.NumFrames());
+  deferred_stats.FlushDeferredStats(extractor);
+  KALDI_ASSERT(!deferred_stats.HasDeferredStats());
+
+  Vector<double> ivector1(ivector_dim), ivector2(ivector_dim),
+      ivector3(ivector_dim);
 
   extractor.GetIvectorDistribution(utt_stats, &ivector1, NULL);
 
   int32 num_cg_iters = -1;  // for testing purposes, compute it exactly.
   online_stats.GetIvector(num_cg_iters, &ivector2);
+  deferred_stats.GetIvector(num_cg_iters, &ivector3);
+  KALDI_ASSERT(ivector2.ApproxEqual(ivector3, 1.0e-05));
 
   KALDI_LOG << "ivector1 = " << ivector1;
   KALDI_LOG << "ivector2 = " << ivector2;
@@ -141,6 +165,45 @@ void TestIvectorExtraction(const IvectorExtractor &extractor,
   KALDI_ASSERT(ivector1.ApproxEqual(ivector2));
 }
 
+// Checks that GetIvectorDistributionBatch() gives the same answer as
+// GetIvectorDistribution() called on each utterance.
+void TestIvectorExtractionBatch(const IvectorExtractor &extractor,
+                                const std::vector<Matrix<BaseFloat> > &all_feats,
+                                const FullGmm &fgmm) {
+  int32 num_utts = all_feats.size(),
+      ivector_dim = extractor.IvectorDim();
+  std::vector<IvectorExtractorUtteranceStats*> utt_stats(num_utts);
+  std::vector<const IvectorExtractorUtteranceStats*> utt_stats_const(num_utts);
+  for (int32 n = 0; n < num_utts; n++) {
+    const Matrix<BaseFloat> &feats = all_feats[n];
+    Posterior post(feats.NumRows());
+    for (int32 t = 0; t < feats.NumRows(); t++) {
+      Vector<BaseFloat> posterior(fgmm.NumGauss(), kUndefined);
+      fgmm.ComponentPosteriors(feats.Row(t), &posterior);
+      for (int32 i = 0; i < posterior.Dim(); i++)
+        if (Rand() % 4 != 0)  // Leave some zero stats, as after pruning.
+          post[t].push_back(std::make_pair(i, posterior(i)));
+    }
+    utt_stats[n] = new IvectorExtractorUtteranceStats(extractor.NumGauss(),
+                                                      extractor.FeatDim(),
+                                                      false);
+    utt_stats[n]->AccStats(feats, post);
+    utt_stats_const[n] = utt_stats[n];
+  }
+  Matrix<double> means(num_utts, ivector_dim);
+  std::vector<SpMatrix<double> > vars;
+  extractor.GetIvectorDistributionBatch(utt_stats_const, &means, &vars);
+  KALDI_ASSERT(vars.size() == static_cast<size_t>(num_utts));
+  for (int32 n = 0; n < num_utts; n++) {
+    Vector<double> mean(ivector_dim);
+    SpMatrix<double> var(ivector_dim);
+    extractor.GetIvectorDistribution(*(utt_stats[n]), &mean, &var);
+    KALDI_ASSERT(mean.ApproxEqual(Vector<double>(means.Row(n)), 1.0e-05));
+    KALDI_ASSERT(var.ApproxEqual(vars[n], 1.0e-05));
+    delete utt_stats[n];
+  }
+}
+
 
 void UnitTestIvectorExtractor() {
   FullGmm fgmm;
@@ -185,6 +248,7 @@ void UnitTestIvectorExtractor() {
       TestIvectorExtraction(extractor, feats, fgmm);
     }
     TestIvectorExtractorStatsIO(stats);
+    TestIvectorExtractionBatch(extractor, all_feats, fgmm);
     
     IvectorExtractorEstimationOptions estimation_opts;
     estimation_opts.gaussian_min_count = dim + 5;
@@ -211,6 +275,62 @@ void UnitTestIvectorExtractor() {
   std::cout << "********************************************************************************************\n";
 }
 
+
+// Compares the speed of OnlineIvectorEstimationStats::AccStats() on blocks of
+// 10 frames (as OnlineIvectorFeature called it before, with the default
+// --ivector-period) with AccStatsDeferred() on the same blocks followed by a
+// flush.  In both cases an iVector is estimated after each block.  Reports the
+// number of real-time streams (at 100 frames per second) that one core could
+// keep up with, counting only the stats accumulation and iVector estimation.
+void UnitTestOnlineIvectorStatsSpeed() {
+  int32 dim = 40, num_comp = 512, ivector_dim = 100, num_frames = 1000,
+      num_gselect = 20, ivector_period = 10, num_cg_iters = 15;
+  FullGmm fgmm;
+  unittest::InitRandFullGmm(dim, num_comp, &fgmm);
+  IvectorExtractorOptions ivector_opts;
+  ivector_opts.ivector_dim = ivector_dim;
+  ivector_opts.use_weights = false;
+  IvectorExtractor extractor(ivector_opts, fgmm);
+
+  Matrix<BaseFloat> feats(num_frames, dim);
+  feats.SetRandn();
+  // Posteriors concentrated on a slowly changing set of Gaussians, as in
+  // real speech.
+  std::vector<std::vector<std::pair<int32, BaseFloat> > > post(num_frames);
+  for (int32 t = 0; t < num_frames; t++) {
+    int32 base = (t / 5) * 7;
+    for (int32 j = 0; j < num_gselect; j++)
+      post[t].push_back(std::make_pair((base + RandInt(0, 2 * num_gselect)) %
+                                       num_comp, 1.0 / num_gselect));
+    MergePairVectorSumming(&(post[t]));
+  }
+
+  for (int32 deferred = 0; deferred <= 1; deferred++) {
+    OnlineIvectorEstimationStats stats(ivector_dim, extractor.PriorOffset(),
+                                       0.0);
+    Vector<double> ivector(ivector_dim);
+    Timer timer;
+    for (int32 t = 0; t < num_frames; t += ivector_period) {
+      int32 n = std::min(ivector_period, num_frames - t);
+      std::vector<std::vector<std::pair<int32, BaseFloat> > > this_post(
+          post.begin() + t, post.begin() + t + n);
+      if (deferred) {
+        stats.AccStatsDeferred(extractor, feats.RowRange(t, n), this_post);
+        stats.FlushDeferredStats(extractor);
+      } else {
+        stats.AccStats(extractor, feats.RowRange(t, n), this_post);
+      }
+      stats.GetIvector(num_cg_iters, &ivector);
+    }
+    double elapsed = timer.Elapsed(),
+        streams_per_core = num_frames / (100.0 * elapsed);
+    KALDI_LOG << "With deferred=" << (deferred ? "true" : "false")
+              << ", processed " << num_frames << " frames in " << elapsed
+              << " seconds, i.e. " << streams_per_core
+              << " real-time streams per core.";
+  }
+}
+
 }
 
 int main() {
@@ -218,6 +338,8 @@ int main() {
   SetVerboseLevel(5);
   for (int i = 0; i < 10; i++)
     UnitTestIvectorExtractor();
+  SetVerboseLevel(0);
+  UnitTestOnlineIvectorStatsSpeed();
   std::cout << "Test OK.\n";
   return 0;
 }
@@ -64,11 +64,55 @@ void IvectorExtractor::GetIvectorDistribution(
     const IvectorExtractorUtteranceStats &utt_stats,
     VectorBase<double> *mean,
     SpMatrix<double> *var) const {
+  Vector<double> linear(IvectorDim());
+  SpMatrix<double> quadratic(IvectorDim());
+  GetIvectorDistMean(utt_stats, &linear, &quadratic);
+  GetIvectorDistPrior(utt_stats, &linear, &quadratic);
+  GetIvectorDistributionFromTerms(utt_stats, linear, &quadratic, mean, var);
+}
+
+
+void IvectorExtractor::GetIvectorDistributionBatch(
+    const std::vector<const IvectorExtractorUtteranceStats*> &utt_stats,
+    MatrixBase<double> *means,
+    std::vector<SpMatrix<double> > *vars) const {
+  int32 num_utts = utt_stats.size(), S = IvectorDim();
+  KALDI_ASSERT(means->NumRows() == num_utts && means->NumCols() == S);
+  if (vars != NULL)
+    vars->resize(num_utts);
+  if (num_utts == 0)
+    return;
+  Matrix<double> linear(num_utts, S), quadratic(num_utts, S * (S + 1) / 2);
+  GetIvectorDistMeanBatch(utt_stats, &linear, &quadratic);
+
+  // The remaining work (mostly the matrix inversion) is per utterance.
+  SpMatrix<double> this_quadratic(S);
+  for (int32 n = 0; n < num_utts; n++) {
+    SubVector<double> this_linear(linear, n),
+        quadratic_vec(this_quadratic.Data(), S * (S + 1) / 2);
+    quadratic_vec.CopyFromVec(quadratic.Row(n));
+    GetIvectorDistPrior(*(utt_stats[n]), &this_linear, &this_quadratic);
+    SubVector<double> mean(*means, n);
+    SpMatrix<double> *var = NULL;
+    if (vars != NULL) {
+      (*vars)[n].Resize(S);
+      var = &((*vars)[n]);
+    }
+    GetIvectorDistributionFromTerms(*(utt_stats[n]), this_linear,
+                                    &this_quadratic, &mean, var);
+  }
+}
+
+
+void IvectorExtractor::GetIvectorDistributionFromTerms(
+    const IvectorExtractorUtteranceStats &utt_stats,
+    const VectorBase<double> &linear,
+    SpMatrix<double> *quadratic_in,
+    VectorBase<double> *mean,
+    SpMatrix<double> *var) const {
+  // We may invert "quadratic" in-place.
+  SpMatrix<double> &quadratic = *quadratic_in;
   if (!IvectorDependentWeights()) {
-    Vector<double> linear(IvectorDim());
-    SpMatrix<double> quadratic(IvectorDim());
-    GetIvectorDistMean(utt_stats, &linear, &quadratic);
-    GetIvectorDistPrior(utt_stats, &linear, &quadratic);
     if (var != NULL) {
       var->CopyFromSp(quadratic);
       var->Invert(); // now it's a variance.
@@ -80,10 +124,6 @@ void IvectorExtractor::GetIvectorDistribution(
       mean->AddSpVec(1.0, quadratic, linear, 0.0);
     }
   } else {
-    Vector<double> linear(IvectorDim());
-    SpMatrix<double> quadratic(IvectorDim());
-    GetIvectorDistMean(utt_stats, &linear, &quadratic);
-    GetIvectorDistPrior(utt_stats, &linear, &quadratic);
     // At this point, "linear" and "quadratic" contain
     // the mean and prior-related terms, and we avoid
     // recomputing those.
@@ -271,6 +311,43 @@ void IvectorExtractor::GetIvectorDistMean(
   q_vec.AddMatVec(1.0, U_, kTrans, utt_stats.gamma_, 1.0);
 }
 
+void IvectorExtractor::GetIvectorDistMeanBatch(
+    const std::vector<const IvectorExtractorUtteranceStats*> &utt_stats,
+    MatrixBase<double> *linear,
+    MatrixBase<double> *quadratic) const {
+  int32 N = utt_stats.size(), I = NumGauss(), D = FeatDim(),
+      S = IvectorDim();
+  KALDI_ASSERT(linear->NumRows() == N && linear->NumCols() == S &&
+               quadratic->NumRows() == N &&
+               quadratic->NumCols() == S * (S + 1) / 2);
+  // gamma is the zeroth-order stats of all the utterances, [N][I].
+  Matrix<double> gamma(N, I);
+  for (int32 n = 0; n < N; n++)
+    gamma.CopyRowFromVec(utt_stats[n]->gamma_, n);
+
+  // The linear term: for each Gaussian i, stack the first-order stats of all
+  // the utterances as the rows of an [N][D] matrix, so that the term
+  //   a_n += \M_i^T \Sigma_i^{-1} \m_{n,i}
+  // for all n becomes a single matrix-matrix multiply.
+  Matrix<double> X_i(N, D);
+  for (int32 i = 0; i < I; i++) {
+    bool nonzero = false;
+    for (int32 n = 0; n < N; n++) {
+      if (gamma(n, i) != 0.0) {
+        X_i.CopyRowFromVec(utt_stats[n]->X_.Row(i), n);
+        nonzero = true;
+      } else {
+        X_i.Row(n).SetZero();
+      }
+    }
+    if (nonzero)
+      linear->AddMatMat(1.0, X_i, kNoTrans, Sigma_inv_M_[i], kNoTrans, 1.0);
+  }
+  // The quadratic term: rows of U_ are the packed U_i; one GEMM gives
+  // sum_i gamma_{n,i} U_i for all n.
+  quadratic->AddMatMat(1.0, gamma, kNoTrans, U_, kNoTrans, 1.0);
+}
+
 void IvectorExtractor::GetIvectorDistPrior(
     const IvectorExtractorUtteranceStats &utt_stats,
     VectorBase<double> *linear,
@@ -562,11 +639,25 @@ void OnlineIvectorEstimationStats::AccStats(
     quadratic_term_vec.AddVec(weight, U_g);
     tot_weight += weight;
   }
+  UpdatePriorForCount(num_frames_, num_frames_ + tot_weight);
+  num_frames_ += tot_weight;
+}
+
+
+// This is used in OnlineIvectorEstimationStats::AccStats().
+struct GaussInfo {
+  // total weight for this Gaussian.
+  BaseFloat tot_weight;
+  // vector of pairs of (frame-index, weight for this Gaussian)
+  std::vector<std::pair<int32, BaseFloat> > frame_weights;
+  GaussInfo(): tot_weight(0.0) { }
+};
+
+void OnlineIvectorEstimationStats::UpdatePriorForCount(double old_num_frames,
+                                                       double new_num_frames) {
   if (max_count_ > 0.0) {
     // see comments in header RE max_count for explanation.  It relates to
     // prior scaling when the count exceeds max_count_
-    double old_num_frames = num_frames_,
-        new_num_frames = num_frames_ + tot_weight;
     double old_prior_scale = std::max(old_num_frames, max_count_) / max_count_,
         new_prior_scale = std::max(new_num_frames, max_count_) / max_count_;
     // The prior_scales are the inverses of the scales we would put on the stats
@@ -578,18 +669,78 @@ void OnlineIvectorEstimationStats::AccStats(
       quadratic_term_.AddToDiag(prior_scale_change);
     }
   }
-  num_frames_ += tot_weight;
 }
 
+void OnlineIvectorEstimationStats::AccStatsDeferred(
+    const IvectorExtractor &extractor,
+    const MatrixBase<BaseFloat> &features,
+    const std::vector<std::vector<std::pair<int32, BaseFloat> > > &gauss_post) {
+  KALDI_ASSERT(extractor.IvectorDim() == this->IvectorDim());
+  KALDI_ASSERT(!extractor.IvectorDependentWeights());
+  KALDI_ASSERT(static_cast<int32>(gauss_post.size()) == features.NumRows());
+  int32 num_gauss = extractor.NumGauss(), feat_dim = extractor.FeatDim();
+  KALDI_ASSERT(features.NumCols() == feat_dim);
+  if (deferred_gamma_.Dim() != num_gauss) {
+    KALDI_ASSERT(deferred_gauss_.empty());
+    deferred_gamma_.Resize(num_gauss);
+    deferred_X_.Resize(num_gauss, feat_dim);
+  }
+  double tot_weight = 0.0;
+  int32 num_frames = features.NumRows();
+  for (int32 t = 0; t < num_frames; t++) {
+    const std::vector<std::pair<int32, BaseFloat> > &this_post = gauss_post[t];
+    std::vector<std::pair<int32, BaseFloat> >::const_iterator
+        iter = this_post.begin(), end = this_post.end();
+    for (; iter != end; ++iter) {
+      int32 g = iter->first;
+      double weight = iter->second;
+      if (weight == 0.0)
+        continue;
+      // If the count for g is zero, g is not yet in deferred_gauss_ (unless
+      // its weights happened to cancel out, in which case it gets listed
+      // twice; that's harmless, as FlushDeferredStats() zeroes the stats of
+      // each Gaussian after adding them).
+      if (deferred_gamma_(g) == 0.0)
+        deferred_gauss_.push_back(g);
+      deferred_gamma_(g) += weight;
+      deferred_X_.Row(g).AddVec(weight, features.Row(t));
+      tot_weight += weight;
+    }
+  }
+  UpdatePriorForCount(num_frames_, num_frames_ + tot_weight);
+  num_frames_ += tot_weight;
+}
 
-// This is used in OnlineIvectorEstimationStats::AccStats().
-struct GaussInfo {
-  // total weight for this Gaussian.
-  BaseFloat tot_weight;
-  // vector of pairs of (frame-index, weight for this Gaussian)
-  std::vector<std::pair<int32, BaseFloat> > frame_weights;
-  GaussInfo(): tot_weight(0.0) { }
-};
+void OnlineIvectorEstimationStats::FlushDeferredStats(
+    const IvectorExtractor &extractor) {
+  if (deferred_gauss_.empty())
+    return;
+  int32 ivector_dim = this->IvectorDim(),
+      quadratic_term_dim = (ivector_dim * (ivector_dim + 1)) / 2,
+      num_gauss = extractor.NumGauss();
+  SubVector<double> quadratic_term_vec(quadratic_term_.Data(),
+                                       quadratic_term_dim);
+  // If most of the Gaussians were seen, a single matrix-vector product over
+  // all the stacked U_g is faster than adding the rows one by one.
+  bool dense = (static_cast<int32>(deferred_gauss_.size()) * 2 > num_gauss);
+  if (dense)
+    quadratic_term_vec.AddMatVec(1.0, extractor.U_, kTrans, deferred_gamma_,
+                                 1.0);
+  std::vector<int32>::const_iterator iter = deferred_gauss_.begin(),
+      end = deferred_gauss_.end();
+  for (; iter != end; ++iter) {
+    int32 g = *iter;
+    SubVector<double> x(deferred_X_, g);
+    linear_term_.AddMatVec(1.0, extractor.Sigma_inv_M_[g], kTrans, x, 1.0);
+    if (!dense) {
+      SubVector<double> U_g(extractor.U_, g);
+      quadratic_term_vec.AddVec(deferred_gamma_(g), U_g);
+    }
+    deferred_gamma_(g) = 0.0;
+    x.SetZero();
+  }
+  deferred_gauss_.clear();
+}
 
 static void ConvertPostToGaussInfo(
     const std::vector<std::vector<std::pair<int32, BaseFloat> > > &gauss_post,
@@ -648,28 +799,13 @@ void OnlineIvectorEstimationStats::AccStats(
     quadratic_term_vec.AddVec(this_tot_weight, U_g);
     tot_weight += this_tot_weight;
   }
-  if (max_count_ > 0.0) {
-    // see comments in header RE max_count for explanation.  It relates to
-    // prior scaling when the count exceeds max_count_
-    double old_num_frames = num_frames_,
-        new_num_frames = num_frames_ + tot_weight;
-    double old_prior_scale = std::max(old_num_frames, max_count_) / max_count_,
-        new_prior_scale = std::max(new_num_frames, max_count_) / max_count_;
-    // The prior_scales are the inverses of the scales we would put on the stats
-    // if we were implementing this by scaling the stats.  Instead we
-    // scale the prior term.
-    double prior_scale_change = new_prior_scale - old_prior_scale;
-    if (prior_scale_change != 0.0) {
-      linear_term_(0) += prior_offset_ * prior_scale_change;
-      quadratic_term_.AddToDiag(prior_scale_change);
-    }
-  }
+  UpdatePriorForCount(num_frames_, num_frames_ + tot_weight);
   num_frames_ += tot_weight;
 }
 
 
 void OnlineIvectorEstimationStats::Scale(double scale) {
-  KALDI_ASSERT(scale >= 0.0 && scale <= 1.0);
+  KALDI_ASSERT(scale >= 0.0 && scale <= 1.0 && !HasDeferredStats());
   double old_num_frames = num_frames_;
   num_frames_ *= scale;
   quadratic_term_.Scale(scale);
@@ -693,6 +829,7 @@ void OnlineIvectorEstimationStats::Scale(double scale) {
 }
 
 void OnlineIvectorEstimationStats::Write(std::ostream &os, bool binary) const {
+  KALDI_ASSERT(!HasDeferredStats());
   WriteToken(os, binary, "<OnlineIvectorEstimationStats>");
   WriteToken(os, binary, "<PriorOffset>");
   WriteBasicType(os, binary, prior_offset_);
@@ -733,7 +870,7 @@ void OnlineIvectorEstimationStats::GetIvector(
     int32 num_cg_iters,
     VectorBase<double> *ivector) const {
   KALDI_ASSERT(ivector != NULL && ivector->Dim() ==
-               this->IvectorDim());
+               this->IvectorDim() && !HasDeferredStats());
 
   if (num_frames_ > 0.0) {
     // could be done exactly as follows:
@@ -764,6 +901,7 @@ double OnlineIvectorEstimationStats::ObjfChange(
 
 double OnlineIvectorEstimationStats::Objf(
     const VectorBase<double> &ivector) const {
+  KALDI_ASSERT(!HasDeferredStats());
   if (num_frames_ == 0.0) {
     return 0.0;
   } else {
@@ -800,7 +938,14 @@ OnlineIvectorEstimationStats::OnlineIvectorEstimationStats(
     max_count_(other.max_count_),
     num_frames_(other.num_frames_),
     quadratic_term_(other.quadratic_term_),
-    linear_term_(other.linear_term_) { }
+    linear_term_(other.linear_term_),
+    deferred_gauss_(other.deferred_gauss_) {
+  // we don't copy the buffers for deferred stats unless they are in use.
+  if (other.HasDeferredStats()) {
+    deferred_gamma_ = other.deferred_gamma_;
+    deferred_X_ = other.deferred_X_;
+  }
+}
 
 
 
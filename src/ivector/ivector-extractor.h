@@ -153,6 +153,21 @@ class IvectorExtractor {
       VectorBase<double> *mean,
       SpMatrix<double> *var) const;
 
+  /// Batched version of GetIvectorDistribution(), which gets the distributions
+  /// for many utterances at once.  The terms arising from the Gaussian means
+  /// are computed for all utterances together with matrix-matrix products
+  /// (see GetIvectorDistMeanBatch()), which is much faster than doing it
+  /// utterance by utterance when there are many Gaussians.  The result is
+  /// the same as calling GetIvectorDistribution() for each utterance, up to
+  /// roundoff.  "means" must have utt_stats.size() rows and IvectorDim()
+  /// columns; row n is set to the mean for utterance n.  "vars" may be NULL;
+  /// otherwise it is resized to utt_stats.size() and (*vars)[n] is set to the
+  /// variance for utterance n.
+  void GetIvectorDistributionBatch(
+      const std::vector<const IvectorExtractorUtteranceStats*> &utt_stats,
+      MatrixBase<double> *means,
+      std::vector<SpMatrix<double> > *vars) const;
+
   /// The distribution over iVectors, in our formulation, is not centered at
   /// zero; its first dimension has a nonzero offset.  This function returns
   /// that offset.
@@ -215,6 +230,15 @@ class IvectorExtractor {
       VectorBase<double> *linear,
       SpMatrix<double> *quadratic) const;
 
+  /// Batched version of GetIvectorDistMean().  Row n of "linear" (dimension
+  /// [N][S]) and of "quadratic" (dimension [N][S(S+1)/2], each row being the
+  /// packed data of an SpMatrix) are *added to* with the terms for utterance
+  /// n, where N = utt_stats.size().
+  void GetIvectorDistMeanBatch(
+      const std::vector<const IvectorExtractorUtteranceStats*> &utt_stats,
+      MatrixBase<double> *linear,
+      MatrixBase<double> *quadratic) const;
+
   /// Gets the linear and quadratic terms in the distribution over
   /// iVectors, that arise from the prior.  Adds to the outputs,
   /// rather than setting them.
@@ -305,6 +329,17 @@ class IvectorExtractor {
   // due to the prior term.
   static void InvertWithFlooring(const SpMatrix<double> &quadratic_term,
                                  SpMatrix<double> *var);
+
+  // Does the part of GetIvectorDistribution() that comes after the terms
+  // from the means and the prior have been computed: it works out the
+  // distribution given those terms, iterating to deal with the weights if
+  // they are iVector dependent.  "quadratic" may be changed.
+  void GetIvectorDistributionFromTerms(
+      const IvectorExtractorUtteranceStats &utt_stats,
+      const VectorBase<double> &linear,
+      SpMatrix<double> *quadratic,
+      VectorBase<double> *mean,
+      SpMatrix<double> *var) const;
 };
 
 /**
@@ -333,6 +368,28 @@ class OnlineIvectorEstimationStats {
                 const MatrixBase<BaseFloat> &features,
                 const std::vector<std::vector<std::pair<int32, BaseFloat> > > &gauss_post);
 
+  /// This is like AccStats(), but it only accumulates the per-Gaussian
+  /// zeroth and first-order stats, which is cheap; the expensive projection
+  /// of these into the linear and quadratic terms is deferred until you call
+  /// FlushDeferredStats(), where it is done once per Gaussian for all the
+  /// frames accumulated since the last flush.  This is useful when the iVector
+  /// is only needed every so often (e.g. every ivector-period frames in
+  /// online decoding).  NumFrames() is kept up to date, but you must call
+  /// FlushDeferredStats() before GetIvector(), ObjfChange(), Scale() or
+  /// Write().  The results are the same as with AccStats(), up to roundoff.
+  void AccStatsDeferred(
+      const IvectorExtractor &extractor,
+      const MatrixBase<BaseFloat> &features,
+      const std::vector<std::vector<std::pair<int32, BaseFloat> > > &gauss_post);
+
+  /// Adds the stats accumulated by AccStatsDeferred() to the linear and
+  /// quadratic terms.  Does nothing if there are no deferred stats.
+  void FlushDeferredStats(const IvectorExtractor &extractor);
+
+  /// Returns true if there are stats from AccStatsDeferred() that have not
+  /// yet been flushed.
+  bool HasDeferredStats() const { return !deferred_gauss_.empty(); }
+
 
   int32 IvectorDim() const { return linear_term_.Dim(); }
 
@@ -379,6 +436,15 @@ class OnlineIvectorEstimationStats {
     this->num_frames_ = other.num_frames_;
     this->quadratic_term_=other.quadratic_term_;
     this->linear_term_=other.linear_term_;
+    // we don't copy the buffers for deferred stats unless they are in use.
+    if (other.HasDeferredStats()) {
+      this->deferred_gamma_ = other.deferred_gamma_;
+      this->deferred_X_ = other.deferred_X_;
+    } else {
+      this->deferred_gamma_.Resize(0);
+      this->deferred_X_.Resize(0, 0);
+    }
+    this->deferred_gauss_ = other.deferred_gauss_;
     return *this;
   }
 
@@ -396,6 +462,19 @@ class OnlineIvectorEstimationStats {
   double num_frames_;  // num frames (weighted, if applicable).
   SpMatrix<double> quadratic_term_;
   Vector<double> linear_term_;
+
+  // Adds to the prior term to account for the count increasing from
+  // old_num_frames to new_num_frames, if max_count_ > 0.
+  void UpdatePriorForCount(double old_num_frames, double new_num_frames);
+
+  // The following are the stats accumulated by AccStatsDeferred() that have
+  // not yet been flushed.  deferred_gamma_ [dimension I] and deferred_X_
+  // [dimension I by D] are the zeroth and first-order stats; they are sized
+  // on the first call to AccStatsDeferred() and are only nonzero for the
+  // Gaussians listed in deferred_gauss_.
+  Vector<double> deferred_gamma_;
+  Matrix<double> deferred_X_;
+  std::vector<int32> deferred_gauss_;
 };
 
 
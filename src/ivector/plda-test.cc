@@ -22,6 +22,29 @@
 
 namespace kaldi {
 
+void TestPldaBatchScoring(const Plda &plda) {
+  int32 dim = plda.Dim(), num_enroll = 1 + Rand() % 10,
+      num_test = 1 + Rand() % 20;
+  Matrix<double> enroll(num_enroll, dim), test(num_test, dim);
+  enroll.SetRandn();
+  test.SetRandn();
+  std::vector<int32> num_enroll_utts(num_enroll);
+  for (int32 i = 0; i < num_enroll; i++)
+    num_enroll_utts[i] = 1 + Rand() % 5;
+
+  Matrix<double> scores(num_enroll, num_test);
+  plda.LogLikelihoodRatios(enroll, num_enroll_utts, test, &scores);
+  for (int32 i = 0; i < num_enroll; i++) {
+    for (int32 j = 0; j < num_test; j++) {
+      double ref_score = plda.LogLikelihoodRatio(enroll.Row(i),
+                                                 num_enroll_utts[i],
+                                                 test.Row(j));
+      KALDI_ASSERT(ApproxEqual(scores(i, j), ref_score, 1.0e-06) ||
+                   std::abs(scores(i, j) - ref_score) < 1.0e-06);
+    }
+  }
+}
+
 void UnitTestPldaEstimation(int32 dim) {
   int32 num_classes = 1000 + Rand() % 10;
   Matrix<double> between_proj(dim, dim);
@@ -68,6 +91,7 @@ void UnitTestPldaEstimation(int32 dim) {
   Plda plda;
   PldaEstimationConfig config;
   estimator.Estimate(config, &plda);
+  TestPldaBatchScoring(plda);
 
   KALDI_LOG << "Trace of true within-var is " << within_var.Trace();
   KALDI_LOG << "Trace of true between-var is " << between_var.Trace();
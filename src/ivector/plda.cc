@@ -191,6 +191,70 @@ double Plda::LogLikelihoodRatio(
   return loglike_ratio;
 }
 
+/*
+   Expanding the log-likelihood ratio from LogLikelihoodRatio() in terms of
+   the test iVector t, with a_i = n \psi_i / (n \psi_i + 1),
+   v_i = 1 + \psi_i / (n \psi_i + 1) and w_i = 1 + \psi_i, we get
+     \sum_i (a_i u_i / v_i) t_i  - 0.5 \sum_i (1/v_i - 1/w_i) t_i^2
+         - 0.5 \sum_i (a_i^2 u_i^2 / v_i + \log v_i - \log w_i)
+   which is the dot product of [ a.u/v, -0.5 (1/v - 1/w), const ] with
+   [ t, t.^2, 1 ].
+*/
+void Plda::GetEnrollScoringMatrix(
+    const MatrixBase<double> &transformed_enroll_ivectors,
+    const std::vector<int32> &num_enroll_utts,
+    Matrix<double> *enroll_scoring) const {
+  int32 dim = Dim(), num_enroll = transformed_enroll_ivectors.NumRows();
+  KALDI_ASSERT(transformed_enroll_ivectors.NumCols() == dim &&
+               static_cast<int32>(num_enroll_utts.size()) == num_enroll);
+  enroll_scoring->Resize(num_enroll, ScoringDim(), kUndefined);
+  for (int32 r = 0; r < num_enroll; r++) {
+    double n = num_enroll_utts[r];
+    KALDI_ASSERT(n > 0);
+    SubVector<double> u(transformed_enroll_ivectors, r),
+        out(*enroll_scoring, r);
+    double constant = 0.0;
+    for (int32 i = 0; i < dim; i++) {
+      double a = n * psi_(i) / (n * psi_(i) + 1.0),
+          v = 1.0 + psi_(i) / (n * psi_(i) + 1.0),
+          w = 1.0 + psi_(i),
+          au = a * u(i);
+      out(i) = au / v;
+      out(dim + i) = -0.5 * (1.0 / v - 1.0 / w);
+      constant -= 0.5 * (au * au / v + Log(v) - Log(w));
+    }
+    out(2 * dim) = constant;
+  }
+}
+
+void Plda::GetTestScoringMatrix(
+    const MatrixBase<double> &transformed_test_ivectors,
+    Matrix<double> *test_scoring) const {
+  int32 dim = Dim(), num_test = transformed_test_ivectors.NumRows();
+  KALDI_ASSERT(transformed_test_ivectors.NumCols() == dim);
+  test_scoring->Resize(num_test, ScoringDim(), kUndefined);
+  test_scoring->ColRange(0, dim).CopyFromMat(transformed_test_ivectors);
+  SubMatrix<double> sq(*test_scoring, 0, num_test, dim, dim);
+  sq.CopyFromMat(transformed_test_ivectors);
+  sq.ApplyPow(2.0);
+  test_scoring->ColRange(2 * dim, 1).Set(1.0);
+}
+
+void Plda::LogLikelihoodRatios(
+    const MatrixBase<double> &transformed_enroll_ivectors,
+    const std::vector<int32> &num_enroll_utts,
+    const MatrixBase<double> &transformed_test_ivectors,
+    MatrixBase<double> *scores) const {
+  KALDI_ASSERT(scores->NumRows() == transformed_enroll_ivectors.NumRows() &&
+               scores->NumCols() == transformed_test_ivectors.NumRows());
+  Matrix<double> enroll_scoring, test_scoring;
+  GetEnrollScoringMatrix(transformed_enroll_ivectors, num_enroll_utts,
+                         &enroll_scoring);
+  GetTestScoringMatrix(transformed_test_ivectors, &test_scoring);
+  scores->AddMatMat(1.0, enroll_scoring, kNoTrans,
+                    test_scoring, kTrans, 0.0);
+}
+
 
 void Plda::SmoothWithinClassCovariance(double smoothing_factor) {
   KALDI_ASSERT(smoothing_factor >= 0.0 && smoothing_factor <= 1.0);
@@ -122,6 +122,40 @@ class Plda {
                             const VectorBase<double> &transformed_test_ivector)
                             const;
 
+  /// The following functions support batched scoring of large numbers of
+  /// trials.  The log-likelihood ratio computed by LogLikelihoodRatio() is a
+  /// quadratic function of the test iVector, so it can be written as the dot
+  /// product of a per-enrollment row with the per-test row [ t, t.^2, 1 ].
+  /// This function computes those per-enrollment rows; the output
+  /// "enroll_scoring" will be of dimension
+  /// transformed_enroll_ivectors.NumRows() by ScoringDim().
+  /// The inputs are assumed to have been transformed by TransformIvector().
+  void GetEnrollScoringMatrix(
+      const MatrixBase<double> &transformed_enroll_ivectors,
+      const std::vector<int32> &num_enroll_utts,
+      Matrix<double> *enroll_scoring) const;
+
+  /// Computes the per-test rows [ t, t.^2, 1 ] that go with the output of
+  /// GetEnrollScoringMatrix(); "test_scoring" will be of dimension
+  /// transformed_test_ivectors.NumRows() by ScoringDim().
+  void GetTestScoringMatrix(
+      const MatrixBase<double> &transformed_test_ivectors,
+      Matrix<double> *test_scoring) const;
+
+  /// Dimension of the rows output by GetEnrollScoringMatrix() and
+  /// GetTestScoringMatrix().
+  int32 ScoringDim() const { return 2 * Dim() + 1; }
+
+  /// Batched version of LogLikelihoodRatio(): sets
+  /// (*scores)(i, j) to the log-likelihood ratio of row i of
+  /// transformed_enroll_ivectors (an average over num_enroll_utts[i]
+  /// utterances) versus row j of transformed_test_ivectors.  All the scores
+  /// are computed with a single matrix multiplication.
+  void LogLikelihoodRatios(
+      const MatrixBase<double> &transformed_enroll_ivectors,
+      const std::vector<int32> &num_enroll_utts,
+      const MatrixBase<double> &transformed_test_ivectors,
+      MatrixBase<double> *scores) const;
 
   /// This function smooths the within-class covariance by adding to it,
   /// smoothing_factor (e.g. 0.1) times the between-class covariance (it's
@@ -23,8 +23,60 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "util/stl-utils.h"
+#include "util/kaldi-thread.h"
 #include "ivector/agglomerative-clustering.h"
 
+namespace kaldi {
+
+// Clusters the utterances of one recording; used inside a TaskSequencer so
+// that several recordings can be clustered in parallel.  The labels are
+// written in the destructor, in the original order of the recordings.
+class AgglomerativeClusterTask {
+ public:
+  // Takes ownership of the contents of "costs" and "uttlist" (it swaps them).
+  AgglomerativeClusterTask(bool use_nn_chain, BaseFloat threshold,
+                           int32 min_clusters, int32 first_pass_max_points,
+                           BaseFloat max_cluster_fraction,
+                           Matrix<BaseFloat> *costs,
+                           std::vector<std::string> *uttlist,
+                           Int32Writer *label_writer):
+      use_nn_chain_(use_nn_chain), threshold_(threshold),
+      min_clusters_(min_clusters),
+      first_pass_max_points_(first_pass_max_points),
+      max_cluster_fraction_(max_cluster_fraction),
+      label_writer_(label_writer) {
+    costs_.Swap(costs);
+    uttlist_.swap(*uttlist);
+  }
+
+  void operator () () {
+    if (use_nn_chain_)
+      AgglomerativeClusterNnChain(threshold_, min_clusters_, &costs_,
+                                  &spk_ids_);
+    else
+      AgglomerativeCluster(costs_, threshold_, min_clusters_,
+                           first_pass_max_points_, max_cluster_fraction_,
+                           &spk_ids_);
+  }
+
+  ~AgglomerativeClusterTask() {
+    for (int32 i = 0; i < spk_ids_.size(); i++)
+      label_writer_->Write(uttlist_[i], spk_ids_[i]);
+  }
+ private:
+  bool use_nn_chain_;
+  BaseFloat threshold_;
+  int32 min_clusters_;
+  int32 first_pass_max_points_;
+  BaseFloat max_cluster_fraction_;
+  Matrix<BaseFloat> costs_;
+  std::vector<std::string> uttlist_;
+  Int32Writer *label_writer_;
+  std::vector<int32> spk_ids_;
+};
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   using namespace kaldi;
   typedef kaldi::int32 int32;
@@ -39,7 +91,11 @@ int main(int argc, char *argv[]) {
       "clustering with a score threshold as stop criterion.  By default, the\n"
       "program reads in similarity scores, but with --read-costs=true\n"
       "the scores are interpreted as costs (i.e. a smaller value indicates\n"
-      "utterance similarity).\n"
+      "utterance similarity).  With --algorithm=nn-chain, the clustering\n"
+      "uses the nearest-neighbor chain algorithm, which gives the same\n"
+      "result as single-pass clustering but needs only O(N) memory on top\n"
+      "of the score matrix, making it suitable for recordings with tens of\n"
+      "thousands of segments.\n"
       "Usage: agglomerative-cluster [options] <scores-rspecifier> "
       "<reco2utt-rspecifier> <labels-wspecifier>\n"
       "e.g.: \n"
@@ -51,6 +107,8 @@ int main(int argc, char *argv[]) {
     BaseFloat threshold = 0.0, max_spk_fraction = 1.0;
     bool read_costs = false;
     int32 first_pass_max_utterances = std::numeric_limits<int16>::max();
+    std::string algorithm = "priority-queue";
+    TaskSequencerConfig sequencer_config;
 
     po.Register("reco2num-spk-rspecifier", &reco2num_spk_rspecifier,
       "If supplied, clustering creates exactly this many clusters for each"
@@ -70,6 +128,12 @@ int main(int argc, char *argv[]) {
       " total fraction of utterances in them is less than this threshold."
       " This is active only when reco2num-spk-rspecifier is supplied and"
       " 1.0 / num-spk <= max-spk-fraction <= 1.0.");
+    po.Register("algorithm", &algorithm, "Clustering algorithm: "
+      "\"priority-queue\" or \"nn-chain\".  nn-chain is exact (it ignores "
+      "--first-pass-max-utterances) and much faster for large recordings, "
+      "but does not support --max-spk-fraction < 1.0; recordings where that "
+      "applies fall back to priority-queue.");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -78,6 +142,10 @@ int main(int argc, char *argv[]) {
       exit(1);
     }
 
+    if (algorithm != "priority-queue" && algorithm != "nn-chain")
+      KALDI_ERR << "Invalid value for --algorithm: " << algorithm;
+    bool use_nn_chain = (algorithm == "nn-chain");
+
     std::string scores_rspecifier = po.GetArg(1),
       reco2utt_rspecifier = po.GetArg(2),
       label_wspecifier = po.GetArg(3);
@@ -89,6 +157,7 @@ int main(int argc, char *argv[]) {
 
     if (!read_costs)
       threshold = -threshold;
+    TaskSequencer<AgglomerativeClusterTask> sequencer(sequencer_config);
     for (; !scores_reader.Done(); scores_reader.Next()) {
       std::string reco = scores_reader.Key();
       Matrix<BaseFloat> costs = scores_reader.Value();
@@ -99,24 +168,21 @@ int main(int argc, char *argv[]) {
       if (!read_costs)
         costs.Scale(-1);
       std::vector<std::string> uttlist = reco2utt_reader.Value(reco);
-      std::vector<int32> spk_ids;
+      BaseFloat this_threshold = threshold, max_cluster_fraction = 1.0;
+      int32 min_clusters = 1;
       if (reco2num_spk_rspecifier.size()) {
         int32 num_speakers = reco2num_spk_reader.Value(reco);
+        this_threshold = std::numeric_limits<BaseFloat>::max();
+        min_clusters = num_speakers;
         if (1.0 / num_speakers <= max_spk_fraction && max_spk_fraction <= 1.0)
-          AgglomerativeCluster(costs, std::numeric_limits<BaseFloat>::max(),
-                               num_speakers, first_pass_max_utterances,
-                               max_spk_fraction, &spk_ids);
-        else
-          AgglomerativeCluster(costs, std::numeric_limits<BaseFloat>::max(),
-                               num_speakers, first_pass_max_utterances,
-                               1.0, &spk_ids);
-      } else {
-        AgglomerativeCluster(costs, threshold, 1, first_pass_max_utterances,
-                             1.0, &spk_ids);
+          max_cluster_fraction = max_spk_fraction;
       }
-      for (int32 i = 0; i < spk_ids.size(); i++)
-        label_writer.Write(uttlist[i], spk_ids[i]);
+      sequencer.Run(new AgglomerativeClusterTask(
+          use_nn_chain && max_cluster_fraction >= 1.0, this_threshold,
+          min_clusters, first_pass_max_utterances, max_cluster_fraction,
+          &costs, &uttlist, &label_writer));
     }
+    sequencer.Wait();
     return 0;
 
   } catch(const std::exception &e) {
@@ -27,66 +27,83 @@
 namespace kaldi {
 
 // This class will be used to parallelize over multiple threads the job
-// that this program does.  The work happens in the operator (), the
-// output happens in the destructor.
+// that this program does.  Each task handles a batch of utterances, whose
+// iVectors are computed together using
+// IvectorExtractor::GetIvectorDistributionBatch().  The work happens in the
+// operator (), the output happens in the destructor.
 class IvectorExtractTask {
  public:
   IvectorExtractTask(const IvectorExtractor &extractor,
-                     std::string utt,
-                     const Matrix<BaseFloat> &feats,
-                     const Posterior &posterior,
+                     const std::vector<std::string> &utts,
+                     const std::vector<Posterior> &posteriors,
+                     const std::vector<Matrix<BaseFloat> > &feats,
                      BaseFloatVectorWriter *writer,
                      double *tot_auxf_change):
-      extractor_(extractor), utt_(utt), feats_(feats), posterior_(posterior),
-      writer_(writer), tot_auxf_change_(tot_auxf_change) { }
+      extractor_(extractor), utts_(utts), feats_(feats),
+      posteriors_(posteriors), writer_(writer),
+      tot_auxf_change_(tot_auxf_change) { }
 
   void operator () () {
     bool need_2nd_order_stats = false;
+    int32 num_utts = utts_.size();
+
+    std::vector<IvectorExtractorUtteranceStats*> utt_stats(num_utts);
+    std::vector<const IvectorExtractorUtteranceStats*> utt_stats_const(
+        num_utts);
+    for (int32 n = 0; n < num_utts; n++) {
+      utt_stats[n] = new IvectorExtractorUtteranceStats(
+          extractor_.NumGauss(), extractor_.FeatDim(), need_2nd_order_stats);
+      utt_stats[n]->AccStats(feats_[n], posteriors_[n]);
+      utt_stats_const[n] = utt_stats[n];
+    }
+    // Free the features early, we don't need them any more.
+    feats_.clear();
 
-    IvectorExtractorUtteranceStats utt_stats(extractor_.NumGauss(),
-                                             extractor_.FeatDim(),
-                                             need_2nd_order_stats);
-
-    utt_stats.AccStats(feats_, posterior_);
-
-    ivector_.Resize(extractor_.IvectorDim());
-    ivector_(0) = extractor_.PriorOffset();
+    ivectors_.Resize(num_utts, extractor_.IvectorDim());
+    extractor_.GetIvectorDistributionBatch(utt_stats_const, &ivectors_, NULL);
 
     if (tot_auxf_change_ != NULL) {
-      double old_auxf = extractor_.GetAuxf(utt_stats, ivector_);
-      extractor_.GetIvectorDistribution(utt_stats, &ivector_, NULL);
-      double new_auxf = extractor_.GetAuxf(utt_stats, ivector_);
-      auxf_change_ = new_auxf - old_auxf;
-    } else {
-      extractor_.GetIvectorDistribution(utt_stats, &ivector_, NULL);
+      auxf_changes_.resize(num_utts);
+      Vector<double> ivector_baseline(extractor_.IvectorDim());
+      ivector_baseline(0) = extractor_.PriorOffset();
+      for (int32 n = 0; n < num_utts; n++) {
+        double old_auxf = extractor_.GetAuxf(*(utt_stats[n]), ivector_baseline),
+            new_auxf = extractor_.GetAuxf(*(utt_stats[n]), ivectors_.Row(n));
+        auxf_changes_[n] = new_auxf - old_auxf;
+      }
     }
+    for (int32 n = 0; n < num_utts; n++)
+      delete utt_stats[n];
   }
   ~IvectorExtractTask() {
-    if (tot_auxf_change_ != NULL) {
-      double T = TotalPosterior(posterior_);
-      *tot_auxf_change_ += auxf_change_;
-      KALDI_VLOG(2) << "Auxf change for utterance " << utt_ << " was "
-                    << (auxf_change_ / T) << " per frame over " << T
-                    << " frames (weighted)";
+    for (size_t n = 0; n < utts_.size(); n++) {
+      if (tot_auxf_change_ != NULL) {
+        double T = TotalPosterior(posteriors_[n]);
+        *tot_auxf_change_ += auxf_changes_[n];
+        KALDI_VLOG(2) << "Auxf change for utterance " << utts_[n] << " was "
+                      << (auxf_changes_[n] / T) << " per frame over " << T
+                      << " frames (weighted)";
+      }
+      // We actually write out the offset of the iVectors from the mean of the
+      // prior distribution; this is the form we'll need it in for scoring.
+      // (most formulations of iVectors have zero-mean priors so this is not
+      // normally an issue).
+      SubVector<double> ivector(ivectors_, n);
+      ivector(0) -= extractor_.PriorOffset();
+      KALDI_VLOG(2) << "Ivector norm for utterance " << utts_[n]
+                    << " was " << ivector.Norm(2.0);
+      writer_->Write(utts_[n], Vector<BaseFloat>(ivector));
     }
-    // We actually write out the offset of the iVectors from the mean of the
-    // prior distribution; this is the form we'll need it in for scoring.  (most
-    // formulations of iVectors have zero-mean priors so this is not normally an
-    // issue).
-    ivector_(0) -= extractor_.PriorOffset();
-    KALDI_VLOG(2) << "Ivector norm for utterance " << utt_
-                  << " was " << ivector_.Norm(2.0);
-    writer_->Write(utt_, Vector<BaseFloat>(ivector_));
   }
  private:
   const IvectorExtractor &extractor_;
-  std::string utt_;
-  Matrix<BaseFloat> feats_;
-  Posterior posterior_;
+  std::vector<std::string> utts_;
+  std::vector<Matrix<BaseFloat> > feats_;
+  std::vector<Posterior> posteriors_;
   BaseFloatVectorWriter *writer_;
   double *tot_auxf_change_; // if non-NULL we need the auxf change.
-  Vector<double> ivector_;
-  double auxf_change_;
+  Matrix<double> ivectors_;
+  std::vector<double> auxf_changes_;
 };
 
 int32 RunPerSpeaker(const std::string &ivector_extractor_rxfilename,
@@ -226,6 +243,7 @@ int main(int argc, char *argv[]) {
     IvectorEstimationOptions opts;
     std::string spk2utt_rspecifier;
     TaskSequencerConfig sequencer_config;
+    int32 batch_size = 16;
     po.Register("compute-objf-change", &compute_objf_change,
                 "If true, compute the change in objective function from using "
                 "nonzero iVector (a potentially useful diagnostic).  Combine "
@@ -237,6 +255,11 @@ int main(int argc, char *argv[]) {
                 "This option will cause the program to ignore the --num-threads "
                 "option.");
 
+    po.Register("batch-size", &batch_size, "Number of utterances whose "
+                "iVectors are estimated together, using matrix-matrix "
+                "operations (larger is faster but uses more memory).  Each "
+                "thread processes one batch at a time.");
+
     opts.Register(&po);
     sequencer_config.Register(&po);
 
@@ -246,6 +269,8 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       exit(1);
     }
+    if (batch_size <= 0)
+      KALDI_ERR << "--batch-size must be positive.";
 
     std::string ivector_extractor_rxfilename = po.GetArg(1),
         feature_rspecifier = po.GetArg(2),
@@ -269,6 +294,10 @@ int main(int argc, char *argv[]) {
 
       {
         TaskSequencer<IvectorExtractTask> sequencer(sequencer_config);
+        double *auxf_ptr = (compute_objf_change ? &tot_auxf_change : NULL );
+        std::vector<std::string> utts;
+        std::vector<Posterior> posteriors;
+        std::vector<Matrix<BaseFloat> > feats;
         for (; !feature_reader.Done(); feature_reader.Next()) {
           std::string utt = feature_reader.Key();
           if (!posterior_reader.HasKey(utt)) {
@@ -287,8 +316,6 @@ int main(int argc, char *argv[]) {
             continue;
           }
 
-          double *auxf_ptr = (compute_objf_change ? &tot_auxf_change : NULL );
-
           double this_t = opts.acoustic_weight * TotalPosterior(posterior),
               max_count_scale = 1.0;
           if (opts.max_count > 0 && this_t > opts.max_count) {
@@ -302,12 +329,26 @@ int main(int argc, char *argv[]) {
                          &posterior);
           // note: now, this_t == sum of posteriors.
 
-          sequencer.Run(new IvectorExtractTask(extractor, utt, mat, posterior,
-                                               &ivector_writer, auxf_ptr));
+          utts.push_back(utt);
+          posteriors.resize(posteriors.size() + 1);
+          posteriors.back().swap(posterior);
+          feats.push_back(mat);
+          if (static_cast<int32>(utts.size()) == batch_size) {
+            sequencer.Run(new IvectorExtractTask(extractor, utts, posteriors,
+                                                 feats, &ivector_writer,
+                                                 auxf_ptr));
+            utts.clear();
+            posteriors.clear();
+            feats.clear();
+          }
 
           tot_t += this_t;
           num_done++;
         }
+        if (!utts.empty())
+          sequencer.Run(new IvectorExtractTask(extractor, utts, posteriors,
+                                               feats, &ivector_writer,
+                                               auxf_ptr));
         // Destructor of "sequencer" will wait for any remaining tasks.
       }
 
@@ -20,8 +20,81 @@
 
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
 #include "ivector/plda.h"
 
+namespace kaldi {
+
+// This class scores a batch of trials; it's used inside a TaskSequencer so
+// that batches can be scored in parallel while the output is written in the
+// original order of the trials file.
+class PldaScoringTask {
+ public:
+  // "enroll_scoring" and "test_scoring" are as output by
+  // Plda::GetEnrollScoringMatrix() and Plda::GetTestScoringMatrix().  This
+  // class takes ownership of the contents of "keys" and "indexes" (it swaps
+  // them).
+  PldaScoringTask(const Matrix<double> &enroll_scoring,
+                  const Matrix<double> &test_scoring,
+                  std::vector<std::pair<std::string, std::string> > *keys,
+                  std::vector<std::pair<int32, int32> > *indexes,
+                  std::ostream *os, double *tot_sum, double *tot_sumsq):
+      enroll_scoring_(enroll_scoring), test_scoring_(test_scoring),
+      os_(os), tot_sum_(tot_sum), tot_sumsq_(tot_sumsq) {
+    keys_.swap(*keys);
+    indexes_.swap(*indexes);
+  }
+
+  void operator () () {
+    int32 num_trials = indexes_.size(), dim = test_scoring_.NumCols();
+    scores_.resize(num_trials);
+    // Sort the trials by enrollment index so that all the trials of each
+    // enrollment iVector can be scored with one matrix-vector product.
+    std::vector<std::pair<int32, int32> > order(num_trials);
+    for (int32 i = 0; i < num_trials; i++)
+      order[i] = std::pair<int32, int32>(indexes_[i].first, i);
+    std::sort(order.begin(), order.end());
+    Matrix<double> test_rows;
+    Vector<double> scores;
+    for (int32 begin = 0; begin < num_trials; ) {
+      int32 enroll_index = order[begin].first, end = begin + 1;
+      while (end < num_trials && order[end].first == enroll_index)
+        end++;
+      int32 n = end - begin;
+      test_rows.Resize(n, dim, kUndefined);
+      for (int32 i = 0; i < n; i++)
+        test_rows.Row(i).CopyFromVec(
+            test_scoring_.Row(indexes_[order[begin + i].second].second));
+      scores.Resize(n, kUndefined);
+      scores.AddMatVec(1.0, test_rows, kNoTrans,
+                       enroll_scoring_.Row(enroll_index), 0.0);
+      for (int32 i = 0; i < n; i++)
+        scores_[order[begin + i].second] = scores(i);
+      begin = end;
+    }
+  }
+
+  ~PldaScoringTask() {
+    for (size_t i = 0; i < keys_.size(); i++) {
+      BaseFloat score = scores_[i];
+      *tot_sum_ += score;
+      *tot_sumsq_ += score * score;
+      *os_ << keys_[i].first << ' ' << keys_[i].second << ' '
+           << score << std::endl;
+    }
+  }
+ private:
+  const Matrix<double> &enroll_scoring_;
+  const Matrix<double> &test_scoring_;
+  std::vector<std::pair<std::string, std::string> > keys_;
+  std::vector<std::pair<int32, int32> > indexes_;
+  std::vector<BaseFloat> scores_;
+  std::ostream *os_;
+  double *tot_sum_;
+  double *tot_sumsq_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   using namespace kaldi;
@@ -51,9 +124,14 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
 
     std::string num_utts_rspecifier;
+    int32 batch_size = 10000;
 
     PldaConfig plda_config;
     plda_config.Register(&po);
+    TaskSequencerConfig sequencer_config;
+    sequencer_config.Register(&po);
+    po.Register("batch-size", &batch_size, "Number of trials to score "
+                "together (each batch is scored by one thread).");
     po.Register("num-utts", &num_utts_rspecifier, "Table to read the number of "
                 "utterances per speaker, e.g. ark:num_utts.ark\n");
 
@@ -85,13 +163,17 @@ int main(int argc, char *argv[]) {
     SequentialBaseFloatVectorReader test_ivector_reader(test_ivector_rspecifier);
     RandomAccessInt32Reader num_utts_reader(num_utts_rspecifier);
 
-    typedef unordered_map<string, Vector<BaseFloat>*, StringHasher> HashType;
+    KALDI_ASSERT(batch_size > 0);
 
-    // These hashes will contain the iVectors in the PLDA subspace
-    // (that makes the within-class variance unit and diagonalizes the
-    // between-class covariance).  They will also possibly be length-normalized,
-    // depending on the config.
+    typedef unordered_map<string, int32, StringHasher> HashType;
+
+    // These hashes map from the keys to row-indexes into the matrices of
+    // iVectors in the PLDA subspace (that makes the within-class variance unit
+    // and diagonalizes the between-class covariance).  They will also possibly
+    // be length-normalized, depending on the config.
     HashType train_ivectors, test_ivectors;
+    std::vector<Vector<BaseFloat> > transformed_ivectors;
+    std::vector<int32> train_num_utts;
 
     KALDI_LOG << "Reading train iVectors";
     for (; !train_ivector_reader.Done(); train_ivector_reader.Next()) {
@@ -111,12 +193,12 @@ int main(int argc, char *argv[]) {
       } else {
         num_examples = 1;
       }
-      Vector<BaseFloat> *transformed_ivector = new Vector<BaseFloat>(dim);
+      transformed_ivectors.push_back(Vector<BaseFloat>(dim));
 
-      tot_train_renorm_scale += plda.TransformIvector(plda_config, ivector,
-                                                      num_examples,
-                                                      transformed_ivector);
-      train_ivectors[spk] = transformed_ivector;
+      tot_train_renorm_scale += plda.TransformIvector(
+          plda_config, ivector, num_examples, &(transformed_ivectors.back()));
+      train_ivectors[spk] = num_train_ivectors;
+      train_num_utts.push_back(num_examples);
       num_train_ivectors++;
     }
     KALDI_LOG << "Read " << num_train_ivectors << " training iVectors, "
@@ -126,6 +208,18 @@ int main(int argc, char *argv[]) {
     KALDI_LOG << "Average renormalization scale on training iVectors was "
               << (tot_train_renorm_scale / num_train_ivectors);
 
+    // The enrollment and test scoring matrices are computed once, so that
+    // the score of each trial is just a dot product; see
+    // Plda::GetEnrollScoringMatrix().
+    Matrix<double> enroll_scoring;
+    {
+      Matrix<double> train_mat(num_train_ivectors, dim, kUndefined);
+      for (int32 i = 0; i < num_train_ivectors; i++)
+        train_mat.Row(i).CopyFromVec(transformed_ivectors[i]);
+      transformed_ivectors.clear();
+      plda.GetEnrollScoringMatrix(train_mat, train_num_utts, &enroll_scoring);
+    }
+
     KALDI_LOG << "Reading test iVectors";
     for (; !test_ivector_reader.Done(); test_ivector_reader.Next()) {
       std::string utt = test_ivector_reader.Key();
@@ -136,12 +230,11 @@ int main(int argc, char *argv[]) {
       int32 num_examples = 1; // this value is always used for test (affects the
                               // length normalization in the TransformIvector
                               // function).
-      Vector<BaseFloat> *transformed_ivector = new Vector<BaseFloat>(dim);
+      transformed_ivectors.push_back(Vector<BaseFloat>(dim));
 
-      tot_test_renorm_scale += plda.TransformIvector(plda_config, ivector,
-                                                     num_examples,
-                                                     transformed_ivector);
-      test_ivectors[utt] = transformed_ivector;
+      tot_test_renorm_scale += plda.TransformIvector(
+          plda_config, ivector, num_examples, &(transformed_ivectors.back()));
+      test_ivectors[utt] = num_test_ivectors;
       num_test_ivectors++;
     }
     KALDI_LOG << "Read " << num_test_ivectors << " test iVectors.";
@@ -150,6 +243,14 @@ int main(int argc, char *argv[]) {
     KALDI_LOG << "Average renormalization scale on test iVectors was "
               << (tot_test_renorm_scale / num_test_ivectors);
 
+    Matrix<double> test_scoring;
+    {
+      Matrix<double> test_mat(num_test_ivectors, dim, kUndefined);
+      for (int32 i = 0; i < num_test_ivectors; i++)
+        test_mat.Row(i).CopyFromVec(transformed_ivectors[i]);
+      std::vector<Vector<BaseFloat> >().swap(transformed_ivectors);
+      plda.GetTestScoringMatrix(test_mat, &test_scoring);
+    }
 
     Input ki(trials_rxfilename);
     bool binary = false;
@@ -158,56 +259,47 @@ int main(int argc, char *argv[]) {
     double sum = 0.0, sumsq = 0.0;
     std::string line;
 
-    while (std::getline(ki.Stream(), line)) {
-      std::vector<std::string> fields;
-      SplitStringToVector(line, " \t\n\r", true, &fields);
-      if (fields.size() != 2) {
-        KALDI_ERR << "Bad line " << (num_trials_done + num_trials_err)
-                  << "in input (expected two fields: key1 key2): " << line;
-      }
-      std::string key1 = fields[0], key2 = fields[1];
-      if (train_ivectors.count(key1) == 0) {
-        KALDI_WARN << "Key " << key1 << " not present in training iVectors.";
-        num_trials_err++;
-        continue;
-      }
-      if (test_ivectors.count(key2) == 0) {
-        KALDI_WARN << "Key " << key2 << " not present in test iVectors.";
-        num_trials_err++;
-        continue;
-      }
-      const Vector<BaseFloat> *train_ivector = train_ivectors[key1],
-          *test_ivector = test_ivectors[key2];
-
-      Vector<double> train_ivector_dbl(*train_ivector),
-          test_ivector_dbl(*test_ivector);
-
-      int32 num_train_examples;
-      if (!num_utts_rspecifier.empty()) {
-        // we already checked that it has this key.
-        num_train_examples = num_utts_reader.Value(key1);
-      } else {
-        num_train_examples = 1;
+    {
+      TaskSequencer<PldaScoringTask> sequencer(sequencer_config);
+      std::vector<std::pair<std::string, std::string> > keys;
+      std::vector<std::pair<int32, int32> > indexes;
+
+      while (std::getline(ki.Stream(), line)) {
+        std::vector<std::string> fields;
+        SplitStringToVector(line, " \t\n\r", true, &fields);
+        if (fields.size() != 2) {
+          KALDI_ERR << "Bad line " << (num_trials_done + num_trials_err)
+                    << "in input (expected two fields: key1 key2): " << line;
+        }
+        std::string key1 = fields[0], key2 = fields[1];
+        HashType::const_iterator train_iter = train_ivectors.find(key1),
+            test_iter = test_ivectors.find(key2);
+        if (train_iter == train_ivectors.end()) {
+          KALDI_WARN << "Key " << key1 << " not present in training iVectors.";
+          num_trials_err++;
+          continue;
+        }
+        if (test_iter == test_ivectors.end()) {
+          KALDI_WARN << "Key " << key2 << " not present in test iVectors.";
+          num_trials_err++;
+          continue;
+        }
+        keys.push_back(std::pair<std::string, std::string>(key1, key2));
+        indexes.push_back(std::pair<int32, int32>(train_iter->second,
+                                                  test_iter->second));
+        num_trials_done++;
+        if (static_cast<int32>(keys.size()) == batch_size)
+          sequencer.Run(new PldaScoringTask(enroll_scoring, test_scoring,
+                                            &keys, &indexes, &(ko.Stream()),
+                                            &sum, &sumsq));
       }
-
-
-      BaseFloat score = plda.LogLikelihoodRatio(train_ivector_dbl,
-                                                num_train_examples,
-                                                test_ivector_dbl);
-      sum += score;
-      sumsq += score * score;
-      num_trials_done++;
-      ko.Stream() << key1 << ' ' << key2 << ' ' << score << std::endl;
+      if (!keys.empty())
+        sequencer.Run(new PldaScoringTask(enroll_scoring, test_scoring,
+                                          &keys, &indexes, &(ko.Stream()),
+                                          &sum, &sumsq));
+      // Destructor of "sequencer" will wait for any remaining tasks.
     }
 
-    for (HashType::iterator iter = train_ivectors.begin();
-         iter != train_ivectors.end(); ++iter)
-      delete iter->second;
-    for (HashType::iterator iter = test_ivectors.begin();
-         iter != test_ivectors.end(); ++iter)
-      delete iter->second;
-
-
     if (num_trials_done != 0) {
       BaseFloat mean = sum / num_trials_done, scatter = sumsq / num_trials_done,
           variance = scatter - mean * mean, stddev = sqrt(variance);
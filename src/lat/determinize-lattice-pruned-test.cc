@@ -136,6 +136,50 @@ template<class Arc> void TestDeterminizeLatticePruned2() {
   }
 }
 
+// test that DeterminizeLatticePrunedParallel() gives the same result as
+// DeterminizeLatticePruned(), on lattices that it can split into segments
+// (we make those by concatenating random lattices).
+void TestDeterminizeLatticePrunedParallel() {
+  typedef kaldi::LatticeArc Arc;
+  typedef kaldi::CompactLatticeArc CompactArc;
+  RandFstOptions opts;
+  opts.n_states = 4;
+  opts.n_arcs = 8;
+  opts.n_final = 2;
+  opts.allow_empty = false;
+  opts.weight_multiplier = 0.5;
+  opts.acyclic = true;
+  for (int i = 0; i < 50; i++) {
+    VectorFst<Arc> fst;
+    int num_pieces = 2 + kaldi::Rand() % 3;
+    for (int j = 0; j < num_pieces; j++) {
+      VectorFst<Arc> *piece = RandPairFst<Arc>(opts);
+      if (j == 0)
+        fst = *piece;
+      else
+        Concat(&fst, *piece);
+      delete piece;
+    }
+    Connect(&fst);
+    if (fst.NumStates() == 0)
+      continue;
+    bool sorted = TopSort(&fst);
+    KALDI_ASSERT(sorted);
+    ArcSort(&fst, ILabelCompare<Arc>());
+
+    DeterminizeLatticePrunedOptions lat_opts;
+    VectorFst<CompactArc> det_fst, parallel_det_fst;
+    bool ans = DeterminizeLatticePruned<kaldi::LatticeWeight, kaldi::int32>(
+        fst, 10.0, &det_fst, lat_opts);
+    bool parallel_ans = DeterminizeLatticePrunedParallel(
+        fst, 10.0, &parallel_det_fst, lat_opts, 2, 1);
+    if (ans && parallel_ans)
+      KALDI_ASSERT(RandEquivalent(det_fst, parallel_det_fst, 5/*paths*/,
+                                  0.01/*delta*/, kaldi::Rand()/*seed*/,
+                                  100/*path length, max*/));
+  }
+}
+
 
 } // end namespace fst
 
@@ -143,5 +187,6 @@ int main() {
   using namespace fst;
   TestDeterminizeLatticePruned<kaldi::LatticeArc>();
   TestDeterminizeLatticePruned2<kaldi::LatticeArc>();
+  TestDeterminizeLatticePrunedParallel();
   std::cout << "Tests succeeded\n";
 }
@@ -21,6 +21,7 @@
 
 #include <vector>
 #include <climits>
+#include <thread>
 #include "fstext/determinize-lattice.h" // for LatticeStringRepository
 #include "fstext/fstext-utils.h"
 #include "lat/lattice-functions.h"  // for PruneLattice
@@ -1485,6 +1486,260 @@ bool DeterminizeLatticePhonePruned(
                                        beam, ofst, opts);
 }
 
+/**
+   This function, used in parallel determinization, splits the lattice 'ifst'
+   (which must be topologically sorted, with words on the input side and
+   transition-ids on the output side) into pieces, at states that all
+   successful paths pass through.  Each piece except the last ends at such a
+   state (with final-cost One()), and the next piece starts there.  The pieces
+   are chosen to be at least 'segment_length' frames long.  If the lattice
+   cannot be split, 'pieces' will be empty.
+*/
+static void SplitLatticeAtBottlenecks(
+    const ExpandedFst<kaldi::LatticeArc> &ifst,
+    int32 segment_length,
+    std::vector<kaldi::Lattice> *pieces) {
+  typedef kaldi::LatticeArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Weight Weight;
+  pieces->clear();
+  StateId num_states = ifst.NumStates();
+  if (num_states == 0 || ifst.Start() != 0 || segment_length <= 0)
+    return;
+
+  // 'times' is the number of frames before each state (-1 if the state is not
+  // reachable).  'jump_diff' is a difference array for the number of arcs that
+  // skip over each state (i.e. arcs u->v with u < s < v).
+  std::vector<int32> times(num_states, -1), jump_diff(num_states + 1, 0);
+  times[0] = 0;
+  int32 num_frames = 0;
+  StateId first_final = num_states;
+  for (StateId s = 0; s < num_states; s++) {
+    if (first_final == num_states && ifst.Final(s) != Weight::Zero())
+      first_final = s;
+    if (times[s] > num_frames)
+      num_frames = times[s];
+    for (ArcIterator<ExpandedFst<Arc> > aiter(ifst, s); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      KALDI_ASSERT(arc.nextstate > s && "Lattice is not topologically sorted");
+      if (times[s] >= 0)
+        times[arc.nextstate] = times[s] + (arc.olabel != 0 ? 1 : 0);
+      if (arc.nextstate > s + 1) {
+        jump_diff[s + 1]++;
+        jump_diff[arc.nextstate]--;
+      }
+    }
+  }
+
+  // A state s is a "bottleneck", i.e. all successful paths pass through it, if
+  // no arc skips over it and there is no final state before it.
+  std::vector<StateId> split_states(1, 0);
+  int32 num_jumps = jump_diff[0];
+  for (StateId s = 1; s <= first_final && s < num_states; s++) {
+    num_jumps += jump_diff[s];
+    if (num_jumps == 0 && times[s] >= 0 &&
+        times[s] - times[split_states.back()] >= segment_length &&
+        num_frames - times[s] >= segment_length / 2)
+      split_states.push_back(s);
+  }
+  if (split_states.size() == 1)
+    return;
+
+  size_t num_pieces = split_states.size();
+  pieces->resize(num_pieces);
+  for (size_t i = 0; i < num_pieces; i++) {
+    bool is_last = (i + 1 == num_pieces);
+    StateId begin = split_states[i],
+        last = (is_last ? num_states - 1 : split_states[i + 1]);
+    kaldi::Lattice &piece = (*pieces)[i];
+    for (StateId s = begin; s <= last; s++)
+      piece.AddState();
+    piece.SetStart(0);
+    for (StateId s = begin; s <= last; s++) {
+      if (!is_last && s == last) {
+        piece.SetFinal(s - begin, Weight::One());
+        break;
+      }
+      if (is_last)
+        piece.SetFinal(s - begin, ifst.Final(s));
+      for (ArcIterator<ExpandedFst<Arc> > aiter(ifst, s); !aiter.Done();
+           aiter.Next()) {
+        Arc arc = aiter.Value();
+        KALDI_ASSERT(arc.nextstate <= last);
+        arc.nextstate -= begin;
+        piece.AddArc(s - begin, arc);
+      }
+    }
+  }
+}
+
+/// Determinizes one of the pieces from SplitLatticeAtBottlenecks(): if
+/// 'trans_model' is non-NULL, with DeterminizeLatticePhonePruned() (without
+/// minimization), otherwise with DeterminizeLatticePruned().
+static bool DeterminizeLatticePiece(
+    const kaldi::TransitionModel *trans_model,
+    double beam,
+    const DeterminizeLatticePhonePrunedOptions &phone_opts,
+    const DeterminizeLatticePrunedOptions &opts,
+    kaldi::Lattice *piece,
+    kaldi::CompactLattice *det_piece) {
+  ArcSort(piece, ILabelCompare<kaldi::LatticeArc>());
+  bool ans;
+  if (trans_model != NULL) {
+    DeterminizeLatticePhonePrunedOptions piece_opts(phone_opts);
+    piece_opts.minimize = false;
+    ans = DeterminizeLatticePhonePruned<kaldi::LatticeWeight, kaldi::int32>(
+        *trans_model, piece, beam, det_piece, piece_opts);
+  } else {
+    ans = DeterminizeLatticePruned<kaldi::LatticeWeight, kaldi::int32>(
+        *piece, beam, det_piece, opts);
+  }
+  Connect(det_piece);
+  // Free the memory of the input as soon as possible.
+  piece->DeleteStates();
+  return ans;
+}
+
+/// Determinizes pieces thread_id, thread_id + num_threads, ... of 'pieces';
+/// this is the function run by each thread.
+static void DeterminizeLatticePiecesThread(
+    int32 thread_id, int32 num_threads,
+    const kaldi::TransitionModel *trans_model,
+    double beam,
+    const DeterminizeLatticePhonePrunedOptions *phone_opts,
+    const DeterminizeLatticePrunedOptions *opts,
+    std::vector<kaldi::Lattice> *pieces,
+    std::vector<kaldi::CompactLattice> *det_pieces,
+    std::vector<char> *piece_ok) {
+  for (size_t i = thread_id; i < pieces->size(); i += num_threads)
+    (*piece_ok)[i] = DeterminizeLatticePiece(trans_model, beam, *phone_opts,
+                                             *opts, &((*pieces)[i]),
+                                             &((*det_pieces)[i]));
+}
+
+/**
+   Determinizes the pieces from SplitLatticeAtBottlenecks() in parallel and
+   concatenates the results into 'ofst'.  If 'final_pass' is true, the
+   concatenation is determinized again at the word level (and pushed and
+   minimized if phone_opts.minimize); this removes any duplicate word
+   sequences that arise from words being assigned to different pieces on
+   different paths, and applies the beam to the whole lattice.
+*/
+static bool DeterminizeLatticePieces(
+    const kaldi::TransitionModel *trans_model,
+    double beam,
+    const DeterminizeLatticePhonePrunedOptions &phone_opts,
+    const DeterminizeLatticePrunedOptions &opts,
+    int32 num_threads,
+    bool final_pass,
+    std::vector<kaldi::Lattice> *pieces,
+    MutableFst<kaldi::CompactLatticeArc> *ofst) {
+  typedef kaldi::CompactLatticeArc CompactArc;
+  typedef CompactArc::StateId StateId;
+  size_t num_pieces = pieces->size();
+  std::vector<kaldi::CompactLattice> det_pieces(num_pieces);
+  std::vector<char> piece_ok(num_pieces, 1);
+  num_threads = std::min<int32>(num_threads, num_pieces);
+  {
+    std::vector<std::thread> threads;
+    for (int32 t = 0; t < num_threads; t++)
+      threads.push_back(std::thread(DeterminizeLatticePiecesThread, t,
+                                    num_threads, trans_model, beam,
+                                    &phone_opts, &opts, pieces, &det_pieces,
+                                    &piece_ok));
+    for (int32 t = 0; t < num_threads; t++)
+      threads[t].join();
+  }
+  bool ans = true;
+  for (size_t i = 0; i < num_pieces; i++)
+    ans = ans && piece_ok[i];
+
+  // Concatenate the pieces: the final-states of each piece get epsilon arcs,
+  // carrying the final-weight, to the start state of the next piece.
+  kaldi::CompactLattice concatenated;
+  std::vector<StateId> offsets(num_pieces + 1, 0);
+  for (size_t i = 0; i < num_pieces; i++) {
+    if (det_pieces[i].NumStates() == 0) {
+      KALDI_WARN << "Determinization of a lattice segment gave an empty "
+                 << "result.";
+      ofst->DeleteStates();
+      return false;
+    }
+    offsets[i + 1] = offsets[i] + det_pieces[i].NumStates();
+  }
+  for (StateId s = 0; s < offsets[num_pieces]; s++)
+    concatenated.AddState();
+  concatenated.SetStart(det_pieces[0].Start());
+  for (size_t i = 0; i < num_pieces; i++) {
+    const kaldi::CompactLattice &det_piece = det_pieces[i];
+    bool is_last = (i + 1 == num_pieces);
+    for (StateId s = 0; s < det_piece.NumStates(); s++) {
+      StateId new_s = offsets[i] + s;
+      for (ArcIterator<kaldi::CompactLattice> aiter(det_piece, s);
+           !aiter.Done(); aiter.Next()) {
+        CompactArc arc = aiter.Value();
+        arc.nextstate += offsets[i];
+        concatenated.AddArc(new_s, arc);
+      }
+      CompactArc::Weight final_weight = det_piece.Final(s);
+      if (final_weight == CompactArc::Weight::Zero())
+        continue;
+      if (is_last)
+        concatenated.SetFinal(new_s, final_weight);
+      else
+        concatenated.AddArc(new_s, CompactArc(0, 0, final_weight,
+                                              offsets[i + 1] +
+                                              det_pieces[i + 1].Start()));
+    }
+    det_pieces[i].DeleteStates();
+  }
+
+  if (!final_pass) {
+    *ofst = concatenated;
+    return ans;
+  }
+  kaldi::Lattice lat;
+  // invert == false: the words go on the input side, as the determinization
+  // code expects.
+  ConvertLattice(concatenated, &lat, false);
+  concatenated.DeleteStates();
+  TopSort(&lat);
+  ArcSort(&lat, ILabelCompare<kaldi::LatticeArc>());
+  ans = DeterminizeLatticePruned<kaldi::LatticeWeight, kaldi::int32>(
+      lat, beam, ofst, opts) && ans;
+  if (phone_opts.minimize) {
+    ans = PushCompactLatticeStrings<kaldi::LatticeWeight, kaldi::int32>(ofst) &&
+        ans;
+    ans = PushCompactLatticeWeights<kaldi::LatticeWeight, kaldi::int32>(ofst) &&
+        ans;
+    ans = MinimizeCompactLattice<kaldi::LatticeWeight, kaldi::int32>(ofst) &&
+        ans;
+  }
+  return ans;
+}
+
+bool DeterminizeLatticePrunedParallel(
+    const ExpandedFst<kaldi::LatticeArc> &ifst,
+    double beam,
+    MutableFst<kaldi::CompactLatticeArc> *ofst,
+    DeterminizeLatticePrunedOptions opts,
+    int num_threads,
+    int segment_length) {
+  std::vector<kaldi::Lattice> pieces;
+  if (num_threads > 1)
+    SplitLatticeAtBottlenecks(ifst, segment_length, &pieces);
+  if (pieces.empty())
+    return DeterminizeLatticePruned<kaldi::LatticeWeight, kaldi::int32>(
+        ifst, beam, ofst, opts);
+  KALDI_VLOG(2) << "Determinizing lattice in " << pieces.size()
+                << " segments.";
+  DeterminizeLatticePhonePrunedOptions phone_opts;  // not used.
+  phone_opts.minimize = false;
+  return DeterminizeLatticePieces(NULL, beam, phone_opts, opts, num_threads,
+                                  true, &pieces, ofst);
+}
+
 bool DeterminizeLatticePhonePrunedWrapper(
     const kaldi::TransitionModel &trans_model,
     MutableFst<kaldi::LatticeArc> *ifst,
@@ -1501,6 +1756,24 @@ bool DeterminizeLatticePhonePrunedWrapper(
                 << ").";
     }
   }
+  if (opts.num_threads > 1 &&
+      (opts.phone_determinize || opts.word_determinize)) {
+    std::vector<kaldi::Lattice> pieces;
+    SplitLatticeAtBottlenecks(*ifst, opts.segment_length, &pieces);
+    if (!pieces.empty()) {
+      KALDI_VLOG(2) << "Determinizing lattice in " << pieces.size()
+                    << " segments.";
+      ifst->DeleteStates();  // The pieces have a copy.
+      DeterminizeLatticePrunedOptions det_opts;
+      det_opts.delta = opts.delta;
+      det_opts.max_mem = opts.max_mem;
+      ans = DeterminizeLatticePieces(&trans_model, beam, opts, det_opts,
+                                     opts.num_threads, opts.word_determinize,
+                                     &pieces, ofst);
+      Connect(ofst);
+      return ans;
+    }
+  }
   ILabelCompare<kaldi::LatticeArc> ilabel_comp;
   ArcSort(ifst, ilabel_comp);
   ans = DeterminizeLatticePhonePruned<kaldi::LatticeWeight, kaldi::int32>(
@@ -155,11 +155,19 @@ struct DeterminizeLatticePhonePrunedOptions {
   bool word_determinize;
   // minimize: if true, push and minimize after determinization.
   bool minimize;
+  // num_threads: if > 1, DeterminizeLatticePhonePrunedWrapper() splits long
+  // lattices into segments and determinizes them in parallel; see
+  // DeterminizeLatticePrunedParallel().
+  int num_threads;
+  // segment_length: the approximate length in frames of those segments.
+  int segment_length;
   DeterminizeLatticePhonePrunedOptions(): delta(kDelta),
                                           max_mem(50000000),
                                           phone_determinize(true),
                                           word_determinize(true),
-                                          minimize(false) {}
+                                          minimize(false),
+                                          num_threads(1),
+                                          segment_length(3000) {}
   void Register (kaldi::OptionsItf *opts) {
     opts->Register("delta", &delta, "Tolerance used in determinization");
     opts->Register("max-mem", &max_mem, "Maximum approximate memory usage in "
@@ -172,6 +180,13 @@ struct DeterminizeLatticePhonePrunedOptions {
                    "--phone-determinize)");
     opts->Register("minimize", &minimize, "If true, push and minimize after "
                    "determinization.");
+    opts->Register("determinize-num-threads", &num_threads, "If >1, split "
+                   "long lattices into segments (see "
+                   "--determinize-segment-length) and determinize them using "
+                   "this many threads.");
+    opts->Register("determinize-segment-length", &segment_length,
+                   "Approximate length in frames of the segments that long "
+                   "lattices are split into, if --determinize-num-threads > 1.");
   }
 };
 
@@ -280,6 +295,8 @@ bool DeterminizeLatticePhonePruned(
     output side.
     This function can be used as the top-level interface to all the determinization
     code.
+    If opts.num_threads > 1, long lattices are split into segments that are
+    determinized in parallel; see DeterminizeLatticePrunedParallel().
 */
 bool DeterminizeLatticePhonePrunedWrapper(
     const kaldi::TransitionModel &trans_model,
@@ -289,6 +306,35 @@ bool DeterminizeLatticePhonePrunedWrapper(
     DeterminizeLatticePhonePrunedOptions opts
       = DeterminizeLatticePhonePrunedOptions());
 
+/**
+   This is a version of DeterminizeLatticePruned() (the version that outputs
+   CompactLattice) for very long lattices, e.g. from recordings of an hour or
+   more decoded in one pass, that uses multiple threads.  The requirements on
+   'ifst' are the same: words on the input side, and topologically sorted.
+
+   We split the lattice in time at states that all successful paths pass
+   through (these occur where the lattice has collapsed to a single
+   hypothesis, typically in silence), choosing them so that the segments are
+   at least 'segment_length' frames long.  The segments are determinized in
+   parallel using 'num_threads' threads, with the same beam; since the best
+   path through the whole lattice is the concatenation of the best paths
+   through the segments, this keeps everything that the beam would keep for
+   the whole lattice.  The determinized segments are concatenated and
+   determinized once more, which is cheap because the input is then small
+   and almost deterministic; this deals with word sequences that can be split
+   between segments in more than one way, and applies the beam exactly.
+
+   If the lattice cannot be split, this just calls DeterminizeLatticePruned().
+   Returns the same as DeterminizeLatticePruned().
+*/
+bool DeterminizeLatticePrunedParallel(
+    const ExpandedFst<kaldi::LatticeArc> &ifst,
+    double prune,
+    MutableFst<kaldi::CompactLatticeArc> *ofst,
+    DeterminizeLatticePrunedOptions opts,
+    int num_threads,
+    int segment_length);
+
 /// @} end "addtogroup fst_extensions"
 
 } // end namespace fst
@@ -36,11 +36,14 @@ class DeterminizeLatticeTask {
       BaseFloat acoustic_scale,
       BaseFloat beam,
       bool minimize,
+      int32 num_threads,
+      int32 segment_length,
       Lattice *lat,
       CompactLatticeWriter *clat_writer,
       int32 *num_warn):
       opts_(opts), key_(key), acoustic_scale_(acoustic_scale), beam_(beam),
-      minimize_(minimize), lat_(lat), clat_writer_(clat_writer),
+      minimize_(minimize), num_threads_(num_threads),
+      segment_length_(segment_length), lat_(lat), clat_writer_(clat_writer),
       num_warn_(num_warn) { }
 
   void operator () () {
@@ -55,7 +58,8 @@ class DeterminizeLatticeTask {
       (*num_warn_)++;
     }
     fst::ArcSort(lat_, fst::ILabelCompare<LatticeArc>());
-    if (!DeterminizeLatticePruned(*lat_, beam_, &det_clat_, opts_)) {
+    if (!DeterminizeLatticePrunedParallel(*lat_, beam_, &det_clat_, opts_,
+                                          num_threads_, segment_length_)) {
       KALDI_WARN << "For key " << key_ << ", determinization did not succeed"
           "(partial output will be pruned tighter than the specified beam.)";
       (*num_warn_)++;
@@ -83,6 +87,8 @@ class DeterminizeLatticeTask {
   BaseFloat acoustic_scale_;
   BaseFloat beam_;
   bool minimize_;
+  int32 num_threads_;  // for determinizing segments of a lattice in parallel.
+  int32 segment_length_;
   Lattice *lat_; // The lattice we're working on.  Owned locally.
   CompactLattice det_clat_; // The output of our process.  Will be written
   // to clat_writer_ in the destructor.
@@ -104,6 +110,8 @@ int main(int argc, char *argv[]) {
         "for each input-symbol sequence.  This is a version of lattice-determnize-pruned\n"
         "that accepts the --num-threads option.  These programs do pruning as part of the\n"
         "determinization algorithm, which is more efficient and prevents blowup.\n"
+        "With --segment-length, long lattices (e.g. from recordings of an hour or\n"
+        "more) are also split in time and the pieces determinized in parallel.\n"
         "See http://kaldi-asr.org/doc/lattices.html for more information on lattices.\n"
         "\n"
         "Usage: lattice-determinize-pruned-parallel [options] lattice-rspecifier lattice-wspecifier\n"
@@ -113,6 +121,7 @@ int main(int argc, char *argv[]) {
     BaseFloat acoustic_scale = 1.0;
     BaseFloat beam = 10.0;
     bool minimize = false;
+    int32 segment_length = 0;
     TaskSequencerConfig sequencer_config; // has --num-threads option
     fst::DeterminizeLatticePrunedOptions determinize_config; // Options used in DeterminizeLatticePruned--
     // this options class does not have its own Register function as it's viewed as
@@ -125,6 +134,11 @@ int main(int argc, char *argv[]) {
     po.Register("beam", &beam, "Pruning beam [applied after acoustic scaling].");
     po.Register("minimize", &minimize,
                 "If true, push and minimize after determinization");
+    po.Register("segment-length", &segment_length, "If >0, split lattices "
+                "into segments of about this many frames, at points where "
+                "the lattice has a single state, and determinize them in "
+                "parallel using --num-threads threads.  For very long "
+                "lattices.");
     determinize_config.Register(&po);
     sequencer_config.Register(&po);
     po.Read(argc, argv);
@@ -161,7 +175,8 @@ int main(int argc, char *argv[]) {
 
       DeterminizeLatticeTask *task = new DeterminizeLatticeTask(
           determinize_config, key, acoustic_scale, beam, minimize,
-          lat, &compact_lat_writer, &n_warn);
+          (segment_length > 0 ? sequencer_config.num_threads : 1),
+          segment_length, lat, &compact_lat_writer, &n_warn);
       sequencer.Run(task);
       n_done++;
     }
@@ -59,6 +59,7 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     rnnlm::RnnlmComputeStateComputationOptions opts;
+    rnnlm::RnnlmStateCacheOptions cache_opts;
     ComposeLatticePrunedOptions compose_opts;
 
     int32 max_ngram_order = 3;
@@ -79,6 +80,7 @@ int main(int argc, char *argv[]) {
                 "as a const-arpa file as opposed to an FST file");
 
     opts.Register(&po);
+    cache_opts.Register(&po);
     compose_opts.Register(&po);
 
     po.Read(argc, argv);
@@ -144,8 +146,14 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_err = 0;
 
-    rnnlm::KaldiRnnlmDeterministicFst* lm_to_add_orig = 
-         new rnnlm::KaldiRnnlmDeterministicFst(max_ngram_order, info);
+    // The state cache, if used, persists across lattices.
+    rnnlm::RnnlmStateCache *state_cache = NULL;
+    if (cache_opts.cache_size > 0)
+      state_cache = new rnnlm::RnnlmStateCache(cache_opts);
+
+    rnnlm::KaldiRnnlmDeterministicFst* lm_to_add_orig =
+         new rnnlm::KaldiRnnlmDeterministicFst(max_ngram_order, info,
+                                               state_cache);
 
     for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
       fst::DeterministicOnDemandFst<StdArc> *lm_to_add =
@@ -193,6 +201,10 @@ int main(int argc, char *argv[]) {
 
     delete lm_to_subtract_fst;
     delete lm_to_add_orig;
+    if (state_cache != NULL) {
+      state_cache->PrintStats();
+      delete state_cache;
+    }
     delete lm_to_subtract_det_backoff;
     delete lm_to_subtract_det_scale;
 
@@ -49,6 +49,7 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     rnnlm::RnnlmComputeStateComputationOptions opts;
+    rnnlm::RnnlmStateCacheOptions cache_opts;
 
     int32 max_ngram_order = 3;
     BaseFloat lm_scale = 1.0;
@@ -60,6 +61,7 @@ int main(int argc, char *argv[]) {
         "with each other for rescoring purposes (an approximation that "
         "saves time and reduces output lattice size).");
     opts.Register(&po);
+    cache_opts.Register(&po);
 
     po.Read(argc, argv);
 
@@ -93,7 +95,13 @@ int main(int argc, char *argv[]) {
 
     int32 n_done = 0, n_fail = 0;
 
-    rnnlm::KaldiRnnlmDeterministicFst rnnlm_fst(max_ngram_order, info);
+    // The state cache, if used, persists across lattices.
+    rnnlm::RnnlmStateCache *state_cache = NULL;
+    if (cache_opts.cache_size > 0)
+      state_cache = new rnnlm::RnnlmStateCache(cache_opts);
+
+    rnnlm::KaldiRnnlmDeterministicFst rnnlm_fst(max_ngram_order, info,
+                                                state_cache);
 
     for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
       std::string key = compact_lattice_reader.Key();
@@ -138,6 +146,10 @@ int main(int argc, char *argv[]) {
       rnnlm_fst.Clear();
     }
 
+    if (state_cache != NULL) {
+      state_cache->PrintStats();
+      delete state_cache;
+    }
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
     return (n_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
@@ -28,6 +28,7 @@
 #include "matrix/jama-eig.h"
 #include "matrix/compressed-matrix.h"
 #include "matrix/sparse-matrix.h"
+#include "matrix/simd-math.h"
 
 static_assert(int(kaldi::kNoTrans) == int(CblasNoTrans) && int(kaldi::kTrans) == int(CblasTrans), 
     "kaldi::kNoTrans and kaldi::kTrans must be equal to the appropriate CBLAS library constants!");
@@ -2118,10 +2119,8 @@ void MatrixBase<Real>::Exp(const MatrixBase<Real> &src) {
   Real *row_data = data_;
   const Real *src_row_data = src.Data();
   for (MatrixIndexT row = 0; row < num_rows;
-       row++,row_data += stride_, src_row_data += src.stride_) {
-    for (MatrixIndexT col = 0; col < num_cols; col++)
-      row_data[col] = kaldi::Exp(src_row_data[col]);
-  }
+       row++,row_data += stride_, src_row_data += src.stride_)
+    VecExp(num_cols, src_row_data, row_data);
 }
 
 template<typename Real>
@@ -2189,10 +2188,8 @@ void MatrixBase<Real>::Log(const MatrixBase<Real> &src) {
   Real *row_data = data_;
   const Real *src_row_data = src.Data();
   for (MatrixIndexT row = 0; row < num_rows;
-       row++,row_data += stride_, src_row_data += src.stride_) {
-    for (MatrixIndexT col = 0; col < num_cols; col++)
-      row_data[col] = kaldi::Log(src_row_data[col]);
-  }
+       row++,row_data += stride_, src_row_data += src.stride_)
+    VecLog(num_cols, src_row_data, row_data);
 }
 
 template<typename Real>
@@ -2749,11 +2746,12 @@ Real MatrixBase<Real>::LogSumExp(Real prune) const {
 
 template<typename Real>
 Real MatrixBase<Real>::ApplySoftMax() {
-  Real max = this->Max(), sum = 0.0;
+  Real max = this->Max();
   // the 'max' helps to get in good numeric range.
+  this->Add(-max);
   for (MatrixIndexT i = 0; i < num_rows_; i++)
-    for (MatrixIndexT j = 0; j < num_cols_; j++)
-      sum += ((*this)(i, j) = kaldi::Exp((*this)(i, j) - max));
+    VecExp(num_cols_, RowData(i), RowData(i));
+  Real sum = this->Sum();
   this->Scale(1.0 / sum);
   return max + kaldi::Log(sum);
 }
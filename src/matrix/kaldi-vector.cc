@@ -28,6 +28,7 @@
 #include "matrix/cblas-wrappers.h"
 #include "matrix/kaldi-vector.h"
 #include "matrix/kaldi-matrix.h"
+#include "matrix/simd-math.h"
 #include "matrix/sp-matrix.h"
 #include "matrix/sparse-matrix.h"
 
@@ -784,23 +785,19 @@ void VectorBase<Real>::ApplyLog() {
   for (MatrixIndexT i = 0; i < dim_; i++) {
     if (data_[i] < 0.0)
       KALDI_ERR << "Trying to take log of a negative number.";
-    data_[i] = Log(data_[i]);
   }
+  VecLog(dim_, data_, data_);
 }
 
 template<typename Real>
 void VectorBase<Real>::ApplyLogAndCopy(const VectorBase<Real> &v) {
   KALDI_ASSERT(dim_ == v.Dim());
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    data_[i] = Log(v(i));
-  }
+  VecLog(dim_, v.data_, data_);
 }
 
 template<typename Real>
 void VectorBase<Real>::ApplyExp() {
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    data_[i] = Exp(data_[i]);
-  }
+  VecExp(dim_, data_, data_);
 }
 
 template<typename Real>
@@ -865,10 +862,10 @@ MatrixIndexT VectorBase<Real>::ApplyFloor(const VectorBase<Real> &floor_vec) {
 
 template<typename Real>
 Real VectorBase<Real>::ApplySoftMax() {
-  Real max = this->Max(), sum = 0.0;
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    sum += (data_[i] = Exp(data_[i] - max));
-  }
+  Real max = this->Max();
+  this->Add(-max);
+  VecExp(dim_, data_, data_);
+  Real sum = this->Sum();
   this->Scale(1.0 / sum);
   return max + Log(sum);
 }
@@ -876,8 +873,15 @@ Real VectorBase<Real>::ApplySoftMax() {
 template<typename Real>
 Real VectorBase<Real>::ApplyLogSoftMax() {
   Real max = this->Max(), sum = 0.0;
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    sum += Exp((data_[i] -= max));
+  this->Add(-max);
+  // Compute the exponentials in blocks, so we don't need to allocate memory.
+  const MatrixIndexT kBlockSize = 256;
+  Real buf[kBlockSize];
+  for (MatrixIndexT i = 0; i < dim_; i += kBlockSize) {
+    MatrixIndexT n = std::min(kBlockSize, dim_ - i);
+    VecExp(n, data_ + i, buf);
+    for (MatrixIndexT j = 0; j < n; j++)
+      sum += buf[j];
   }
   sum = Log(sum);
   this->Add(-1.0 * sum);
@@ -899,17 +903,7 @@ void VectorBase<double>::Tanh(const VectorBase<double> &src) {
 template<typename Real>
 void VectorBase<Real>::Tanh(const VectorBase<Real> &src) {
   KALDI_ASSERT(dim_ == src.dim_);
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    Real x = src.data_[i];
-    if (x > 0.0) {
-      Real inv_expx = Exp(-x);
-      x = -1.0 + 2.0 / (1.0 + inv_expx * inv_expx);
-    } else {
-      Real expx = Exp(x);
-      x = 1.0 - 2.0 / (1.0 + expx * expx);
-    }
-    data_[i] = x;
-  }
+  VecTanh(dim_, src.data_, data_);
 }
 #endif
 
@@ -937,17 +931,7 @@ void VectorBase<double>::Sigmoid(const VectorBase<double> &src) {
 template<typename Real>
 void VectorBase<Real>::Sigmoid(const VectorBase<Real> &src) {
   KALDI_ASSERT(dim_ == src.dim_);
-  for (MatrixIndexT i = 0; i < dim_; i++) {
-    Real x = src.data_[i];
-    // We aim to avoid floating-point overflow here.
-    if (x > 0.0) {
-      x = 1.0 / (1.0 + Exp(-x));
-    } else {
-      Real ex = Exp(x);
-      x = ex / (ex + 1.0);
-    }
-    data_[i] = x;
-  }
+  VecSigmoid(dim_, src.data_, data_);
 }
 #endif
 
@@ -0,0 +1,124 @@
+// matrix/simd-math-avx2.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// This file contains the AVX2 versions of the functions in simd-math.h.  It is
+// compiled with the normal compiler flags, but with the code below targeted at
+// AVX2 and FMA, so the rest of Kaldi still runs on machines without them;
+// simd-math.cc only calls these functions if the CPU supports AVX2 and FMA.
+
+#include "matrix/simd-math.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+  (defined(__GNUC__) || defined(__clang__))
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), \
+                              apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+#include <immintrin.h>
+
+#include "matrix/simd-math-inl.h"
+
+namespace kaldi {
+namespace simd_math {
+
+struct Avx2Ops {
+  typedef __m256 V;
+  typedef __m256 M;
+  static const int32 kWidth = 8;
+  static inline V Load(const float *p) { return _mm256_loadu_ps(p); }
+  static inline void Store(float *p, V v) { _mm256_storeu_ps(p, v); }
+  static inline V Set1(float f) { return _mm256_set1_ps(f); }
+  static inline V Add(V a, V b) { return _mm256_add_ps(a, b); }
+  static inline V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+  static inline V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+  static inline V Div(V a, V b) { return _mm256_div_ps(a, b); }
+  static inline V MulAdd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+  static inline V Min(V a, V b) { return _mm256_min_ps(a, b); }
+  static inline V Max(V a, V b) { return _mm256_max_ps(a, b); }
+  static inline V Abs(V a) {
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+  }
+  static inline V Floor(V a) { return _mm256_floor_ps(a); }
+  static inline V Pow2(V n) {
+    return _mm256_castsi256_ps(_mm256_slli_epi32(
+        _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23));
+  }
+  static inline V Frexp(V a, V *e) {
+    __m256i bits = _mm256_castps_si256(a);
+    *e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23),
+                                             _mm256_set1_epi32(126)));
+    return _mm256_or_ps(_mm256_and_ps(a, _mm256_castsi256_ps(
+        _mm256_set1_epi32(0x807fffff))), _mm256_set1_ps(0.5f));
+  }
+  static inline M Less(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static inline M Greater(V a, V b) {
+    return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+  }
+  static inline M Equal(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+  static inline M IsNan(V a) { return _mm256_cmp_ps(a, a, _CMP_UNORD_Q); }
+  static inline M Or(M a, M b) { return _mm256_or_ps(a, b); }
+  static inline V Select(M m, V a, V b) { return _mm256_blendv_ps(b, a, m); }
+};
+
+void ExpAvx2(MatrixIndexT dim, const float *src, float *dest) {
+  ApplyToArray<Avx2Ops, ExpFunction>(dim, src, dest);
+}
+
+void LogAvx2(MatrixIndexT dim, const float *src, float *dest) {
+  ApplyToArray<Avx2Ops, LogFunction>(dim, src, dest);
+}
+
+void SigmoidAvx2(MatrixIndexT dim, const float *src, float *dest) {
+  ApplyToArray<Avx2Ops, SigmoidFunction>(dim, src, dest);
+}
+
+void TanhAvx2(MatrixIndexT dim, const float *src, float *dest) {
+  ApplyToArray<Avx2Ops, TanhFunction>(dim, src, dest);
+}
+
+int32 BlockSparseBlockAvx2(MatrixIndexT num_rows, int32 num_cols,
+                           int32 num_indexes, const int32 *indexes,
+                           const float *weights, MatrixIndexT weights_stride,
+                           const float *src, MatrixIndexT src_stride,
+                           float *dest, MatrixIndexT dest_stride) {
+  return BlockSparseBlock<Avx2Ops>(num_rows, num_cols, num_indexes, indexes,
+                                   weights, weights_stride, src, src_stride,
+                                   dest, dest_stride);
+}
+
+int32 ColumnOpsRowsAvx2(MatrixIndexT num_rows, int32 num_cols, int32 num_ops,
+                        const ColumnOp<float> *ops, float *data,
+                        MatrixIndexT stride) {
+  return ColumnOpsRows<Avx2Ops>(num_rows, num_cols, num_ops, ops, data,
+                                stride);
+}
+
+}  // namespace simd_math
+}  // namespace kaldi
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif  // x86 with GCC or clang
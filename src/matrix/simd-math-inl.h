@@ -0,0 +1,350 @@
+// matrix/simd-math-inl.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_SIMD_MATH_INL_H_
+#define KALDI_MATRIX_SIMD_MATH_INL_H_
+
+// This header is only to be included by simd-math.cc and simd-math-avx2.cc.
+// It contains the implementations of the functions declared in simd-math.h,
+// written once in terms of a class 'Ops' that wraps the SIMD instructions;
+// simd-math-avx2.cc includes it in a region compiled for AVX2, so that it can
+// be used on machines without AVX2 (we choose the version at runtime).
+//
+// 'Ops' must define:
+//   typedef ... V;      // a vector of kWidth floats
+//   typedef ... M;      // a mask, the result of comparing two V's
+//   static const int32 kWidth;
+//   static V Load(const float *p);  static void Store(float *p, V v);
+//   static V Set1(float f);
+//   static V Add(V a, V b), Sub(V a, V b), Mul(V a, V b), Div(V a, V b);
+//   static V MulAdd(V a, V b, V c);  // a * b + c
+//   static V Min(V a, V b), Max(V a, V b), Abs(V a);
+//   static V Floor(V a);  // only needs to work for |a| < 2^31
+//   static V Pow2(V n);   // 2^n, for integer n with -126 <= n <= 127
+//   static V Frexp(V a, V *e);  // like frexp(), for positive normal a
+//   static M Less(V a, V b), Greater(V a, V b), Equal(V a, V b), IsNan(V a);
+//   static M Or(M a, M b);
+//   static V Select(M m, V a, V b);  // a where m is true, else b.
+// See Sse2Ops in simd-math.cc for an example.
+//
+// It also contains the SIMD parts of AddMatBlockSparse() and
+// ApplyColumnOps(), which only need Load(), Store(), Set1(), Add(), Mul(),
+// MulAdd() and Max().
+
+#include <algorithm>
+#include <limits>
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-common.h"
+#include "matrix/simd-math.h"
+
+namespace kaldi {
+namespace simd_math {
+
+// Returns exp(x), using the method of Cephes' expf(): we write
+// x = n log(2) + r, with integer n and |r| <= log(2) / 2, and
+// exp(x) = 2^n exp(r), with exp(r) approximated by a polynomial.
+template<class Ops>
+inline typename Ops::V Exp(typename Ops::V x) {
+  typedef typename Ops::V V;
+  typedef typename Ops::M M;
+  // exp(x) overflows above kMaxInput and underflows to zero (even as a
+  // denormal) below kMinInput.
+  const float kMaxInput = 88.72283935546875f, kMinInput = -103.972084045410f;
+  M is_nan = Ops::IsNan(x),
+      too_big = Ops::Greater(x, Ops::Set1(kMaxInput)),
+      too_small = Ops::Less(x, Ops::Set1(kMinInput));
+  V x_clamped = Ops::Min(Ops::Max(x, Ops::Set1(kMinInput)),
+                         Ops::Set1(kMaxInput));
+  V n = Ops::Floor(Ops::MulAdd(x_clamped, Ops::Set1(1.44269504088896341f),
+                               Ops::Set1(0.5f)));
+  // r = x - n log(2), with log(2) split into two parts for accuracy.
+  V r = Ops::MulAdd(n, Ops::Set1(-0.693359375f), x_clamped);
+  r = Ops::MulAdd(n, Ops::Set1(2.12194440e-4f), r);
+  V r2 = Ops::Mul(r, r),
+      y = Ops::Set1(1.9875691500e-4f);
+  y = Ops::MulAdd(y, r, Ops::Set1(1.3981999507e-3f));
+  y = Ops::MulAdd(y, r, Ops::Set1(8.3334519073e-3f));
+  y = Ops::MulAdd(y, r, Ops::Set1(4.1665795894e-2f));
+  y = Ops::MulAdd(y, r, Ops::Set1(1.6666665459e-1f));
+  y = Ops::MulAdd(y, r, Ops::Set1(5.0000001201e-1f));
+  y = Ops::Add(Ops::MulAdd(y, r2, r), Ops::Set1(1.0f));
+  // Multiply by 2^n in two steps, as n may be -150 to 128, which is outside
+  // the range of exponents of normal floats; this way denormal results are
+  // correctly rounded.
+  V n1 = Ops::Floor(Ops::Mul(n, Ops::Set1(0.5f))),
+      n2 = Ops::Sub(n, n1);
+  y = Ops::Mul(Ops::Mul(y, Ops::Pow2(n1)), Ops::Pow2(n2));
+  y = Ops::Select(too_small, Ops::Set1(0.0f), y);
+  y = Ops::Select(too_big,
+                  Ops::Set1(std::numeric_limits<float>::infinity()), y);
+  return Ops::Select(is_nan, x, y);
+}
+
+// Returns log(x), using the method of Cephes' logf(): we write x = m 2^e,
+// with sqrt(0.5) <= m < sqrt(2), and log(x) = e log(2) + log(m), with
+// log(m) approximated by a polynomial in m - 1.
+template<class Ops>
+inline typename Ops::V Log(typename Ops::V x) {
+  typedef typename Ops::V V;
+  typedef typename Ops::M M;
+  V zero = Ops::Set1(0.0f), one = Ops::Set1(1.0f);
+  M is_invalid = Ops::Or(Ops::Less(x, zero), Ops::IsNan(x)),
+      is_zero = Ops::Equal(x, zero),
+      is_inf = Ops::Equal(x, Ops::Set1(std::numeric_limits<float>::infinity()));
+  // Scale denormals up by 2^23 so that Frexp() can handle them.
+  M is_denormal = Ops::Less(x, Ops::Set1(std::numeric_limits<float>::min()));
+  x = Ops::Select(is_denormal, Ops::Mul(x, Ops::Set1(8388608.0f)), x);
+  V e, m = Ops::Frexp(x, &e);  // now m is in [0.5, 1).
+  e = Ops::Select(is_denormal, Ops::Sub(e, Ops::Set1(23.0f)), e);
+  M m_small = Ops::Less(m, Ops::Set1(0.707106781186547524f));
+  e = Ops::Select(m_small, Ops::Sub(e, one), e);
+  V t = Ops::Sub(Ops::Select(m_small, Ops::Add(m, m), m), one),
+      t2 = Ops::Mul(t, t),
+      y = Ops::Set1(7.0376836292e-2f);
+  y = Ops::MulAdd(y, t, Ops::Set1(-1.1514610310e-1f));
+  y = Ops::MulAdd(y, t, Ops::Set1(1.1676998740e-1f));
+  y = Ops::MulAdd(y, t, Ops::Set1(-1.2420140846e-1f));
+  y = Ops::MulAdd(y, t, Ops::Set1(1.4249322787e-1f));
+  y = Ops::MulAdd(y, t, Ops::Set1(-1.6668057665e-1f));
+  y = Ops::MulAdd(y, t, Ops::Set1(2.0000714765e-1f));
+  y = Ops::MulAdd(y, t, Ops::Set1(-2.4999993993e-1f));
+  y = Ops::MulAdd(y, t, Ops::Set1(3.3333331174e-1f));
+  y = Ops::Mul(Ops::Mul(y, t), t2);
+  y = Ops::MulAdd(e, Ops::Set1(-2.12194440e-4f), y);
+  y = Ops::MulAdd(t2, Ops::Set1(-0.5f), y);
+  y = Ops::Add(t, y);
+  y = Ops::MulAdd(e, Ops::Set1(0.693359375f), y);
+  y = Ops::Select(is_inf, x, y);
+  y = Ops::Select(is_zero,
+                  Ops::Set1(-std::numeric_limits<float>::infinity()), y);
+  return Ops::Select(is_invalid,
+                     Ops::Set1(std::numeric_limits<float>::quiet_NaN()), y);
+}
+
+template<class Ops>
+inline typename Ops::V Sigmoid(typename Ops::V x) {
+  typename Ops::V one = Ops::Set1(1.0f);
+  return Ops::Div(one, Ops::Add(one, Exp<Ops>(Ops::Sub(Ops::Set1(0.0f), x))));
+}
+
+// For |x| < 0.625 we use the polynomial from Cephes' tanhf(), which is
+// accurate near zero; otherwise tanh(|x|) = 1 - 2 / (exp(2|x|) + 1).
+template<class Ops>
+inline typename Ops::V Tanh(typename Ops::V x) {
+  typedef typename Ops::V V;
+  typedef typename Ops::M M;
+  V zero = Ops::Set1(0.0f), one = Ops::Set1(1.0f), abs_x = Ops::Abs(x);
+  M is_small = Ops::Less(abs_x, Ops::Set1(0.625f));
+  V z = Ops::Mul(x, x),
+      p = Ops::Set1(-5.70498872745e-3f);
+  p = Ops::MulAdd(p, z, Ops::Set1(2.06390887954e-2f));
+  p = Ops::MulAdd(p, z, Ops::Set1(-5.37397155531e-2f));
+  p = Ops::MulAdd(p, z, Ops::Set1(1.33314422036e-1f));
+  p = Ops::MulAdd(p, z, Ops::Set1(-3.33332819422e-1f));
+  V small_ans = Ops::MulAdd(Ops::Mul(p, z), x, x);
+  V e = Exp<Ops>(Ops::Add(abs_x, abs_x)),
+      large_ans = Ops::Sub(one, Ops::Div(Ops::Set1(2.0f), Ops::Add(e, one)));
+  large_ans = Ops::Select(Ops::Less(x, zero), Ops::Sub(zero, large_ans),
+                          large_ans);
+  return Ops::Select(is_small, small_ans, large_ans);
+}
+
+// These wrap the functions above so they can be passed as template arguments
+// to ApplyToArray().
+struct ExpFunction {
+  template<class Ops> static inline typename Ops::V Apply(
+      typename Ops::V x) { return Exp<Ops>(x); }
+};
+struct LogFunction {
+  template<class Ops> static inline typename Ops::V Apply(
+      typename Ops::V x) { return Log<Ops>(x); }
+};
+struct SigmoidFunction {
+  template<class Ops> static inline typename Ops::V Apply(
+      typename Ops::V x) { return Sigmoid<Ops>(x); }
+};
+struct TanhFunction {
+  template<class Ops> static inline typename Ops::V Apply(
+      typename Ops::V x) { return Tanh<Ops>(x); }
+};
+
+// Sets dest[i] = F(src[i]) for 0 <= i < dim; any leftover elements that do
+// not fill a whole vector are done via a padded temporary.
+template<class Ops, class F>
+void ApplyToArray(MatrixIndexT dim, const float *src, float *dest) {
+  const int32 width = Ops::kWidth;
+  MatrixIndexT i = 0;
+  for (; i + width <= dim; i += width)
+    Ops::Store(dest + i, F::template Apply<Ops>(Ops::Load(src + i)));
+  if (i < dim) {
+    float buf[width];
+    int32 n = dim - i, j;
+    for (j = 0; j < n; j++) buf[j] = src[i + j];
+    for (; j < width; j++) buf[j] = 0.0f;
+    Ops::Store(buf, F::template Apply<Ops>(Ops::Load(buf)));
+    for (j = 0; j < n; j++) dest[i + j] = buf[j];
+  }
+}
+
+// This makes the compiler fully unroll the loops over the (compile-time
+// constant) tile dimensions below, so that the accumulators are kept in
+// registers; without it, GCC does not do this at -O1 or -O2.
+#if defined(__clang__)
+#define KALDI_SIMD_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define KALDI_SIMD_UNROLL _Pragma("GCC unroll 8")
+#else
+#define KALDI_SIMD_UNROLL
+#endif
+
+// Does, for 0 <= n < F and 0 <= i < NV * Ops::kWidth,
+//   dest[n * dest_stride + i] += sum_k src[n * src_stride + indexes[k]]
+//                                      * weights[k * weights_stride + i]
+// with the sum over 0 <= k < num_indexes.  For each k we load NV vectors of
+// weights and broadcast F elements of src, so the F * NV accumulators (plus
+// those) need to fit in the 16 vector registers.
+template<class Ops, int32 F, int32 NV>
+inline void BlockSparseTile(int32 num_indexes, const int32 *indexes,
+                            const float *weights, MatrixIndexT weights_stride,
+                            const float *src, MatrixIndexT src_stride,
+                            float *dest, MatrixIndexT dest_stride) {
+  typedef typename Ops::V V;
+  const int32 width = Ops::kWidth;
+  V acc[F][NV];
+  KALDI_SIMD_UNROLL
+  for (int32 n = 0; n < F; n++) {
+    KALDI_SIMD_UNROLL
+    for (int32 v = 0; v < NV; v++)
+      acc[n][v] = Ops::Load(dest + n * dest_stride + v * width);
+  }
+  for (int32 k = 0; k < num_indexes; k++) {
+    const float *this_weights = weights + k * weights_stride,
+        *this_src = src + indexes[k];
+    V w[NV];
+    KALDI_SIMD_UNROLL
+    for (int32 v = 0; v < NV; v++)
+      w[v] = Ops::Load(this_weights + v * width);
+    KALDI_SIMD_UNROLL
+    for (int32 n = 0; n < F; n++) {
+      V x = Ops::Set1(this_src[n * src_stride]);
+      KALDI_SIMD_UNROLL
+      for (int32 v = 0; v < NV; v++)
+        acc[n][v] = Ops::MulAdd(x, w[v], acc[n][v]);
+    }
+  }
+  KALDI_SIMD_UNROLL
+  for (int32 n = 0; n < F; n++) {
+    KALDI_SIMD_UNROLL
+    for (int32 v = 0; v < NV; v++)
+      Ops::Store(dest + n * dest_stride + v * width, acc[n][v]);
+  }
+}
+
+// Does what BlockSparseTile() does for all 'num_rows' rows.
+template<class Ops, int32 NV>
+inline void BlockSparseRows(MatrixIndexT num_rows, int32 num_indexes,
+                            const int32 *indexes, const float *weights,
+                            MatrixIndexT weights_stride, const float *src,
+                            MatrixIndexT src_stride, float *dest,
+                            MatrixIndexT dest_stride) {
+  const int32 F = (NV == 1 ? 8 : 6);
+  MatrixIndexT n = 0;
+  for (; n + F <= num_rows; n += F)
+    BlockSparseTile<Ops, F, NV>(num_indexes, indexes, weights, weights_stride,
+                                src + n * src_stride, src_stride,
+                                dest + n * dest_stride, dest_stride);
+  for (; n < num_rows; n++)
+    BlockSparseTile<Ops, 1, NV>(num_indexes, indexes, weights, weights_stride,
+                                src + n * src_stride, src_stride,
+                                dest + n * dest_stride, dest_stride);
+}
+
+// Does, for 0 <= n < num_rows and for the first 'num_cols' columns i rounded
+// down to a multiple of Ops::kWidth,
+//   dest[n * dest_stride + i] += sum_k src[n * src_stride + indexes[k]]
+//                                      * weights[k * weights_stride + i],
+// and returns the number of columns done; this is the work of
+// AddMatBlockSparse() for one block.  We go through the indexes in pieces so
+// that the parts of src and weights that we use stay in the L1 cache.
+template<class Ops>
+int32 BlockSparseBlock(MatrixIndexT num_rows, int32 num_cols,
+                       int32 num_indexes, const int32 *indexes,
+                       const float *weights, MatrixIndexT weights_stride,
+                       const float *src, MatrixIndexT src_stride,
+                       float *dest, MatrixIndexT dest_stride) {
+  const int32 width = Ops::kWidth, kIndexPiece = 128;
+  int32 i = 0;
+  for (; i + width <= num_cols; ) {
+    int32 num_vectors = (i + 2 * width <= num_cols ? 2 : 1);
+    for (int32 k = 0; k < num_indexes; k += kIndexPiece) {
+      int32 this_num_indexes = std::min(kIndexPiece, num_indexes - k);
+      const float *this_weights = weights + k * weights_stride + i;
+      if (num_vectors == 2)
+        BlockSparseRows<Ops, 2>(num_rows, this_num_indexes, indexes + k,
+                                this_weights, weights_stride, src, src_stride,
+                                dest + i, dest_stride);
+      else
+        BlockSparseRows<Ops, 1>(num_rows, this_num_indexes, indexes + k,
+                                this_weights, weights_stride, src, src_stride,
+                                dest + i, dest_stride);
+    }
+    i += num_vectors * width;
+  }
+  return i;
+}
+
+// Does the work of ApplyColumnOps() for the first 'num_cols' columns of each
+// row, rounded down to a multiple of Ops::kWidth, and returns the number of
+// columns done.  Each vector of the data is loaded and stored once, with all
+// the operations done on it in between.
+template<class Ops>
+int32 ColumnOpsRows(MatrixIndexT num_rows, int32 num_cols, int32 num_ops,
+                    const ColumnOp<float> *ops, float *data,
+                    MatrixIndexT stride) {
+  typedef typename Ops::V V;
+  const int32 width = Ops::kWidth;
+  int32 end = num_cols - num_cols % width;
+  for (MatrixIndexT n = 0; n < num_rows; n++) {
+    float *this_data = data + n * stride;
+    for (int32 i = 0; i < end; i += width) {
+      V x = Ops::Load(this_data + i);
+      for (int32 k = 0; k < num_ops; k++) {
+        const ColumnOp<float> &op = ops[k];
+        if (op.scale != NULL) {
+          if (op.offset != NULL)
+            x = Ops::MulAdd(x, Ops::Load(op.scale + i),
+                            Ops::Load(op.offset + i));
+          else
+            x = Ops::Mul(x, Ops::Load(op.scale + i));
+        } else if (op.offset != NULL) {
+          x = Ops::Add(x, Ops::Load(op.offset + i));
+        }
+        // Max() returns its second argument if either is NaN.
+        if (op.apply_floor)
+          x = Ops::Max(Ops::Set1(op.floor), x);
+      }
+      Ops::Store(this_data + i, x);
+    }
+  }
+  return end;
+}
+
+}  // namespace simd_math
+}  // namespace kaldi
+
+#endif  // KALDI_MATRIX_SIMD_MATH_INL_H_
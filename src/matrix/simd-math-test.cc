@@ -0,0 +1,400 @@
+// matrix/simd-math-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <limits>
+#include <string>
+
+#include "base/timer.h"
+#include "matrix/matrix-lib.h"
+#include "matrix/simd-math.h"
+
+namespace kaldi {
+
+typedef void (*VecFunction)(MatrixIndexT, const float*, float*);
+
+static double RefExp(double x) { return std::exp(x); }
+static double RefLog(double x) { return std::log(x); }
+static double RefSigmoid(double x) { return 1.0 / (1.0 + std::exp(-x)); }
+static double RefTanh(double x) { return std::tanh(x); }
+
+// Checks 'func' against 'ref' (computed in double) on 'dim' random inputs in
+// [min, max]; we require a relative error below 1e-6, except that results
+// with absolute value below 'abs_tolerance' may have that absolute error.
+static void TestAccuracy(const char *name, VecFunction func,
+                         double (*ref)(double), float min, float max,
+                         double abs_tolerance) {
+  // Use an odd dimension so the code for the leftover elements is tested.
+  MatrixIndexT dim = 10001;
+  std::vector<float> input(dim), output(dim);
+  for (MatrixIndexT i = 0; i < dim; i++)
+    input[i] = min + (max - min) * RandUniform();
+  func(dim, &(input[0]), &(output[0]));
+  double max_rel_error = 0.0;
+  for (MatrixIndexT i = 0; i < dim; i++) {
+    double x = input[i], y = output[i], y_ref = ref(x),
+        error = std::abs(y - y_ref);
+    if (error > abs_tolerance) {
+      double rel_error = error / std::abs(y_ref);
+      if (rel_error > 1.0e-06)
+        KALDI_ERR << name << "(" << x << ") = " << y << ", expected "
+                  << y_ref << " (instruction set is "
+                  << SimdMathInstructionSet() << ")";
+      max_rel_error = std::max(max_rel_error, rel_error);
+    }
+  }
+  KALDI_LOG << "Max relative error of " << name << " on [" << min << ", "
+            << max << "] is " << max_rel_error;
+}
+
+static void UnitTestSimdMathAccuracy() {
+  double min_float = std::numeric_limits<float>::min(),
+      denorm_min = std::numeric_limits<float>::denorm_min();
+  // For exp() and log() we allow a (denormal) rounding error in the last
+  // place for results below min_float.
+  TestAccuracy("exp", VecExp<float>, RefExp, -10.0, 10.0, 0.0);
+  TestAccuracy("exp", VecExp<float>, RefExp, -103.0, 88.0, 2 * denorm_min);
+  TestAccuracy("log", VecLog<float>, RefLog, 0.0, 2.0, 0.0);
+  TestAccuracy("log", VecLog<float>, RefLog, 0.0, 1.0e+30, 0.0);
+  TestAccuracy("log", VecLog<float>, RefLog, 0.0, 1.0e-37, 0.0);
+  TestAccuracy("sigmoid", VecSigmoid<float>, RefSigmoid, -30.0, 30.0, 0.0);
+  // The sigmoid is zero, not denormal, for inputs below about -88.7.
+  TestAccuracy("sigmoid", VecSigmoid<float>, RefSigmoid, -100.0, 100.0,
+               min_float);
+  TestAccuracy("tanh", VecTanh<float>, RefTanh, -1.0, 1.0, 0.0);
+  TestAccuracy("tanh", VecTanh<float>, RefTanh, -20.0, 20.0, 0.0);
+}
+
+static void UnitTestSimdMathSpecialValues() {
+  float inf = std::numeric_limits<float>::infinity(),
+      nan = std::numeric_limits<float>::quiet_NaN(),
+      denorm_min = std::numeric_limits<float>::denorm_min();
+  float input[] = { 0.0, -0.0, inf, -inf, nan, -1.0, denorm_min, 1000.0,
+                    -1000.0 };
+  const int32 n = sizeof(input) / sizeof(input[0]);
+  float output[n];
+
+  VecExp(n, input, output);
+  KALDI_ASSERT(output[0] == 1.0 && output[1] == 1.0 && output[2] == inf &&
+               output[3] == 0.0 && KALDI_ISNAN(output[4]) &&
+               ApproxEqual(output[5], std::exp(-1.0f)) &&
+               output[6] == 1.0 && output[7] == inf && output[8] == 0.0);
+
+  VecLog(n, input, output);
+  KALDI_ASSERT(output[0] == -inf && output[1] == -inf && output[2] == inf &&
+               KALDI_ISNAN(output[3]) && KALDI_ISNAN(output[4]) &&
+               KALDI_ISNAN(output[5]) &&
+               ApproxEqual(output[6], std::log(denorm_min)) &&
+               ApproxEqual(output[7], std::log(1000.0f)) &&
+               KALDI_ISNAN(output[8]));
+
+  VecSigmoid(n, input, output);
+  KALDI_ASSERT(output[0] == 0.5 && output[1] == 0.5 && output[2] == 1.0 &&
+               output[3] == 0.0 && KALDI_ISNAN(output[4]) &&
+               ApproxEqual(output[5], 1.0f / (1.0f + std::exp(1.0f))) &&
+               output[6] == 0.5 && output[7] == 1.0 && output[8] == 0.0);
+
+  VecTanh(n, input, output);
+  KALDI_ASSERT(output[0] == 0.0 && output[1] == 0.0 && output[2] == 1.0 &&
+               output[3] == -1.0 && KALDI_ISNAN(output[4]) &&
+               ApproxEqual(output[5], std::tanh(-1.0f)) &&
+               output[6] == denorm_min && output[7] == 1.0 &&
+               output[8] == -1.0);
+}
+
+// Tests that the double versions, and the float versions with
+// g_kaldi_fast_math == false, give the same results as the C library.
+static void UnitTestSimdMathAccurate() {
+  MatrixIndexT dim = 1 + Rand() % 100;
+  Vector<double> x(dim), y(dim);
+  x.SetRandn();
+  x.Scale(10.0);
+  VecExp(dim, x.Data(), y.Data());
+  for (MatrixIndexT i = 0; i < dim; i++)
+    KALDI_ASSERT(y(i) == std::exp(x(i)));
+  VecTanh(dim, x.Data(), y.Data());
+  for (MatrixIndexT i = 0; i < dim; i++)
+    KALDI_ASSERT(ApproxEqual(y(i), std::tanh(x(i)), 1.0e-14));
+
+  bool fast_math = g_kaldi_fast_math;
+  g_kaldi_fast_math = false;
+  Vector<float> xf(x), yf(dim);
+  xf.ApplyAbs();
+  VecLog(dim, xf.Data(), yf.Data());
+  for (MatrixIndexT i = 0; i < dim; i++)
+    KALDI_ASSERT(yf(i) == std::log(xf(i)));
+  g_kaldi_fast_math = fast_math;
+}
+
+// Tests the functions of VectorBase and MatrixBase that use these functions,
+// in float against double.
+static void UnitTestSimdMathMatrix() {
+  for (int32 i = 0; i < 10; i++) {
+    MatrixIndexT rows = 1 + Rand() % 10, cols = 1 + Rand() % 1000;
+    Matrix<double> M(rows, cols);
+    M.SetRandn();
+    M.Scale(5.0);
+    Matrix<float> Mf(M);
+
+    Matrix<double> N(M);
+    Matrix<float> Nf(Mf);
+    N.Sigmoid(M);
+    Nf.Sigmoid(Mf);
+    AssertEqual(Matrix<double>(Nf), N, 1.0e-06);
+    N.Tanh(M);
+    Nf.Tanh(Mf);
+    AssertEqual(Matrix<double>(Nf), N, 1.0e-06);
+    N.Exp(M);
+    Nf.Exp(Mf);
+    AssertEqual(Matrix<double>(Nf), N, 1.0e-06);
+    N.Log(N);
+    Nf.Log(Nf);
+    AssertEqual(Matrix<double>(Nf), M, 1.0e-06);
+
+    N.CopyFromMat(M);
+    Nf.CopyFromMat(Mf);
+    double ans = N.ApplySoftMax();
+    float ans_f = Nf.ApplySoftMax();
+    KALDI_ASSERT(ApproxEqual(ans, ans_f, 1.0e-05));
+    AssertEqual(Matrix<double>(Nf), N, 1.0e-05);
+
+    Vector<double> v(M.Row(0));
+    Vector<float> vf(Mf.Row(0));
+    ans = v.ApplyLogSoftMax();
+    ans_f = vf.ApplyLogSoftMax();
+    KALDI_ASSERT(ApproxEqual(ans, ans_f, 1.0e-05));
+    Vector<double> vd(vf);
+    AssertEqual(vd, v, 1.0e-05);
+  }
+}
+
+// Makes a random block-sparse matrix in the format of AddMatBlockSparse(),
+// with about 'density' of the columns in each block, and sets 'dense' to it.
+template<typename Real>
+static void RandomBlockSparse(MatrixIndexT num_rows, MatrixIndexT num_cols,
+                              int32 block_size, BaseFloat density,
+                              Matrix<Real> *weights,
+                              std::vector<int32> *col_indexes,
+                              std::vector<int32> *offsets,
+                              Matrix<Real> *dense) {
+  int32 num_blocks = (num_rows + block_size - 1) / block_size;
+  col_indexes->clear();
+  offsets->assign(1, 0);
+  for (int32 b = 0; b < num_blocks; b++) {
+    for (int32 c = 0; c < num_cols; c++)
+      if (WithProb(density))
+        col_indexes->push_back(c);
+    // A Matrix cannot have zero rows and nonzero columns.
+    if (b == 0 && col_indexes->empty())
+      col_indexes->push_back(RandInt(0, num_cols - 1));
+    offsets->push_back(col_indexes->size());
+  }
+  weights->Resize(col_indexes->size(), block_size);
+  weights->SetRandn();
+  dense->Resize(num_rows, num_cols);
+  for (int32 b = 0; b < num_blocks; b++)
+    for (int32 k = (*offsets)[b]; k < (*offsets)[b + 1]; k++)
+      for (int32 i = 0; i < block_size && b * block_size + i < num_rows; i++)
+        (*dense)(b * block_size + i, (*col_indexes)[k]) = (*weights)(k, i);
+}
+
+template<typename Real>
+static void UnitTestAddMatBlockSparse() {
+  for (int32 i = 0; i < 20; i++) {
+    MatrixIndexT num_frames = 1 + Rand() % 20, input_dim = 1 + Rand() % 100,
+        output_dim = 1 + Rand() % 100;
+    int32 block_size = 1 + Rand() % 40;
+    Matrix<Real> weights, dense, input(num_frames, input_dim),
+        output(num_frames, output_dim);
+    std::vector<int32> col_indexes, offsets;
+    RandomBlockSparse(output_dim, input_dim, block_size, RandUniform(),
+                      &weights, &col_indexes, &offsets, &dense);
+    input.SetRandn();
+    output.SetRandn();
+    Matrix<Real> output2(output);
+    AddMatBlockSparse(input, weights, col_indexes, offsets, &output);
+    output2.AddMatMat(1.0, input, kNoTrans, dense, kTrans, 1.0);
+    AssertEqual(output, output2, 1.0e-05);
+  }
+}
+
+// Compares ApplyColumnOps() with doing the same operations one at a time, as
+// nnet3 does for an affine component followed by a ReLU and a batch-norm.
+template<typename Real>
+static void UnitTestApplyColumnOps() {
+  for (int32 i = 0; i < 20; i++) {
+    MatrixIndexT num_rows = 1 + Rand() % 20, num_cols = 1 + Rand() % 100;
+    Matrix<Real> mat(num_rows, num_cols), mat2;
+    mat.SetRandn();
+    if (Rand() % 2 == 0) {
+      // a sub-matrix, so the stride is not the number of columns.
+      mat2.Resize(num_rows, num_cols + 3);
+      mat2.SetRandn();
+    }
+    Vector<Real> scale(num_cols), offset(num_cols), bias(num_cols);
+    scale.SetRandn();
+    offset.SetRandn();
+    bias.SetRandn();
+    Matrix<Real> expected(mat);
+    std::vector<ColumnOp<Real> > ops(3);
+    ops[0].offset = bias.Data();
+    expected.AddVecToRows(1.0, bias);
+    ops[1].apply_floor = true;
+    ops[1].floor = (Rand() % 2 == 0 ? 0.0 : 0.1);
+    expected.ApplyFloor(ops[1].floor);
+    ops[2].scale = scale.Data();
+    ops[2].offset = offset.Data();
+    expected.MulColsVec(scale);
+    expected.AddVecToRows(1.0, offset);
+    if (mat2.NumRows() != 0) {
+      SubMatrix<Real> sub(mat2, 0, num_rows, 1, num_cols);
+      sub.CopyFromMat(mat);
+      ApplyColumnOps(ops, &sub);
+      mat.CopyFromMat(sub);
+    } else {
+      ApplyColumnOps(ops, &mat);
+    }
+    AssertEqual(mat, expected, 1.0e-05);
+  }
+  // A NaN stays a NaN, as with ApplyFloor().
+  Matrix<Real> mat(1, 9);
+  mat(0, 2) = std::numeric_limits<Real>::quiet_NaN();
+  std::vector<ColumnOp<Real> > ops(1);
+  ops[0].apply_floor = true;
+  ApplyColumnOps(ops, &mat);
+  KALDI_ASSERT(KALDI_ISNAN(mat(0, 2)) && mat(0, 1) == 0.0);
+}
+
+// Compares the speed of ApplyColumnOps() with doing the operations of an
+// affine component's bias, a ReLU and a test-mode batch-norm separately.
+static void ColumnOpsSpeedTest() {
+  MatrixIndexT num_rows = 150, num_cols = 1536;
+  Matrix<float> mat(num_rows, num_cols);
+  Vector<float> bias(num_cols), scale(num_cols), offset(num_cols);
+  mat.SetRandn();
+  bias.SetRandn();
+  scale.SetRandn();
+  offset.SetRandn();
+  std::vector<ColumnOp<float> > ops(3);
+  ops[0].offset = bias.Data();
+  ops[1].apply_floor = true;
+  ops[2].scale = scale.Data();
+  ops[2].offset = offset.Data();
+  for (int32 fused = 0; fused <= 1; fused++) {
+    Timer timer;
+    int32 iter = 0;
+    do {
+      if (fused) {
+        ApplyColumnOps(ops, &mat);
+      } else {
+        mat.AddVecToRows(1.0, bias);
+        mat.ApplyFloor(0.0);
+        mat.MulColsVec(scale);
+        mat.AddVecToRows(1.0, offset);
+      }
+      iter++;
+    } while (timer.Elapsed() < 0.05);
+    KALDI_LOG << "Bias, ReLU and batch-norm on " << num_rows << " x "
+              << num_cols << (fused ? " with ApplyColumnOps()" : " separately")
+              << " took " << (timer.Elapsed() * 1000.0 / iter) << " ms.";
+  }
+}
+
+// Compares the speed of AddMatBlockSparse() with that of a dense
+// multiplication, at densities of 50% and 30%.
+static void BlockSparseSpeedTest() {
+  MatrixIndexT num_frames = 128, dim = 1024;
+  int32 block_size = 16;
+  Matrix<float> input(num_frames, dim), output(num_frames, dim);
+  input.SetRandn();
+  for (int32 d = 0; d <= 2; d++) {
+    BaseFloat density = (d == 0 ? 1.0 : (d == 1 ? 0.5 : 0.3));
+    Matrix<float> weights, dense;
+    std::vector<int32> col_indexes, offsets;
+    RandomBlockSparse(dim, dim, block_size, density, &weights, &col_indexes,
+                      &offsets, &dense);
+    Timer timer;
+    int32 iter = 0;
+    do {
+      if (d == 0)
+        output.AddMatMat(1.0, input, kNoTrans, dense, kTrans, 0.0);
+      else
+        AddMatBlockSparse(input, weights, col_indexes, offsets, &output);
+      iter++;
+    } while (timer.Elapsed() < 0.05);
+    KALDI_LOG << "Multiplying " << num_frames << " x " << dim << " by "
+              << dim << " x " << dim << " with density " << density
+              << (d == 0 ? " (dense)" : "") << " took "
+              << (timer.Elapsed() * 1000.0 / iter) << " ms.";
+  }
+}
+
+static void SimdMathSpeedTest(const char *name, VecFunction func) {
+  MatrixIndexT dim = 4096;
+  Vector<float> x(dim), y(dim);
+  x.SetRandn();
+  x.Scale(4.0);
+  x.ApplyAbs();  // so the input is valid for log().
+  for (int32 fast = 0; fast <= 1; fast++) {
+    bool fast_math = g_kaldi_fast_math;
+    g_kaldi_fast_math = (fast != 0);
+    Timer timer;
+    int64 num_elements = 0;
+    do {
+      for (int32 i = 0; i < 10; i++)
+        func(dim, x.Data(), y.Data());
+      num_elements += 10 * dim;
+    } while (timer.Elapsed() < 0.05);
+    g_kaldi_fast_math = fast_math;
+    KALDI_LOG << "For " << name << ", "
+              << (fast ? SimdMathInstructionSet() : "libm") << " speed was "
+              << (num_elements * 1.0e-06 / timer.Elapsed())
+              << " million elements per second.";
+  }
+}
+
+static void SimdMathSpeedTests() {
+  SimdMathSpeedTest("exp", VecExp<float>);
+  SimdMathSpeedTest("log", VecLog<float>);
+  SimdMathSpeedTest("sigmoid", VecSigmoid<float>);
+  SimdMathSpeedTest("tanh", VecTanh<float>);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  KALDI_LOG << "Instruction set is " << SimdMathInstructionSet();
+  // These two test our SIMD code; without it, the float versions call the C
+  // library the way Kaldi always has, which is less accurate near zero.
+  if (std::string(SimdMathInstructionSet()) != "generic") {
+    UnitTestSimdMathAccuracy();
+    UnitTestSimdMathSpecialValues();
+  }
+  for (int32 i = 0; i < 10; i++)
+    UnitTestSimdMathAccurate();
+  UnitTestSimdMathMatrix();
+  UnitTestAddMatBlockSparse<float>();
+  UnitTestAddMatBlockSparse<double>();
+  UnitTestApplyColumnOps<float>();
+  UnitTestApplyColumnOps<double>();
+  SimdMathSpeedTests();
+  BlockSparseSpeedTest();
+  ColumnOpsSpeedTest();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
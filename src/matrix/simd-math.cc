@@ -0,0 +1,451 @@
+// matrix/simd-math.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+
+#include "matrix/kaldi-matrix.h"
+#include "matrix/simd-math.h"
+#include "matrix/simd-math-inl.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KALDI_SIMD_MATH_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// The AVX2 code is compiled using target attributes (see simd-math-avx2.cc),
+// which needs GCC or clang.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+  (defined(__GNUC__) || defined(__clang__))
+#define KALDI_SIMD_MATH_HAVE_AVX2 1
+#endif
+
+namespace kaldi {
+
+bool g_kaldi_fast_math = true;
+
+namespace simd_math {
+
+#ifdef KALDI_SIMD_MATH_HAVE_SSE2
+struct Sse2Ops {
+  typedef __m128 V;
+  typedef __m128 M;
+  static const int32 kWidth = 4;
+  static inline V Load(const float *p) { return _mm_loadu_ps(p); }
+  static inline void Store(float *p, V v) { _mm_storeu_ps(p, v); }
+  static inline V Set1(float f) { return _mm_set1_ps(f); }
+  static inline V Add(V a, V b) { return _mm_add_ps(a, b); }
+  static inline V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+  static inline V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+  static inline V Div(V a, V b) { return _mm_div_ps(a, b); }
+  static inline V MulAdd(V a, V b, V c) {
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+  }
+  static inline V Min(V a, V b) { return _mm_min_ps(a, b); }
+  static inline V Max(V a, V b) { return _mm_max_ps(a, b); }
+  static inline V Abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+  // SSE2 has no floor instruction: _mm_cvttps_epi32 rounds towards zero, so
+  // we subtract one where that rounded up.
+  static inline V Floor(V a) {
+    V t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+  }
+  static inline V Pow2(V n) {
+    return _mm_castsi128_ps(_mm_slli_epi32(
+        _mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23));
+  }
+  static inline V Frexp(V a, V *e) {
+    __m128i bits = _mm_castps_si128(a);
+    *e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23),
+                                       _mm_set1_epi32(126)));
+    return _mm_or_ps(_mm_and_ps(a, _mm_castsi128_ps(
+        _mm_set1_epi32(0x807fffff))), _mm_set1_ps(0.5f));
+  }
+  static inline M Less(V a, V b) { return _mm_cmplt_ps(a, b); }
+  static inline M Greater(V a, V b) { return _mm_cmpgt_ps(a, b); }
+  static inline M Equal(V a, V b) { return _mm_cmpeq_ps(a, b); }
+  static inline M IsNan(V a) { return _mm_cmpunord_ps(a, a); }
+  static inline M Or(M a, M b) { return _mm_or_ps(a, b); }
+  static inline V Select(M m, V a, V b) {
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+  }
+};
+#endif  // KALDI_SIMD_MATH_HAVE_SSE2
+
+#ifdef KALDI_SIMD_MATH_HAVE_AVX2
+// These are defined in simd-math-avx2.cc.
+void ExpAvx2(MatrixIndexT dim, const float *src, float *dest);
+void LogAvx2(MatrixIndexT dim, const float *src, float *dest);
+void SigmoidAvx2(MatrixIndexT dim, const float *src, float *dest);
+void TanhAvx2(MatrixIndexT dim, const float *src, float *dest);
+int32 BlockSparseBlockAvx2(MatrixIndexT num_rows, int32 num_cols,
+                           int32 num_indexes, const int32 *indexes,
+                           const float *weights, MatrixIndexT weights_stride,
+                           const float *src, MatrixIndexT src_stride,
+                           float *dest, MatrixIndexT dest_stride);
+int32 ColumnOpsRowsAvx2(MatrixIndexT num_rows, int32 num_cols, int32 num_ops,
+                        const ColumnOp<float> *ops, float *data,
+                        MatrixIndexT stride);
+#else
+// So that Dispatch() can be called; these are never used, as we never detect
+// AVX2 in this case.
+static void ExpAvx2(MatrixIndexT, const float*, float*) { }
+static void LogAvx2(MatrixIndexT, const float*, float*) { }
+static void SigmoidAvx2(MatrixIndexT, const float*, float*) { }
+static void TanhAvx2(MatrixIndexT, const float*, float*) { }
+static int32 BlockSparseBlockAvx2(MatrixIndexT, int32, int32, const int32*,
+                                  const float*, MatrixIndexT, const float*,
+                                  MatrixIndexT, float*, MatrixIndexT) {
+  return 0;
+}
+static int32 ColumnOpsRowsAvx2(MatrixIndexT, int32, int32,
+                               const ColumnOp<float>*, float*, MatrixIndexT) {
+  return 0;
+}
+#endif
+
+// The accurate versions, which call the C library; these are used for
+// double, and for float if g_kaldi_fast_math is false.
+template<typename Real>
+static void ExpAccurate(MatrixIndexT dim, const Real *src, Real *dest) {
+  for (MatrixIndexT i = 0; i < dim; i++)
+    dest[i] = kaldi::Exp(src[i]);
+}
+
+template<typename Real>
+static void LogAccurate(MatrixIndexT dim, const Real *src, Real *dest) {
+  for (MatrixIndexT i = 0; i < dim; i++)
+    dest[i] = kaldi::Log(src[i]);
+}
+
+template<typename Real>
+static void SigmoidAccurate(MatrixIndexT dim, const Real *src, Real *dest) {
+  for (MatrixIndexT i = 0; i < dim; i++) {
+    Real x = src[i];
+    // We aim to avoid floating-point overflow here.
+    if (x > 0.0) {
+      x = 1.0 / (1.0 + kaldi::Exp(-x));
+    } else {
+      Real ex = kaldi::Exp(x);
+      x = ex / (ex + 1.0);
+    }
+    dest[i] = x;
+  }
+}
+
+template<typename Real>
+static void TanhAccurate(MatrixIndexT dim, const Real *src, Real *dest) {
+  for (MatrixIndexT i = 0; i < dim; i++) {
+    Real x = src[i];
+    if (x > 0.0) {
+      Real inv_expx = kaldi::Exp(-x);
+      x = -1.0 + 2.0 / (1.0 + inv_expx * inv_expx);
+    } else {
+      Real expx = kaldi::Exp(x);
+      x = 1.0 - 2.0 / (1.0 + expx * expx);
+    }
+    dest[i] = x;
+  }
+}
+
+enum InstructionSet { kGeneric, kSse2, kAvx2 };
+
+static InstructionSet DetectInstructionSet() {
+#ifdef KALDI_SIMD_MATH_HAVE_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return kAvx2;
+#endif
+#ifdef KALDI_SIMD_MATH_HAVE_SSE2
+  return kSse2;
+#else
+  return kGeneric;
+#endif
+}
+
+static InstructionSet GetInstructionSet() {
+  static const InstructionSet instruction_set = DetectInstructionSet();
+  return instruction_set;
+}
+
+// Applies the function F to the array using the best instruction set
+// available; 'avx2_version' is the version of it in simd-math-avx2.cc, and
+// 'generic_version' is the accurate version, which we use if there is no SIMD
+// code for this platform (our code is slower than the C library without SIMD).
+template<class F>
+static inline void Dispatch(MatrixIndexT dim, const float *src, float *dest,
+                            void (*avx2_version)(MatrixIndexT, const float*,
+                                                 float*),
+                            void (*generic_version)(MatrixIndexT, const float*,
+                                                    float*)) {
+  switch (GetInstructionSet()) {
+    case kAvx2:
+      avx2_version(dim, src, dest);
+      break;
+#ifdef KALDI_SIMD_MATH_HAVE_SSE2
+    case kSse2:
+      ApplyToArray<Sse2Ops, F>(dim, src, dest);
+      break;
+#endif
+    default:
+      generic_version(dim, src, dest);
+  }
+}
+
+// The generic version of BlockSparseBlock() (see simd-math-inl.h), which does
+// the columns from 'begin_col' to 'end_col - 1'.
+template<typename Real>
+static void BlockSparseBlockGeneric(MatrixIndexT num_rows, int32 begin_col,
+                                    int32 end_col, int32 num_indexes,
+                                    const int32 *indexes, const Real *weights,
+                                    MatrixIndexT weights_stride,
+                                    const Real *src, MatrixIndexT src_stride,
+                                    Real *dest, MatrixIndexT dest_stride) {
+  for (MatrixIndexT n = 0; n < num_rows; n++) {
+    const Real *this_src = src + n * src_stride;
+    Real *this_dest = dest + n * dest_stride;
+    for (int32 k = 0; k < num_indexes; k++) {
+      Real x = this_src[indexes[k]];
+      const Real *this_weights = weights + k * weights_stride;
+      for (int32 i = begin_col; i < end_col; i++)
+        this_dest[i] += x * this_weights[i];
+    }
+  }
+}
+
+// Returns the number of columns done, like BlockSparseBlock().
+static int32 BlockSparseBlockSimd(MatrixIndexT num_rows, int32 num_cols,
+                                  int32 num_indexes, const int32 *indexes,
+                                  const float *weights,
+                                  MatrixIndexT weights_stride,
+                                  const float *src, MatrixIndexT src_stride,
+                                  float *dest, MatrixIndexT dest_stride) {
+  switch (GetInstructionSet()) {
+    case kAvx2:
+      return BlockSparseBlockAvx2(num_rows, num_cols, num_indexes, indexes,
+                                  weights, weights_stride, src, src_stride,
+                                  dest, dest_stride);
+#ifdef KALDI_SIMD_MATH_HAVE_SSE2
+    case kSse2:
+      return BlockSparseBlock<Sse2Ops>(num_rows, num_cols, num_indexes,
+                                       indexes, weights, weights_stride, src,
+                                       src_stride, dest, dest_stride);
+#endif
+    default:
+      return 0;
+  }
+}
+
+static int32 BlockSparseBlockSimd(MatrixIndexT, int32, int32, const int32*,
+                                  const double*, MatrixIndexT, const double*,
+                                  MatrixIndexT, double*, MatrixIndexT) {
+  return 0;
+}
+
+// The generic version of ColumnOpsRows() (see simd-math-inl.h), which does
+// the columns from 'begin_col' to 'end_col - 1'.
+template<typename Real>
+static void ColumnOpsRowsGeneric(MatrixIndexT num_rows, int32 begin_col,
+                                 int32 end_col, int32 num_ops,
+                                 const ColumnOp<Real> *ops, Real *data,
+                                 MatrixIndexT stride) {
+  for (MatrixIndexT n = 0; n < num_rows; n++) {
+    Real *this_data = data + n * stride;
+    for (int32 i = begin_col; i < end_col; i++) {
+      Real x = this_data[i];
+      for (int32 k = 0; k < num_ops; k++) {
+        const ColumnOp<Real> &op = ops[k];
+        if (op.scale != NULL) x *= op.scale[i];
+        if (op.offset != NULL) x += op.offset[i];
+        if (op.apply_floor && x < op.floor) x = op.floor;
+      }
+      this_data[i] = x;
+    }
+  }
+}
+
+// Returns the number of columns done, like ColumnOpsRows().
+static int32 ColumnOpsRowsSimd(MatrixIndexT num_rows, int32 num_cols,
+                               int32 num_ops, const ColumnOp<float> *ops,
+                               float *data, MatrixIndexT stride) {
+  switch (GetInstructionSet()) {
+    case kAvx2:
+      return ColumnOpsRowsAvx2(num_rows, num_cols, num_ops, ops, data, stride);
+#ifdef KALDI_SIMD_MATH_HAVE_SSE2
+    case kSse2:
+      return ColumnOpsRows<Sse2Ops>(num_rows, num_cols, num_ops, ops, data,
+                                    stride);
+#endif
+    default:
+      return 0;
+  }
+}
+
+static int32 ColumnOpsRowsSimd(MatrixIndexT, int32, int32,
+                               const ColumnOp<double>*, double*,
+                               MatrixIndexT) {
+  return 0;
+}
+
+}  // namespace simd_math
+
+
+const char *SimdMathInstructionSet() {
+  switch (simd_math::GetInstructionSet()) {
+    case simd_math::kAvx2: return "avx2";
+    case simd_math::kSse2: return "sse2";
+    default: return "generic";
+  }
+}
+
+template<typename Real>
+void VecExp(MatrixIndexT dim, const Real *src, Real *dest) {
+  simd_math::ExpAccurate(dim, src, dest);
+}
+
+template<typename Real>
+void VecLog(MatrixIndexT dim, const Real *src, Real *dest) {
+  simd_math::LogAccurate(dim, src, dest);
+}
+
+template<typename Real>
+void VecSigmoid(MatrixIndexT dim, const Real *src, Real *dest) {
+  simd_math::SigmoidAccurate(dim, src, dest);
+}
+
+template<typename Real>
+void VecTanh(MatrixIndexT dim, const Real *src, Real *dest) {
+  simd_math::TanhAccurate(dim, src, dest);
+}
+
+template<>
+void VecExp(MatrixIndexT dim, const float *src, float *dest) {
+  if (g_kaldi_fast_math)
+    simd_math::Dispatch<simd_math::ExpFunction>(
+        dim, src, dest, simd_math::ExpAvx2, simd_math::ExpAccurate<float>);
+  else
+    simd_math::ExpAccurate(dim, src, dest);
+}
+
+template<>
+void VecLog(MatrixIndexT dim, const float *src, float *dest) {
+  if (g_kaldi_fast_math)
+    simd_math::Dispatch<simd_math::LogFunction>(
+        dim, src, dest, simd_math::LogAvx2, simd_math::LogAccurate<float>);
+  else
+    simd_math::LogAccurate(dim, src, dest);
+}
+
+template<>
+void VecSigmoid(MatrixIndexT dim, const float *src, float *dest) {
+  if (g_kaldi_fast_math)
+    simd_math::Dispatch<simd_math::SigmoidFunction>(
+        dim, src, dest, simd_math::SigmoidAvx2,
+        simd_math::SigmoidAccurate<float>);
+  else
+    simd_math::SigmoidAccurate(dim, src, dest);
+}
+
+template<>
+void VecTanh(MatrixIndexT dim, const float *src, float *dest) {
+  if (g_kaldi_fast_math)
+    simd_math::Dispatch<simd_math::TanhFunction>(
+        dim, src, dest, simd_math::TanhAvx2, simd_math::TanhAccurate<float>);
+  else
+    simd_math::TanhAccurate(dim, src, dest);
+}
+
+template<typename Real>
+void AddMatBlockSparse(const MatrixBase<Real> &src,
+                       const MatrixBase<Real> &weights,
+                       const std::vector<int32> &col_indexes,
+                       const std::vector<int32> &offsets,
+                       MatrixBase<Real> *dest) {
+  int32 block_size = weights.NumCols(),
+      num_blocks = static_cast<int32>(offsets.size()) - 1;
+  KALDI_ASSERT(src.NumRows() == dest->NumRows() && block_size > 0 &&
+               offsets[0] == 0 && offsets.back() == weights.NumRows() &&
+               static_cast<int32>(col_indexes.size()) == weights.NumRows() &&
+               (num_blocks - 1) * block_size < dest->NumCols() &&
+               num_blocks * block_size >= dest->NumCols());
+  if (src.NumRows() == 0)
+    return;
+  for (int32 b = 0; b < num_blocks; b++) {
+    int32 num_indexes = offsets[b + 1] - offsets[b],
+        num_cols = std::min(block_size, dest->NumCols() - b * block_size);
+    if (num_indexes == 0)
+      continue;
+    const int32 *indexes = &(col_indexes[offsets[b]]);
+    const Real *this_weights = weights.RowData(offsets[b]);
+    Real *this_dest = dest->Data() + b * block_size;
+    int32 cols_done = simd_math::BlockSparseBlockSimd(
+        src.NumRows(), num_cols, num_indexes, indexes, this_weights,
+        weights.Stride(), src.Data(), src.Stride(), this_dest,
+        dest->Stride());
+    if (cols_done < num_cols)
+      simd_math::BlockSparseBlockGeneric(
+          src.NumRows(), cols_done, num_cols, num_indexes, indexes,
+          this_weights, weights.Stride(), src.Data(), src.Stride(), this_dest,
+          dest->Stride());
+  }
+}
+
+template<typename Real>
+void ApplyColumnOps(const std::vector<ColumnOp<Real> > &ops,
+                    MatrixBase<Real> *mat) {
+  int32 num_ops = ops.size(), num_cols = mat->NumCols();
+  if (num_ops == 0 || mat->NumRows() == 0)
+    return;
+  int32 cols_done = simd_math::ColumnOpsRowsSimd(
+      mat->NumRows(), num_cols, num_ops, &(ops[0]), mat->Data(),
+      mat->Stride());
+  if (cols_done < num_cols)
+    simd_math::ColumnOpsRowsGeneric(mat->NumRows(), cols_done, num_cols,
+                                    num_ops, &(ops[0]), mat->Data(),
+                                    mat->Stride());
+}
+
+template
+void ApplyColumnOps(const std::vector<ColumnOp<float> > &ops,
+                    MatrixBase<float> *mat);
+template
+void ApplyColumnOps(const std::vector<ColumnOp<double> > &ops,
+                    MatrixBase<double> *mat);
+
+template
+void AddMatBlockSparse(const MatrixBase<float> &src,
+                       const MatrixBase<float> &weights,
+                       const std::vector<int32> &col_indexes,
+                       const std::vector<int32> &offsets,
+                       MatrixBase<float> *dest);
+template
+void AddMatBlockSparse(const MatrixBase<double> &src,
+                       const MatrixBase<double> &weights,
+                       const std::vector<int32> &col_indexes,
+                       const std::vector<int32> &offsets,
+                       MatrixBase<double> *dest);
+
+template
+void VecExp(MatrixIndexT dim, const double *src, double *dest);
+template
+void VecLog(MatrixIndexT dim, const double *src, double *dest);
+template
+void VecSigmoid(MatrixIndexT dim, const double *src, double *dest);
+template
+void VecTanh(MatrixIndexT dim, const double *src, double *dest);
+
+}  // namespace kaldi
@@ -0,0 +1,140 @@
+// matrix/simd-math.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_SIMD_MATH_H_
+#define KALDI_MATRIX_SIMD_MATH_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "matrix/matrix-common.h"
+
+namespace kaldi {
+
+/// \addtogroup matrix_funcs_misc
+/// @{
+
+/**
+   This header declares vectorized versions of exp(), log(), the sigmoid and
+   tanh, which apply the function to an array of values.  They are used by
+   the CPU code in MatrixBase, VectorBase and (via those) CuMatrixBase.
+
+   For float, if g_kaldi_fast_math is true (the default), these use SIMD
+   implementations based on the polynomial approximations in the Cephes
+   library, with the instruction set chosen at runtime (AVX2 with FMA if the
+   CPU supports it, else SSE2); on platforms without SSE2 they call the C
+   library, which is faster than our code would be without SIMD.  The
+   relative error of exp() and log() is within a few units in the last place;
+   the sigmoid and tanh have relative errors below 1e-6 (except that the
+   sigmoid is zero where its value would be denormal).  Infinities, NaNs,
+   zeros and denormal inputs are handled as by the C library.
+
+   For double, and for float if g_kaldi_fast_math is false, they call the C
+   library functions one element at a time.
+
+   In all of these, 'src' and 'dest' may be the same but must not otherwise
+   overlap.
+
+   This header also declares AddMatBlockSparse(), a SIMD kernel for
+   multiplying by a block-sparse matrix, which is used by
+   BlockSparseAffineComponent in nnet3 on CPU; and ApplyColumnOps(), which
+   does a sequence of elementwise operations in one pass over a matrix and is
+   used by nnet3 to fuse the propagation of components such as ReLUs into
+   that of the preceding affine component.
+ */
+
+/// If true (the default), the functions declared below use fast SIMD
+/// approximations for float data; if false, they use the C library.  This is
+/// set by the standard --fast-math option of ParseOptions.
+extern bool g_kaldi_fast_math;
+
+/// Returns the name of the instruction set used by the functions below for
+/// float data when g_kaldi_fast_math is true: "avx2", "sse2" or "generic"
+/// (meaning the C library).
+const char *SimdMathInstructionSet();
+
+/// dest[i] = exp(src[i]) for 0 <= i < dim.
+template<typename Real>
+void VecExp(MatrixIndexT dim, const Real *src, Real *dest);
+
+/// dest[i] = log(src[i]) for 0 <= i < dim.  Does not check for negative
+/// inputs (which give NaN).
+template<typename Real>
+void VecLog(MatrixIndexT dim, const Real *src, Real *dest);
+
+/// dest[i] = 1 / (1 + exp(-src[i])) for 0 <= i < dim.
+template<typename Real>
+void VecSigmoid(MatrixIndexT dim, const Real *src, Real *dest);
+
+/// dest[i] = tanh(src[i]) for 0 <= i < dim.
+template<typename Real>
+void VecTanh(MatrixIndexT dim, const Real *src, Real *dest);
+
+/**
+   Multiplication by a block-sparse matrix W, i.e. *dest += src W^T, where the
+   rows of W are in blocks of weights.NumCols() rows and each block has
+   nonzero values in only a subset of the columns.  For block b, these are
+   the columns col_indexes[k] for offsets[b] <= k < offsets[b+1], and the
+   values in them are the rows 'k' of 'weights'.  That is, we do:
+   \f[
+     dest(n, b s + i) \mathrel{+}= \sum_{k = offsets[b]}^{offsets[b+1] - 1}
+        src(n, col\_indexes[k]) weights(k, i)
+   \f]
+   where s is the block size weights.NumCols(), for 0 <= i < s and
+   b s + i < dest->NumCols() (the last block may be partial).  The column
+   indexes within a block need not be sorted, but the kernel is faster if
+   they are.  For float, the columns of each block are done 8 (AVX2) or 4
+   (SSE2) at a time, so the block size should be a multiple of 8 for speed;
+   this does not depend on g_kaldi_fast_math.
+*/
+template<typename Real>
+void AddMatBlockSparse(const MatrixBase<Real> &src,
+                       const MatrixBase<Real> &weights,
+                       const std::vector<int32> &col_indexes,
+                       const std::vector<int32> &offsets,
+                       MatrixBase<Real> *dest);
+
+/**
+   One of the operations done by ApplyColumnOps().  For each element x in
+   column j of the matrix it does x = x * scale[j] + offset[j], where a NULL
+   'scale' means 1 and a NULL 'offset' means 0, and then, if 'apply_floor' is
+   true, x = max(x, floor) (a NaN stays a NaN, as with ApplyFloor()).
+*/
+template<typename Real>
+struct ColumnOp {
+  const Real *scale;
+  const Real *offset;
+  bool apply_floor;
+  Real floor;
+  ColumnOp(): scale(NULL), offset(NULL), apply_floor(false), floor(0.0) { }
+};
+
+/// Does ops[0], ops[1], ... in that order to every element of *mat, in one
+/// pass over the data; the 'scale' and 'offset' arrays must have
+/// mat->NumCols() elements.  For float the columns are done 8 (AVX2) or 4
+/// (SSE2) at a time; this does not depend on g_kaldi_fast_math.  With AVX2
+/// the multiply-add is fused, so results may differ from doing the
+/// operations separately in the last bit.
+template<typename Real>
+void ApplyColumnOps(const std::vector<ColumnOp<Real> > &ops,
+                    MatrixBase<Real> *mat);
+
+/// @} end of "addtogroup matrix_funcs_misc"
+
+}  // namespace kaldi
+
+#endif  // KALDI_MATRIX_SIMD_MATH_H_
@@ -318,6 +318,86 @@ void UnitTestPreconditionDirectionsOnline() {
   return;
 }
 
+// Checks that the results are the same when the updates are done in
+// background threads.
+void UnitTestPreconditionDirectionsAsync() {
+  MatrixIndexT R = 1 + Rand() % 30,  // rank of correction
+      N = (2 * R) + Rand() % 30,  // batch size
+      D = R + 1 + Rand() % 20; // problem dimension.  Must be > R.
+
+  OnlineNaturalGradient preconditioner1, preconditioner2;
+  preconditioner1.SetRank(R);
+  preconditioner1.SetUpdatePeriod(RandInt(1, 3));
+  preconditioner1.TurnOnDebug();
+  preconditioner2 = preconditioner1;
+
+  int32 num_iters = 30;
+  for (int32 iter = 0; iter < num_iters; iter++) {
+    CuMatrix<BaseFloat> M(N, D);
+    M.SetRandn();
+    CuMatrix<BaseFloat> Mcopy1(M), Mcopy2(M);
+    BaseFloat gamma1, gamma2;
+
+    OnlineNaturalGradient::SetNumUpdateThreads(0);
+    preconditioner1.PreconditionDirections(&Mcopy1, &gamma1);
+    OnlineNaturalGradient::SetNumUpdateThreads(2);
+    preconditioner2.PreconditionDirections(&Mcopy2, &gamma2);
+
+    AssertEqual(Mcopy1, Mcopy2, 1.0e-05);
+    AssertEqual(gamma1, gamma2, 1.0e-05);
+
+    if (iter % 10 == 5) {
+      // Copying an object must include the update that it is doing.
+      OnlineNaturalGradient preconditioner3(preconditioner2);
+      preconditioner2.Swap(&preconditioner3);
+    }
+  }
+  OnlineNaturalGradient::SetNumUpdateThreads(0);
+}
+
+// Tests that when the updates of several objects queue up for one thread,
+// the results are the same as without threads.
+void UnitTestPreconditionDirectionsQueued() {
+  MatrixIndexT R = 1 + Rand() % 30,  // rank of correction
+      D = R + 1 + Rand() % 20; // problem dimension.  Must be > R.
+
+  int32 num_objects = 8;
+  std::vector<OnlineNaturalGradient> preconditioners1(num_objects),
+      preconditioners2;
+  for (int32 i = 0; i < num_objects; i++) {
+    preconditioners1[i].SetRank(R);
+    preconditioners1[i].SetUpdatePeriod(RandInt(1, 2));
+  }
+  preconditioners2 = preconditioners1;
+
+  int32 num_iters = 20;
+  for (int32 iter = 0; iter < num_iters; iter++) {
+    // Some minibatches have N > D and some N <= D, which compute L_t and K_t
+    // differently.
+    std::vector<CuMatrix<BaseFloat> > M1(num_objects), M2(num_objects);
+    for (int32 i = 0; i < num_objects; i++) {
+      M1[i].Resize(1 + Rand() % (2 * D), D);
+      M1[i].SetRandn();
+      M2[i] = M1[i];
+    }
+    std::vector<BaseFloat> gamma1(num_objects), gamma2(num_objects);
+
+    OnlineNaturalGradient::SetNumUpdateThreads(0);
+    for (int32 i = 0; i < num_objects; i++)
+      preconditioners1[i].PreconditionDirections(&(M1[i]), &(gamma1[i]));
+    // While the thread is doing the first update, the others queue up.
+    OnlineNaturalGradient::SetNumUpdateThreads(1);
+    for (int32 i = 0; i < num_objects; i++)
+      preconditioners2[i].PreconditionDirections(&(M2[i]), &(gamma2[i]));
+
+    for (int32 i = 0; i < num_objects; i++) {
+      AssertEqual(M1[i], M2[i], 1.0e-05);
+      AssertEqual(gamma1[i], gamma2[i], 1.0e-05);
+    }
+  }
+  OnlineNaturalGradient::SetNumUpdateThreads(0);
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
@@ -336,6 +416,8 @@ int main() {
 #endif
     for (int32 i = 0; i < 5; i++) {
       UnitTestPreconditionDirectionsOnline();
+      UnitTestPreconditionDirectionsAsync();
+      UnitTestPreconditionDirectionsQueued();
     }
   }
 }
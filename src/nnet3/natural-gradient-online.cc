@@ -17,6 +17,10 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include "nnet3/natural-gradient-online.h"
 #include "nnet3/nnet-parse.h"
 
@@ -28,7 +32,146 @@ OnlineNaturalGradient::OnlineNaturalGradient():
     rank_(40), update_period_(1), num_samples_history_(2000.0),
     num_minibatches_history_(0.0), alpha_(4.0),
     epsilon_(1.0e-10), delta_(5.0e-04), frozen_(false), t_(0),
-    self_debug_(false), rho_t_(-1.0e+10) { }
+    self_debug_(false), rho_t_(-1.0e+10), update_task_(NULL) { }
+
+
+// This holds the inputs and outputs of an update of the parameters of an
+// OnlineNaturalGradient object that is done in a background thread.
+class OnlineNaturalGradient::UpdateTask {
+ public:
+  explicit UpdateTask(const OnlineNaturalGradient *owner):
+      owner(owner), tr_X_Xt(0.0), rho_t1(0.0), pending(false),
+      running_(false) { }
+
+  // Called by UpdateThreads::Run() before the task is queued.
+  void Start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = true;
+    pending = true;
+    error.clear();
+  }
+
+  // Called from a background thread.
+  void Run() {
+    std::string error_message;
+    try {
+      owner->ComputeUpdate(X_t, H_t, tr_X_Xt, &W_t1, &rho_t1, &d_t1);
+    } catch (const std::exception &e) {
+      error_message = e.what();
+      if (error_message.empty())
+        error_message = "unknown error";
+    }
+    // Free the inputs, whose size is proportional to the minibatch size.
+    X_t.Resize(0, 0);
+    H_t.Resize(0, 0);
+    std::lock_guard<std::mutex> lock(mutex_);
+    error = error_message;
+    running_ = false;
+    finished_.notify_all();
+  }
+
+  // Waits for Run() to finish, if it has been started; returns true if the
+  // result hasn't been used yet (i.e. 'pending' is set).
+  bool Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_)
+      finished_.wait(lock);
+    return pending;
+  }
+
+  const OnlineNaturalGradient *owner;
+  // The inputs: X_t before preconditioning, H_t = X_t W_t^T, and tr(X_t X_t^T).
+  CuMatrix<BaseFloat> X_t;
+  CuMatrix<BaseFloat> H_t;
+  BaseFloat tr_X_Xt;
+  // The outputs.
+  CuMatrix<BaseFloat> W_t1;
+  BaseFloat rho_t1;
+  Vector<BaseFloat> d_t1;
+  // Nonempty if the update failed.
+  std::string error;
+  // True from Start() until the owner has used the result (this is only
+  // accessed from the owner's thread).
+  bool pending;
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable finished_;
+  bool running_;
+};
+
+
+// The pool of threads in which UpdateTasks are run; see SetNumUpdateThreads().
+class OnlineNaturalGradient::UpdateThreads {
+ public:
+  explicit UpdateThreads(int32 num_threads): stop_(false) {
+    for (int32 i = 0; i < num_threads; i++)
+      threads_.push_back(std::thread(&UpdateThreads::ThreadFunction, this));
+  }
+
+  // Queues 'task' to be run in one of the threads.
+  void Run(UpdateTask *task) {
+    task->Start();
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(task);
+    queue_not_empty_.notify_one();
+  }
+
+  // Waits for the queued tasks to be done, and stops the threads.
+  ~UpdateThreads() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      queue_not_empty_.notify_all();
+    }
+    for (size_t i = 0; i < threads_.size(); i++)
+      threads_[i].join();
+  }
+
+ private:
+  void ThreadFunction() {
+    while (true) {
+      UpdateTask *task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (queue_.empty() && !stop_)
+          queue_not_empty_.wait(lock);
+        if (queue_.empty())
+          return;
+        task = queue_.front();
+        queue_.pop_front();
+      }
+      task->Run();
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable queue_not_empty_;
+  std::deque<UpdateTask*> queue_;
+  bool stop_;
+};
+
+
+OnlineNaturalGradient::UpdateThreads *OnlineNaturalGradient::update_threads_ =
+    NULL;
+
+// static
+void OnlineNaturalGradient::SetNumUpdateThreads(int32 num_threads) {
+  KALDI_ASSERT(num_threads >= 0);
+  delete update_threads_;
+  update_threads_ = (num_threads > 0 ? new UpdateThreads(num_threads) : NULL);
+}
+
+// Returns true if the current thread is using a GPU, in which case we don't
+// use the background threads (the CUDA state is per thread).
+static bool UsingGpu() {
+#if HAVE_CUDA == 1
+  return CuDevice::Instantiate().Enabled();
+#else
+  return false;
+#endif
+}
 
 
 /**
@@ -150,6 +293,7 @@ void OnlineNaturalGradient::Init(const CuMatrixBase<BaseFloat> &X0) {
     X0_copy.CopyFromMat(X0);
     this_copy.PreconditionDirections(&X0_copy, &scale);
   }
+  this_copy.WaitForUpdate();
   rank_ = this_copy.rank_;
   W_t_.Swap(&this_copy.W_t_);
   d_t_.Swap(&this_copy.d_t_);
@@ -172,20 +316,16 @@ void OnlineNaturalGradient::PreconditionDirections(
   if (t_ == 0) // not initialized
     Init(*X_t);
 
-  int32 R = W_t_.NumRows(), D = W_t_.NumCols();
-  // space for W_t, J_t, K_t, L_t.
-  CuMatrix<BaseFloat> WJKL_t(2 * R, D + R);
-  WJKL_t.Range(0, R, 0, D).CopyFromMat(W_t_);
-  BaseFloat rho_t(rho_t_);
-  Vector<BaseFloat> d_t(d_t_);
+  // Make sure W_t_, rho_t_ and d_t_ include any update that was started in the
+  // previous call.
+  WaitForUpdate();
 
   bool updating = Updating();
 
   BaseFloat initial_product;
   initial_product = TraceMatMat(*X_t, *X_t, kTrans);
 
-  PreconditionDirectionsInternal(rho_t, initial_product,
-                                 updating, d_t, &WJKL_t, X_t);
+  PreconditionDirectionsInternal(initial_product, updating, X_t);
 
   if (scale) {
     if (initial_product <= 0.0) {
@@ -203,7 +343,7 @@ void OnlineNaturalGradient::ReorthogonalizeRt1(
     BaseFloat rho_t1,
     CuMatrixBase<BaseFloat> *W_t1,
     CuMatrixBase<BaseFloat> *temp_W,
-    CuMatrixBase<BaseFloat> *temp_O) {
+    CuMatrixBase<BaseFloat> *temp_O) const {
   // threshold is a configuration value: a desired threshold on orthogonality,
   // below which we won't reorthogonalize.
   const BaseFloat threshold = 1.0e-03;
@@ -322,39 +462,82 @@ void OnlineNaturalGradient::SelfTest() const {
 }
 
 void OnlineNaturalGradient::PreconditionDirectionsInternal(
-    const BaseFloat rho_t,
     const BaseFloat tr_X_Xt,
     bool updating,
-    const Vector<BaseFloat> &d_t,
-    CuMatrixBase<BaseFloat> *WJKL_t,
     CuMatrixBase<BaseFloat> *X_t) {
   NVTX_RANGE(__func__);
   int32 N = X_t->NumRows(),  // Minibatch size.
       D = X_t->NumCols(),  // Dimensions of vectors we're preconditioning
       R = rank_;  // Rank of correction to unit matrix.
-  KALDI_ASSERT(R > 0 && R < D);
-  BaseFloat eta = Eta(N);
+  KALDI_ASSERT(R > 0 && R < D && W_t_.NumRows() == R && W_t_.NumCols() == D);
 
   CuMatrix<BaseFloat> H_t(N, R);
-  const CuSubMatrix<BaseFloat> W_t(*WJKL_t, 0, R, 0, D);
-  // Below, WJ_t and LK_t are combinations of two matrices,
-  // which we define in order to combine two separate multiplications into one.
-  CuSubMatrix<BaseFloat> J_t(*WJKL_t, R, R, 0, D),
-      L_t(*WJKL_t, 0, R, D, R),
-      K_t(*WJKL_t, R, R, D, R),
-      WJ_t(*WJKL_t, 0, 2 * R, 0, D),
-      LK_t(*WJKL_t, 0, 2 * R, D, R);
-
-  H_t.AddMatMat(1.0, *X_t, kNoTrans, W_t, kTrans, 0.0);  // H_t = X_t W_t^T
+  H_t.AddMatMat(1.0, *X_t, kNoTrans, W_t_, kTrans, 0.0);  // H_t = X_t W_t^T
 
   if (!updating) {
     // We're not updating the estimate of the Fisher matrix; we just apply the
     // preconditioning and return.
     // X_hat_t = X_t - H_t W_t
-    X_t->AddMatMat(-1.0, H_t, kNoTrans, W_t, kNoTrans, 1.0);
+    X_t->AddMatMat(-1.0, H_t, kNoTrans, W_t_, kNoTrans, 1.0);
     return;
   }
-  J_t.AddMatMat(1.0, H_t, kTrans, *X_t, kNoTrans, 0.0);  // J_t = H_t^T X_t
+
+  if (update_threads_ != NULL && !UsingGpu()) {
+    // The update needs X_t before preconditioning, so it gets a copy.
+    if (update_task_ == NULL)
+      update_task_ = new UpdateTask(this);
+    update_task_->X_t.Resize(N, D, kUndefined);
+    update_task_->X_t.CopyFromMat(*X_t);
+    update_task_->tr_X_Xt = tr_X_Xt;
+    X_t->AddMatMat(-1.0, H_t, kNoTrans, W_t_, kNoTrans, 1.0);
+    update_task_->H_t.Swap(&H_t);
+    update_threads_->Run(update_task_);
+    return;
+  }
+
+  CuMatrix<BaseFloat> W_t1;  // W_{t+1}
+  BaseFloat rho_t1;
+  Vector<BaseFloat> d_t1;
+  ComputeUpdate(*X_t, H_t, tr_X_Xt, &W_t1, &rho_t1, &d_t1);
+
+  X_t->AddMatMat(-1.0, H_t, kNoTrans, W_t_, kNoTrans, 1.0);  // X_hat_t = X_t - H_t W_t
+
+  W_t_.Swap(&W_t1);
+  d_t_.Swap(&d_t1);
+  rho_t_ = rho_t1;
+
+  if (self_debug_)
+    SelfTest();
+}
+
+void OnlineNaturalGradient::ComputeUpdate(const CuMatrixBase<BaseFloat> &X_t,
+                                          const CuMatrixBase<BaseFloat> &H_t,
+                                          BaseFloat tr_X_Xt,
+                                          CuMatrix<BaseFloat> *W_t1,
+                                          BaseFloat *rho_t1,
+                                          Vector<BaseFloat> *d_t1) const {
+  NVTX_RANGE(__func__);
+  int32 N = X_t.NumRows(),  // Minibatch size.
+      D = X_t.NumCols(),  // Dimensions of vectors we're preconditioning
+      R = rank_;  // Rank of correction to unit matrix.
+  BaseFloat eta = Eta(N);
+  const BaseFloat rho_t = rho_t_;
+  const Vector<BaseFloat> &d_t = d_t_;
+
+  // Space for W_t, J_t, K_t, L_t: WJKL_t (dimension 2*R by D + R) is
+  // [ W_t L_t; J_t K_t ].
+  CuMatrix<BaseFloat> WJKL_t(2 * R, D + R);
+  WJKL_t.Range(0, R, 0, D).CopyFromMat(W_t_);
+  const CuSubMatrix<BaseFloat> W_t(WJKL_t, 0, R, 0, D);
+  // Below, WJ_t and LK_t are combinations of two matrices,
+  // which we define in order to combine two separate multiplications into one.
+  CuSubMatrix<BaseFloat> J_t(WJKL_t, R, R, 0, D),
+      L_t(WJKL_t, 0, R, D, R),
+      K_t(WJKL_t, R, R, D, R),
+      WJ_t(WJKL_t, 0, 2 * R, 0, D),
+      LK_t(WJKL_t, 0, 2 * R, D, R);
+
+  J_t.AddMatMat(1.0, H_t, kTrans, X_t, kNoTrans, 0.0);  // J_t = H_t^T X_t
 
   bool compute_lk_together = (N > D);
 
@@ -416,44 +599,36 @@ void OnlineNaturalGradient::PreconditionDirectionsInternal(
     KALDI_WARN << "Floored " << nf << " elements of C_t.";
   }
 
-  X_t->AddMatMat(-1.0, H_t, kNoTrans, W_t, kNoTrans, 1.0);  // X_hat_t = X_t - H_t W_t
-
   Vector<BaseFloat> sqrt_c_t(c_t);
   sqrt_c_t.ApplyPow(0.5);
 
   // \rho_{t+1} = 1/(D - R) (\eta/N tr(X_t X_t^T) + (1-\eta)(D \rho_t + tr(D_t)) - tr(C_t^{0.5})).
-  BaseFloat rho_t1 = 1.0 / (D - R) * (eta / N * tr_X_Xt
-                                      + (1-eta)*(D * rho_t + d_t.Sum())
-                                      - sqrt_c_t.Sum());
+  *rho_t1 = 1.0 / (D - R) * (eta / N * tr_X_Xt
+                             + (1-eta)*(D * rho_t + d_t.Sum())
+                             - sqrt_c_t.Sum());
   // D_{t+1} = C_t^{0.5} - \rho_{t+1} I
-  Vector<BaseFloat> d_t1(sqrt_c_t);
-  d_t1.Add(-rho_t1);
+  d_t1->Resize(R, kUndefined);
+  d_t1->CopyFromVec(sqrt_c_t);
+  d_t1->Add(-*rho_t1);
   BaseFloat floor_val = std::max(epsilon_, delta_ * sqrt_c_t.Max());
-  if (rho_t1 < floor_val)
-    rho_t1 = floor_val;
-  d_t1.ApplyFloor(floor_val);
+  if (*rho_t1 < floor_val)
+    *rho_t1 = floor_val;
+  d_t1->ApplyFloor(floor_val);
 
-  CuMatrix<BaseFloat> W_t1(R, D);  // W_{t+1}
-  ComputeWt1(N, d_t, d_t1, rho_t, rho_t1, U_t, sqrt_c_t, inv_sqrt_e_t,
-             W_t, &J_t, &W_t1);
+  W_t1->Resize(R, D);
+  ComputeWt1(N, d_t, *d_t1, rho_t, *rho_t1, U_t, sqrt_c_t, inv_sqrt_e_t,
+             W_t, &J_t, W_t1);
 
   if (must_reorthogonalize) {
     if (self_debug_) {
       KALDI_WARN << "Reorthogonalizing.";
     }
-    ReorthogonalizeRt1(d_t1,
-                       rho_t1,
-                       &W_t1,
+    ReorthogonalizeRt1(*d_t1,
+                       *rho_t1,
+                       W_t1,
                        &J_t,
                        &L_t);
   }
-
-  W_t_.Swap(&W_t1);
-  d_t_.CopyFromVec(d_t1);
-  rho_t_ = rho_t1;
-
-  if (self_debug_)
-    SelfTest();
 }
 
 bool OnlineNaturalGradient::Updating() const {
@@ -581,12 +756,14 @@ OnlineNaturalGradient::OnlineNaturalGradient(const OnlineNaturalGradient &other)
     num_minibatches_history_(other.num_minibatches_history_),
     alpha_(other.alpha_), epsilon_(other.epsilon_), delta_(other.delta_),
     frozen_(other.frozen_), t_(other.t_),
-    self_debug_(other.self_debug_), W_t_(other.W_t_),
-    rho_t_(other.rho_t_), d_t_(other.d_t_) { }
+    self_debug_(other.self_debug_), update_task_(NULL) {
+  CopyParams(other);
+}
 
 
 OnlineNaturalGradient& OnlineNaturalGradient::operator = (
     const OnlineNaturalGradient &other) {
+  WaitForUpdate();
   rank_ = other.rank_;
   update_period_ = other.update_period_;
   num_samples_history_ = other.num_samples_history_;
@@ -595,12 +772,45 @@ OnlineNaturalGradient& OnlineNaturalGradient::operator = (
   delta_ = other.delta_;
   t_ = other.t_;
   self_debug_ = other.self_debug_;
-  W_t_ = other.W_t_;
-  rho_t_ = other.rho_t_;
-  d_t_ = other.d_t_;
+  CopyParams(other);
   return *this;
 }
 
+void OnlineNaturalGradient::CopyParams(const OnlineNaturalGradient &other) {
+  UpdateTask *task = other.update_task_;
+  if (task != NULL && task->Wait() && task->error.empty()) {
+    // 'other' hasn't installed the result of its update yet.
+    W_t_ = task->W_t1;
+    rho_t_ = task->rho_t1;
+    d_t_ = task->d_t1;
+  } else {
+    W_t_ = other.W_t_;
+    rho_t_ = other.rho_t_;
+    d_t_ = other.d_t_;
+  }
+}
+
+void OnlineNaturalGradient::WaitForUpdate() {
+  if (update_task_ == NULL || !update_task_->Wait())
+    return;
+  update_task_->pending = false;
+  if (!update_task_->error.empty())
+    KALDI_ERR << "Error updating the natural-gradient parameters in a "
+              << "background thread: " << update_task_->error;
+  W_t_.Swap(&update_task_->W_t1);
+  d_t_.Swap(&update_task_->d_t1);
+  rho_t_ = update_task_->rho_t1;
+  if (self_debug_)
+    SelfTest();
+}
+
+OnlineNaturalGradient::~OnlineNaturalGradient() {
+  if (update_task_ != NULL) {
+    update_task_->Wait();
+    delete update_task_;
+  }
+}
+
 void OnlineNaturalGradient::SetRank(int32 rank) {
   KALDI_ASSERT(rank > 0);
   rank_ = rank;
@@ -626,6 +836,9 @@ void OnlineNaturalGradient::SetAlpha(BaseFloat alpha) {
 }
 
 void OnlineNaturalGradient::Swap(OnlineNaturalGradient *other) {
+  // The update tasks aren't swapped, as they point to their owners.
+  WaitForUpdate();
+  other->WaitForUpdate();
   std::swap(rank_, other->rank_);
   std::swap(update_period_, other->update_period_);
   std::swap(num_samples_history_, other->num_samples_history_);
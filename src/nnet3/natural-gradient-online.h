@@ -389,21 +389,20 @@ namespace nnet3 {
    crash for zero inputs.
 
    A note on multi-threading.  This technique was really designed for use
-   with a GPU, where we won't have multi-threading, but we want it to work
-   also on a CPU, where we may have multiple worker threads.
-   Our approach is as follows (we do this when we're about to start updating
-   the parameters R_t, D_t, \rho_t and derived quantities):
-
-    For time t > 0 (where the matrices are already initialized), before starting
-    the part of the computation that updates the parameters (R_t, D_t, \rho_t and
-    derived quantities), we try to lock a mutex that guards the OnlinePreconditioner.
-    If we can lock it right away, we go ahead and do the update, but if not,
-    we just abandon the attempt to update those quantities.
-
-    We will have another mutex to ensure that when we access quantities like
-    W_t, \rho_t they are all "in sync" (and we don't access them while they are
-    being written by another thread).  This mutex will only be locked for short
-    periods of time.
+   with a GPU, but we want it to work also on a CPU, where the update of the
+   parameters R_t, D_t, \rho_t (which we do every update_period_ minibatches,
+   after the first few) can take a significant fraction of the time: it
+   consists of a few matrix multiplications and an eigenvalue decomposition of
+   dimension R, and a model may have hundreds of these objects.  If
+   SetNumUpdateThreads() has been called with a nonzero value (and we are not
+   using a GPU), PreconditionDirections() just computes X_hat_t, which depends
+   only on the current parameters, and leaves the update of the parameters to a
+   pool of background threads that is shared by all the objects of this class.
+   The next call to PreconditionDirections() on the same object waits for that
+   update to finish before using the new parameters, so the results are the
+   same as without the threads.  This only saves time if there are spare cores
+   on which the update can run while the rest of the backprop is being done;
+   the gain has not been measured on a multi-core machine.
 
    Note: it might be a good idea to make sure that the R_t still retain orthonormal
    rows even in the presence of roundoff, without errors accumulating.  My instinct
@@ -436,6 +435,13 @@ class OnlineNaturalGradient {
   // see comment where 'frozen_' is declared.
   inline void Freeze(bool frozen) { frozen_ = frozen; }
 
+  /// Sets the number of background threads that update the parameters of all
+  /// the OnlineNaturalGradient objects in this process; if 0 (the default),
+  /// the updates are done in PreconditionDirections() itself.  See the note on
+  /// multi-threading above.  Does nothing if we are using a GPU.  This should
+  /// be called before training, not while it is in progress.
+  static void SetNumUpdateThreads(int32 num_threads);
+
   /**
      This call implements the main functionality of this class.
 
@@ -469,18 +475,38 @@ class OnlineNaturalGradient {
 
   // Shallow swap
   void Swap(OnlineNaturalGradient *other);
- private:
 
+  // Waits for any update in a background thread to finish.
+  ~OnlineNaturalGradient();
+ private:
+  class UpdateTask;
+  class UpdateThreads;
 
-  // This is an internal function called from PreconditionDirections().
-  // Note: WJKL_t (dimension 2*R by D + R) is [ W_t L_t; J_t K_t ].
-  void PreconditionDirectionsInternal(const BaseFloat rho_t,
-                                      const BaseFloat tr_X_Xt,
+  // This is an internal function called from PreconditionDirections().  It
+  // preconditions X_t, and, if 'updating' is true, updates W_t_, rho_t_ and
+  // d_t_, or starts a background thread doing so.
+  void PreconditionDirectionsInternal(const BaseFloat tr_X_Xt,
                                       bool updating,
-                                      const Vector<BaseFloat> &d_t,
-                                      CuMatrixBase<BaseFloat> *WJKL_t,
                                       CuMatrixBase<BaseFloat> *X_t);
 
+  // Computes the updated parameters W_{t+1}, \rho_{t+1} and D_{t+1} from the
+  // minibatch X_t (before preconditioning), H_t = X_t W_t^T and
+  // tr_X_Xt = tr(X_t X_t^T).  This doesn't change the object, so it can be
+  // done in a background thread.
+  void ComputeUpdate(const CuMatrixBase<BaseFloat> &X_t,
+                     const CuMatrixBase<BaseFloat> &H_t,
+                     BaseFloat tr_X_Xt,
+                     CuMatrix<BaseFloat> *W_t1,
+                     BaseFloat *rho_t1,
+                     Vector<BaseFloat> *d_t1) const;
+
+  // If an update is being done in a background thread, waits for it to finish
+  // and sets W_t_, rho_t_ and d_t_ to its result.
+  void WaitForUpdate();
+
+  // Sets W_t_, rho_t_ and d_t_ to those of 'other', including the result of
+  // any update it is doing in a background thread.
+  void CopyParams(const OnlineNaturalGradient &other);
 
   // Works out from t_ and various class variables whether we will update
   // the parameters on this iteration (returns true if so).
@@ -519,7 +545,7 @@ class OnlineNaturalGradient {
                           BaseFloat rho_t1,
                           CuMatrixBase<BaseFloat> *W_t1,
                           CuMatrixBase<BaseFloat> *temp_W,
-                          CuMatrixBase<BaseFloat> *temp_O);
+                          CuMatrixBase<BaseFloat> *temp_O) const;
 
   void Init(const CuMatrixBase<BaseFloat> &R0);
 
@@ -612,6 +638,13 @@ class OnlineNaturalGradient {
   CuMatrix<BaseFloat> W_t_;
   BaseFloat rho_t_;
   Vector<BaseFloat> d_t_;
+
+  // The inputs and outputs of the update that is being done (or was last done)
+  // in a background thread; NULL if there hasn't been one.
+  UpdateTask *update_task_;
+
+  // The threads set up by SetNumUpdateThreads(); NULL if there are none.
+  static UpdateThreads *update_threads_;
 };
 
 } // namespace nnet3
@@ -0,0 +1,231 @@
+// nnet3/nnet-allreduce-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-allreduce.h"
+#include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-utils.h"
+
+#ifndef _MSC_VER
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace kaldi {
+namespace nnet3 {
+
+#ifndef _MSC_VER
+
+// Runs worker(opts) in opts.num_workers processes, with opts.rank set, and
+// checks that they all succeed.
+static void RunWorkers(const NnetAllreduceOptions &opts,
+                       void (*worker)(const NnetAllreduceOptions &opts)) {
+  std::vector<pid_t> pids;
+  for (int32 rank = 0; rank < opts.num_workers; rank++) {
+    pid_t pid = fork();
+    KALDI_ASSERT(pid >= 0);
+    if (pid == 0) {
+      NnetAllreduceOptions worker_opts(opts);
+      worker_opts.rank = rank;
+      int status = 0;
+      try {
+        worker(worker_opts);
+      } catch (...) {
+        status = 1;
+      }
+      _exit(status);
+    }
+    pids.push_back(pid);
+  }
+  // Wait for them in the order in which they exit; a worker whose neighbor
+  // has failed only notices it once the neighbor's process has been reaped.
+  for (size_t i = 0; i < pids.size(); i++) {
+    int status;
+    KALDI_ASSERT(waitpid(-1, &status, 0) > 0);
+    KALDI_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+}
+
+// Sets the options so that the workers communicate over TCP on this machine.
+static void SetTcpAddresses(NnetAllreduceOptions *opts) {
+  // Find free ports by letting the system choose them.
+  std::vector<int> fds;
+  std::ostringstream addresses;
+  for (int32 i = 0; i < opts->num_workers; i++) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    KALDI_ASSERT(fd >= 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    KALDI_ASSERT(bind(fd, reinterpret_cast<sockaddr*>(&addr), len) == 0 &&
+                 getsockname(fd, reinterpret_cast<sockaddr*>(&addr),
+                             &len) == 0);
+    addresses << (i > 0 ? "," : "") << "localhost:" << ntohs(addr.sin_port);
+    fds.push_back(fd);
+  }
+  for (size_t i = 0; i < fds.size(); i++)
+    close(fds[i]);
+  opts->shm_prefix = "";
+  opts->addresses = addresses.str();
+}
+
+static void SetShmPrefix(NnetAllreduceOptions *opts) {
+  std::ostringstream prefix;
+  prefix << "/tmp/nnet-allreduce-test." << getpid() << "." << Rand();
+  opts->shm_prefix = prefix.str();
+  opts->addresses = "";
+}
+
+// The dimension of the vectors in TestRingAllreducer; it is set before the
+// workers are forked.
+static int32 test_dim;
+
+static void FillVector(int32 rank, int32 iter, VectorBase<BaseFloat> *v) {
+  for (int32 i = 0; i < v->Dim(); i++)
+    (*v)(i) = (rank + 1) * 0.5 + (i % 17) * 0.25 - iter;
+}
+
+static void TestRingAllreducer(const NnetAllreduceOptions &opts) {
+  RingAllreducer allreducer(opts);
+  KALDI_ASSERT(allreducer.Rank() == opts.rank &&
+               allreducer.NumWorkers() == opts.num_workers);
+  for (int32 iter = 0; iter < 3; iter++) {
+    Vector<BaseFloat> data(test_dim), expected(test_dim), part(test_dim);
+    FillVector(opts.rank, iter, &data);
+    for (int32 rank = 0; rank < opts.num_workers; rank++) {
+      FillVector(rank, iter, &part);
+      expected.AddVec(1.0, part);
+    }
+    allreducer.Sum(&data);
+    KALDI_ASSERT(data.ApproxEqual(expected, 1.0e-05));
+    // Check that the sum is exactly the same on all workers.
+    Vector<BaseFloat> data0(data);
+    allreducer.Broadcast(&data0);
+    KALDI_ASSERT(data0.ApproxEqual(data, 0.0));
+  }
+}
+
+void UnitTestRingAllreducer() {
+  // The sizes include ones smaller than the number of workers, and ones
+  // larger than the buffers of the shared-memory channels.
+  int32 dims[] = { 0, 1, 2, 3, 100, 12345, 3000000 };
+  for (int32 num_workers = 2; num_workers <= 5; num_workers += 3) {
+    for (size_t i = 0; i < sizeof(dims) / sizeof(dims[0]); i++) {
+      NnetAllreduceOptions opts;
+      opts.num_workers = num_workers;
+      test_dim = dims[i];
+      SetShmPrefix(&opts);
+      RunWorkers(opts, TestRingAllreducer);
+      SetTcpAddresses(&opts);
+      RunWorkers(opts, TestRingAllreducer);
+    }
+  }
+}
+
+
+// The model for TestNnetAllreducer; it is set before the workers are forked.
+static Nnet *test_nnet;
+
+// Sets *delta_nnet to the parameter change that worker 'rank' computes on
+// minibatch 'minibatch'.
+static void GetTestDelta(int32 rank, int32 minibatch, Nnet *delta_nnet) {
+  ScaleNnet(0.0, delta_nnet);
+  srand(1000 * rank + minibatch);
+  PerturbParams(1.0, delta_nnet);
+}
+
+static void TestNnetAllreducer(const NnetAllreduceOptions &opts) {
+  // The workers were forked from the same process, so they get the same
+  // seed here.
+  int32 backstitch_interval = 4, orig_seed = RandInt(0, 100000),
+      srand_seed = orig_seed;
+  Nnet nnet(*test_nnet);
+  if (opts.rank != 0)
+    PerturbParams(0.1, &nnet);
+  NnetAllreducer allreducer(opts);
+  allreducer.Start(backstitch_interval, &nnet, &srand_seed);
+  // The model of worker 0 is copied to the others.
+  KALDI_ASSERT(NnetParametersAreIdentical(nnet, *test_nnet, 0.0));
+  KALDI_ASSERT(srand_seed == orig_seed + opts.rank * backstitch_interval);
+
+  // Worker 'rank' has 3 + rank minibatches, so the training stops when worker
+  // 0 runs out of data.
+  int32 num_minibatches = 3 + opts.rank;
+  Nnet delta_nnet(nnet), other_delta_nnet(nnet);
+  int32 dim = NumParameters(nnet);
+  Vector<BaseFloat> expected(dim), other(dim), result(dim);
+  for (int32 minibatch = 0; minibatch < num_minibatches; minibatch++) {
+    KALDI_ASSERT(!allreducer.Finished());
+    GetTestDelta(opts.rank, minibatch, &delta_nnet);
+    bool ans = allreducer.AverageNnet(&delta_nnet);
+    KALDI_ASSERT(ans == (minibatch < 3) && allreducer.Finished() == !ans);
+    if (!ans)
+      break;
+    expected.SetZero();
+    for (int32 rank = 0; rank < opts.num_workers; rank++) {
+      GetTestDelta(rank, minibatch, &other_delta_nnet);
+      VectorizeNnet(other_delta_nnet, &other);
+      expected.AddVec(1.0 / opts.num_workers, other);
+    }
+    VectorizeNnet(delta_nnet, &result);
+    KALDI_ASSERT(result.ApproxEqual(expected, 1.0e-04));
+  }
+  allreducer.Finish();
+  KALDI_ASSERT(allreducer.Finished());
+  allreducer.PrintStats();
+}
+
+void UnitTestNnetAllreducer() {
+  for (int32 n = 0; n < 3; n++) {
+    NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    test_nnet = &nnet;
+    NnetAllreduceOptions opts;
+    opts.num_workers = 3;
+    if (n % 2 == 0)
+      SetShmPrefix(&opts);
+    else
+      SetTcpAddresses(&opts);
+    RunWorkers(opts, TestNnetAllreducer);
+  }
+}
+
+#endif  // _MSC_VER
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+#ifndef _MSC_VER
+  UnitTestRingAllreducer();
+  UnitTestNnetAllreducer();
+  KALDI_LOG << "Nnet allreduce tests succeeded.";
+#endif
+  return 0;
+}
@@ -0,0 +1,700 @@
+// nnet3/nnet-allreduce.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-allreduce.h"
+#include "nnet3/nnet-utils.h"
+#include "base/timer.h"
+#include "util/text-utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+namespace kaldi {
+namespace nnet3 {
+
+// A one-directional connection between two workers.
+class AllreduceChannel {
+ public:
+  virtual void Send(const char *data, size_t size) = 0;
+
+  virtual void Recv(char *data, size_t size) = 0;
+
+  // Called from another thread to make a Send() that is waiting fail.
+  virtual void Abort() = 0;
+
+  virtual ~AllreduceChannel() { }
+};
+
+
+#ifndef _MSC_VER
+
+static bool ProcessExists(int32 pid) {
+  return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+// The header of the shared-memory file through which a worker sends to the
+// next one.  It is followed by a circular buffer of kShmBufferSize bytes.
+struct ShmHeader {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  std::atomic<int32> magic;  // Set to kShmMagic once the rest is initialized.
+  int32 receiver_pid;
+  int32 sender_pid;  // 0 until the sender has opened the file.
+  // The total numbers of bytes written and read.
+  uint64 write_pos;
+  uint64 read_pos;
+};
+
+static const int32 kShmMagic = 0x4b415252;
+static const size_t kShmHeaderSize = 256;
+static const size_t kShmBufferSize = 1 << 22;
+
+class ShmLock {
+ public:
+  explicit ShmLock(pthread_mutex_t *mutex): mutex_(mutex) {
+    pthread_mutex_lock(mutex_);
+  }
+  ~ShmLock() { pthread_mutex_unlock(mutex_); }
+ private:
+  pthread_mutex_t *mutex_;
+};
+
+class ShmChannel: public AllreduceChannel {
+ public:
+  // If 'create' is true, this is the receiving end and it creates the file
+  // 'path'; otherwise this is the sending end and it waits for the file to be
+  // created.
+  ShmChannel(const std::string &path, bool create, BaseFloat timeout);
+
+  // Called on the receiving end: waits for the sender to open the file, then
+  // deletes it.
+  void WaitForSender(BaseFloat timeout);
+
+  virtual void Send(const char *data, size_t size);
+
+  virtual void Recv(char *data, size_t size);
+
+  virtual void Abort() { aborted_ = true; }
+
+  virtual ~ShmChannel();
+
+ private:
+  // Maps the file; returns false if it has the wrong size (i.e. it is still
+  // being created).
+  bool Map(int fd);
+
+  // Waits on the condition variable (the mutex must be locked) for up to a
+  // short time, and checks that the other process still exists.
+  void Wait();
+
+  std::string path_;
+  bool is_receiver_;
+  bool unlinked_;
+  ShmHeader *header_;
+  char *buffer_;
+  std::atomic<bool> aborted_;
+};
+
+ShmChannel::ShmChannel(const std::string &path, bool create,
+                       BaseFloat timeout):
+    path_(path), is_receiver_(create), unlinked_(!create), header_(NULL),
+    buffer_(NULL), aborted_(false) {
+  KALDI_ASSERT(sizeof(ShmHeader) <= kShmHeaderSize);
+  if (create) {
+    // Remove any file left over by an earlier job that failed.
+    unlink(path.c_str());
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+      KALDI_ERR << "Could not create " << path << ": " << strerror(errno);
+    if (ftruncate(fd, kShmHeaderSize + kShmBufferSize) != 0 || !Map(fd)) {
+      close(fd);
+      KALDI_ERR << "Could not map " << path << ": " << strerror(errno);
+    }
+    close(fd);
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&header_->mutex, &mutex_attr);
+    pthread_mutexattr_destroy(&mutex_attr);
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&header_->cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    header_->receiver_pid = getpid();
+    header_->sender_pid = 0;
+    header_->write_pos = 0;
+    header_->read_pos = 0;
+    header_->magic = kShmMagic;
+  } else {
+    Timer timer;
+    while (true) {
+      int fd = open(path.c_str(), O_RDWR);
+      if (fd >= 0) {
+        bool mapped = Map(fd);
+        close(fd);
+        if (mapped) {
+          // A file whose receiver has exited was left over by an earlier job,
+          // and will be replaced.
+          if (header_->magic == kShmMagic &&
+              ProcessExists(header_->receiver_pid)) {
+            ShmLock lock(&header_->mutex);
+            header_->sender_pid = getpid();
+            pthread_cond_broadcast(&header_->cond);
+            break;
+          }
+          munmap(header_, kShmHeaderSize + kShmBufferSize);
+          header_ = NULL;
+        }
+      }
+      if (timer.Elapsed() > timeout)
+        KALDI_ERR << "Timed out waiting for the next worker to create "
+                  << path;
+      Sleep(0.01);
+    }
+  }
+}
+
+bool ShmChannel::Map(int fd) {
+  struct stat stat_buf;
+  if (fstat(fd, &stat_buf) != 0 ||
+      stat_buf.st_size != static_cast<off_t>(kShmHeaderSize + kShmBufferSize))
+    return false;
+  void *addr = mmap(NULL, kShmHeaderSize + kShmBufferSize,
+                    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED)
+    return false;
+  header_ = static_cast<ShmHeader*>(addr);
+  buffer_ = static_cast<char*>(addr) + kShmHeaderSize;
+  return true;
+}
+
+void ShmChannel::WaitForSender(BaseFloat timeout) {
+  Timer timer;
+  {
+    ShmLock lock(&header_->mutex);
+    while (header_->sender_pid == 0) {
+      if (timer.Elapsed() > timeout)
+        KALDI_ERR << "Timed out waiting for the previous worker to open "
+                  << path_;
+      Wait();
+    }
+  }
+  unlink(path_.c_str());
+  unlinked_ = true;
+}
+
+void ShmChannel::Wait() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  int64 nsec = now.tv_usec * 1000 + 100000000;  // wait for up to 0.1 seconds.
+  struct timespec deadline;
+  deadline.tv_sec = now.tv_sec + nsec / 1000000000;
+  deadline.tv_nsec = nsec % 1000000000;
+  if (pthread_cond_timedwait(&header_->cond, &header_->mutex,
+                             &deadline) == ETIMEDOUT) {
+    if (aborted_)
+      KALDI_ERR << "Aborted.";
+    int32 pid = (is_receiver_ ? header_->sender_pid : header_->receiver_pid);
+    if (pid != 0 && !ProcessExists(pid))
+      KALDI_ERR << "Worker process " << pid << " has exited.";
+  }
+}
+
+void ShmChannel::Send(const char *data, size_t size) {
+  while (size > 0) {
+    uint64 write_pos, read_pos;
+    {
+      ShmLock lock(&header_->mutex);
+      while (header_->write_pos - header_->read_pos == kShmBufferSize)
+        Wait();
+      write_pos = header_->write_pos;
+      read_pos = header_->read_pos;
+    }
+    // The receiver doesn't touch the free part of the buffer, so we can write
+    // it without holding the lock.
+    size_t offset = write_pos % kShmBufferSize,
+        count = std::min(size, kShmBufferSize - (write_pos - read_pos));
+    count = std::min(count, kShmBufferSize - offset);
+    memcpy(buffer_ + offset, data, count);
+    {
+      ShmLock lock(&header_->mutex);
+      header_->write_pos += count;
+      pthread_cond_broadcast(&header_->cond);
+    }
+    data += count;
+    size -= count;
+  }
+}
+
+void ShmChannel::Recv(char *data, size_t size) {
+  while (size > 0) {
+    uint64 write_pos, read_pos;
+    {
+      ShmLock lock(&header_->mutex);
+      while (header_->write_pos == header_->read_pos)
+        Wait();
+      write_pos = header_->write_pos;
+      read_pos = header_->read_pos;
+    }
+    size_t offset = read_pos % kShmBufferSize,
+        count = std::min(size, static_cast<size_t>(write_pos - read_pos));
+    count = std::min(count, kShmBufferSize - offset);
+    memcpy(data, buffer_ + offset, count);
+    {
+      ShmLock lock(&header_->mutex);
+      header_->read_pos += count;
+      pthread_cond_broadcast(&header_->cond);
+    }
+    data += count;
+    size -= count;
+  }
+}
+
+ShmChannel::~ShmChannel() {
+  if (header_ != NULL)
+    munmap(header_, kShmHeaderSize + kShmBufferSize);
+  if (!unlinked_)
+    unlink(path_.c_str());
+}
+
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+class TcpChannel: public AllreduceChannel {
+ public:
+  // Takes ownership of the connected socket 'fd'.
+  explicit TcpChannel(int fd): fd_(fd) { }
+
+  virtual void Send(const char *data, size_t size) {
+    while (size > 0) {
+      ssize_t n = send(fd_, data, size, kSendFlags);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        KALDI_ERR << "Error sending to the next worker: " << strerror(errno);
+      }
+      data += n;
+      size -= n;
+    }
+  }
+
+  virtual void Recv(char *data, size_t size) {
+    while (size > 0) {
+      ssize_t n = recv(fd_, data, size, 0);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        KALDI_ERR << "Error receiving from the previous worker: "
+                  << strerror(errno);
+      }
+      if (n == 0)
+        KALDI_ERR << "The previous worker closed the connection.";
+      data += n;
+      size -= n;
+    }
+  }
+
+  virtual void Abort() { shutdown(fd_, SHUT_RDWR); }
+
+  virtual ~TcpChannel() { close(fd_); }
+
+ private:
+  int fd_;
+};
+
+static void SetSocketOptions(int fd) {
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+// Splits "host:port" into its parts.
+static void ParseAddress(const std::string &address, std::string *host,
+                         std::string *port) {
+  size_t pos = address.rfind(':');
+  if (pos == std::string::npos || pos == 0 || pos + 1 == address.size())
+    KALDI_ERR << "Invalid address '" << address << "' in --allreduce.addresses;"
+              << " expected host:port";
+  *host = address.substr(0, pos);
+  *port = address.substr(pos + 1);
+}
+
+// Returns a socket listening on 'port' on all interfaces.
+static int TcpListen(const std::string &port) {
+  int32 port_number;
+  if (!ConvertStringToInteger(port, &port_number) || port_number <= 0 ||
+      port_number > 65535)
+    KALDI_ERR << "Invalid port " << port << " in --allreduce.addresses";
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    KALDI_ERR << "Could not create socket: " << strerror(errno);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port_number);
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, 4) != 0) {
+    std::string error = strerror(errno);
+    close(fd);
+    KALDI_ERR << "Could not listen on port " << port << ": " << error;
+  }
+  return fd;
+}
+
+// Connects to 'address', retrying until the other side is listening.
+static int TcpConnect(const std::string &address, BaseFloat timeout) {
+  std::string host, port;
+  ParseAddress(address, &host, &port);
+  Timer timer;
+  while (true) {
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+    if (ret != 0)
+      KALDI_ERR << "Could not resolve " << address << ": "
+                << gai_strerror(ret);
+    for (struct addrinfo *p = result; p != NULL; p = p->ai_next) {
+      int fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+      if (fd < 0)
+        continue;
+      if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) {
+        freeaddrinfo(result);
+        SetSocketOptions(fd);
+        return fd;
+      }
+      close(fd);
+    }
+    freeaddrinfo(result);
+    if (timer.Elapsed() > timeout)
+      KALDI_ERR << "Timed out trying to connect to the next worker at "
+                << address;
+    Sleep(0.1);
+  }
+}
+
+// Accepts one connection on 'listen_fd'.
+static int TcpAccept(int listen_fd, BaseFloat timeout) {
+  Timer timer;
+  while (true) {
+    struct pollfd poll_fd;
+    poll_fd.fd = listen_fd;
+    poll_fd.events = POLLIN;
+    poll_fd.revents = 0;
+    int ret = poll(&poll_fd, 1, 100);
+    if (ret > 0) {
+      int fd = accept(listen_fd, NULL, NULL);
+      if (fd >= 0) {
+        SetSocketOptions(fd);
+        return fd;
+      }
+    }
+    if (ret < 0 && errno != EINTR)
+      KALDI_ERR << "Error waiting for a connection: " << strerror(errno);
+    if (timer.Elapsed() > timeout)
+      KALDI_ERR << "Timed out waiting for the previous worker to connect.";
+  }
+}
+
+void RingAllreducer::ConnectShm() {
+  int32 next = (Rank() + 1) % NumWorkers();
+  // Each worker creates the file through which it receives.
+  ShmChannel *recv_channel = new ShmChannel(
+      opts_.shm_prefix + "." + std::to_string(Rank()), true,
+      opts_.connect_timeout);
+  recv_channel_ = recv_channel;
+  send_channel_ = new ShmChannel(
+      opts_.shm_prefix + "." + std::to_string(next), false,
+      opts_.connect_timeout);
+  recv_channel->WaitForSender(opts_.connect_timeout);
+}
+
+void RingAllreducer::ConnectTcp() {
+  std::vector<std::string> addresses;
+  SplitStringToVector(opts_.addresses, ",", true, &addresses);
+  if (addresses.size() != static_cast<size_t>(NumWorkers()))
+    KALDI_ERR << "--allreduce.addresses has " << addresses.size()
+              << " addresses but --allreduce.num-workers is " << NumWorkers();
+  std::string host, port;
+  ParseAddress(addresses[Rank()], &host, &port);
+  // We listen before connecting, so that all the workers can connect to the
+  // next one before any of them waits to accept a connection.
+  int listen_fd = TcpListen(port);
+  try {
+    send_channel_ = new TcpChannel(TcpConnect(
+        addresses[(Rank() + 1) % NumWorkers()], opts_.connect_timeout));
+    recv_channel_ = new TcpChannel(TcpAccept(listen_fd,
+                                             opts_.connect_timeout));
+  } catch (...) {
+    close(listen_fd);
+    throw;
+  }
+  close(listen_fd);
+}
+
+#else  // _MSC_VER
+
+void RingAllreducer::ConnectShm() {
+  KALDI_ERR << "Data-parallel training is not supported on Windows.";
+}
+
+void RingAllreducer::ConnectTcp() {
+  KALDI_ERR << "Data-parallel training is not supported on Windows.";
+}
+
+#endif  // _MSC_VER
+
+
+RingAllreducer::RingAllreducer(const NnetAllreduceOptions &opts):
+    opts_(opts), send_channel_(NULL), recv_channel_(NULL), failed_(false) {
+  if (opts_.num_workers < 2 || opts_.rank < 0 ||
+      opts_.rank >= opts_.num_workers)
+    KALDI_ERR << "Invalid options --allreduce.num-workers="
+              << opts_.num_workers << " --allreduce.rank=" << opts_.rank;
+  if (opts_.shm_prefix.empty() == opts_.addresses.empty())
+    KALDI_ERR << "Exactly one of the options --allreduce.shm-prefix and "
+              << "--allreduce.addresses must be set.";
+  try {
+    if (!opts_.shm_prefix.empty())
+      ConnectShm();
+    else
+      ConnectTcp();
+    // Check that the workers agree about their positions in the ring.
+    int32 header[2] = { Rank(), NumWorkers() }, prev_header[2];
+    send_channel_->Send(reinterpret_cast<const char*>(header),
+                        sizeof(header));
+    recv_channel_->Recv(reinterpret_cast<char*>(prev_header),
+                        sizeof(prev_header));
+    if (prev_header[0] != (Rank() + NumWorkers() - 1) % NumWorkers() ||
+        prev_header[1] != NumWorkers())
+      KALDI_ERR << "Worker " << Rank() << " of " << NumWorkers()
+                << " is connected to worker " << prev_header[0] << " of "
+                << prev_header[1] << "; check the --allreduce options.";
+  } catch (...) {
+    delete send_channel_;
+    delete recv_channel_;
+    throw;
+  }
+  KALDI_LOG << "Worker " << Rank() << " of " << NumWorkers()
+            << " is connected to the others.";
+}
+
+void RingAllreducer::SendRecv(const BaseFloat *send_data, int32 send_dim,
+                              BaseFloat *recv_data, int32 recv_dim) {
+  std::string send_error;
+  std::thread sender([&]() {
+      try {
+        send_channel_->Send(reinterpret_cast<const char*>(send_data),
+                            send_dim * sizeof(BaseFloat));
+      } catch (const std::exception &e) {
+        send_error = e.what();
+      }
+    });
+  try {
+    recv_channel_->Recv(reinterpret_cast<char*>(recv_data),
+                        recv_dim * sizeof(BaseFloat));
+  } catch (...) {
+    send_channel_->Abort();
+    sender.join();
+    throw;
+  }
+  sender.join();
+  if (!send_error.empty())
+    KALDI_ERR << send_error;
+}
+
+void RingAllreducer::Sum(VectorBase<BaseFloat> *data) {
+  if (failed_)
+    KALDI_ERR << "An earlier allreduce operation failed.";
+  failed_ = true;  // until we succeed.
+  int32 n = NumWorkers(), rank = Rank(), dim = data->Dim();
+  // Segment i of the data is the range [offsets[i], offsets[i+1]).
+  std::vector<int32> offsets(n + 1);
+  int32 max_size = 0;
+  for (int32 i = 0; i <= n; i++) {
+    offsets[i] = static_cast<int32>(static_cast<int64>(dim) * i / n);
+    if (i > 0)
+      max_size = std::max(max_size, offsets[i] - offsets[i - 1]);
+  }
+  if (recv_buffer_.Dim() < max_size)
+    recv_buffer_.Resize(max_size, kUndefined);
+  BaseFloat *ptr = data->Data();
+
+  // Reduce-scatter: in step s, we send segment rank - s and add segment
+  // rank - s - 1 from the previous worker to ours, so afterwards we have the
+  // total of segment rank + 1.
+  for (int32 s = 0; s + 1 < n; s++) {
+    int32 send_seg = (rank - s + n) % n,
+        recv_seg = (rank - s - 1 + n) % n,
+        recv_size = offsets[recv_seg + 1] - offsets[recv_seg];
+    SendRecv(ptr + offsets[send_seg],
+             offsets[send_seg + 1] - offsets[send_seg],
+             recv_buffer_.Data(), recv_size);
+    if (recv_size > 0) {
+      SubVector<BaseFloat> seg(*data, offsets[recv_seg], recv_size);
+      seg.AddVec(1.0, SubVector<BaseFloat>(recv_buffer_, 0, recv_size));
+    }
+  }
+  // All-gather: pass the totals around the ring.
+  for (int32 s = 0; s + 1 < n; s++) {
+    int32 send_seg = (rank + 1 - s + n) % n,
+        recv_seg = (rank - s + n) % n;
+    SendRecv(ptr + offsets[send_seg],
+             offsets[send_seg + 1] - offsets[send_seg],
+             ptr + offsets[recv_seg],
+             offsets[recv_seg + 1] - offsets[recv_seg]);
+  }
+  failed_ = false;
+}
+
+void RingAllreducer::Broadcast(VectorBase<BaseFloat> *data) {
+  if (failed_)
+    KALDI_ERR << "An earlier allreduce operation failed.";
+  failed_ = true;
+  char *ptr = reinterpret_cast<char*>(data->Data());
+  size_t size = data->Dim() * sizeof(BaseFloat);
+  if (Rank() != 0)
+    recv_channel_->Recv(ptr, size);
+  if (Rank() + 1 != NumWorkers())
+    send_channel_->Send(ptr, size);
+  failed_ = false;
+}
+
+RingAllreducer::~RingAllreducer() {
+  delete send_channel_;
+  delete recv_channel_;
+}
+
+
+NnetAllreducer::NnetAllreducer(const NnetAllreduceOptions &opts):
+    allreducer_(opts), num_params_(-1), finished_(false), num_averages_(0),
+    time_(0.0) { }
+
+void NnetAllreducer::Start(int32 backstitch_interval, Nnet *nnet,
+                           int32 *srand_seed) {
+  KALDI_ASSERT(num_params_ < 0 && "Start() called twice.");
+  num_params_ = NumParameters(*nnet);
+  // Floats represent integers exactly only up to 2^24, so we send the number
+  // of parameters in two parts.  (The integers sent here and the counts of
+  // workers summed in AverageNnet() are exact, so they may be cast back.)
+  Vector<BaseFloat> info(3);
+  info(0) = num_params_ % 65536;
+  info(1) = num_params_ / 65536;
+  info(2) = *srand_seed;
+  allreducer_.Broadcast(&info);
+  int32 num_params0 = static_cast<int32>(info(0)) +
+      65536 * static_cast<int32>(info(1));
+  if (num_params0 != num_params_)
+    KALDI_ERR << "Worker 0's model has " << num_params0 << " parameters "
+              << "but this one has " << num_params_;
+  params_.Resize(num_params_ + 1);
+  SubVector<BaseFloat> params(params_, 0, num_params_);
+  VectorizeNnet(*nnet, &params);
+  allreducer_.Broadcast(&params);
+  UnVectorizeNnet(params, nnet);
+  *srand_seed = static_cast<int32>(info(2)) +
+      allreducer_.Rank() * backstitch_interval;
+}
+
+void NnetAllreducer::SumParams() {
+  Timer timer;
+  // If this fails we can't continue, so we are finished unless it succeeds.
+  finished_ = true;
+  allreducer_.Sum(&params_);
+  finished_ = false;
+  num_averages_++;
+  time_ += timer.Elapsed();
+}
+
+bool NnetAllreducer::AverageNnet(Nnet *delta_nnet) {
+  KALDI_ASSERT(num_params_ >= 0 && "Start() was not called.");
+  if (finished_)
+    return false;
+  SubVector<BaseFloat> params(params_, 0, num_params_);
+  VectorizeNnet(*delta_nnet, &params);
+  params_(num_params_) = 1.0;
+  SumParams();
+  int32 num_workers = static_cast<int32>(params_(num_params_));
+  if (num_workers < allreducer_.NumWorkers()) {
+    KALDI_LOG << "Stopping training because another worker has run out of "
+              << "data; the remaining minibatches will not be used.";
+    finished_ = true;
+    return false;
+  }
+  params.Scale(1.0 / num_workers);
+  UnVectorizeNnet(params, delta_nnet);
+  return true;
+}
+
+void NnetAllreducer::Finish() {
+  if (finished_ || num_params_ < 0)
+    return;
+  params_.SetZero();
+  SumParams();
+  finished_ = true;
+  if (static_cast<int32>(params_(num_params_)) > 0)
+    KALDI_LOG << "This worker has run out of data, so the training stops.";
+}
+
+void NnetAllreducer::PrintStats() const {
+  KALDI_LOG << "Averaged " << num_params_ << " parameters over "
+            << allreducer_.NumWorkers() << " workers " << num_averages_
+            << " times, taking " << time_ << " seconds including the time "
+            << "spent waiting for the other workers.";
+}
+
+NnetAllreducer::~NnetAllreducer() {
+  // If we stopped because of an exception, e.g. an error reading the data,
+  // this makes the other workers stop too.
+  try {
+    Finish();
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error telling the other workers to stop: " << e.what();
+  }
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,189 @@
+// nnet3/nnet-allreduce.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_ALLREDUCE_H_
+#define KALDI_NNET3_NNET_ALLREDUCE_H_
+
+#include <string>
+
+#include "base/kaldi-common.h"
+#include "matrix/kaldi-vector.h"
+#include "util/parse-options.h"
+#include "nnet3/nnet-nnet.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+/**
+   Options for synchronous data-parallel training, in which several worker
+   processes (e.g. several copies of nnet3-train, each reading different
+   examples) train the same model and average their parameter changes after
+   each minibatch.  The workers communicate in a ring: each one sends to the
+   worker with the next rank and receives from the one with the previous
+   rank.  Workers on the same machine can communicate through shared memory
+   (--allreduce.shm-prefix); otherwise they use TCP connections
+   (--allreduce.addresses).
+*/
+struct NnetAllreduceOptions {
+  int32 num_workers;
+  int32 rank;
+  std::string shm_prefix;
+  std::string addresses;
+  BaseFloat connect_timeout;
+
+  NnetAllreduceOptions(): num_workers(1), rank(0), connect_timeout(300.0) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("num-workers", &num_workers, "Number of processes that "
+                   "train the model together, averaging the parameter changes "
+                   "after each minibatch.  If 1, this process trains alone.");
+    opts->Register("rank", &rank, "The index of this worker, in the range "
+                   "[0, num-workers - 1].  Worker 0's initial model is copied "
+                   "to the others.");
+    opts->Register("shm-prefix", &shm_prefix, "If the workers are on the same "
+                   "machine, a prefix for the files (e.g. /dev/shm/exp-iter5) "
+                   "through which they communicate; it must be the same for "
+                   "all workers and unique to this job.  The files are deleted "
+                   "once the workers are connected.");
+    opts->Register("addresses", &addresses, "For communication over TCP: a "
+                   "comma-separated list of host:port, one per worker in order "
+                   "of rank.  Each worker listens on its own port.");
+    opts->Register("connect-timeout", &connect_timeout, "Time in seconds to "
+                   "wait for the other workers to start.");
+  }
+};
+
+
+class AllreduceChannel;
+
+/**
+   This class connects the workers described by NnetAllreduceOptions and does
+   collective operations on vectors.  Sum() uses the ring algorithm, which
+   sends and receives 2 (n-1)/n times the size of the vector on each worker
+   (for n workers), regardless of the number of workers.  All the workers must
+   call the same functions, in the same order, with vectors of the same
+   dimension.  The results are bitwise identical on all workers.
+*/
+class RingAllreducer {
+ public:
+  /// Connects to the other workers; waits for them to start if necessary.
+  /// opts.num_workers must be at least 2.
+  explicit RingAllreducer(const NnetAllreduceOptions &opts);
+
+  int32 Rank() const { return opts_.rank; }
+
+  int32 NumWorkers() const { return opts_.num_workers; }
+
+  /// Replaces 'data' with its sum over all the workers.
+  void Sum(VectorBase<BaseFloat> *data);
+
+  /// Replaces 'data' with its value on worker 0.
+  void Broadcast(VectorBase<BaseFloat> *data);
+
+  ~RingAllreducer();
+
+ private:
+  void ConnectShm();
+
+  void ConnectTcp();
+
+  // Sends 'send_dim' values to the next worker while receiving 'recv_dim'
+  // values from the previous one.  (Doing both at the same time is necessary
+  // to avoid deadlock if the values don't fit in the channels' buffers.)
+  void SendRecv(const BaseFloat *send_data, int32 send_dim,
+                BaseFloat *recv_data, int32 recv_dim);
+
+  NnetAllreduceOptions opts_;
+  AllreduceChannel *send_channel_;  // to worker rank + 1.
+  AllreduceChannel *recv_channel_;  // from worker rank - 1.
+  Vector<BaseFloat> recv_buffer_;
+  // Set if an operation failed, after which the channels can't be used.
+  bool failed_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RingAllreducer);
+};
+
+
+/**
+   This class is used by NnetTrainer and NnetChainTrainer to average the
+   parameter changes over the workers after each minibatch, if
+   --allreduce.num-workers > 1.  Each worker computes the parameter change for
+   its own minibatch in the usual way, including the natural-gradient
+   preconditioning (which uses statistics from that worker's data only), and
+   then they all apply the average of those changes, so that their models stay
+   the same except for stored stats such as those of batchnorm components.
+
+   The workers must take part in the same number of averaging operations, so
+   when one of them runs out of data they all stop, and the remaining
+   minibatches on the other workers are not used.  The model on worker 0
+   should be used as the result.
+*/
+class NnetAllreducer {
+ public:
+  explicit NnetAllreducer(const NnetAllreduceOptions &opts);
+
+  /// This is to be called once, before training.  It copies worker 0's
+  /// parameters to 'nnet' and modifies *srand_seed (the seed from which the
+  /// trainers choose on which minibatches to do backstitch training) so that it
+  /// is the same on all workers modulo 'backstitch_interval', so they all do
+  /// backstitch on the same minibatches, but is otherwise different, so that
+  /// their dropout masks differ.
+  void Start(int32 backstitch_interval, Nnet *nnet, int32 *srand_seed);
+
+  /// Replaces the parameters of 'delta_nnet' with their average over the
+  /// workers and returns true; or, if any worker has run out of data (see
+  /// Finish()), returns false, in which case the training should stop and
+  /// this update should not be applied.
+  bool AverageNnet(Nnet *delta_nnet);
+
+  /// Called when this worker has no more data; takes part in the next
+  /// averaging operation of the other workers so that they stop too.  Does
+  /// nothing if the training has already stopped.
+  void Finish();
+
+  /// Returns true if the training has stopped, i.e. AverageNnet() returned
+  /// false or Finish() was called.
+  bool Finished() const { return finished_; }
+
+  /// Prints the time spent on communication.
+  void PrintStats() const;
+
+  /// Calls Finish(), so that the other workers stop if this one stops
+  /// because of an error.
+  ~NnetAllreducer();
+
+ private:
+  // Sums params_ over the workers.
+  void SumParams();
+
+  RingAllreducer allreducer_;
+  int32 num_params_;
+  bool finished_;
+  // The parameters of the nnet being averaged, with an extra element at the
+  // end that is 1 if the worker has data, which sums to the number of workers
+  // that contributed.
+  Vector<BaseFloat> params_;
+
+  int64 num_averages_;
+  double time_;
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_ALLREDUCE_H_
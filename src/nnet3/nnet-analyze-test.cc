@@ -20,6 +20,7 @@
 #include "nnet3/nnet-nnet.h"
 #include "nnet3/nnet-compile.h"
 #include "nnet3/nnet-analyze.h"
+#include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-test-utils.h"
 
 namespace kaldi {
@@ -93,6 +94,79 @@ void UnitTestNnetAnalyze() {
   }
 }
 
+// Checks that ComputeMemoryPlan() never puts matrices that exist at the same
+// time in overlapping memory.
+void UnitTestComputeMemoryPlan() {
+  for (int32 n = 0; n < 20; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+
+    ComputationRequest request;
+    std::vector<Matrix<BaseFloat> > inputs;
+    ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+
+    NnetComputation computation;
+    Compiler compiler(request, nnet);
+    CompilerOptions opts;
+    compiler.CreateComputation(opts, &computation);
+    if (RandInt(0, 1) == 0) {
+      NnetOptimizeOptions optimize_opts;
+      Optimize(optimize_opts, nnet, MaxOutputTimeInRequest(request),
+               &computation);
+    }
+
+    ComputationMemoryPlan plan;
+    ComputeMemoryPlan(computation, &plan);
+    int32 num_matrices = computation.matrices.size(),
+        num_submatrices = computation.submatrices.size(),
+        num_commands = computation.commands.size();
+    KALDI_ASSERT(plan.offsets.size() == computation.matrices.size() &&
+                 plan.strides.size() == computation.matrices.size());
+
+    // The commands that allocate and deallocate each matrix.
+    std::vector<int32> alloc(num_matrices, -1),
+        dealloc(num_matrices, num_commands);
+    for (int32 c = 0; c < num_commands; c++) {
+      const NnetComputation::Command &command = computation.commands[c];
+      int32 m = (command.arg1 >= 0 && command.arg1 < num_submatrices ?
+                 computation.submatrices[command.arg1].matrix_index : -1);
+      if (command.command_type == kAllocMatrix) alloc[m] = c;
+      if (command.command_type == kDeallocMatrix) dealloc[m] = c;
+    }
+    int64 total_size = 0;
+    for (int32 m = 0; m < num_matrices; m++) {
+      if (plan.offsets[m] < 0)
+        continue;
+      const NnetComputation::MatrixInfo &info = computation.matrices[m];
+      KALDI_ASSERT(alloc[m] >= 0 && alloc[m] < dealloc[m]);
+      KALDI_ASSERT(plan.offsets[m] % ComputationMemoryPlan::kAlignment == 0 &&
+                   plan.strides[m] >= info.num_cols);
+      int64 end = plan.offsets[m] +
+          static_cast<int64>(plan.strides[m]) * info.num_rows;
+      KALDI_ASSERT(end <= plan.arena_size);
+      total_size += end - plan.offsets[m];
+      for (int32 m2 = 0; m2 < m; m2++) {
+        if (plan.offsets[m2] < 0 || alloc[m] > dealloc[m2] ||
+            alloc[m2] > dealloc[m])
+          continue;
+        int64 end2 = plan.offsets[m2] + static_cast<int64>(plan.strides[m2]) *
+            computation.matrices[m2].num_rows;
+        KALDI_ASSERT(end <= plan.offsets[m2] || end2 <= plan.offsets[m]);
+      }
+    }
+    KALDI_LOG << "Placed " << plan.NumMatricesPlanned() << " of "
+              << (num_matrices - 1) << " matrices in an arena of size "
+              << plan.arena_size << " (their total size is " << total_size
+              << ")";
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -102,6 +176,7 @@ int main() {
   //SetVerboseLevel(2);
 
   UnitTestNnetAnalyze();
+  UnitTestComputeMemoryPlan();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
@@ -17,6 +17,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <map>
 #include "nnet3/nnet-analyze.h"
 
 namespace kaldi {
@@ -857,6 +858,31 @@ void ComputationChecker::CheckComputationIndexes() const {
           memo_to_command[c.arg5] = command_index;
         }
         KALDI_ASSERT(c.arg6 == 0 || c.arg6 == 1);
+        if (c.arg7 > 0) {
+          // This command is fused with the arg7 commands after it (see
+          // FusePropagateCommands()).
+          if (c.arg5 != 0 || c.arg6 != 0 ||
+              command_index + c.arg7 >= num_commands)
+            KALDI_ERR << "Invalid fused propagation";
+          for (int32 i = 1; i <= c.arg7; i++) {
+            const NnetComputation::Command &c2 =
+                computation_.commands[command_index + i];
+            if (c2.command_type != kPropagate || c2.arg7 != 0 ||
+                !(submatrices[c2.arg3] == submatrices[c.arg4]) ||
+                !(submatrices[c2.arg4] == submatrices[c.arg4]))
+              KALDI_ERR << "Invalid fused propagation";
+          }
+        } else if (c.arg7 == 0) {
+          // This command is fused into the one before it.
+          if (command_index == 0 ||
+              computation_.commands[command_index - 1].command_type !=
+              kPropagate ||
+              computation_.commands[command_index - 1].arg7 < 0 ||
+              c.arg5 != 0 || c.arg6 != 0 ||
+              !(properties & kSimpleComponent) ||
+              !(properties & kPropagateInPlace))
+            KALDI_ERR << "Invalid fused propagation";
+        }
         break;
       }
       case kBackprop:
@@ -1495,5 +1521,118 @@ int64 GetMaxMemoryUse(const NnetComputation &computation) {
   return max_memory_use;
 }
 
+const int32 ComputationMemoryPlan::kAlignment;
+
+int32 ComputationMemoryPlan::NumMatricesPlanned() const {
+  int32 ans = 0;
+  for (size_t m = 0; m < offsets.size(); m++)
+    if (offsets[m] >= 0)
+      ans++;
+  return ans;
+}
+
+void ComputeMemoryPlan(const NnetComputation &computation,
+                       ComputationMemoryPlan *plan) {
+  int32 num_commands = computation.commands.size(),
+      num_matrices = computation.matrices.size();
+  // For each matrix, the command that allocates it and the command that
+  // deallocates it (-1 if none); -2 means it is not a candidate for the arena.
+  std::vector<int32> alloc_command(num_matrices, -1),
+      dealloc_command(num_matrices, -1);
+  int32 loop_begin = -1, loop_end = -1;
+  for (int32 c = 0; c < num_commands; c++) {
+    const NnetComputation::Command &command = computation.commands[c];
+    switch (command.command_type) {
+      case kAllocMatrix: {
+        int32 m = computation.submatrices[command.arg1].matrix_index;
+        alloc_command[m] = (alloc_command[m] == -1 ? c : -2);
+        break;
+      }
+      case kDeallocMatrix: {
+        int32 m = computation.submatrices[command.arg1].matrix_index;
+        if (dealloc_command[m] == -1 && alloc_command[m] >= 0)
+          dealloc_command[m] = c;
+        else
+          alloc_command[m] = -2;
+        break;
+      }
+      case kSwapMatrix:
+        alloc_command[computation.submatrices[command.arg1].matrix_index] = -2;
+        alloc_command[computation.submatrices[command.arg2].matrix_index] = -2;
+        break;
+      case kAcceptInput: case kProvideOutput:
+        alloc_command[computation.submatrices[command.arg1].matrix_index] = -2;
+        break;
+      case kGotoLabel:
+        loop_begin = command.arg1;
+        loop_end = c;
+        break;
+      default:
+        break;
+    }
+  }
+
+  plan->offsets.clear();
+  plan->offsets.resize(num_matrices, -1);
+  plan->strides.clear();
+  plan->strides.resize(num_matrices, 0);
+  plan->arena_size = 0;
+
+  // The matrices placed in the arena, in the order in which they are
+  // allocated, and their sizes (rounded up to a multiple of kAlignment).
+  std::vector<int32> planned(num_commands, -1);
+  std::vector<int64> sizes(num_matrices, 0);
+  const int32 alignment = ComputationMemoryPlan::kAlignment,
+      row_alignment = 16 / sizeof(BaseFloat);
+  for (int32 m = 1; m < num_matrices; m++) {
+    int32 alloc = alloc_command[m], dealloc = dealloc_command[m];
+    if (alloc < 0)
+      continue;
+    if (loop_end >= 0) {
+      bool inside_loop = (alloc > loop_begin && dealloc >= 0 &&
+                          dealloc < loop_end),
+          contains_loop = (alloc < loop_begin &&
+                           (dealloc < 0 || dealloc > loop_end));
+      if (!inside_loop && !contains_loop)
+        continue;
+    }
+    const NnetComputation::MatrixInfo &info = computation.matrices[m];
+    int32 stride = info.num_cols;
+    if (info.stride_type == kDefaultStride)
+      stride += (row_alignment - stride % row_alignment) % row_alignment;
+    int64 size = static_cast<int64>(stride) * info.num_rows;
+    if (size == 0)
+      continue;  // can't happen in a valid computation.
+    plan->strides[m] = stride;
+    sizes[m] = (size + alignment - 1) / alignment * alignment;
+    planned[alloc] = m;
+  }
+
+  // 'live' maps from the offset of each matrix currently in the arena to the
+  // end of its memory.
+  std::map<int64, int64> live;
+  for (int32 c = 0; c < num_commands; c++) {
+    const NnetComputation::Command &command = computation.commands[c];
+    if (command.command_type == kDeallocMatrix) {
+      int32 m = computation.submatrices[command.arg1].matrix_index;
+      if (plan->offsets[m] >= 0)
+        live.erase(plan->offsets[m]);
+    } else if (planned[c] >= 0) {
+      int32 m = planned[c];
+      // Find the first gap between live matrices that is large enough.
+      int64 offset = 0;
+      for (std::map<int64, int64>::const_iterator iter = live.begin();
+           iter != live.end(); ++iter) {
+        if (iter->first - offset >= sizes[m])
+          break;
+        offset = iter->second;
+      }
+      plan->offsets[m] = offset;
+      live[offset] = offset + sizes[m];
+      plan->arena_size = std::max(plan->arena_size, offset + sizes[m]);
+    }
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
@@ -460,6 +460,58 @@ void CheckComputation(const Nnet &nnet,
 int64 GetMaxMemoryUse(const NnetComputation &computation);
 
 
+/**
+   This struct describes a layout of the matrices of a computation in a single
+   block of memory (an "arena"), in which matrices whose lifetimes do not
+   overlap may share memory.  NnetComputer uses this on CPU so that it does not
+   have to allocate and free memory for each matrix.  See ComputeMemoryPlan().
+*/
+struct ComputationMemoryPlan {
+  /// offsets[m] is the offset, in elements of BaseFloat, of matrix-index m in
+  /// the arena, or -1 if matrix m is not stored in the arena.  Offsets are
+  /// multiples of kAlignment.
+  std::vector<int64> offsets;
+  /// strides[m] is the row stride of matrix m, if offsets[m] >= 0 (else 0).
+  std::vector<int32> strides;
+  /// The number of elements of BaseFloat that the arena needs to have.
+  int64 arena_size;
+
+  /// The alignment of the matrices in the arena, in elements of BaseFloat
+  /// (this is 64 bytes, i.e. a cache line).
+  static const int32 kAlignment = 64 / sizeof(BaseFloat);
+
+  ComputationMemoryPlan(): arena_size(0) { }
+  /// Returns the number of matrices that are stored in the arena.
+  int32 NumMatricesPlanned() const;
+};
+
+/**
+   This function works out a layout of the matrices of 'computation' in a
+   single arena, based on when they are allocated and deallocated.  The
+   lifetime of a matrix is the range of command indexes from its kAllocMatrix
+   to its kDeallocMatrix command (or the end of the computation if it is never
+   deallocated); matrices whose lifetimes do not overlap may be assigned the
+   same memory.  Offsets are assigned greedily (first-fit) in the order in which
+   the matrices are allocated.
+
+   Only matrices that have exactly one kAllocMatrix command and at most one
+   kDeallocMatrix command, after it, are placed in the arena.  Matrices that
+   are inputs or outputs of the computation (which are passed to and from the
+   user by swapping), or that appear in kSwapMatrix commands, are not.  For
+   looped computations, a matrix is only placed in the arena if its lifetime is
+   entirely inside the loop or contains the whole loop.
+
+   The stride of a matrix with kDefaultStride is rounded up to a multiple of
+   16 bytes, as is done by the Matrix class; it is the number of columns for
+   kStrideEqualNumCols.  This function ignores kCompressMatrix and
+   kDecompressMatrix commands (the memory stays reserved while a matrix is
+   compressed), so the plan should only be used where those commands do
+   nothing, i.e. on CPU.
+*/
+void ComputeMemoryPlan(const NnetComputation &computation,
+                       ComputationMemoryPlan *plan);
+
+
 } // namespace nnet3
 } // namespace kaldi
 
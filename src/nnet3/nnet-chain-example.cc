@@ -453,7 +453,13 @@ int32 GetNnetChainExampleSize(const NnetChainExample &a) {
 ChainExampleMerger::ChainExampleMerger(const ExampleMergingConfig &config,
                                        NnetChainExampleWriter *writer):
     finished_(false), num_egs_written_(0),
-    config_(config), writer_(writer) { }
+    config_(config), writer_(writer), minibatches_(NULL) { }
+
+ChainExampleMerger::ChainExampleMerger(
+    const ExampleMergingConfig &config,
+    std::vector<std::vector<NnetChainExample> > *minibatches):
+    finished_(false), num_egs_written_(0),
+    config_(config), writer_(NULL), minibatches_(minibatches) { }
 
 
 void ChainExampleMerger::AcceptExample(NnetChainExample *eg) {
@@ -495,6 +501,12 @@ void ChainExampleMerger::WriteMinibatch(
   size_t structure_hash = eg_hasher((*egs)[0]);
   int32 minibatch_size = egs->size();
   stats_.WroteExample(eg_size, structure_hash, minibatch_size);
+  if (minibatches_ != NULL) {
+    num_egs_written_++;
+    minibatches_->resize(minibatches_->size() + 1);
+    minibatches_->back().swap(*egs);
+    return;
+  }
   NnetChainExample merged_eg;
   MergeChainExamples(config_.compress, egs, &merged_eg);
   std::ostringstream key;
@@ -236,6 +236,14 @@ class ChainExampleMerger {
   ChainExampleMerger(const ExampleMergingConfig &config,
                      NnetChainExampleWriter *writer);
 
+  // This version of the constructor is for when the minibatches are to be
+  // merged by the caller (e.g. in other threads, see class ExampleLoader)
+  // rather than written out: each time a minibatch is ready, its examples
+  // are appended to 'minibatches' as a vector, without being merged.  The
+  // caller should empty 'minibatches' from time to time.
+  ChainExampleMerger(const ExampleMergingConfig &config,
+                     std::vector<std::vector<NnetChainExample> > *minibatches);
+
   // This function accepts an example, and if possible, writes a merged example
   // out.  The ownership of the pointer 'a' is transferred to this class when
   // you call this function.
@@ -254,15 +262,17 @@ class ChainExampleMerger {
   ~ChainExampleMerger() { Finish(); };
  private:
   // called by Finish() and AcceptExample().  Merges, updates the stats, and
-  // writes.  The 'egs' is non-const only because the egs are temporarily
-  // changed inside MergeChainEgs.  The pointer 'egs' is still owned
-  // by the caller.
+  // writes; or if minibatches_ is set, updates the stats and moves the
+  // contents of 'egs' to there.  The 'egs' is non-const only because the egs
+  // are temporarily changed inside MergeChainEgs.  The pointer 'egs' is still
+  // owned by the caller.
   void WriteMinibatch(std::vector<NnetChainExample> *egs);
 
   bool finished_;
   int32 num_egs_written_;
   const ExampleMergingConfig &config_;
   NnetChainExampleWriter *writer_;
+  std::vector<std::vector<NnetChainExample> > *minibatches_;
   ExampleMergingStats stats_;
 
   // Note: the "key" into the egs is the first element of the vector.
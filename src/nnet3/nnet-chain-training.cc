@@ -19,6 +19,7 @@
 // limitations under the License.
 
 #include "nnet3/nnet-chain-training.h"
+#include "nnet3/natural-gradient-online.h"
 #include "nnet3/nnet-utils.h"
 
 namespace kaldi {
@@ -34,7 +35,8 @@ NnetChainTrainer::NnetChainTrainer(const NnetChainTrainingOptions &opts,
               opts_.nnet_config.compiler_config),
     num_minibatches_processed_(0),
     max_change_stats_(*nnet),
-    srand_seed_(RandInt(0, 100000)) {
+    srand_seed_(RandInt(0, 100000)),
+    allreducer_(NULL) {
   if (opts.nnet_config.zero_component_stats)
     ZeroComponentStats(nnet);
   KALDI_ASSERT(opts.nnet_config.momentum >= 0.0 &&
@@ -42,6 +44,15 @@ NnetChainTrainer::NnetChainTrainer(const NnetChainTrainingOptions &opts,
                opts.nnet_config.backstitch_training_interval > 0);
   delta_nnet_ = nnet_->Copy();
   ScaleNnet(0.0, delta_nnet_);
+  if (opts.nnet_config.natural_gradient_threads > 0)
+    OnlineNaturalGradient::SetNumUpdateThreads(
+        opts.nnet_config.natural_gradient_threads);
+
+  if (opts_.nnet_config.allreduce_config.num_workers > 1) {
+    allreducer_ = new NnetAllreducer(opts_.nnet_config.allreduce_config);
+    allreducer_->Start(opts_.nnet_config.backstitch_training_interval, nnet_,
+                       &srand_seed_);
+  }
 
   if (opts.nnet_config.read_cache != "") {
     bool binary;
@@ -59,6 +70,8 @@ NnetChainTrainer::NnetChainTrainer(const NnetChainTrainingOptions &opts,
 
 void NnetChainTrainer::Train(const NnetChainExample &chain_eg) {
   NVTX_RANGE(__func__);
+  if (allreducer_ != NULL && allreducer_->Finished())
+    return;  // Another worker has run out of data.
   bool need_model_derivative = true;
   const NnetTrainerOptions &nnet_config = opts_.nnet_config;
   bool use_xent_regularization = (opts_.chain_config.xent_regularize != 0.0);
@@ -118,6 +131,12 @@ void NnetChainTrainer::TrainInternal(const NnetChainExample &eg,
                         nnet_config.l2_regularize_factor,
                         delta_nnet_);
 
+  // If there are several workers, average the parameter change over them.
+  if (allreducer_ != NULL && !allreducer_->AverageNnet(delta_nnet_)) {
+    ScaleNnet(0.0, delta_nnet_);
+    return;
+  }
+
   // Updates the parameters of nnet
   bool success = UpdateNnetWithMaxChange(
       *delta_nnet_,
@@ -177,6 +196,11 @@ void NnetChainTrainer::TrainInternalBackstitch(const NnetChainExample &eg,
         nnet_config.l2_regularize_factor, delta_nnet_);
   }
 
+  if (allreducer_ != NULL && !allreducer_->AverageNnet(delta_nnet_)) {
+    ScaleNnet(0.0, delta_nnet_);
+    return;
+  }
+
   // Updates the parameters of nnet
   UpdateNnetWithMaxChange(
       *delta_nnet_, nnet_config.max_param_change,
@@ -281,6 +305,8 @@ bool NnetChainTrainer::PrintTotalStats() const {
     ans = info.PrintTotalStats(name) || ans;
   }
   max_change_stats_.Print(*nnet_);
+  if (allreducer_ != NULL)
+    allreducer_->PrintStats();
   return ans;
 }
 
@@ -291,6 +317,7 @@ NnetChainTrainer::~NnetChainTrainer() {
     KALDI_LOG << "Wrote computation cache to " << opts_.nnet_config.write_cache;
   }
   delete delta_nnet_;
+  delete allreducer_;
 }
 
 
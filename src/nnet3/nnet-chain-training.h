@@ -50,7 +50,8 @@ struct NnetChainTrainingOptions {
 
 /**
    This class is for single-threaded training of neural nets using the 'chain'
-   model.
+   model.  If --allreduce.num-workers > 1, this is one of several processes
+   that train the model together; see class NnetAllreducer.
 */
 class NnetChainTrainer {
  public:
@@ -102,6 +103,9 @@ class NnetChainTrainer {
   // consistent dropout masks.  It's set to a value derived from rand()
   // when the class is initialized.
   int32 srand_seed_;
+
+  // Non-NULL if opts_.nnet_config.allreduce_config.num_workers > 1.
+  NnetAllreducer *allreducer_;
 };
 
 
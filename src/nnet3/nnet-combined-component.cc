@@ -1470,15 +1470,9 @@ void* GruNonlinearityComponent::Propagate(
   // now h_t = hpart_t (note: hpart_t actually means U^h x_t).
   h_t.AddMatMat(1.0, sdotr, kNoTrans, w_h_, kTrans, 1.0);
   // now h_t = hpart_t + W^h (s_{t-1} \dot r_t).
-  h_t.Tanh(h_t);
-  // now, h_t = tanh(hpart_t + W^h (s_{t-1} \dot r_t)).
-
-  c_t.CopyFromMat(h_t);
-  // now c_t = h_t
-  c_t.AddMatMatElements(-1.0, z_t, h_t, 1.0);
-  // now c_t = (1 - z_t) \dot h_t.
-  c_t.AddMatMatElements(1.0, z_t, c_t1, 1.0);
-  // now c_t = (1 - z_t) \dot h_t  +  z_t \dot c_{t-1}.
+  cu::ComputeGruOutput(z_t, c_t1, &h_t, &c_t);
+  // now, h_t = tanh(hpart_t + W^h (s_{t-1} \dot r_t)), and
+  // c_t = (1 - z_t) \dot h_t  +  z_t \dot c_{t-1}.
   return NULL;
 }
 
@@ -1972,15 +1966,9 @@ void* OutputGruNonlinearityComponent::Propagate(
   // now h_t = W^h \dot c_{t-1}
   h_t.AddMat(1.0, hpart_t, kNoTrans);
   // now h_t = hpart_t + W^h \dot c_{t-1}.(note: hpart_t actually means U^h x_t).
-  h_t.Tanh(h_t);
-  // now, h_t = tanh(hpart_t + W^h \dot c_{t-1}).
-
-  c_t.CopyFromMat(h_t);
-  // now c_t = h_t
-  c_t.AddMatMatElements(-1.0, z_t, h_t, 1.0);
-  // now c_t = (1 - z_t) \dot h_t.
-  c_t.AddMatMatElements(1.0, z_t, c_t1, 1.0);
-  // now c_t = (1 - z_t) \dot h_t  +  z_t \dot c_{t-1}.
+  cu::ComputeGruOutput(z_t, c_t1, &h_t, &c_t);
+  // now, h_t = tanh(hpart_t + W^h \dot c_{t-1}), and
+  // c_t = (1 - z_t) \dot h_t  +  z_t \dot c_{t-1}.
   return NULL;
 }
 
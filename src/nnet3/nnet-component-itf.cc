@@ -115,6 +115,8 @@ Component* Component::NewComponentOfType(const std::string &component_type) {
     ans = new AffineComponent();
   } else if (component_type == "LinearComponent") {
     ans = new LinearComponent();
+  } else if (component_type == "BlockSparseAffineComponent") {
+    ans = new BlockSparseAffineComponent();
   } else if (component_type == "NaturalGradientAffineComponent") {
     ans = new NaturalGradientAffineComponent();
   } else if (component_type == "PerElementScaleComponent") {
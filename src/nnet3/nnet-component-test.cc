@@ -518,6 +518,29 @@ void UnitTestNnetComponent() {
   }
 }
 
+// Checks that the parameters of BlockSparseAffineComponent that belong to no
+// output (in a partial last block of rows) stay zero, so that DotProduct()
+// equals the squared norm of the actual parameters.
+void UnitTestBlockSparseAffineUnusedParams() {
+  int32 block_rows = RandInt(2, 16),
+      output_dim = block_rows * RandInt(1, 3) + RandInt(1, block_rows - 1);
+  std::ostringstream os;
+  os << "input-dim=" << RandInt(1, 40) << " output-dim=" << output_dim
+     << " block-rows=" << block_rows << " density=" << (0.1 * RandInt(1, 10));
+  ConfigLine cfl;
+  cfl.ParseLine(os.str());
+  BlockSparseAffineComponent c;
+  c.InitFromConfig(&cfl);
+  for (int32 i = 0; i < 2; i++) {
+    CuMatrix<BaseFloat> linear_params;
+    c.GetLinearParams(&linear_params);
+    BaseFloat norm_sq = TraceMatMat(linear_params, linear_params, kTrans) +
+        VecVec(c.BiasParams(), c.BiasParams());
+    KALDI_ASSERT(ApproxEqual(c.DotProduct(c), norm_sq));
+    c.PerturbParams(0.1);
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -534,6 +557,8 @@ int main() {
       CuDevice::Instantiate().SelectGpuId("yes");
 #endif
     UnitTestNnetComponent();
+    for (int32 i = 0; i < 10; i++)
+      UnitTestBlockSparseAffineUnusedParams();
 #if HAVE_CUDA == 1
   } // No for loop if 'HAVE_CUDA != 1',
   CuDevice::Instantiate().PrintProfile();
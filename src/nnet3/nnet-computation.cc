@@ -549,7 +549,12 @@ static void PrintCommand(std::ostream &os_out,
       if (c.arg2 == 0) os << "NULL, ";
       else os << "precomputed_indexes[" << c.arg2 << "], ";
       os << submatrix_strings[c.arg3] << ", &" << submatrix_strings[c.arg4]
-         << ")\n";
+         << ")";
+      if (c.arg7 > 0)
+        os << "  # fused with the next " << c.arg7 << " command(s)";
+      else if (c.arg7 == 0)
+        os << "  # fused";
+      os << "\n";
       break;
     case kBackprop:
     case kBackpropNoModelUpdate: {
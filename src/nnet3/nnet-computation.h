@@ -205,6 +205,12 @@ struct ComputationRequestPtrEqual {
      - arg6 is 1 if we need to call StoreStats() after the Propagate, or 0
        if we don't.  We used to have a separate command for storing the
        stats, but that has been removed.
+     - arg7 is normally -1.  If it is positive, the next arg7 commands are
+       kPropagate commands, operating in-place on this command's output,
+       that are fused with this one, and those commands have arg7 = 0; on
+       CPU, NnetComputer does them in the same pass over the output as this
+       command, and does nothing when it reaches them (see
+       FusePropagateCommands()).  This is only done when arg5 and arg6 are 0.
    - kBackprop: Do the back-propagation operation, see Component::Backprop()
      - arg1 is index of component in neural net
      - arg2 is index into ComponentPrecomputedIndexes (0 if NULL; always 0
@@ -218,6 +218,8 @@ void UnitTestNnetCompute() {
     NnetComputeOptions compute_opts;
     if (RandInt(0, 1) == 0)
       compute_opts.debug = true;
+    else if (RandInt(0, 1) == 0)
+      compute_opts.num_threads = RandInt(2, 4);
 
     computation.ComputeCudaIndexes();
     NnetComputer computer(compute_opts,
@@ -276,6 +278,77 @@ void UnitTestNnetCompute() {
   }
 }
 
+// Runs the same computation, forward and backward, with one thread and with
+// several, and checks that the outputs, input derivatives and model
+// derivatives are the same.
+void UnitTestNnetComputeThreaded() {
+  for (int32 n = 0; n < 20; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    ComputationRequest request;
+    std::vector<Matrix<BaseFloat> > inputs;
+    ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+
+    NnetComputation computation;
+    Compiler compiler(request, nnet);
+    CompilerOptions opts;
+    compiler.CreateComputation(opts, &computation);
+    if (RandInt(0, 1) == 0) {
+      NnetOptimizeOptions opt_config;
+      Optimize(opt_config, nnet, MaxOutputTimeInRequest(request),
+               &computation);
+    }
+    computation.ComputeCudaIndexes();
+
+    Matrix<BaseFloat> output_deriv;
+    std::vector<Matrix<BaseFloat> > outputs(2);
+    std::vector<std::vector<Matrix<BaseFloat> > > input_derivs(2);
+    std::vector<Vector<BaseFloat> > model_derivs(2);
+    for (int32 threaded = 0; threaded <= 1; threaded++) {
+      // So that dropout masks and the like are the same in both runs.
+      ResetGenerators(&nnet);
+      Nnet deriv(nnet);
+      ScaleNnet(0.0, &deriv);
+      SetNnetAsGradient(&deriv);
+      NnetComputeOptions compute_opts;
+      compute_opts.num_threads = (threaded ? RandInt(2, 4) : 1);
+      NnetComputer computer(compute_opts, computation, nnet, &deriv);
+      for (size_t i = 0; i < request.inputs.size(); i++) {
+        CuMatrix<BaseFloat> temp(inputs[i]);
+        computer.AcceptInput(request.inputs[i].name, &temp);
+      }
+      computer.Run();
+      outputs[threaded] = Matrix<BaseFloat>(computer.GetOutput("output"));
+      if (request.outputs[0].has_deriv) {
+        if (output_deriv.NumRows() == 0) {
+          output_deriv.Resize(outputs[0].NumRows(), outputs[0].NumCols());
+          output_deriv.SetRandn();
+        }
+        CuMatrix<BaseFloat> temp(output_deriv);
+        computer.AcceptInput("output", &temp);
+        computer.Run();
+        for (size_t i = 0; i < request.inputs.size(); i++)
+          if (request.inputs[i].has_deriv)
+            input_derivs[threaded].push_back(Matrix<BaseFloat>(
+                computer.GetOutput(request.inputs[i].name)));
+      }
+      model_derivs[threaded].Resize(NumParameters(deriv));
+      VectorizeNnet(deriv, &(model_derivs[threaded]));
+    }
+    KALDI_ASSERT(outputs[0].ApproxEqual(outputs[1]));
+    KALDI_ASSERT(input_derivs[0].size() == input_derivs[1].size());
+    for (size_t i = 0; i < input_derivs[0].size(); i++)
+      KALDI_ASSERT(input_derivs[0][i].ApproxEqual(input_derivs[1][i]));
+    KALDI_ASSERT(model_derivs[0].ApproxEqual(model_derivs[1]));
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -296,6 +369,7 @@ int main() {
       CuDevice::Instantiate().SelectGpuId("yes");
 #endif
     UnitTestNnetCompute();
+    UnitTestNnetComputeThreaded();
   }
 
   KALDI_LOG << "Nnet tests succeeded.";
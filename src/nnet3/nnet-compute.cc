@@ -17,13 +17,178 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <iterator>
+#include <map>
+#include <new>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
 #include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-optimize-utils.h"
+#include "nnet3/nnet-simple-component.h"
 
 namespace kaldi {
 namespace nnet3 {
 
+/**
+   NnetComputer objects get the memory for their arena from this pool and give
+   it back when they are destroyed, so that successive computations (e.g. one
+   per minibatch or chunk) reuse the same memory.  A free block is only
+   deallocated when a larger one is needed, so the pool holds at most as many
+   blocks as there have been NnetComputer objects at one time.
+*/
+class NnetComputerArenaPool {
+ public:
+  static NnetComputerArenaPool &Instance() {
+    static NnetComputerArenaPool pool;
+    return pool;
+  }
+
+  // Returns a block of memory of at least 'size' elements; sets *capacity to
+  // its actual size.
+  BaseFloat *Get(int64 size, int64 *capacity) {
+    void *to_free = NULL;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // Use the smallest free block that is large enough; if they are all too
+      // small, free the largest one so the pool doesn't grow.
+      int32 best = -1, largest = -1;
+      for (size_t i = 0; i < free_blocks_.size(); i++) {
+        int64 this_capacity = free_blocks_[i].first;
+        if (this_capacity >= size &&
+            (best < 0 || this_capacity < free_blocks_[best].first))
+          best = i;
+        if (largest < 0 || this_capacity > free_blocks_[largest].first)
+          largest = i;
+      }
+      if (best >= 0) {
+        BaseFloat *ans = free_blocks_[best].second;
+        *capacity = free_blocks_[best].first;
+        free_blocks_.erase(free_blocks_.begin() + best);
+        return ans;
+      } else if (largest >= 0) {
+        to_free = free_blocks_[largest].second;
+        free_blocks_.erase(free_blocks_.begin() + largest);
+      }
+    }
+    if (to_free != NULL)
+      KALDI_MEMALIGN_FREE(to_free);
+    void *data;
+    if (KALDI_MEMALIGN(ComputationMemoryPlan::kAlignment * sizeof(BaseFloat),
+                       size * sizeof(BaseFloat), &data) == NULL)
+      throw std::bad_alloc();
+    *capacity = size;
+    return static_cast<BaseFloat*>(data);
+  }
+
+  // Gives back a block obtained from Get().
+  void Release(BaseFloat *data, int64 capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_blocks_.push_back(std::pair<int64, BaseFloat*>(capacity, data));
+  }
+
+  ~NnetComputerArenaPool() {
+    for (size_t i = 0; i < free_blocks_.size(); i++)
+      KALDI_MEMALIGN_FREE(free_blocks_[i].second);
+  }
+
+ private:
+  std::mutex mutex_;
+  // The blocks not currently in use, as (capacity, data).
+  std::vector<std::pair<int64, BaseFloat*> > free_blocks_;
+};
+
+
+/**
+   The threads that NnetComputer uses to execute commands in parallel (see
+   ExecuteCommandsParallel()).  They are created the first time they are
+   needed and then kept, since creating and joining threads for each segment
+   of each computation takes longer than executing the commands of a small
+   computation (e.g. one chunk of online decoding).  The pool has as many
+   threads as the largest number requested; if several NnetComputer objects
+   use it at once they share those threads.
+*/
+class NnetComputerThreadPool {
+ public:
+  static NnetComputerThreadPool &Instance() {
+    static NnetComputerThreadPool pool;
+    return pool;
+  }
+
+  // Calls task() on the calling thread and on up to 'num_extra_threads'
+  // threads of the pool, and returns when all of those calls have returned.
+  // Calls that have not started by the time the call on the calling thread
+  // returns are not made, so 'task' must do all of the work if it is only
+  // called once; 'task' must not throw.
+  void Run(int32 num_extra_threads, const std::function<void()> &task) {
+    Job job;
+    job.task = &task;
+    job.num_running = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      while (static_cast<int32>(threads_.size()) < num_extra_threads)
+        threads_.push_back(std::thread(&NnetComputerThreadPool::WorkerLoop,
+                                       this));
+      for (int32 i = 0; i < num_extra_threads; i++)
+        queue_.push_back(&job);
+    }
+    queue_cond_.notify_all();
+    task();
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_.erase(std::remove(queue_.begin(), queue_.end(), &job),
+                 queue_.end());
+    done_cond_.wait(lock, [&job]() { return job.num_running == 0; });
+  }
+
+  ~NnetComputerThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    queue_cond_.notify_all();
+    for (size_t i = 0; i < threads_.size(); i++)
+      threads_[i].join();
+  }
+
+ private:
+  NnetComputerThreadPool(): stop_(false) { }
+
+  struct Job {
+    const std::function<void()> *task;
+    // The number of pool threads currently calling 'task'.
+    int32 num_running;
+  };
+
+  void WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      queue_cond_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (stop_)
+        return;
+      Job *job = queue_.front();
+      queue_.pop_front();
+      job->num_running++;
+      lock.unlock();
+      (*job->task)();
+      lock.lock();
+      if (--job->num_running == 0)
+        done_cond_.notify_all();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable queue_cond_, done_cond_;
+  // Each entry is a request for one more thread to call a job's task.
+  std::deque<Job*> queue_;
+  std::vector<std::thread> threads_;
+  bool stop_;
+};
+
 
 NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            const NnetComputation &computation,
@@ -31,7 +196,7 @@ NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            Nnet *nnet_to_update):
     options_(options), computation_(computation), nnet_(nnet),
     program_counter_(0), nnet_to_store_stats_(nnet_to_update),
-    nnet_to_update_(nnet_to_update) {
+    nnet_to_update_(nnet_to_update), arena_(NULL), arena_capacity_(0) {
   Init();
 }
 
@@ -41,7 +206,7 @@ NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            Nnet *nnet_to_update):
     options_(options), computation_(computation), nnet_(*nnet),
     program_counter_(0), nnet_to_store_stats_(nnet),
-    nnet_to_update_(nnet_to_update) {
+    nnet_to_update_(nnet_to_update), arena_(NULL), arena_capacity_(0) {
   Init();
 }
 
@@ -62,6 +227,257 @@ void NnetComputer::Init() {
     KALDI_LOG << preamble;
     computation_.GetSubmatrixStrings(nnet_, &submatrix_strings_);
   }
+  bool use_gpu = false;
+#if HAVE_CUDA == 1
+  use_gpu = CuDevice::Instantiate().Enabled();
+#endif
+  if (!use_gpu) {
+    // On GPU, CuMemoryAllocator already caches memory, so we only use the
+    // arena on CPU.
+    ComputeMemoryPlan(computation_, &memory_plan_);
+    if (memory_plan_.arena_size > 0)
+      arena_ = NnetComputerArenaPool::Instance().Get(memory_plan_.arena_size,
+                                                     &arena_capacity_);
+  }
+  // On GPU, the commands are already asynchronous and executing them from
+  // several threads would just contend for the stream.
+  if (options_.num_threads > 1 && !debug_ && !use_gpu)
+    InitParallel();
+}
+
+
+// static
+bool NnetComputer::IsSegmentBoundary(CommandType command_type) {
+  return (command_type == kAcceptInput || command_type == kProvideOutput ||
+          command_type == kNoOperationLabel || command_type == kGotoLabel);
+}
+
+
+void NnetComputer::InitParallel() {
+  ComputationVariables variables;
+  variables.Init(computation_);
+  std::vector<CommandAttributes> attributes;
+  ComputeCommandAttributes(nnet_, computation_, variables, &attributes);
+
+  int32 num_commands = computation_.commands.size(),
+      num_variables = variables.NumVariables();
+  command_dependencies_.clear();
+  command_dependencies_.resize(num_commands);
+
+  // For each variable, the last command in the current segment that wrote to
+  // it (or -1), and the commands that have read it since then.
+  std::vector<int32> last_writer(num_variables, -1);
+  std::vector<std::vector<int32> > readers(num_variables);
+  // Maps from component-index and memo-index to the last command in the
+  // current segment that used them.
+  std::unordered_map<int32, int32> last_component_user, last_memo_user;
+  std::vector<int32> variables_read, variables_written;
+  // Matrices in the arena may share memory with matrices that were
+  // deallocated earlier, so a command that allocates one has to wait for
+  // those deallocations.  'arena_deallocs' maps from an offset in the arena to
+  // the last command in the current segment that deallocated a matrix
+  // containing that offset (or -1), which applies up to the next key.
+  std::map<int64, int32> arena_deallocs;
+
+  for (int32 c = 0; c < num_commands; c++) {
+    const NnetComputation::Command &command = computation_.commands[c];
+    CommandType type = command.command_type;
+    if (IsSegmentBoundary(type)) {
+      std::fill(last_writer.begin(), last_writer.end(), -1);
+      for (int32 v = 0; v < num_variables; v++)
+        readers[v].clear();
+      last_component_user.clear();
+      last_memo_user.clear();
+      arena_deallocs.clear();
+      continue;
+    }
+    variables_read = attributes[c].variables_read;
+    variables_written = attributes[c].variables_written;
+    // Commands that (de)allocate, swap or (de)compress a matrix change the
+    // matrix object itself, although ComputeCommandAttributes() doesn't
+    // record them as accessing it, so we treat them as writing all of it.
+    switch (type) {
+      case kAllocMatrix: case kDeallocMatrix: case kCompressMatrix:
+      case kDecompressMatrix:
+        variables.AppendVariablesForMatrix(
+            computation_.submatrices[command.arg1].matrix_index,
+            &variables_written);
+        break;
+      case kSwapMatrix:
+        variables.AppendVariablesForMatrix(
+            computation_.submatrices[command.arg1].matrix_index,
+            &variables_written);
+        variables.AppendVariablesForMatrix(
+            computation_.submatrices[command.arg2].matrix_index,
+            &variables_written);
+        break;
+      default:
+        break;
+    }
+
+    std::vector<int32> &deps = command_dependencies_[c];
+    if ((type == kAllocMatrix || type == kDeallocMatrix) &&
+        InArena(computation_.submatrices[command.arg1].matrix_index)) {
+      int32 m = computation_.submatrices[command.arg1].matrix_index;
+      int64 begin = memory_plan_.offsets[m],
+          end = begin + static_cast<int64>(memory_plan_.strides[m]) *
+          computation_.matrices[m].num_rows;
+      std::map<int64, int32>::iterator iter =
+          arena_deallocs.upper_bound(begin);
+      if (type == kAllocMatrix) {
+        if (iter != arena_deallocs.begin())
+          --iter;
+        for (; iter != arena_deallocs.end() && iter->first < end; ++iter)
+          if (iter->second >= 0)
+            deps.push_back(iter->second);
+      } else {
+        // Set the value for [begin, end) to c, keeping the value after it.
+        std::map<int64, int32>::iterator end_iter =
+            arena_deallocs.upper_bound(end);
+        int32 value_at_end = -1;
+        if (end_iter != arena_deallocs.begin())
+          value_at_end = (--end_iter)->second;
+        arena_deallocs.erase(arena_deallocs.lower_bound(begin),
+                             arena_deallocs.lower_bound(end));
+        arena_deallocs[begin] = c;
+        arena_deallocs.insert(std::pair<int64, int32>(end, value_at_end));
+      }
+    }
+    for (size_t i = 0; i < variables_read.size(); i++) {
+      int32 v = variables_read[i];
+      if (last_writer[v] >= 0)
+        deps.push_back(last_writer[v]);
+    }
+    for (size_t i = 0; i < variables_written.size(); i++) {
+      int32 v = variables_written[i];
+      if (last_writer[v] >= 0)
+        deps.push_back(last_writer[v]);
+      deps.insert(deps.end(), readers[v].begin(), readers[v].end());
+    }
+    // Commands that use the same component are kept in order, since they may
+    // store stats in it or update it.  A backprop command also has to wait for
+    // the propagate command that produced its memo.
+    std::vector<int32> components, memos;
+    if (type == kPropagate) {
+      components.push_back(command.arg1);
+      if (command.arg5 > 0)
+        memos.push_back(command.arg5);
+    } else if (type == kBackprop || type == kBackpropNoModelUpdate) {
+      components.push_back(command.arg1);
+      if (command.arg7 > 0)
+        memos.push_back(command.arg7);
+    }
+    for (size_t i = 0; i < components.size(); i++) {
+      std::unordered_map<int32, int32>::iterator iter =
+          last_component_user.find(components[i]);
+      if (iter != last_component_user.end())
+        deps.push_back(iter->second);
+      last_component_user[components[i]] = c;
+    }
+    for (size_t i = 0; i < memos.size(); i++) {
+      std::unordered_map<int32, int32>::iterator iter =
+          last_memo_user.find(memos[i]);
+      if (iter != last_memo_user.end())
+        deps.push_back(iter->second);
+      last_memo_user[memos[i]] = c;
+    }
+    SortAndUniq(&deps);
+    if (!deps.empty() && deps.back() == c)
+      deps.pop_back();
+
+    for (size_t i = 0; i < variables_read.size(); i++)
+      readers[variables_read[i]].push_back(c);
+    for (size_t i = 0; i < variables_written.size(); i++) {
+      int32 v = variables_written[i];
+      last_writer[v] = c;
+      readers[v].clear();
+    }
+  }
+}
+
+
+void NnetComputer::ExecuteCommandsParallel(int32 begin, int32 end) {
+  // If every command depends on the one before it there is nothing to gain
+  // from the threads.
+  bool is_chain = true;
+  for (int32 c = begin + 1; c < end && is_chain; c++) {
+    const std::vector<int32> &deps = command_dependencies_[c];
+    is_chain = (!deps.empty() && deps.back() == c - 1);
+  }
+  if (is_chain) {
+    for (int32 c = begin; c < end; c++)
+      ExecuteCommand(c);
+    return;
+  }
+
+  for (int32 c = begin; c < end; c++) {
+    const NnetComputation::Command &command = computation_.commands[c];
+    if (command.command_type == kPropagate && command.arg5 > 0 &&
+        memos_.size() <= static_cast<size_t>(command.arg5))
+      memos_.resize(command.arg5 + 1, NULL);
+    if (command.command_type == kCompressMatrix && compressed_matrices_.empty())
+      compressed_matrices_.resize(matrices_.size(), NULL);
+  }
+
+  // num_pending[c - begin] is the number of dependencies of command c that
+  // have not finished yet; dependents[c - begin] are the commands in this
+  // segment that depend on command c.
+  int32 num_commands = end - begin;
+  std::vector<int32> num_pending(num_commands, 0);
+  std::vector<std::vector<int32> > dependents(num_commands);
+  std::vector<int32> ready;
+  for (int32 c = begin; c < end; c++) {
+    const std::vector<int32> &deps = command_dependencies_[c];
+    for (size_t i = 0; i < deps.size(); i++) {
+      if (deps[i] >= begin) {
+        num_pending[c - begin]++;
+        dependents[deps[i] - begin].push_back(c);
+      }
+    }
+    if (num_pending[c - begin] == 0)
+      ready.push_back(c);
+  }
+  // We pop from the back, so reverse to start with the earliest commands.
+  std::reverse(ready.begin(), ready.end());
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  int32 num_done = 0;
+  std::exception_ptr error;
+
+  auto worker = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      cond.wait(lock, [&]() {
+          return !ready.empty() || num_done == num_commands || error; });
+      if (num_done == num_commands || error)
+        return;
+      int32 c = ready.back();
+      ready.pop_back();
+      lock.unlock();
+      try {
+        ExecuteCommand(c);
+      } catch (...) {
+        lock.lock();
+        if (!error)
+          error = std::current_exception();
+        cond.notify_all();
+        return;
+      }
+      lock.lock();
+      num_done++;
+      const std::vector<int32> &this_dependents = dependents[c - begin];
+      for (size_t i = 0; i < this_dependents.size(); i++)
+        if (--num_pending[this_dependents[i] - begin] == 0)
+          ready.push_back(this_dependents[i]);
+      cond.notify_all();
+    }
+  };
+
+  int32 num_threads = std::min(options_.num_threads, num_commands);
+  NnetComputerThreadPool::Instance().Run(num_threads - 1, worker);
+  if (error)
+    std::rethrow_exception(error);
 }
 
 //static
@@ -88,7 +504,7 @@ void NnetComputer::DebugBeforeExecute(int32 command,
     info->matrices_written_stddevs.resize(size);
     for (size_t i = 0; i < size; i++) {
       int32 m = matrices_written[i];
-      info->matrices_written_stddevs[i] = MatrixStddev(matrices_[m]);
+      info->matrices_written_stddevs[i] = MatrixStddev(GetMatrix(m));
     }
   }
   {
@@ -126,7 +542,7 @@ void NnetComputer::DebugAfterExecute(int32 command,
     for (size_t i = 0; i < size; i++) {
       int32 m = matrices_written[i];
       BaseFloat old_stddev = info.matrices_written_stddevs[i],
-          stddev = MatrixStddev(matrices_[m]);
+          stddev = MatrixStddev(GetMatrix(m));
       os << 'm' << m << ": " << old_stddev << "->" << stddev << " ";
     }
   }
@@ -186,6 +602,38 @@ void* NnetComputer::GetMemo(int32 memo_index) {
 }
 
 
+void NnetComputer::FusedPropagate(int32 command_index,
+                                  const CuMatrixBase<BaseFloat> &input,
+                                  CuMatrixBase<BaseFloat> *output) {
+  const NnetComputation::Command &c = computation_.commands[command_index];
+  const Component *component = nnet_.GetComponent(c.arg1);
+  std::vector<ColumnOp<BaseFloat> > ops;
+  const AffineComponent *affine =
+      dynamic_cast<const AffineComponent*>(component);
+  if (affine != NULL) {
+    // This is AffineComponent::Propagate(), except that we add the bias in
+    // the same pass as the following components' operations.
+    output->AddMatMat(1.0, input, kNoTrans, affine->LinearParams(), kTrans,
+                      0.0);
+    ops.resize(1);
+    ops[0].offset = affine->BiasParams().Data();
+  } else {
+    ComponentPrecomputedIndexes *indexes =
+        computation_.component_precomputed_indexes[c.arg2].data;
+    void *memo = component->Propagate(indexes, input, output);
+    KALDI_ASSERT(memo == NULL);
+  }
+  for (int32 i = 1; i <= c.arg7; i++) {
+    const Component *fused_component =
+        nnet_.GetComponent(computation_.commands[command_index + i].arg1);
+    if (!GetFusableColumnOps(*fused_component, &ops))
+      KALDI_ERR << "Component " << fused_component->Type()
+                << " cannot be fused.";
+  }
+  ApplyColumnOps(ops, &(output->Mat()));
+}
+
+
 NnetComputer::NnetComputer(const NnetComputer &other):
     options_(other.options_),
     computation_(other.computation_),
@@ -199,21 +647,33 @@ NnetComputer::NnetComputer(const NnetComputer &other):
     submatrix_strings_(other.submatrix_strings_),
     command_strings_(other.command_strings_),
     matrices_(other.matrices_),
-    memos_(other.memos_) {
-  // Note: this is the same as the default copy constructor, except for the check below.
+    memory_plan_(other.memory_plan_),
+    arena_(NULL),
+    arena_capacity_(0),
+    memos_(other.memos_),
+    command_dependencies_(other.command_dependencies_) {
+  // Note: this is the same as the default copy constructor, except for the
+  // check below and the copying of the arena.
   if (!memos_.empty()) {
     KALDI_ERR << "You cannot use the copy constructor of NnetComputer if "
         "memos are used.";
   }
+  if (other.arena_ != NULL) {
+    arena_ = NnetComputerArenaPool::Instance().Get(memory_plan_.arena_size,
+                                                   &arena_capacity_);
+    std::copy(other.arena_, other.arena_ + memory_plan_.arena_size, arena_);
+  }
 }
 
-void NnetComputer::ExecuteCommand() {
-  const NnetComputation::Command &c = computation_.commands[program_counter_];
+void NnetComputer::ExecuteCommand(int32 command_index) {
+  const NnetComputation::Command &c = computation_.commands[command_index];
   int32 m1, m2;
   try {
     switch (c.command_type) {
       case kAllocMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
+        if (InArena(m1))
+          break;
         matrices_[m1].Resize(computation_.matrices[m1].num_rows,
                              computation_.matrices[m1].num_cols,
                              kUndefined,
@@ -221,7 +681,8 @@ void NnetComputer::ExecuteCommand() {
         break;
       case kDeallocMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
-        matrices_[m1].Resize(0, 0);
+        if (!InArena(m1))
+          matrices_[m1].Resize(0, 0);
         break;
       case kSwapMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
@@ -241,6 +702,19 @@ void NnetComputer::ExecuteCommand() {
             computation_.component_precomputed_indexes[c.arg2].data;
         const CuSubMatrix<BaseFloat> input(GetSubMatrix(c.arg3));
         CuSubMatrix<BaseFloat> output(GetSubMatrix(c.arg4));
+        if (c.arg7 >= 0) {
+          // c.arg7 > 0 means the next c.arg7 commands are fused with this one;
+          // 0 means this command was done by FusedPropagate() already.
+          bool use_gpu = false;
+#if HAVE_CUDA == 1
+          use_gpu = CuDevice::Instantiate().Enabled();
+#endif
+          if (!use_gpu) {
+            if (c.arg7 > 0)
+              FusedPropagate(command_index, input, &output);
+            break;
+          }
+        }
         void *memo = component->Propagate(indexes, input, &output);
         if (c.arg6) {  // need to store stats.
           KALDI_ASSERT(nnet_to_store_stats_ != NULL);
@@ -432,17 +906,18 @@ void NnetComputer::ExecuteCommand() {
         KALDI_ERR << "Invalid command in computation";
     }
   } catch (...) {
-    if (!debug_) {
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    if (!debug_ && command_strings_.empty()) {
       std::string preamble;
       computation_.GetCommandStrings(nnet_, &preamble, &command_strings_);
       KALDI_WARN << "Printing some background info since error was detected";
       KALDI_LOG << preamble;
-      for (int32 prev_c = 0; prev_c < program_counter_; prev_c++)
+      for (int32 prev_c = 0; prev_c < command_index; prev_c++)
         KALDI_LOG << command_strings_[prev_c];
     }
     // the following will re-throw the error, but now we've printed more info
     // about what went wrong.
-    KALDI_ERR << "Error running command " << command_strings_[program_counter_];
+    KALDI_ERR << "Error running command " << command_strings_[command_index];
   }
 }
 
@@ -451,11 +926,30 @@ CuSubMatrix<BaseFloat> NnetComputer::GetSubMatrix(int32 submatrix_index) {
                         computation_.submatrices.size());
   const NnetComputation::SubMatrixInfo &info =
       computation_.submatrices[submatrix_index];
+  if (InArena(info.matrix_index)) {
+    int32 stride = memory_plan_.strides[info.matrix_index];
+    return CuSubMatrix<BaseFloat>(
+        arena_ + memory_plan_.offsets[info.matrix_index] +
+        static_cast<int64>(info.row_offset) * stride + info.col_offset,
+        info.num_rows, info.num_cols, stride);
+  }
   const CuMatrix<BaseFloat> &mat = matrices_[info.matrix_index];
   return CuSubMatrix<BaseFloat>(
       mat, info.row_offset, info.num_rows, info.col_offset, info.num_cols);
 }
 
+CuSubMatrix<BaseFloat> NnetComputer::GetMatrix(int32 matrix_index) {
+  if (InArena(matrix_index)) {
+    const NnetComputation::MatrixInfo &info =
+        computation_.matrices[matrix_index];
+    return CuSubMatrix<BaseFloat>(arena_ + memory_plan_.offsets[matrix_index],
+                                  info.num_rows, info.num_cols,
+                                  memory_plan_.strides[matrix_index]);
+  }
+  const CuMatrix<BaseFloat> &mat = matrices_[matrix_index];
+  return CuSubMatrix<BaseFloat>(mat, 0, mat.NumRows(), 0, mat.NumCols());
+}
+
 void NnetComputer::GetPointers(int32 indexes_multi_index,
                                int32 num_cols,
                                CuArray<BaseFloat*> *pointers) {
@@ -521,6 +1015,26 @@ void NnetComputer::Run() {
   }
   CheckNoPendingIo();
 
+  if (!command_dependencies_.empty()) {
+    while (program_counter_ < num_commands) {
+      CommandType type = c[program_counter_].command_type;
+      if (type == kAcceptInput || type == kProvideOutput)
+        break;
+      if (IsSegmentBoundary(type)) {
+        // A label or goto; a goto sets program_counter_ to the label.
+        ExecuteCommand(program_counter_);
+        program_counter_++;
+        continue;
+      }
+      int32 end = program_counter_ + 1;
+      while (end < num_commands && !IsSegmentBoundary(c[end].command_type))
+        end++;
+      ExecuteCommandsParallel(program_counter_, end);
+      program_counter_ = end;
+    }
+    return;
+  }
+
   CommandDebugInfo info;
   Timer timer;
   double total_elapsed_previous = 0.0;
@@ -534,7 +1048,7 @@ void NnetComputer::Run() {
     }
     if (debug_)
       DebugBeforeExecute(program_counter_, &info);
-    ExecuteCommand();
+    ExecuteCommand(program_counter_);
     if (debug_) {
       double total_elapsed_now = timer.Elapsed();
       DebugAfterExecute(program_counter_, info,
@@ -684,6 +1198,8 @@ NnetComputer::~NnetComputer() {
   // the forward propagation but not the backprop.
   for (size_t i = 0; i < compressed_matrices_.size(); i++)
     delete compressed_matrices_[i];
+  if (arena_ != NULL)
+    NnetComputerArenaPool::Instance().Release(arena_, arena_capacity_);
 }
 
 } // namespace nnet3
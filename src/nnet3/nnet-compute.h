@@ -30,6 +30,7 @@
 #include <sstream>
 #include <vector>
 #include <map>
+#include <mutex>
 
 
 namespace kaldi {
@@ -38,11 +39,17 @@ namespace nnet3 {
 
 struct NnetComputeOptions {
   bool debug;
-  NnetComputeOptions(): debug(false) { }
+  int32 num_threads;
+  NnetComputeOptions(): debug(false), num_threads(1) { }
   void Register(OptionsItf *opts) {
     opts->Register("debug", &debug, "If true, turn on "
                    "debug for the neural net computation (very verbose!) "
                    "Will be turned on regardless if --verbose >= 5");
+    opts->Register("num-threads", &num_threads, "If >1, the number of "
+                   "CPU threads used to execute commands of the "
+                   "computation that do not depend on each other (e.g. the "
+                   "branches of a TDNN-F or multi-stream network) in "
+                   "parallel.  Ignored when using a GPU or in debug mode.");
   }
 
 };
@@ -156,9 +163,23 @@ class NnetComputer {
   // command_strings_ is only used if debug_=true, or in case of error.
   std::vector<std::string> command_strings_;
 
-  // The matrices used in the computation.
+  // The matrices used in the computation.  For matrices that are stored in
+  // arena_, matrices_[m] is always empty.
   std::vector<CuMatrix<BaseFloat> > matrices_;
 
+  // memory_plan_ is only set up if we are not using a GPU (on GPU,
+  // CuMemoryAllocator already caches memory); it says which matrices are
+  // stored in arena_, and where.  Allocating and deallocating those matrices
+  // does nothing.  arena_ is obtained from a process-wide pool when this object
+  // is constructed and returned to it when it is destroyed, so in steady state
+  // (e.g. decoding, or training on CPU) no memory is allocated for the
+  // matrices.  arena_capacity_ is the actual size of arena_, which may be
+  // larger than memory_plan_.arena_size.  arena_ is NULL if no matrices are
+  // stored in it.
+  ComputationMemoryPlan memory_plan_;
+  BaseFloat *arena_;
+  int64 arena_capacity_;
+
   // Memos returned by Propagate() that must be passed to the corresponding
   // Backprop() routines, indexed by memo-index (zeroth element always
   // NULL).
@@ -172,9 +193,38 @@ class NnetComputer {
   // happens.
   std::vector<CuCompressedMatrixBase*> compressed_matrices_;
 
+  // command_dependencies_ is only set up if we are executing commands in
+  // parallel (options_.num_threads > 1, and not using a GPU or debugging);
+  // otherwise it is empty.  command_dependencies_[c] is a sorted list of the
+  // earlier commands in the same segment that command c has to wait for:
+  // those that access the same variables (where one of the accesses is a
+  // write), that use the same component, or that produce its memo.
+  std::vector<std::vector<int32> > command_dependencies_;
+
+  // Guards the printing of debug info when a command fails, since this may
+  // happen on several threads at once.
+  std::mutex error_mutex_;
+
+
+  // executes the command in computation_.commands[command_index]; a
+  // kGotoLabel command sets program_counter_.
+  void ExecuteCommand(int32 command_index);
+
+  // Returns true if commands of this type must not be reordered with respect
+  // to any others, i.e. they separate the segments of the computation that
+  // may be executed in parallel.
+  static bool IsSegmentBoundary(CommandType command_type);
 
-  // executes the command in computation_.commands[program_counter_].
-  void ExecuteCommand();
+  // Called from Init() if we will be executing commands in parallel; sets up
+  // command_dependencies_.
+  void InitParallel();
+
+  // Executes commands begin ... end - 1, which must not include any segment
+  // boundaries, using up to options_.num_threads threads; each command is
+  // started once all the commands in command_dependencies_ are done.  Before
+  // starting the threads it resizes memos_ and compressed_matrices_ as
+  // needed, as they must not be resized while commands are running.
+  void ExecuteCommandsParallel(int32 begin, int32 end);
 
   // Returns the matrix index where the input (if is_output==false) or output
   // matrix index for "node_name" is stored.  This looks at the next command (at
@@ -195,6 +245,14 @@ class NnetComputer {
 
   CuSubMatrix<BaseFloat> GetSubMatrix(int32 submatrix_index);
 
+  // Returns the whole of matrix 'matrix_index', which may be in arena_.
+  CuSubMatrix<BaseFloat> GetMatrix(int32 matrix_index);
+
+  // Returns true if matrix 'matrix_index' is stored in arena_.
+  inline bool InArena(int32 matrix_index) const {
+    return arena_ != NULL && memory_plan_.offsets[matrix_index] >= 0;
+  }
+
   void GetPointers(int32 indexes_multi_index,
                    int32 num_cols,
                    CuArray<BaseFloat*> *pointers);
@@ -229,6 +287,16 @@ class NnetComputer {
                          const CommandDebugInfo &info,
                          double command_execution_time);
 
+  // Helper function used in executing, on CPU, a kPropagate command that is
+  // fused with the c.arg7 > 0 commands after it (see
+  // FusePropagateCommands()).  It does the propagation of this command's
+  // component (without adding the bias, for AffineComponent), and then the
+  // bias and the following commands' operations in one pass over 'output',
+  // using ApplyColumnOps().
+  void FusedPropagate(int32 command_index,
+                      const CuMatrixBase<BaseFloat> &input,
+                      CuMatrixBase<BaseFloat> *output);
+
   // simple helper function used in executing Propagate().
   // saves 'memo' at memo-index 'memo_index'; if memo
   // is non-NULL and memo_index is 0, it is an error.
@@ -0,0 +1,323 @@
+// nnet3/nnet-example-loader.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-example-loader.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// The following overloaded functions deal with the differences between the
+// example types.
+
+static void MergeMinibatch(bool compress, std::vector<NnetExample> *egs,
+                           NnetExample *merged_eg) {
+  MergeExamples(*egs, compress, merged_eg);
+}
+
+static void MergeMinibatch(bool compress, std::vector<NnetChainExample> *egs,
+                           NnetChainExample *merged_eg) {
+  MergeChainExamples(compress, egs, merged_eg);
+}
+
+static void UncompressFeatures(NnetExample *eg) {
+  for (size_t i = 0; i < eg->io.size(); i++)
+    eg->io[i].features.Uncompress();
+}
+
+static void UncompressFeatures(NnetChainExample *eg) {
+  for (size_t i = 0; i < eg->inputs.size(); i++)
+    eg->inputs[i].features.Uncompress();
+}
+
+
+// This is the class of the tasks that we give to the TaskSequencer: its
+// operator () merges a minibatch, and its destructor (which TaskSequencer
+// calls in the order in which the tasks were created) puts the result in the
+// queue.
+template <class Example, class Reader, class Merger>
+class ExampleLoader<Example, Reader, Merger>::MergeTask {
+ public:
+  // Takes the contents of 'minibatch'.
+  MergeTask(ExampleLoader *loader, std::vector<Example> *minibatch):
+      loader_(loader), merged_eg_(NULL) {
+    minibatch_.swap(*minibatch);
+  }
+
+  void operator () () {
+    try {
+      merged_eg_ = loader_->ProcessMinibatch(&minibatch_);
+    } catch (const std::exception &e) {
+      error_ = e.what();
+    }
+    minibatch_.clear();
+  }
+
+  ~MergeTask() {
+    if (merged_eg_ != NULL)
+      loader_->Push(merged_eg_);
+    else
+      loader_->SetError(error_);
+  }
+
+ private:
+  ExampleLoader *loader_;
+  std::vector<Example> minibatch_;
+  Example *merged_eg_;
+  std::string error_;
+};
+
+
+template <class Example, class Reader, class Merger>
+ExampleLoader<Example, Reader, Merger>::ExampleLoader(
+    const ExampleLoaderOptions &opts, const std::string &rspecifier):
+    opts_(opts), reader_(rspecifier), merger_(NULL), input_done_(false),
+    finished_(false), stop_(false), current_(NULL), num_minibatches_(0),
+    num_waits_(0), wait_time_(0.0), first_wait_time_(0.0), full_time_(0.0) {
+  KALDI_ASSERT(opts_.num_threads >= 0 && opts_.queue_depth > 0);
+  if (opts_.merge) {
+    opts_.merge_config.ComputeDerived();
+    merger_ = new Merger(opts_.merge_config, &minibatches_);
+  }
+  if (opts_.num_threads > 0)
+    thread_ = std::thread(&ExampleLoader::ReadThread, this);
+}
+
+
+template <class Example, class Reader, class Merger>
+bool ExampleLoader<Example, Reader, Merger>::ReadMinibatches(
+    std::vector<std::vector<Example> > *minibatches) {
+  for (; !reader_.Done(); reader_.Next()) {
+    if (merger_ == NULL) {
+      minibatches->resize(minibatches->size() + 1);
+      minibatches->back().resize(1);
+      minibatches->back()[0].Swap(&(reader_.Value()));
+      reader_.Next();
+      return true;
+    }
+    Example *eg = new Example();
+    eg->Swap(&(reader_.Value()));
+    merger_->AcceptExample(eg);
+    if (!minibatches_.empty()) {
+      reader_.Next();
+      break;
+    }
+  }
+  bool ans = true;
+  if (reader_.Done() && !input_done_) {
+    input_done_ = true;
+    if (merger_ != NULL)
+      merger_->Finish();  // flushes out the remaining minibatches.
+  }
+  if (input_done_)
+    ans = false;
+  for (size_t i = 0; i < minibatches_.size(); i++) {
+    minibatches->resize(minibatches->size() + 1);
+    minibatches->back().swap(minibatches_[i]);
+  }
+  minibatches_.clear();
+  return ans;
+}
+
+
+template <class Example, class Reader, class Merger>
+Example* ExampleLoader<Example, Reader, Merger>::ProcessMinibatch(
+    std::vector<Example> *minibatch) const {
+  Example *ans = new Example();
+  if (merger_ != NULL) {
+    MergeMinibatch(opts_.merge_config.compress, minibatch, ans);
+  } else {
+    KALDI_ASSERT(minibatch->size() == 1);
+    ans->Swap(&((*minibatch)[0]));
+  }
+  UncompressFeatures(ans);
+  return ans;
+}
+
+
+template <class Example, class Reader, class Merger>
+void ExampleLoader<Example, Reader, Merger>::ReadThread() {
+  try {
+    TaskSequencerConfig sequencer_config;
+    sequencer_config.num_threads = opts_.num_threads;
+    // Limits the number of minibatches that are merged but waiting for the
+    // earlier ones, which uses memory.
+    sequencer_config.num_threads_total = 2 * opts_.num_threads;
+    TaskSequencer<MergeTask> sequencer(sequencer_config);
+    std::vector<std::vector<Example> > minibatches;
+    bool more_input = true;
+    while (more_input) {
+      more_input = ReadMinibatches(&minibatches);
+      for (size_t i = 0; i < minibatches.size(); i++)
+        sequencer.Run(new MergeTask(this, &(minibatches[i])));
+      minibatches.clear();
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stop_ || !error_.empty())
+        break;
+    }
+  } catch (const std::exception &e) {
+    SetError(e.what());
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  finished_ = true;
+  queue_not_empty_.notify_all();
+}
+
+
+template <class Example, class Reader, class Merger>
+void ExampleLoader<Example, Reader, Merger>::Push(Example *eg) {
+  Timer timer;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (queue_.size() >= static_cast<size_t>(opts_.queue_depth) && !stop_)
+    queue_not_full_.wait(lock);
+  full_time_ += timer.Elapsed();
+  if (stop_) {
+    delete eg;
+    return;
+  }
+  queue_.push_back(eg);
+  queue_not_empty_.notify_all();
+}
+
+
+template <class Example, class Reader, class Merger>
+void ExampleLoader<Example, Reader, Merger>::SetError(
+    const std::string &message) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (error_.empty())
+    error_ = (message.empty() ? "unknown error" : message);
+  queue_not_empty_.notify_all();
+}
+
+
+template <class Example, class Reader, class Merger>
+void ExampleLoader<Example, Reader, Merger>::Fetch() {
+  KALDI_ASSERT(current_ == NULL);
+  Timer timer;
+  // queue_ is only shared with other threads if num_threads > 0.
+  std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+  if (opts_.num_threads > 0)
+    lock.lock();
+  bool waited = queue_.empty() && !finished_;
+  if (opts_.num_threads == 0) {
+    while (queue_.empty() && !finished_) {
+      std::vector<std::vector<Example> > minibatches;
+      finished_ = !ReadMinibatches(&minibatches);
+      for (size_t i = 0; i < minibatches.size(); i++)
+        queue_.push_back(ProcessMinibatch(&(minibatches[i])));
+    }
+  } else {
+    while (queue_.empty() && !finished_ && error_.empty())
+      queue_not_empty_.wait(lock);
+    if (!error_.empty())
+      KALDI_ERR << "Error loading examples: " << error_;
+  }
+  if (!queue_.empty()) {
+    current_ = queue_.front();
+    queue_.pop_front();
+    queue_not_full_.notify_all();
+  }
+  if (lock.owns_lock())
+    lock.unlock();
+
+  double elapsed = timer.Elapsed();
+  if (num_minibatches_ == 0) {
+    first_wait_time_ = elapsed;
+  } else if (waited) {
+    num_waits_++;
+    wait_time_ += elapsed;
+  }
+  if (current_ != NULL)
+    num_minibatches_++;
+}
+
+
+template <class Example, class Reader, class Merger>
+bool ExampleLoader<Example, Reader, Merger>::Done() {
+  if (current_ == NULL)
+    Fetch();
+  return (current_ == NULL);
+}
+
+
+template <class Example, class Reader, class Merger>
+Example& ExampleLoader<Example, Reader, Merger>::Value() {
+  if (current_ == NULL)
+    Fetch();
+  KALDI_ASSERT(current_ != NULL && "Value() called after Done()");
+  return *current_;
+}
+
+
+template <class Example, class Reader, class Merger>
+void ExampleLoader<Example, Reader, Merger>::Next() {
+  if (current_ == NULL)
+    Fetch();
+  delete current_;
+  current_ = NULL;
+}
+
+
+template <class Example, class Reader, class Merger>
+void ExampleLoader<Example, Reader, Merger>::PrintStats() {
+  double total_time = timer_.Elapsed(), full_time;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    full_time = full_time_;
+  }
+  KALDI_LOG << "Loaded " << num_minibatches_ << " minibatches in "
+            << total_time << " seconds.  The training waited "
+            << first_wait_time_ << " seconds for the first minibatch, and "
+            << wait_time_ << " seconds in total for " << num_waits_
+            << " of the others.";
+  if (opts_.num_threads > 0)
+    KALDI_LOG << "The loader was waiting for the training (with "
+              << opts_.queue_depth << " minibatches ready) for "
+              << full_time << " seconds.";
+  if (num_minibatches_ > 1 && wait_time_ > 0.05 * total_time)
+    KALDI_WARN << "The training spent " << (100.0 * wait_time_ / total_time)
+               << "% of the time waiting for input; you may want to increase "
+               << "--loader-threads or make the input pipeline faster.";
+}
+
+
+template <class Example, class Reader, class Merger>
+ExampleLoader<Example, Reader, Merger>::~ExampleLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+    queue_not_full_.notify_all();
+  }
+  if (thread_.joinable())
+    thread_.join();
+  delete current_;
+  for (size_t i = 0; i < queue_.size(); i++)
+    delete queue_[i];
+  delete merger_;
+}
+
+
+// Instantiate the template for the types we need.
+template class ExampleLoader<NnetExample, SequentialNnetExampleReader,
+                             ExampleMerger>;
+template class ExampleLoader<NnetChainExample,
+                             SequentialNnetChainExampleReader,
+                             ChainExampleMerger>;
+
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,179 @@
+// nnet3/nnet-example-loader.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_EXAMPLE_LOADER_H_
+#define KALDI_NNET3_NNET_EXAMPLE_LOADER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/timer.h"
+#include "util/parse-options.h"
+#include "nnet3/nnet-example-utils.h"
+#include "nnet3/nnet-chain-example.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+struct ExampleLoaderOptions {
+  int32 num_threads;
+  int32 queue_depth;
+  bool merge;
+  ExampleMergingConfig merge_config;
+
+  ExampleLoaderOptions(): num_threads(1), queue_depth(4), merge(false) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("loader-threads", &num_threads, "Number of background "
+                   "threads that merge (if --merge=true) and decompress "
+                   "the minibatches, in addition to one thread that reads "
+                   "them.  If 0, the examples are read on the training "
+                   "thread.");
+    opts->Register("loader-queue-depth", &queue_depth, "Maximum number of "
+                   "minibatches that are loaded ahead of the training.");
+    opts->Register("merge", &merge, "If true, merge the examples into "
+                   "minibatches in this program, as nnet3-merge-egs would "
+                   "do, according to the --merge.* options (e.g. "
+                   "--merge.minibatch-size).  If false, the examples must "
+                   "already be merged.");
+    // Use a prefix because --compress and --minibatch-size are too generic.
+    ParseOptions merge_opts("merge", opts);
+    merge_config.Register(&merge_opts);
+  }
+};
+
+
+/**
+   This class reads training examples for a training program, with the same
+   interface as a SequentialTableReader, but does the reading, merging into
+   minibatches (if opts.merge is true) and decompression of the features in
+   background threads, keeping up to opts.queue_depth minibatches ready, so
+   that the training thread doesn't have to wait for them.  The minibatches
+   come out in the same order as if this were done in a single thread.
+
+   One thread reads the examples and groups them into minibatches (merging
+   the minibatches, e.g. appending the supervision FSTs of chain examples, is
+   the expensive part), and up to opts.num_threads threads merge and
+   decompress them.  Errors in those threads are reported by Done().  Call
+   PrintStats() at the end to see how long the training thread waited for
+   input.
+
+   'Example', 'Reader' and 'Merger' are NnetExample,
+   SequentialNnetExampleReader and ExampleMerger, or the corresponding chain
+   types; see the typedefs below.
+*/
+template <class Example, class Reader, class Merger>
+class ExampleLoader {
+ public:
+  ExampleLoader(const ExampleLoaderOptions &opts,
+                const std::string &rspecifier);
+
+  /// Returns true if there are no more minibatches; otherwise, Value() may be
+  /// called.  Waits for the next minibatch if it isn't ready yet.
+  bool Done();
+
+  /// Returns the current minibatch.  Non-const so the caller may Swap() it.
+  Example &Value();
+
+  /// Moves on to the next minibatch.
+  void Next();
+
+  /// Prints diagnostics about how long the training thread waited for
+  /// minibatches.  Warns if it spent a significant part of the time waiting.
+  void PrintStats();
+
+  ~ExampleLoader();
+
+ private:
+  class MergeTask;
+
+  // Called from Done(); sets current_ to the next minibatch, or leaves it
+  // NULL if there are no more.
+  void Fetch();
+
+  // Reads examples until at least one minibatch is complete or the input has
+  // ended, and appends the minibatches (not yet merged) to *minibatches.
+  // Returns false if there was no more input.
+  bool ReadMinibatches(std::vector<std::vector<Example> > *minibatches);
+
+  // Merges the examples in 'minibatch' (if opts_.merge) and decompresses the
+  // features; returns the result, which the caller owns.
+  Example *ProcessMinibatch(std::vector<Example> *minibatch) const;
+
+  // The function that the reading thread runs.
+  void ReadThread();
+
+  // Called from the merging threads: adds 'eg' (which is taken ownership of)
+  // to queue_, waiting if it is full.
+  void Push(Example *eg);
+
+  // Called from the merging threads if there is an error.
+  void SetError(const std::string &message);
+
+  ExampleLoaderOptions opts_;
+  Reader reader_;
+  // Minibatches grouped by merger_ are put here; only used by the reading
+  // thread (or by the training thread if there are no background threads).
+  std::vector<std::vector<Example> > minibatches_;
+  Merger *merger_;  // NULL if !opts_.merge.
+  bool input_done_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable queue_not_empty_;
+  std::condition_variable queue_not_full_;
+  // The minibatches that are ready and not yet taken by the training thread.
+  std::deque<Example*> queue_;
+  // True once the reading thread has put its last minibatch in queue_.
+  bool finished_;
+  // Set by the destructor to make the background threads stop.
+  bool stop_;
+  // The error message if there was an error in a background thread.
+  std::string error_;
+
+  Example *current_;
+
+  // Diagnostics.
+  int64 num_minibatches_;
+  // Number of minibatches that the training thread had to wait for (not
+  // counting the first one), and the total time it waited for them.
+  int64 num_waits_;
+  double wait_time_;
+  // The time taken to get the first minibatch.
+  double first_wait_time_;
+  // Total time during which the queue was full, i.e. the loading was ahead of
+  // the training.
+  double full_time_;
+  // The time since the construction of this object.
+  Timer timer_;
+};
+
+typedef ExampleLoader<NnetExample, SequentialNnetExampleReader,
+                      ExampleMerger> NnetExampleLoader;
+typedef ExampleLoader<NnetChainExample, SequentialNnetChainExampleReader,
+                      ChainExampleMerger> NnetChainExampleLoader;
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_EXAMPLE_LOADER_H_
@@ -25,6 +25,7 @@
 #include "nnet3/nnet-compute.h"
 #include "nnet3/nnet-example.h"
 #include "nnet3/nnet-example-utils.h"
+#include "nnet3/nnet-example-loader.h"
 #include "base/kaldi-math.h"
 
 namespace kaldi {
@@ -96,6 +97,65 @@ void UnitTestNnetMergeExamples() {
 }
 
 
+// Checks that NnetExampleLoader gives the same minibatches as
+// nnet3-merge-egs followed by reading them in the normal way.
+void UnitTestNnetExampleLoader() {
+  for (int32 n = 0; n < 10; n++) {
+    int32 left_context = RandInt(0, 3), right_context = RandInt(0, 3),
+        input_dim = RandInt(1, 10), output_dim = RandInt(5, 10),
+        num_egs = RandInt(0, 40);
+    {
+      NnetExampleWriter writer("ark:tmp.egs");
+      for (int32 i = 0; i < num_egs; i++) {
+        NnetExample eg;
+        // two structures of example, which are merged separately.
+        GenerateSimpleNnetTrainingExample(RandInt(1, 2), left_context,
+                                          right_context, input_dim,
+                                          output_dim, 0, &eg);
+        if (RandInt(0, 1) == 0)
+          eg.Compress();
+        std::ostringstream key;
+        key << "eg-" << i;
+        writer.Write(key.str(), eg);
+      }
+    }
+    ExampleLoaderOptions opts;
+    opts.merge_config.minibatch_size = (RandInt(0, 1) == 0 ? "4" : "2,5");
+    {
+      ExampleMergingConfig merging_config(opts.merge_config);
+      merging_config.ComputeDerived();
+      NnetExampleWriter writer("ark:tmp.merged.egs");
+      ExampleMerger merger(merging_config, &writer);
+      SequentialNnetExampleReader reader("ark:tmp.egs");
+      for (; !reader.Done(); reader.Next())
+        merger.AcceptExample(new NnetExample(reader.Value()));
+    }
+
+    for (int32 merge = 0; merge <= 1; merge++) {
+      opts.merge = (merge == 1);
+      opts.num_threads = RandInt(0, 3);
+      opts.queue_depth = RandInt(1, 3);
+      NnetExampleLoader loader(opts, merge ? "ark:tmp.egs" :
+                               "ark:tmp.merged.egs");
+      SequentialNnetExampleReader reader("ark:tmp.merged.egs");
+      // sometimes stop before the end, to test the destructor.
+      int32 max_minibatches = (RandInt(0, 2) == 0 ? RandInt(0, 3) : 1000);
+      for (int32 i = 0; !reader.Done() && i < max_minibatches;
+           reader.Next(), i++) {
+        KALDI_ASSERT(!loader.Done());
+        KALDI_ASSERT(ExampleApproxEqual(reader.Value(), loader.Value(),
+                                        0.01));
+        loader.Next();
+      }
+      if (reader.Done())
+        KALDI_ASSERT(loader.Done());
+      loader.PrintStats();
+    }
+  }
+  unlink("tmp.egs");
+  unlink("tmp.merged.egs");
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
@@ -106,6 +166,7 @@ int main() {
 
   UnitTestNnetExample();
   UnitTestNnetMergeExamples();
+  UnitTestNnetExampleLoader();
 
   KALDI_LOG << "Nnet-example tests succeeded.";
 
@@ -1188,7 +1188,13 @@ int32 GetNnetExampleSize(const NnetExample &a) {
 ExampleMerger::ExampleMerger(const ExampleMergingConfig &config,
                              NnetExampleWriter *writer):
     finished_(false), num_egs_written_(0),
-    config_(config), writer_(writer) { }
+    config_(config), writer_(writer), minibatches_(NULL) { }
+
+ExampleMerger::ExampleMerger(
+    const ExampleMergingConfig &config,
+    std::vector<std::vector<NnetExample> > *minibatches):
+    finished_(false), num_egs_written_(0),
+    config_(config), writer_(NULL), minibatches_(minibatches) { }
 
 
 void ExampleMerger::AcceptExample(NnetExample *eg) {
@@ -1218,19 +1224,25 @@ void ExampleMerger::AcceptExample(NnetExample *eg) {
       egs_to_merge[i].Swap(vec_copy[i]);
       delete vec_copy[i];  // we owned those pointers.
     }
-    WriteMinibatch(egs_to_merge);
+    WriteMinibatch(&egs_to_merge);
   }
 }
 
-void ExampleMerger::WriteMinibatch(const std::vector<NnetExample> &egs) {
-  KALDI_ASSERT(!egs.empty());
-  int32 eg_size = GetNnetExampleSize(egs[0]);
+void ExampleMerger::WriteMinibatch(std::vector<NnetExample> *egs) {
+  KALDI_ASSERT(!egs->empty());
+  int32 eg_size = GetNnetExampleSize((*egs)[0]);
   NnetExampleStructureHasher eg_hasher;
-  size_t structure_hash = eg_hasher(egs[0]);
-  int32 minibatch_size = egs.size();
+  size_t structure_hash = eg_hasher((*egs)[0]);
+  int32 minibatch_size = egs->size();
   stats_.WroteExample(eg_size, structure_hash, minibatch_size);
+  if (minibatches_ != NULL) {
+    num_egs_written_++;
+    minibatches_->resize(minibatches_->size() + 1);
+    minibatches_->back().swap(*egs);
+    return;
+  }
   NnetExample merged_eg;
-  MergeExamples(egs, config_.compress, &merged_eg);
+  MergeExamples(*egs, config_.compress, &merged_eg);
   std::ostringstream key;
   key << "merged-" << (num_egs_written_++) << "-" << minibatch_size;
   writer_->Write(key.str(), merged_eg);
@@ -1267,7 +1279,7 @@ void ExampleMerger::Finish() {
         delete vec[i];  // we owned those pointers.
       }
       vec.erase(vec.begin(), vec.begin() + minibatch_size);
-      WriteMinibatch(egs_to_merge);
+      WriteMinibatch(&egs_to_merge);
     }
     if (!vec.empty()) {
       int32 eg_size = GetNnetExampleSize(*(vec[0]));
@@ -482,6 +482,14 @@ class ExampleMerger {
   ExampleMerger(const ExampleMergingConfig &config,
                 NnetExampleWriter *writer);
 
+  // This version of the constructor is for when the minibatches are to be
+  // merged by the caller (e.g. in other threads, see class ExampleLoader)
+  // rather than written out: each time a minibatch is ready, its examples
+  // are appended to 'minibatches' as a vector, without being merged.  The
+  // caller should empty 'minibatches' from time to time.
+  ExampleMerger(const ExampleMergingConfig &config,
+                std::vector<std::vector<NnetExample> > *minibatches);
+
   // This function accepts an example, and if possible, writes a merged example
   // out.  The ownership of the pointer 'a' is transferred to this class when
   // you call this function.
@@ -499,14 +507,16 @@ class ExampleMerger {
 
   ~ExampleMerger() { Finish(); };
  private:
-  // called by Finish() and AcceptExample().  Merges, updates the
-  // stats, and writes.
-  void WriteMinibatch(const std::vector<NnetExample> &egs);
+  // called by Finish() and AcceptExample().  Merges, updates the stats, and
+  // writes; or if minibatches_ is set, updates the stats and moves the
+  // contents of 'egs' to there.
+  void WriteMinibatch(std::vector<NnetExample> *egs);
 
   bool finished_;
   int32 num_egs_written_;
   const ExampleMergingConfig &config_;
   NnetExampleWriter *writer_;
+  std::vector<std::vector<NnetExample> > *minibatches_;
   ExampleMergingStats stats_;
 
   // Note: the "key" into the egs is the first element of the vector.
@@ -23,6 +23,7 @@
 #include "nnet3/nnet-test-utils.h"
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-utils.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -265,6 +266,11 @@ static void UnitTestNnetOptimizeInternal(int32 srand_seed) {
                                                               compiler);
   optimize = optimize_all;
 
+  optimize.fuse_propagate = false;
+  bool succ_no_fuse_propagate = UnitTestNnetOptimizeWithOptions(srand_seed, optimize,
+                                                                compiler);
+  optimize = optimize_all;
+
 
   optimize.min_deriv_time = std::numeric_limits<int32>::min();
   optimize.max_deriv_time = std::numeric_limits<int32>::max();
@@ -288,6 +294,7 @@ static void UnitTestNnetOptimizeInternal(int32 srand_seed) {
     << "\n  allocate_from_other  ... " << KALDI_SUCCFAIL(succ_no_allocate_from_other)
     << "\n  move_sizing_commands ... " << KALDI_SUCCFAIL(succ_no_move_sizing_commands)
     << "\n  snip_row_ops         ... " << KALDI_SUCCFAIL(succ_no_snip_row_ops)
+    << "\n  fuse_propagate       ... " << KALDI_SUCCFAIL(succ_no_fuse_propagate)
     << "\n  no_deriv_time        ... " << KALDI_SUCCFAIL(succ_no_deriv_time);
 #undef KALDI_SUCCFAIL
 }
@@ -301,6 +308,76 @@ static void UnitTestNnetOptimize() {
 }
 
 
+// Checks that FusePropagateCommands() fuses the ReLUs and test-mode
+// batch-norms of a TDNN-F-like network with the affine components before
+// them, and that the results are the same as without it.
+static void UnitTestNnetOptimizeFusePropagate() {
+  std::string config =
+      "component name=affine1 type=NaturalGradientAffineComponent "
+      "input-dim=40 output-dim=64\n"
+      "component name=relu1 type=RectifiedLinearComponent dim=64\n"
+      "component name=bn1 type=BatchNormComponent dim=64\n"
+      "component name=linear2 type=LinearComponent input-dim=64 "
+      "output-dim=24\n"
+      "component name=affine2 type=AffineComponent input-dim=24 "
+      "output-dim=64\n"
+      "component name=relu2 type=RectifiedLinearComponent dim=64\n"
+      "component name=bn2 type=BatchNormComponent dim=64\n"
+      "component name=affine3 type=AffineComponent input-dim=64 "
+      "output-dim=10\n"
+      "input-node name=input dim=40\n"
+      "component-node name=affine1 component=affine1 input=input\n"
+      "component-node name=relu1 component=relu1 input=affine1\n"
+      "component-node name=bn1 component=bn1 input=relu1\n"
+      "component-node name=linear2 component=linear2 input=bn1\n"
+      "component-node name=affine2 component=affine2 input=linear2\n"
+      "component-node name=relu2 component=relu2 input=affine2\n"
+      "component-node name=bn2 component=bn2 input=relu2\n"
+      "component-node name=affine3 component=affine3 input=bn2\n"
+      "output-node name=output input=affine3\n";
+  Nnet nnet;
+  std::istringstream is(config);
+  nnet.ReadConfig(is);
+  // This gives the batch-norms random stats.
+  SetBatchnormTestMode(true, &nnet);
+
+  int32 num_frames = RandInt(1, 30);
+  ComputationRequest request;
+  request.inputs.resize(1);
+  request.inputs[0].name = "input";
+  request.outputs.resize(1);
+  request.outputs[0].name = "output";
+  for (int32 t = 0; t < num_frames; t++) {
+    request.inputs[0].indexes.push_back(Index(0, t));
+    request.outputs[0].indexes.push_back(Index(0, t));
+  }
+  Matrix<BaseFloat> input(num_frames, 40);
+  input.SetRandn();
+
+  std::vector<Matrix<BaseFloat> > outputs(2);
+  for (int32 fuse = 0; fuse <= 1; fuse++) {
+    NnetOptimizeOptions opt_config;
+    opt_config.fuse_propagate = (fuse != 0);
+    CachingOptimizingCompiler compiler(nnet, opt_config);
+    const NnetComputation &computation = *compiler.Compile(request);
+    int32 num_fused = 0;
+    for (size_t c = 0; c < computation.commands.size(); c++)
+      if (computation.commands[c].command_type == kPropagate &&
+          computation.commands[c].arg7 >= 0)
+        num_fused++;
+    // affine1, relu1 and bn1, and affine2, relu2 and bn2, are fused.
+    KALDI_ASSERT(num_fused == (fuse ? 6 : 0));
+    NnetComputeOptions compute_opts;
+    NnetComputer computer(compute_opts, computation, nnet, NULL);
+    CuMatrix<BaseFloat> cu_input(input);
+    computer.AcceptInput("input", &cu_input);
+    computer.Run();
+    outputs[fuse].Resize(num_frames, 10);
+    outputs[fuse].CopyFromMat(computer.GetOutput("output"));
+  }
+  AssertEqual(outputs[0], outputs[1]);
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
@@ -317,6 +394,8 @@ int main() {
   CuDevice::Instantiate().SelectGpuId("yes");
 #endif
   UnitTestNnetOptimize();
+  for (int32 i = 0; i < 5; i++)
+    UnitTestNnetOptimizeFusePropagate();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
@@ -17,9 +17,12 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <map>
 #include "nnet3/nnet-optimize-utils.h"
 #include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-simple-component.h"
+#include "nnet3/nnet-normalize-component.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -4579,6 +4582,89 @@ void FixGotoLabel(NnetComputation *computation) {
   }
 }
 
+bool GetFusableColumnOps(const Component &c,
+                         std::vector<ColumnOp<BaseFloat> > *ops) {
+  if (dynamic_cast<const RectifiedLinearComponent*>(&c) != NULL) {
+    if (ops != NULL) {
+      ops->resize(ops->size() + 1);
+      ops->back().apply_floor = true;
+      ops->back().floor = 0.0;
+    }
+    return true;
+  }
+  const BatchNormComponent *bn = dynamic_cast<const BatchNormComponent*>(&c);
+  // In test mode the batch-norm does not use a memo, and its propagation is
+  // just a per-column scale and offset.
+  if (bn != NULL && !(bn->Properties() & kUsesMemo) &&
+      bn->Scale().Dim() == bn->OutputDim()) {
+    if (ops != NULL) {
+      ops->resize(ops->size() + 1);
+      ops->back().scale = bn->Scale().Data();
+      ops->back().offset = bn->Offset().Data();
+    }
+    return true;
+  }
+  return false;
+}
+
+void FusePropagateCommands(const Nnet &nnet,
+                           NnetComputation *computation) {
+  std::vector<NnetComputation::Command> &commands = computation->commands;
+  int32 num_commands = commands.size();
+  // The backprop of the first component would need its output, which the
+  // fused components overwrite, so we only do this for computations without
+  // backprop, i.e. test-time computations.
+  for (int32 c = 0; c < num_commands; c++)
+    if (commands[c].command_type == kBackprop ||
+        commands[c].command_type == kBackpropNoModelUpdate)
+      return;
+
+  for (int32 c = 0; c < num_commands; c++) {
+    NnetComputation::Command &c1 = commands[c];
+    if (c1.command_type != kPropagate || c1.arg5 != 0 || c1.arg6 != 0 ||
+        c1.arg7 >= 0)
+      continue;
+    const NnetComputation::SubMatrixInfo
+        &output = computation->submatrices[c1.arg4];
+    // 'fused' are the commands to fuse with c1, and 'moved' are the commands
+    // in between them, which deallocate other matrices and which we move to
+    // after the fused commands (this only delays freeing the memory).
+    std::vector<int32> fused, moved;
+    for (int32 next = c + 1; next < num_commands; next++) {
+      const NnetComputation::Command &c2 = commands[next];
+      if (c2.command_type == kNoOperation ||
+          (c2.command_type == kDeallocMatrix &&
+           computation->submatrices[c2.arg1].matrix_index !=
+           output.matrix_index)) {
+        moved.push_back(next);
+        continue;
+      }
+      // c2 must operate in-place on the output of c1.
+      if (c2.command_type != kPropagate || c2.arg5 != 0 || c2.arg6 != 0 ||
+          c2.arg7 >= 0 ||
+          !(computation->submatrices[c2.arg3] == output) ||
+          !(computation->submatrices[c2.arg4] == output) ||
+          !GetFusableColumnOps(*nnet.GetComponent(c2.arg1), NULL))
+        break;
+      fused.push_back(next);
+    }
+    if (fused.empty())
+      continue;
+    int32 num_fused = fused.size(), end = fused.back() + 1;
+    std::vector<NnetComputation::Command> reordered;
+    reordered.reserve(end - c - 1);
+    for (int32 i = 0; i < num_fused; i++) {
+      reordered.push_back(commands[fused[i]]);
+      reordered.back().arg7 = 0;
+    }
+    for (size_t i = 0; i < moved.size() && moved[i] < end; i++)
+      reordered.push_back(commands[moved[i]]);
+    std::copy(reordered.begin(), reordered.end(), commands.begin() + c + 1);
+    c1.arg7 = num_fused;
+    c = end - 1;
+  }
+}
+
 bool MatrixIsUnused(const Analyzer &analyzer,
                     const NnetComputation &computation,
                     int32 m) {
@@ -22,6 +22,7 @@
 
 #include <mutex>
 #include <list>
+#include "matrix/simd-math.h"
 #include "nnet3/nnet-compile.h"
 #include "nnet3/nnet-analyze.h"
 
@@ -616,6 +617,31 @@ void OptimizeLoopedComputation(const Nnet &nnet,
 void FixGotoLabel(NnetComputation *computation);
 
 
+/// If 'c' is a component whose propagation, done in-place in a computation
+/// without backprop, is a sequence of elementwise operations that
+/// ApplyColumnOps() can do (a RectifiedLinearComponent, or a
+/// BatchNormComponent in test mode whose block-dim equals its dim), appends
+/// those operations to *ops (if ops is not NULL) and returns true; otherwise
+/// returns false.  The pointers in the ColumnOps point to the component's
+/// parameters.
+bool GetFusableColumnOps(const Component &c,
+                         std::vector<ColumnOp<BaseFloat> > *ops);
+
+/// This function is for computations without backprop (e.g. for decoding).
+/// It finds kPropagate commands that are followed by one or more kPropagate
+/// commands that operate in-place on their output and whose components are
+/// accepted by GetFusableColumnOps() (e.g. an affine component followed by
+/// a ReLU and a test-mode batch-norm), and marks them as fused: the first
+/// command gets the number of commands that follow it in its arg7, and those
+/// commands get 0 in their arg7.  On CPU, NnetComputer then does the
+/// following commands' operations (and, for AffineComponent, the addition of
+/// the bias) in one pass over the output of the first command, using
+/// ApplyColumnOps(), and does nothing for the following commands.  The
+/// commands are not removed, so on GPU they are executed as normal.
+void FusePropagateCommands(const Nnet &nnet,
+                           NnetComputation *computation);
+
+
 /// Class ComputationCache is used inside class CachingOptimizingCompiler to
 /// cache previously computed computations.  The code was moved from class
 /// CachingOptimizingCompiler to this separate class for clarity when adding
@@ -79,6 +79,10 @@ void NnetOptimizeOptions::Read(std::istream &is, bool binary) {
     ExpectToken(is, binary, "<MemoryCompressionLevel>");
     ReadBasicType(is, binary, &memory_compression_level);
   }
+  if (PeekToken(is, binary) == 'F') {
+    ExpectToken(is, binary, "<FusePropagate>");
+    ReadBasicType(is, binary, &fuse_propagate);
+  }
   ExpectToken(is, binary, "</NnetOptimizeOptions>");
 }
 
@@ -122,6 +126,8 @@ void NnetOptimizeOptions::Write(std::ostream &os, bool binary) const {
   WriteBasicType(os, binary, snip_row_ops);
   WriteToken(os, binary, "<MemoryCompressionLevel>");
   WriteBasicType(os, binary, memory_compression_level);
+  WriteToken(os, binary, "<FusePropagate>");
+  WriteBasicType(os, binary, fuse_propagate);
   WriteToken(os, binary, "</NnetOptimizeOptions>");
 }
 
@@ -143,7 +149,8 @@ bool NnetOptimizeOptions::operator == (const NnetOptimizeOptions &other) const {
           other.max_deriv_time == max_deriv_time &&
           other.max_deriv_time_relative == max_deriv_time_relative &&
           other.snip_row_ops == snip_row_ops &&
-          other.memory_compression_level == memory_compression_level);
+          other.memory_compression_level == memory_compression_level &&
+          other.fuse_propagate == fuse_propagate);
 }
 
 // move commands that resize and zero matrices to as late/early as possible.
@@ -606,6 +613,12 @@ void Optimize(const NnetOptimizeOptions &config,
       CheckComputation(nnet, *computation, false);
   }
 
+  if (config.optimize && config.fuse_propagate) {
+    FusePropagateCommands(nnet, computation);
+    if (GetVerboseLevel() >= 3)
+      CheckComputation(nnet, *computation, false);
+  }
+
   // The following is not configurable because it is necessary for
   // the computation to run correctly (we do it after compilation too,
   // but the operations may have been put out of order by
@@ -54,6 +54,7 @@ struct NnetOptimizeOptions {
   int32 max_deriv_time_relative;
   bool snip_row_ops;
   int32 memory_compression_level;
+  bool fuse_propagate;
   // optimize_looped_computation is a 'hidden config' not available from
   // the command line; it's set to true to enable the optimization for
   // looped computation that turns a linear computation into a loop.
@@ -79,6 +80,7 @@ struct NnetOptimizeOptions {
       max_deriv_time_relative(std::numeric_limits<int32>::max()),
       snip_row_ops(true),
       memory_compression_level(1),
+      fuse_propagate(true),
       optimize_looped_computation(false) { }
 
   void Register(OptionsItf *opts) {
@@ -145,6 +147,11 @@ struct NnetOptimizeOptions {
                    "potentially at the expense of speed and the accuracy "
                    "of derivatives.  0 means no compression at all; 1 means "
                    "compression that shouldn't affect results at all.");
+    opts->Register("fuse-propagate", &fuse_propagate, "Set this to false "
+                   "to disable an optimization, for computations without "
+                   "backprop, that on CPU does ReLUs and test-mode "
+                   "batch-norms (and the bias of a preceding affine "
+                   "component) in one pass over the data.");
 
   }
   void Read(std::istream &is, bool binary);
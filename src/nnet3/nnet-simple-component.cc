@@ -28,6 +28,7 @@
 #include "nnet3/nnet-simple-component.h"
 #include "nnet3/nnet-parse.h"
 #include "cudamatrix/cu-math.h"
+#include "matrix/simd-math.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -3341,6 +3342,546 @@ void LinearComponent::ConsolidateMemory() {
   preconditioner_out_.Swap(&temp_out);
 }
 
+void BlockSparseAffineComponent::InitNaturalGradient() {
+  use_natural_gradient_ = true;
+  preconditioner_in_.SetRank(std::min<int32>(20, (input_dim_ + 1) / 2));
+  preconditioner_out_.SetRank(std::min<int32>(80, (output_dim_ + 1) / 2));
+  preconditioner_in_.SetUpdatePeriod(4);
+  preconditioner_out_.SetUpdatePeriod(4);
+  // the component-level defaults of alpha and num_samples_history, at 4.0 and
+  // 2000.0, are the same as in the NaturalGradientOnline code, so there is no
+  // need to set those here.
+}
+
+void BlockSparseAffineComponent::Check() {
+  int32 num_blocks = (output_dim_ + block_rows_ - 1) / block_rows_;
+  if (!(input_dim_ > 0 && output_dim_ > 0 && block_rows_ > 0 &&
+        static_cast<int32>(col_offsets_.size()) == num_blocks + 1 &&
+        col_offsets_[0] == 0 &&
+        col_offsets_.back() == static_cast<int32>(col_indexes_.size()) &&
+        params_.NumRows() == static_cast<int32>(col_indexes_.size()) &&
+        params_.NumCols() == block_rows_ &&
+        (bias_params_.Dim() == 0 || bias_params_.Dim() == output_dim_)))
+    KALDI_ERR << "Invalid BlockSparseAffineComponent.";
+  for (int32 b = 0; b < num_blocks; b++) {
+    if (col_offsets_[b + 1] < col_offsets_[b])
+      KALDI_ERR << "Invalid BlockSparseAffineComponent.";
+    for (int32 k = col_offsets_[b]; k < col_offsets_[b + 1]; k++)
+      if (col_indexes_[k] < 0 || col_indexes_[k] >= input_dim_ ||
+          (k > col_offsets_[b] && col_indexes_[k] <= col_indexes_[k - 1]))
+        KALDI_ERR << "Invalid BlockSparseAffineComponent.";
+  }
+  col_indexes_cuda_ = col_indexes_;
+}
+
+void BlockSparseAffineComponent::ZeroUnusedParams() {
+  int32 num_blocks = col_offsets_.size() - 1,
+      last_block_rows = output_dim_ - (num_blocks - 1) * block_rows_,
+      last_block_cols = col_offsets_[num_blocks] - col_offsets_[num_blocks - 1];
+  if (last_block_rows < block_rows_ && last_block_cols > 0)
+    params_.Range(col_offsets_[num_blocks - 1], last_block_cols,
+                  last_block_rows, block_rows_ - last_block_rows).SetZero();
+}
+
+void BlockSparseAffineComponent::InitFromDense(
+    const CuMatrixBase<BaseFloat> &linear_params,
+    int32 block_rows, int32 block_cols, BaseFloat sparsity) {
+  KALDI_ASSERT(block_rows > 0 && block_cols > 0 &&
+               sparsity >= 0.0 && sparsity < 1.0);
+  Matrix<BaseFloat> params(linear_params);
+  input_dim_ = params.NumCols();
+  output_dim_ = params.NumRows();
+  block_rows_ = block_rows;
+  int32 num_row_blocks = (output_dim_ + block_rows - 1) / block_rows,
+      num_col_blocks = (input_dim_ + block_cols - 1) / block_cols;
+
+  // We work out the squared Frobenius norm of each block, and keep those
+  // whose norms are at least 'threshold'.
+  Matrix<BaseFloat> block_norms(num_row_blocks, num_col_blocks);
+  for (int32 r = 0; r < output_dim_; r++)
+    for (int32 c = 0; c < input_dim_; c++)
+      block_norms(r / block_rows, c / block_cols) += params(r, c) * params(r, c);
+  int64 num_params = static_cast<int64>(input_dim_) * output_dim_,
+      num_params_kept = 0;
+  std::vector<std::pair<BaseFloat, int32> > sorted_blocks;
+  sorted_blocks.reserve(num_row_blocks * num_col_blocks);
+  for (int32 rb = 0; rb < num_row_blocks; rb++)
+    for (int32 cb = 0; cb < num_col_blocks; cb++)
+      sorted_blocks.push_back(std::pair<BaseFloat, int32>(
+          -block_norms(rb, cb), rb * num_col_blocks + cb));
+  std::sort(sorted_blocks.begin(), sorted_blocks.end());
+  std::vector<bool> keep(sorted_blocks.size(), false);
+  for (size_t i = 0; i < sorted_blocks.size(); i++) {
+    int32 rb = sorted_blocks[i].second / num_col_blocks,
+        cb = sorted_blocks[i].second % num_col_blocks,
+        this_num_params =
+        (std::min(output_dim_, (rb + 1) * block_rows) - rb * block_rows) *
+        (std::min(input_dim_, (cb + 1) * block_cols) - cb * block_cols);
+    if (i > 0 && num_params_kept + this_num_params >
+        (1.0 - sparsity) * num_params)
+      break;
+    keep[sorted_blocks[i].second] = true;
+    num_params_kept += this_num_params;
+  }
+
+  col_offsets_.resize(num_row_blocks + 1);
+  col_offsets_[0] = 0;
+  col_indexes_.clear();
+  for (int32 rb = 0; rb < num_row_blocks; rb++) {
+    for (int32 cb = 0; cb < num_col_blocks; cb++)
+      if (keep[rb * num_col_blocks + cb])
+        for (int32 c = cb * block_cols;
+             c < std::min(input_dim_, (cb + 1) * block_cols); c++)
+          col_indexes_.push_back(c);
+    col_offsets_[rb + 1] = col_indexes_.size();
+  }
+  Matrix<BaseFloat> sparse_params(col_indexes_.size(), block_rows);
+  for (int32 rb = 0; rb < num_row_blocks; rb++)
+    for (int32 k = col_offsets_[rb]; k < col_offsets_[rb + 1]; k++)
+      for (int32 i = 0; i < block_rows && rb * block_rows + i < output_dim_;
+           i++)
+        sparse_params(k, i) = params(rb * block_rows + i, col_indexes_[k]);
+  params_.Swap(&sparse_params);
+}
+
+BlockSparseAffineComponent::BlockSparseAffineComponent(
+    const UpdatableComponent &other,
+    const CuMatrixBase<BaseFloat> &linear_params,
+    const CuVectorBase<BaseFloat> &bias_params,
+    int32 block_rows, int32 block_cols, BaseFloat sparsity):
+    UpdatableComponent(other),
+    bias_params_(bias_params) {
+  InitFromDense(linear_params, block_rows, block_cols, sparsity);
+  InitNaturalGradient();
+  Check();
+}
+
+void BlockSparseAffineComponent::Prune(int32 block_rows, int32 block_cols,
+                                       BaseFloat sparsity) {
+  CuMatrix<BaseFloat> linear_params;
+  GetLinearParams(&linear_params);
+  InitFromDense(linear_params, block_rows, block_cols, sparsity);
+  Check();
+}
+
+void BlockSparseAffineComponent::GetLinearParams(
+    CuMatrix<BaseFloat> *linear_params) const {
+  Matrix<BaseFloat> params(params_), ans(output_dim_, input_dim_);
+  int32 num_blocks = col_offsets_.size() - 1;
+  for (int32 b = 0; b < num_blocks; b++)
+    for (int32 k = col_offsets_[b]; k < col_offsets_[b + 1]; k++)
+      for (int32 i = 0; i < block_rows_ && b * block_rows_ + i < output_dim_;
+           i++)
+        ans(b * block_rows_ + i, col_indexes_[k]) = params(k, i);
+  linear_params->Swap(&ans);
+}
+
+BaseFloat BlockSparseAffineComponent::Density() const {
+  int32 num_blocks = col_offsets_.size() - 1;
+  int64 num_params = 0;
+  for (int32 b = 0; b < num_blocks; b++)
+    num_params += static_cast<int64>(col_offsets_[b + 1] - col_offsets_[b]) *
+        std::min(block_rows_, output_dim_ - b * block_rows_);
+  return num_params / (static_cast<BaseFloat>(input_dim_) * output_dim_);
+}
+
+void BlockSparseAffineComponent::Read(std::istream &is, bool binary) {
+  std::string token = ReadUpdatableCommon(is, binary);
+  KALDI_ASSERT(token == "");
+  ExpectToken(is, binary, "<InputDim>");
+  ReadBasicType(is, binary, &input_dim_);
+  ExpectToken(is, binary, "<OutputDim>");
+  ReadBasicType(is, binary, &output_dim_);
+  ExpectToken(is, binary, "<BlockRows>");
+  ReadBasicType(is, binary, &block_rows_);
+  ExpectToken(is, binary, "<ColOffsets>");
+  ReadIntegerVector(is, binary, &col_offsets_);
+  ExpectToken(is, binary, "<ColIndexes>");
+  ReadIntegerVector(is, binary, &col_indexes_);
+  ExpectToken(is, binary, "<Params>");
+  params_.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "<UseNaturalGradient>");
+  ReadBasicType(is, binary, &use_natural_gradient_);
+
+  // Read various natural-gradient-related configs.
+  int32 rank_in,  rank_out, update_period;
+  BaseFloat alpha, num_samples_history;
+  ExpectToken(is, binary, "<RankInOut>");
+  ReadBasicType(is, binary, &rank_in);
+  ReadBasicType(is, binary, &rank_out);
+  ExpectToken(is, binary, "<Alpha>");
+  ReadBasicType(is, binary, &alpha);
+  ExpectToken(is, binary, "<NumSamplesHistory>");
+  ReadBasicType(is, binary, &num_samples_history);
+  ExpectToken(is, binary, "<UpdatePeriod>");
+  ReadBasicType(is, binary, &update_period);
+
+  preconditioner_in_.SetAlpha(alpha);
+  preconditioner_out_.SetAlpha(alpha);
+  preconditioner_in_.SetRank(rank_in);
+  preconditioner_out_.SetRank(rank_out);
+  preconditioner_in_.SetNumSamplesHistory(num_samples_history);
+  preconditioner_out_.SetNumSamplesHistory(num_samples_history);
+  preconditioner_in_.SetUpdatePeriod(update_period);
+  preconditioner_out_.SetUpdatePeriod(update_period);
+
+  ExpectToken(is, binary, "</BlockSparseAffineComponent>");
+  Check();
+}
+
+void BlockSparseAffineComponent::InitFromConfig(ConfigLine *cfl) {
+  bool ok = true;
+  is_gradient_ = false;  // not configurable; there's no reason you'd want this
+
+  InitLearningRatesFromConfig(cfl);
+
+  block_rows_ = 16;
+  BaseFloat density = 0.5;
+  bool use_bias = true;
+  ok = ok && cfl->GetValue("input-dim", &input_dim_);
+  ok = ok && cfl->GetValue("output-dim", &output_dim_);
+  cfl->GetValue("block-rows", &block_rows_);
+  cfl->GetValue("density", &density);
+  cfl->GetValue("use-bias", &use_bias);
+  if (!ok || input_dim_ <= 0 || output_dim_ <= 0 || block_rows_ <= 0 ||
+      density <= 0.0 || density > 1.0)
+    KALDI_ERR << "Bad initializer " << cfl->WholeLine();
+
+  // Each block of rows uses a random subset of the input columns, of size
+  // 'num_cols'.
+  int32 num_blocks = (output_dim_ + block_rows_ - 1) / block_rows_,
+      num_cols = std::max<int32>(1, density * input_dim_ + 0.5);
+  std::vector<int32> all_cols(input_dim_);
+  for (int32 c = 0; c < input_dim_; c++)
+    all_cols[c] = c;
+  col_offsets_.resize(num_blocks + 1);
+  col_offsets_[0] = 0;
+  col_indexes_.clear();
+  for (int32 b = 0; b < num_blocks; b++) {
+    std::random_shuffle(all_cols.begin(), all_cols.end());
+    std::vector<int32> cols(all_cols.begin(), all_cols.begin() + num_cols);
+    std::sort(cols.begin(), cols.end());
+    col_indexes_.insert(col_indexes_.end(), cols.begin(), cols.end());
+    col_offsets_[b + 1] = col_indexes_.size();
+  }
+
+  BaseFloat param_stddev = 1.0 / std::sqrt(num_cols),
+      bias_stddev = 1.0;
+  cfl->GetValue("param-stddev", &param_stddev);
+  cfl->GetValue("bias-stddev", &bias_stddev);
+  KALDI_ASSERT(param_stddev >= 0.0 && bias_stddev >= 0.0);
+  params_.Resize(col_indexes_.size(), block_rows_);
+  params_.SetRandn();
+  params_.Scale(param_stddev);
+  ZeroUnusedParams();
+  if (use_bias) {
+    bias_params_.Resize(output_dim_);
+    bias_params_.SetRandn();
+    bias_params_.Scale(bias_stddev);
+  } else {
+    bias_params_.Resize(0);
+  }
+
+  // Read various natural-gradient-related configs.
+  int32 rank_in = -1, rank_out = -1, update_period = 4;
+  BaseFloat alpha = 4.0,
+      num_samples_history = 2000.0;
+
+  use_natural_gradient_ = true;
+
+  cfl->GetValue("num-samples-history", &num_samples_history);
+  cfl->GetValue("alpha", &alpha);
+  cfl->GetValue("rank-in", &rank_in);
+  cfl->GetValue("rank-out", &rank_out);
+  cfl->GetValue("update-period", &update_period);
+  cfl->GetValue("use-natural-gradient", &use_natural_gradient_);
+
+  if (rank_in < 0)
+    rank_in = std::min<int32>(20, (InputDim() + 1) / 2);
+  if (rank_out < 0)
+    rank_out = std::min<int32>(80, (OutputDim() + 1) / 2);
+
+  preconditioner_in_.SetAlpha(alpha);
+  preconditioner_out_.SetAlpha(alpha);
+  preconditioner_in_.SetRank(rank_in);
+  preconditioner_out_.SetRank(rank_out);
+  preconditioner_in_.SetNumSamplesHistory(num_samples_history);
+  preconditioner_out_.SetNumSamplesHistory(num_samples_history);
+  preconditioner_in_.SetUpdatePeriod(update_period);
+  preconditioner_out_.SetUpdatePeriod(update_period);
+
+  if (cfl->HasUnusedValues())
+    KALDI_ERR << "Could not process these elements in initializer: "
+              << cfl->UnusedValues();
+  Check();
+}
+
+void BlockSparseAffineComponent::Write(std::ostream &os,
+                                       bool binary) const {
+  WriteUpdatableCommon(os, binary);  // Write the opening tag and learning rate
+  WriteToken(os, binary, "<InputDim>");
+  WriteBasicType(os, binary, input_dim_);
+  WriteToken(os, binary, "<OutputDim>");
+  WriteBasicType(os, binary, output_dim_);
+  WriteToken(os, binary, "<BlockRows>");
+  WriteBasicType(os, binary, block_rows_);
+  WriteToken(os, binary, "<ColOffsets>");
+  WriteIntegerVector(os, binary, col_offsets_);
+  WriteToken(os, binary, "<ColIndexes>");
+  WriteIntegerVector(os, binary, col_indexes_);
+  WriteToken(os, binary, "<Params>");
+  params_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "<UseNaturalGradient>");
+  WriteBasicType(os, binary, use_natural_gradient_);
+
+  int32 rank_in = preconditioner_in_.GetRank(),
+      rank_out = preconditioner_out_.GetRank(),
+      update_period = preconditioner_in_.GetUpdatePeriod();
+  BaseFloat alpha = preconditioner_in_.GetAlpha(),
+      num_samples_history = preconditioner_in_.GetNumSamplesHistory();
+  WriteToken(os, binary, "<RankInOut>");
+  WriteBasicType(os, binary, rank_in);
+  WriteBasicType(os, binary, rank_out);
+  WriteToken(os, binary, "<Alpha>");
+  WriteBasicType(os, binary, alpha);
+  WriteToken(os, binary, "<NumSamplesHistory>");
+  WriteBasicType(os, binary, num_samples_history);
+  WriteToken(os, binary, "<UpdatePeriod>");
+  WriteBasicType(os, binary, update_period);
+  WriteToken(os, binary, "</BlockSparseAffineComponent>");
+}
+
+std::string BlockSparseAffineComponent::Info() const {
+  std::ostringstream stream;
+  stream << UpdatableComponent::Info();
+  stream << ", block-rows=" << block_rows_
+         << ", density=" << Density();
+  PrintParameterStats(stream, "params", params_);
+  if (bias_params_.Dim() != 0)
+    PrintParameterStats(stream, "bias", bias_params_, true);
+  stream << ", use-natural-gradient="
+         << (use_natural_gradient_ ? "true" : "false")
+         << ", rank-in=" << preconditioner_in_.GetRank()
+         << ", rank-out=" << preconditioner_out_.GetRank()
+         << ", num-samples-history="
+         << preconditioner_in_.GetNumSamplesHistory()
+         << ", update-period=" << preconditioner_in_.GetUpdatePeriod()
+         << ", alpha=" << preconditioner_in_.GetAlpha();
+  return stream.str();
+}
+
+void* BlockSparseAffineComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  if (bias_params_.Dim() != 0)
+    out->CopyRowsFromVec(bias_params_);
+  // else we add to 'out', as kPropagateAdds is set.
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    int32 num_blocks = col_offsets_.size() - 1;
+    for (int32 b = 0; b < num_blocks; b++) {
+      int32 num_cols = col_offsets_[b + 1] - col_offsets_[b],
+          num_rows = std::min(block_rows_, output_dim_ - b * block_rows_);
+      if (num_cols == 0)
+        continue;
+      CuSubArray<int32> this_col_indexes(col_indexes_cuda_, col_offsets_[b],
+                                         num_cols);
+      CuMatrix<BaseFloat> in_part(in.NumRows(), num_cols, kUndefined);
+      in_part.CopyCols(in, this_col_indexes);
+      out->ColRange(b * block_rows_, num_rows).AddMatMat(
+          1.0, in_part, kNoTrans,
+          params_.Range(col_offsets_[b], num_cols, 0, num_rows), kNoTrans, 1.0);
+    }
+    return NULL;
+  }
+#endif
+  AddMatBlockSparse(in.Mat(), params_.Mat(), col_indexes_, col_offsets_,
+                    &(out->Mat()));
+  return NULL;
+}
+
+void BlockSparseAffineComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &in_value,
+    const CuMatrixBase<BaseFloat> &, // out_value
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    void *memo,
+    Component *to_update_in,
+    CuMatrixBase<BaseFloat> *in_deriv) const {
+  NVTX_RANGE("BlockSparseAffineComponent::Backprop");
+  BlockSparseAffineComponent *to_update =
+      dynamic_cast<BlockSparseAffineComponent*>(to_update_in);
+  int32 num_frames = in_value.NumRows(),
+      num_blocks = col_offsets_.size() - 1;
+
+  if (in_deriv) {
+    // We work out the transpose of the input derivative, since
+    // AddToRows() is the operation we need.
+    CuMatrix<BaseFloat> in_deriv_trans(input_dim_, num_frames);
+    for (int32 b = 0; b < num_blocks; b++) {
+      int32 num_cols = col_offsets_[b + 1] - col_offsets_[b],
+          num_rows = std::min(block_rows_, output_dim_ - b * block_rows_);
+      if (num_cols == 0)
+        continue;
+      CuSubArray<int32> this_col_indexes(col_indexes_cuda_, col_offsets_[b],
+                                         num_cols);
+      CuMatrix<BaseFloat> in_deriv_part(num_cols, num_frames, kUndefined);
+      in_deriv_part.AddMatMat(
+          1.0, params_.Range(col_offsets_[b], num_cols, 0, num_rows), kNoTrans,
+          out_deriv.ColRange(b * block_rows_, num_rows), kTrans, 0.0);
+      in_deriv_part.AddToRows(1.0, this_col_indexes, &in_deriv_trans);
+    }
+    in_deriv->AddMat(1.0, in_deriv_trans, kTrans);
+  }
+
+  if (to_update != NULL) {
+    bool use_bias = (bias_params_.Dim() != 0);
+    // in_value_temp is the input with a column of ones appended to it if we
+    // have a bias, as in TdnnComponent.
+    CuMatrix<BaseFloat> in_value_temp(num_frames,
+                                      input_dim_ + (use_bias ? 1 : 0),
+                                      kUndefined),
+        out_deriv_temp(out_deriv);
+    in_value_temp.ColRange(0, input_dim_).CopyFromMat(in_value);
+    if (use_bias)
+      in_value_temp.ColRange(input_dim_, 1).Set(1.0);
+    BaseFloat local_lrate = to_update->learning_rate_;
+    if (!to_update->is_gradient_ && to_update->use_natural_gradient_) {
+      // These "scale" values get will get multiplied into the learning rate
+      // (faster than having the matrices scaled inside the preconditioning
+      // code).
+      BaseFloat in_scale, out_scale;
+      to_update->preconditioner_in_.PreconditionDirections(&in_value_temp,
+                                                           &in_scale);
+      to_update->preconditioner_out_.PreconditionDirections(&out_deriv_temp,
+                                                            &out_scale);
+      local_lrate *= in_scale * out_scale;
+    }
+    if (use_bias) {
+      // this "precon_ones" is what happens to the vector of 1's representing
+      // offsets, after multiplication by the preconditioner.
+      CuVector<BaseFloat> precon_ones(num_frames);
+      precon_ones.CopyColFromMat(in_value_temp, input_dim_);
+      to_update->bias_params_.AddMatVec(local_lrate, out_deriv_temp, kTrans,
+                                        precon_ones, 1.0);
+    }
+    // Only the parameters that are not pruned away are updated.
+    for (int32 b = 0; b < num_blocks; b++) {
+      int32 num_cols = col_offsets_[b + 1] - col_offsets_[b],
+          num_rows = std::min(block_rows_, output_dim_ - b * block_rows_);
+      if (num_cols == 0)
+        continue;
+      CuSubArray<int32> this_col_indexes(col_indexes_cuda_, col_offsets_[b],
+                                         num_cols);
+      CuMatrix<BaseFloat> in_value_part(num_frames, num_cols, kUndefined);
+      in_value_part.CopyCols(in_value_temp, this_col_indexes);
+      to_update->params_.Range(col_offsets_[b], num_cols, 0, num_rows).AddMatMat(
+          local_lrate, in_value_part, kTrans,
+          out_deriv_temp.ColRange(b * block_rows_, num_rows), kNoTrans, 1.0);
+    }
+  }
+}
+
+Component* BlockSparseAffineComponent::Copy() const {
+  return new BlockSparseAffineComponent(*this);
+}
+
+BlockSparseAffineComponent::BlockSparseAffineComponent(
+    const BlockSparseAffineComponent &other):
+    UpdatableComponent(other),
+    input_dim_(other.input_dim_),
+    output_dim_(other.output_dim_),
+    block_rows_(other.block_rows_),
+    col_offsets_(other.col_offsets_),
+    col_indexes_(other.col_indexes_),
+    col_indexes_cuda_(other.col_indexes_cuda_),
+    params_(other.params_),
+    bias_params_(other.bias_params_),
+    use_natural_gradient_(other.use_natural_gradient_),
+    preconditioner_in_(other.preconditioner_in_),
+    preconditioner_out_(other.preconditioner_out_) { }
+
+void BlockSparseAffineComponent::Scale(BaseFloat scale) {
+  if (scale == 0.0) {
+    params_.SetZero();
+    bias_params_.SetZero();
+  } else {
+    params_.Scale(scale);
+    bias_params_.Scale(scale);
+  }
+}
+
+void BlockSparseAffineComponent::Add(BaseFloat alpha,
+                                     const Component &other_in) {
+  const BlockSparseAffineComponent *other =
+      dynamic_cast<const BlockSparseAffineComponent*>(&other_in);
+  KALDI_ASSERT(other != NULL && other->col_indexes_ == col_indexes_ &&
+               other->col_offsets_ == col_offsets_);
+  params_.AddMat(alpha, other->params_);
+  bias_params_.AddVec(alpha, other->bias_params_);
+}
+
+void BlockSparseAffineComponent::PerturbParams(BaseFloat stddev) {
+  CuMatrix<BaseFloat> temp_params(params_);
+  temp_params.SetRandn();
+  params_.AddMat(stddev, temp_params);
+  ZeroUnusedParams();
+  if (bias_params_.Dim() != 0) {
+    CuVector<BaseFloat> temp_bias_params(bias_params_);
+    temp_bias_params.SetRandn();
+    bias_params_.AddVec(stddev, temp_bias_params);
+  }
+}
+
+int32 BlockSparseAffineComponent::NumParameters() const {
+  return params_.NumRows() * params_.NumCols() + bias_params_.Dim();
+}
+
+void BlockSparseAffineComponent::Vectorize(
+    VectorBase<BaseFloat> *params) const {
+  KALDI_ASSERT(params->Dim() == this->NumParameters());
+  int32 num_params = params_.NumRows() * params_.NumCols();
+  params->Range(0, num_params).CopyRowsFromMat(params_);
+  if (bias_params_.Dim() != 0)
+    params->Range(num_params, bias_params_.Dim()).CopyFromVec(bias_params_);
+}
+
+void BlockSparseAffineComponent::UnVectorize(
+    const VectorBase<BaseFloat> &params) {
+  KALDI_ASSERT(params.Dim() == this->NumParameters());
+  int32 num_params = params_.NumRows() * params_.NumCols();
+  params_.CopyRowsFromVec(params.Range(0, num_params));
+  ZeroUnusedParams();
+  if (bias_params_.Dim() != 0)
+    bias_params_.CopyFromVec(params.Range(num_params, bias_params_.Dim()));
+}
+
+BaseFloat BlockSparseAffineComponent::DotProduct(
+    const UpdatableComponent &other_in) const {
+  const BlockSparseAffineComponent *other =
+      dynamic_cast<const BlockSparseAffineComponent*>(&other_in);
+  return TraceMatMat(params_, other->params_, kTrans) +
+      VecVec(bias_params_, other->bias_params_);
+}
+
+void BlockSparseAffineComponent::FreezeNaturalGradient(bool freeze) {
+  preconditioner_in_.Freeze(freeze);
+  preconditioner_out_.Freeze(freeze);
+}
+
+void BlockSparseAffineComponent::ConsolidateMemory() {
+  OnlineNaturalGradient temp_in(preconditioner_in_);
+  preconditioner_in_.Swap(&temp_in);
+  OnlineNaturalGradient temp_out(preconditioner_out_);
+  preconditioner_out_.Swap(&temp_out);
+}
+
 std::string FixedAffineComponent::Info() const {
   std::ostringstream stream;
   stream << Component::Info();
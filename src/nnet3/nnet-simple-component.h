@@ -986,6 +986,183 @@ class LinearComponent: public UpdatableComponent {
   OnlineNaturalGradient preconditioner_out_;
 };
 
+/*
+  BlockSparseAffineComponent is an affine (or, with use-bias=false, linear)
+  transformation whose matrix is block-sparse, for models that have been
+  pruned (see the 'prune-blocks' directive of ReadEditConfig() in
+  nnet-utils.h, which converts AffineComponent and LinearComponent to this
+  type).  The rows of the matrix (i.e. the output dimensions) are divided into
+  blocks of block-rows rows, and each block has a set of input columns that
+  it uses; all other elements of the matrix are zero, and stay zero in
+  training, which only updates the nonzero parameters.
+
+  On CPU, the propagation uses AddMatBlockSparse() (see matrix/simd-math.h),
+  which is faster than the dense multiplication of AffineComponent if the
+  fraction of nonzero parameters is below about 0.5 to 0.7, depending on the
+  machine; it needs AVX2 and block-rows a multiple of 8 for that, and 16 is a
+  good value.  On GPU, and in the backprop, we do a dense multiplication for
+  each block of rows, which is slower than AffineComponent unless the blocks
+  are large; this component is intended for decoding on CPU, and for
+  fine-tuning after pruning.
+
+  Configuration values accepted by this component:
+
+  Values inherited from UpdatableComponent (see its declaration in
+  nnet-component-itf for details):
+     learning-rate
+     learning-rate-factor
+     max-change
+
+  Values used in initializing the component's parameters:
+     input-dim             e.g. input-dim=1024.  The input dimension.
+     output-dim            e.g. output-dim=1024.  The output dimension.
+     block-rows            e.g. block-rows=16.  The number of rows (outputs)
+                           in each block; default=16.
+     density               e.g. density=0.3.  The fraction of the columns
+                           that each block of rows uses; they are chosen at
+                           random.  default=0.5.
+     param-stddev          e.g. param-stddev=0.025.  The standard deviation
+                           used to randomly initialize the nonzero parameters.
+                           Defaults to 1/sqrt(density * input-dim).
+     bias-stddev           e.g. bias-stddev=0.0.  The standard deviation used
+                           to randomly initialize the bias; default=1.0.
+     use-bias=true         If false, there is no bias term.
+
+   Options to the natural gradient, which is as in LinearComponent (it
+   preconditions the input and the output derivative as if the matrix were
+   dense): use-natural-gradient, num-samples-history, alpha, rank-in,
+   rank-out and update-period.
+*/
+class BlockSparseAffineComponent: public UpdatableComponent {
+ public:
+  virtual int32 InputDim() const { return input_dim_; }
+  virtual int32 OutputDim() const { return output_dim_; }
+
+  virtual std::string Type() const { return "BlockSparseAffineComponent"; }
+  virtual int32 Properties() const {
+    return kSimpleComponent|kUpdatableComponent|kBackpropNeedsInput|
+        kBackpropAdds|(bias_params_.Dim() == 0 ? kPropagateAdds : 0);
+  }
+
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                         const CuMatrixBase<BaseFloat> &in,
+                         CuMatrixBase<BaseFloat> *out) const;
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &in_value,
+                        const CuMatrixBase<BaseFloat> &, // out_value
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *to_update,
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+  // this constructor does not really initialize, use InitFromConfig() or Read().
+  BlockSparseAffineComponent(): input_dim_(0), output_dim_(0),
+                                block_rows_(0) { }
+  void InitFromConfig(ConfigLine *cfl);
+  virtual std::string Info() const;
+  virtual Component* Copy() const;
+  virtual void Scale(BaseFloat scale);
+  virtual void Add(BaseFloat alpha, const Component &other);
+  virtual void PerturbParams(BaseFloat stddev);
+  virtual BaseFloat DotProduct(const UpdatableComponent &other) const;
+  virtual int32 NumParameters() const;
+  virtual void Vectorize(VectorBase<BaseFloat> *params) const;
+  virtual void UnVectorize(const VectorBase<BaseFloat> &params);
+  virtual void FreezeNaturalGradient(bool freeze);
+  virtual void ConsolidateMemory();
+
+  // copy constructor
+  explicit BlockSparseAffineComponent(const BlockSparseAffineComponent &other);
+
+  /// Converts a dense component to this type: 'other' supplies the
+  /// learning-rate and other settings of UpdatableComponent, and
+  /// 'linear_params' and 'bias_params' the parameters (bias_params may be
+  /// empty, meaning no bias).  The parameters are pruned as described for
+  /// Prune().
+  BlockSparseAffineComponent(const UpdatableComponent &other,
+                             const CuMatrixBase<BaseFloat> &linear_params,
+                             const CuVectorBase<BaseFloat> &bias_params,
+                             int32 block_rows, int32 block_cols,
+                             BaseFloat sparsity);
+
+  /// Prunes the parameters, after changing the number of rows in each block to
+  /// 'block_rows'.  We divide the matrix into blocks of block_rows by
+  /// block_cols (the last ones may be partial) and keep the blocks with the
+  /// largest Frobenius norms, as many as needed to make the fraction of
+  /// parameters we remove at least 'sparsity' (rounding down to a whole number
+  /// of blocks, and keeping at least one block).  Blocks that were already
+  /// removed have a norm of zero, so this can be called repeatedly with
+  /// increasing sparsity, with fine-tuning in between.  'block_cols' only
+  /// affects the pruning: the component itself keeps track of which columns
+  /// each block of rows uses.
+  void Prune(int32 block_rows, int32 block_cols, BaseFloat sparsity);
+
+  /// Returns the number of rows in each block.
+  int32 BlockRows() const { return block_rows_; }
+
+  /// Returns the fraction of the elements of the matrix that are not pruned
+  /// away.
+  BaseFloat Density() const;
+
+  /// Outputs the linear parameters as a dense matrix of dimension
+  /// OutputDim() by InputDim().
+  void GetLinearParams(CuMatrix<BaseFloat> *linear_params) const;
+  const CuVector<BaseFloat> &BiasParams() const { return bias_params_; }
+ private:
+  // disallow assignment operator.
+  BlockSparseAffineComponent &operator= (
+      const BlockSparseAffineComponent&);
+
+  // Sets the block structure and params_ from a dense matrix; this does the
+  // work of Prune().
+  void InitFromDense(const CuMatrixBase<BaseFloat> &linear_params,
+                     int32 block_rows, int32 block_cols, BaseFloat sparsity);
+
+  // Sets the natural-gradient options to their defaults, as in
+  // LinearComponent.
+  void InitNaturalGradient();
+
+  // Checks that the members are consistent with each other, and sets
+  // col_indexes_cuda_ from col_indexes_.
+  void Check();
+
+  // Sets to zero the columns of params_ that would belong to outputs past
+  // output_dim_ in the last block of rows, if it is partial.  They are never
+  // used, but are included in NumParameters(), Vectorize() and DotProduct(),
+  // so we keep them zero.
+  void ZeroUnusedParams();
+
+  int32 input_dim_;
+  int32 output_dim_;
+  // The number of rows (output dimensions) in each block.  The last block has
+  // output_dim_ - (num_blocks - 1) * block_rows_ rows if output_dim_ is not a
+  // multiple of it; params_ still has block_rows_ columns, and the rest are
+  // unused.
+  int32 block_rows_;
+  // Block b uses the input columns col_indexes_[k] for col_offsets_[b] <= k <
+  // col_offsets_[b+1]; col_offsets_ has dimension num_blocks + 1.  The column
+  // indexes of each block are sorted.
+  std::vector<int32> col_offsets_;
+  std::vector<int32> col_indexes_;
+  // A copy of col_indexes_, for the GPU (derived from col_indexes_; not
+  // written to disk).
+  CuArray<int32> col_indexes_cuda_;
+  // The parameters, of dimension col_indexes_.size() by block_rows_: element
+  // (k, i) for col_offsets_[b] <= k < col_offsets_[b+1] is the element of the
+  // matrix in row b * block_rows_ + i and column col_indexes_[k].  This is the
+  // format that AddMatBlockSparse() expects.
+  CuMatrix<BaseFloat> params_;
+  // The bias; empty if use-bias=false.
+  CuVector<BaseFloat> bias_params_;
+
+  // If true (and if no this->is_gradient_), use natural gradient updates.
+  bool use_natural_gradient_;
+  OnlineNaturalGradient preconditioner_in_;
+  OnlineNaturalGradient preconditioner_out_;
+};
+
 
 /// FixedAffineComponent is an affine transform that is supplied
 /// at network initialization time and is not trainable.
@@ -1400,7 +1400,7 @@ void ComputeExampleComputationRequestSimple(
 static void GenerateRandomComponentConfig(std::string *component_type,
                                           std::string *config) {
 
-  int32 n = RandInt(0, 37);
+  int32 n = RandInt(0, 38);
   BaseFloat learning_rate = 0.001 * RandInt(1, 100);
 
   std::ostringstream os;
@@ -1773,6 +1773,16 @@ static void GenerateRandomComponentConfig(std::string *component_type,
 
       break;
     }
+    case 38: {
+      *component_type = "BlockSparseAffineComponent";
+      int32 input_dim = RandInt(1, 50), output_dim = RandInt(1, 50);
+      os << "input-dim=" << input_dim << " output-dim=" << output_dim
+         << " block-rows=" << RandInt(1, 20) << " density="
+         << (0.1 * RandInt(1, 10)) << " learning-rate=" << learning_rate
+         << " use-natural-gradient=" << (RandInt(0,1) == 0 ? "true":"false")
+         << " use-bias=" << (RandInt(0,1) == 0 ? "true":"false");
+      break;
+    }
     default:
       KALDI_ERR << "Error generating random component";
   }
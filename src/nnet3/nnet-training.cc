@@ -19,6 +19,7 @@
 // limitations under the License.
 
 #include "nnet3/nnet-training.h"
+#include "nnet3/natural-gradient-online.h"
 #include "nnet3/nnet-utils.h"
 
 namespace kaldi {
@@ -31,7 +32,8 @@ NnetTrainer::NnetTrainer(const NnetTrainerOptions &config,
     compiler_(*nnet, config_.optimize_config, config_.compiler_config),
     num_minibatches_processed_(0),
     max_change_stats_(*nnet),
-    srand_seed_(RandInt(0, 100000)) {
+    srand_seed_(RandInt(0, 100000)),
+    allreducer_(NULL) {
   if (config.zero_component_stats)
     ZeroComponentStats(nnet);
   KALDI_ASSERT(config.momentum >= 0.0 &&
@@ -39,6 +41,14 @@ NnetTrainer::NnetTrainer(const NnetTrainerOptions &config,
                config.backstitch_training_interval > 0);
   delta_nnet_ = nnet_->Copy();
   ScaleNnet(0.0, delta_nnet_);
+  if (config.natural_gradient_threads > 0)
+    OnlineNaturalGradient::SetNumUpdateThreads(config.natural_gradient_threads);
+
+  if (config_.allreduce_config.num_workers > 1) {
+    allreducer_ = new NnetAllreducer(config_.allreduce_config);
+    allreducer_->Start(config_.backstitch_training_interval, nnet_,
+                       &srand_seed_);
+  }
 
   if (config_.read_cache != "") {
     bool binary;
@@ -55,6 +65,8 @@ NnetTrainer::NnetTrainer(const NnetTrainerOptions &config,
 
 
 void NnetTrainer::Train(const NnetExample &eg) {
+  if (allreducer_ != NULL && allreducer_->Finished())
+    return;  // Another worker has run out of data.
   bool need_model_derivative = true;
   ComputationRequest request;
   GetComputationRequest(*nnet_, eg, need_model_derivative,
@@ -108,6 +120,12 @@ void NnetTrainer::TrainInternal(const NnetExample &eg,
                         GetNumNvalues(eg.io, false) * config_.l2_regularize_factor,
                         delta_nnet_);
 
+  // If there are several workers, average the parameter change over them.
+  if (allreducer_ != NULL && !allreducer_->AverageNnet(delta_nnet_)) {
+    ScaleNnet(0.0, delta_nnet_);
+    return;
+  }
+
   // Update the parameters of nnet
   bool success = UpdateNnetWithMaxChange(
       *delta_nnet_, config_.max_param_change,
@@ -164,6 +182,11 @@ void NnetTrainer::TrainInternalBackstitch(const NnetExample &eg,
                           config_.l2_regularize_factor, delta_nnet_);
   }
 
+  if (allreducer_ != NULL && !allreducer_->AverageNnet(delta_nnet_)) {
+    ScaleNnet(0.0, delta_nnet_);
+    return;
+  }
+
   // Updates the parameters of nnet
   UpdateNnetWithMaxChange(
       *delta_nnet_, config_.max_param_change,
@@ -236,6 +259,8 @@ bool NnetTrainer::PrintTotalStats() const {
     ans = ans || ok;
   }
   max_change_stats_.Print(*nnet_);
+  if (allreducer_ != NULL)
+    allreducer_->PrintStats();
   return ans;
 }
 
@@ -334,6 +359,7 @@ NnetTrainer::~NnetTrainer() {
     KALDI_LOG << "Wrote computation cache to " << config_.write_cache;
   }
   delete delta_nnet_;
+  delete allreducer_;
 }
 
 void ComputeObjectiveFunction(const GeneralMatrix &supervision,
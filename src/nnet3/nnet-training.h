@@ -22,6 +22,7 @@
 #define KALDI_NNET3_NNET_TRAINING_H_
 
 #include "nnet3/nnet-example.h"
+#include "nnet3/nnet-allreduce.h"
 #include "nnet3/nnet-computation.h"
 #include "nnet3/nnet-compute.h"
 #include "nnet3/nnet-optimize.h"
@@ -45,9 +46,11 @@ struct NnetTrainerOptions {
   std::string write_cache;
   bool binary_write_cache;
   BaseFloat max_param_change;
+  int32 natural_gradient_threads;
   NnetOptimizeOptions optimize_config;
   NnetComputeOptions compute_config;
   CachingOptimizingCompilerOptions compiler_config;
+  NnetAllreduceOptions allreduce_config;
   NnetTrainerOptions():
       zero_component_stats(true),
       store_component_stats(true),
@@ -59,7 +62,8 @@ struct NnetTrainerOptions {
       backstitch_training_interval(1),
       batchnorm_stats_scale(0.8),
       binary_write_cache(true),
-      max_param_change(2.0) { }
+      max_param_change(2.0),
+      natural_gradient_threads(0) { }
   void Register(OptionsItf *opts) {
     opts->Register("store-component-stats", &store_component_stats,
                    "If true, store activations and derivatives for nonlinear "
@@ -105,6 +109,14 @@ struct NnetTrainerOptions {
                    "the cached computation.");
     opts->Register("binary-write-cache", &binary_write_cache, "Write "
                    "computation cache in binary mode");
+    opts->Register("natural-gradient-threads", &natural_gradient_threads,
+                   "If >0, the number of background threads that update the "
+                   "natural-gradient preconditioners' estimates of the Fisher "
+                   "matrix (every update-period minibatches), overlapping it "
+                   "with the rest of the training.  The results are the same. "
+                   "Whether this is faster depends on having spare cores; with "
+                   "no spare core it is slightly slower.  Only used when not "
+                   "using a GPU.");
 
     // register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -114,6 +126,10 @@ struct NnetTrainerOptions {
     // register the compute options with the prefix "computation".
     ParseOptions compute_opts("computation", opts);
     compute_config.Register(&compute_opts);
+    // register the options for data-parallel training with the prefix
+    // "allreduce".
+    ParseOptions allreduce_opts("allreduce", opts);
+    allreduce_config.Register(&allreduce_opts);
   }
 };
 
@@ -176,6 +192,10 @@ struct ObjectiveFunctionInfo {
     speech-recognition training.  (If the structure is the same each time,
     the CachingOptimizingCompiler notices this and uses the computation from
     last time).
+
+    If --allreduce.num-workers > 1, this is one of several processes that
+    train the model together, averaging their parameter changes after each
+    minibatch; see class NnetAllreducer.
  */
 class NnetTrainer {
  public:
@@ -225,6 +245,9 @@ class NnetTrainer {
   // consistent dropout masks.  It's set to a value derived from rand()
   // when the class is initialized.
   int32 srand_seed_;
+
+  // Non-NULL if config_.allreduce_config.num_workers > 1.
+  NnetAllreducer *allreducer_;
 };
 
 /**
@@ -19,8 +19,11 @@
 // limitations under the License.
 
 #include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-compile.h"
+#include "nnet3/nnet-compute.h"
 #include "nnet3/nnet-simple-component.h"
 #include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-utils.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -100,6 +103,69 @@ void UnitTestConvertRepeatedToBlockAffineComposite() {
   }
 }
 
+// Computes the output of 'nnet' for the inputs in 'request'.
+static void ComputeOutput(const Nnet &nnet,
+                          const ComputationRequest &request,
+                          const std::vector<Matrix<BaseFloat> > &inputs,
+                          CuMatrix<BaseFloat> *output) {
+  NnetComputation computation;
+  Compiler compiler(request, nnet);
+  CompilerOptions opts;
+  compiler.CreateComputation(opts, &computation);
+  computation.ComputeCudaIndexes();
+  NnetComputeOptions compute_opts;
+  NnetComputer computer(compute_opts, computation, nnet, NULL);
+  for (size_t i = 0; i < request.inputs.size(); i++) {
+    CuMatrix<BaseFloat> temp(inputs[i]);
+    computer.AcceptInput(request.inputs[i].name, &temp);
+  }
+  computer.Run();
+  computer.GetOutputDestructive("output", output);
+}
+
+void UnitTestCollapseModelLinear() {
+  // A LinearComponent followed by an affine component that takes two
+  // time-offsets of its output, as in TDNN-F layers.  The first linear
+  // component is not dimension-reducing so it can be collapsed; the second
+  // is a bottleneck, and should be left alone.
+  std::string config =
+    "component name=linear1 type=LinearComponent "
+    "input-dim=20 output-dim=30\n"
+    "component name=affine1 type=NaturalGradientAffineComponent "
+    "input-dim=60 output-dim=40\n"
+    "component name=linear2 type=LinearComponent "
+    "input-dim=40 output-dim=10\n"
+    "component name=affine2 type=AffineComponent "
+    "input-dim=20 output-dim=15\n"
+    "\n"
+    "input-node name=input dim=20\n"
+    "component-node name=linear1 component=linear1 input=input\n"
+    "component-node name=affine1 component=affine1 "
+    "input=Append(Offset(linear1, -1), linear1)\n"
+    "component-node name=linear2 component=linear2 input=affine1\n"
+    "component-node name=affine2 component=affine2 "
+    "input=Append(linear2, Offset(linear2, 1))\n"
+    "output-node name=output input=affine2\n";
+
+  Nnet nnet;
+  std::istringstream is(config);
+  nnet.ReadConfig(is);
+  ComputationRequest request;
+  std::vector<Matrix<BaseFloat> > inputs;
+  ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+  CuMatrix<BaseFloat> output;
+  ComputeOutput(nnet, request, inputs, &output);
+
+  Nnet nnet_collapsed(nnet);
+  CollapseModelConfig collapse_config;
+  CollapseModel(collapse_config, &nnet_collapsed);
+  KALDI_ASSERT(nnet_collapsed.GetComponentIndex("linear1") == -1 &&
+               nnet_collapsed.GetComponentIndex("linear2") != -1);
+  CuMatrix<BaseFloat> output_collapsed;
+  ComputeOutput(nnet_collapsed, request, inputs, &output_collapsed);
+  KALDI_ASSERT(ApproxEqual(output, output_collapsed));
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -111,6 +177,7 @@ int main() {
   UnitTestNnetContext();
   UnitTestConvertRepeatedToBlockAffine();
   UnitTestConvertRepeatedToBlockAffineComposite();
+  UnitTestCollapseModelLinear();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
@@ -1228,6 +1228,55 @@ void ReduceRankOfComponents(const std::string component_name_pattern,
             << " components.";
 }
 
+// This implements the internals of the edit directive 'prune-blocks'.
+void PruneBlocksOfComponents(const std::string component_name_pattern,
+                             int32 block_rows, int32 block_cols,
+                             BaseFloat sparsity, Nnet *nnet) {
+  int32 num_components_changed = 0;
+  for (int32 c = 0; c < nnet->NumComponents(); c++) {
+    Component *component = nnet->GetComponent(c);
+    std::string component_name = nnet->GetComponentName(c);
+    if (!NameMatchesPattern(component_name.c_str(),
+                            component_name_pattern.c_str()))
+      continue;
+    int32 num_params = component->InputDim() * component->OutputDim();
+    BlockSparseAffineComponent *block_sparse =
+        dynamic_cast<BlockSparseAffineComponent*>(component);
+    AffineComponent *affine = dynamic_cast<AffineComponent*>(component);
+    LinearComponent *linear = dynamic_cast<LinearComponent*>(component);
+    if (block_sparse != NULL) {
+      block_sparse->Prune(block_rows, block_cols, sparsity);
+    } else if (affine != NULL || linear != NULL) {
+      if ((affine != NULL ? affine->OrthonormalConstraint() :
+           linear->OrthonormalConstraint()) != 0.0) {
+        KALDI_WARN << "Not pruning component " << component_name
+                   << " as it has an orthonormal constraint.";
+        continue;
+      }
+      CuVector<BaseFloat> no_bias;
+      nnet->SetComponent(c, new BlockSparseAffineComponent(
+          *dynamic_cast<UpdatableComponent*>(component),
+          (affine != NULL ? affine->LinearParams() : linear->Params()),
+          (affine != NULL ? affine->BiasParams() : no_bias),
+          block_rows, block_cols, sparsity));
+      block_sparse =
+          dynamic_cast<BlockSparseAffineComponent*>(nnet->GetComponent(c));
+    } else {
+      KALDI_WARN << "Not pruning component " << component_name
+                 << " as it is not an AffineComponent, LinearComponent or "
+                 << "BlockSparseAffineComponent.";
+      continue;
+    }
+    KALDI_LOG << "Pruned component " << component_name << " in blocks of "
+              << block_rows << " x " << block_cols << "; the fraction of its "
+              << num_params << " matrix elements kept is "
+              << block_sparse->Density();
+    num_components_changed++;
+  }
+  KALDI_LOG << "Pruned parameters of " << num_components_changed
+            << " components.";
+}
+
 
 
 
@@ -1425,6 +1474,22 @@ void ReadEditConfig(std::istream &edit_config_is, Nnet *nnet) {
       if (rank <= 0)
         KALDI_ERR << "Rank must be positive in reduce-rank command.";
       ReduceRankOfComponents(name_pattern, rank, nnet);
+    } else if (directive == "prune-blocks") {
+      std::string name_pattern;
+      int32 block_rows = 16, block_cols = 1;
+      BaseFloat sparsity = -1.0;
+      if (!config_line.GetValue("name", &name_pattern) ||
+          !config_line.GetValue("sparsity", &sparsity))
+        KALDI_ERR << "Edit directive prune-blocks requires 'name' and "
+            "'sparsity' to be specified.";
+      config_line.GetValue("block-rows", &block_rows);
+      config_line.GetValue("block-cols", &block_cols);
+      if (sparsity < 0.0 || sparsity >= 1.0 || block_rows <= 0 ||
+          block_cols <= 0)
+        KALDI_ERR << "Invalid values in prune-blocks command: "
+                  << config_line.WholeLine();
+      PruneBlocksOfComponents(name_pattern, block_rows, block_cols, sparsity,
+                              nnet);
     } else {
       KALDI_ERR << "Directive '" << directive << "' is not currently "
           "supported (reading edit-config).";
@@ -1753,8 +1818,13 @@ class ModelCollapser {
      Tries to produce a component that's equivalent to running the component
      'component_index2' with input given by 'component_index1'.  This handles
      the case where 'component_index1' is of type FixedAffineComponent,
-     AffineComponent or NaturalGradientAffineComponent, and 'component_index2'
-     is of type AffineComponent or NaturalGradientAffineComponent.
+     AffineComponent, NaturalGradientAffineComponent or LinearComponent, and
+     'component_index2' is of type AffineComponent or
+     NaturalGradientAffineComponent.  As for the other types, we don't
+     collapse a LinearComponent that is dimension-reducing, so the
+     factorized layers of TDNN-F models (where the LinearComponent is the
+     bottleneck) stay as they are; combining them would increase the
+     compute.
 
      Returns -1 if this code can't produce a combined component.
    */
@@ -1770,8 +1840,12 @@ class ModelCollapser {
         *affine_component2 =
         dynamic_cast<const AffineComponent*>(
             nnet_->GetComponent(component_index2));
+    const LinearComponent *linear_component1 =
+        dynamic_cast<const LinearComponent*>(
+            nnet_->GetComponent(component_index1));
     if (affine_component2 == NULL ||
-        (fixed_affine_component1 == NULL && affine_component1 == NULL))
+        (fixed_affine_component1 == NULL && affine_component1 == NULL &&
+         linear_component1 == NULL))
       return -1;
 
     std::ostringstream new_component_name_os;
@@ -1782,9 +1856,16 @@ class ModelCollapser {
     if (new_component_index >= 0)
       return new_component_index;  // we previously created this.
 
-    const CuMatrix<BaseFloat> *linear_params1;
-    const CuVector<BaseFloat> *bias_params1;
-    if (fixed_affine_component1 != NULL) {
+    const CuMatrixBase<BaseFloat> *linear_params1;
+    const CuVectorBase<BaseFloat> *bias_params1;
+    CuVector<BaseFloat> zero_bias;
+    if (linear_component1 != NULL) {
+      if (linear_component1->InputDim() > linear_component1->OutputDim())
+        return -1;  // dimension-reducing, e.g. a TDNN-F bottleneck.
+      linear_params1 = &(linear_component1->Params());
+      zero_bias.Resize(linear_component1->OutputDim());
+      bias_params1 = &zero_bias;
+    } else if (fixed_affine_component1 != NULL) {
       if (fixed_affine_component1->InputDim() >
           fixed_affine_component1->OutputDim()) {
         // first affine component is dimension-reducing, so combining the two
@@ -240,7 +240,7 @@ void FindOrphanNodes(const Nnet &nnet, std::vector<int32> *nodes);
 struct CollapseModelConfig {
   bool collapse_dropout;  // dropout then affine/conv.
   bool collapse_batchnorm;  // batchnorm then affine.
-  bool collapse_affine;  // affine or fixed-affine then affine.
+  bool collapse_affine;  // affine, fixed-affine or linear then affine.
   bool collapse_scale;  // affine then fixed-scale.
   CollapseModelConfig(): collapse_dropout(false),
                          collapse_batchnorm(false),
@@ -329,6 +329,19 @@ void CollapseModel(const CollapseModelConfig &config,
        and writes the reconstructed matrix back to the component.  See also
        'apply-svd', which structurally breaks the component into two pieces.
 
+    prune-blocks name=<name-pattern> sparsity=<s> [block-rows=<r>] [block-cols=<c>]
+       Locates all components with names matching <name-pattern>, which are of
+       type AffineComponent or child classes thereof, LinearComponent or
+       BlockSparseAffineComponent, and replaces them with components of type
+       BlockSparseAffineComponent in which the fraction <s> (e.g. 0.6) of the
+       parameters, in blocks of <r> by <c> (default: 16 by 1), are removed;
+       the blocks with the smallest Frobenius norms are removed.  Components
+       that are already of type BlockSparseAffineComponent are pruned again
+       (so you can prune with increasing <s>, training in between).  Components
+       with an orthonormal constraint are not changed.  The result is faster
+       on CPU if <s> is at least about 0.3 to 0.5 and <r> is a multiple of 8;
+       see BlockSparseAffineComponent for details.
+
    \endverbatim
 */
 void ReadEditConfig(std::istream &config_file, Nnet *nnet);
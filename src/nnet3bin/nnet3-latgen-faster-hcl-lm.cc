@@ -0,0 +1,305 @@
+// nnet3bin/nnet3-latgen-faster-hcl-lm.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "tree/context-dep.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/decoder-wrappers.h"
+#include "decoder/hcl-lm-compose-fst.h"
+#include "lm/const-arpa-lm.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-utils.h"
+#include "base/timer.h"
+
+namespace kaldi {
+
+// Returns the peak resident set size of this process in MB, or -1 if it
+// cannot be determined (this works only on Linux).
+static double PeakMemoryMb() {
+  std::ifstream is("/proc/self/status");
+  std::string line;
+  while (std::getline(is, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      std::istringstream iss(line.substr(6));
+      double kb;
+      if (iss >> kb)
+        return kb / 1024.0;
+    }
+  }
+  return -1.0;
+}
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::StdArc;
+
+    const char *usage =
+        "Generate lattices using nnet3 neural net model, with an HCL.fst\n"
+        "composed on the fly with a language model in ConstArpaLm format (see\n"
+        "arpa-to-const-arpa), for LMs too large to compile into HCLG.fst.\n"
+        "HCL.fst is as for nnet3-latgen-faster-lookahead, i.e. with the\n"
+        "disambiguation symbols not removed.  If it was built from\n"
+        "L_disambig.fst, supply the word-level #0 with --word-disambig-syms.\n"
+        "Prints the real-time factor and\n"
+        "peak memory, for comparison with nnet3-latgen-faster on a static\n"
+        "graph.\n"
+        "Usage: nnet3-latgen-faster-hcl-lm [options] <nnet-in> <hcl-fst-in> "
+        "<const-arpa-lm-in> <disambig-syms> <features-rspecifier> "
+        "<lattice-wspecifier> [ <words-wspecifier> [<alignments-wspecifier>] ]\n";
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = false;
+    LatticeFasterDecoderConfig config;
+    NnetSimpleComputationOptions decodable_opts;
+    fst::HclLmComposeFstOptions compose_opts;
+
+    std::string word_syms_filename, word_disambig_rxfilename;
+    std::string ivector_rspecifier,
+        online_ivector_rspecifier,
+        utt2spk_rspecifier;
+    int32 online_ivector_period = 0;
+    config.Register(&po);
+    decodable_opts.Register(&po);
+    compose_opts.Register(&po);
+    po.Register("word-symbol-table", &word_syms_filename,
+                "Symbol table for words [for debug output]");
+    po.Register("word-disambig-syms", &word_disambig_rxfilename,
+                "File containing the list of word-level disambiguation "
+                "symbols on the output side of HCL.fst (e.g. "
+                "data/lang/phones/wdisambig_words.int); they are treated as "
+                "epsilons, not as words of the language model.");
+    po.Register("allow-partial", &allow_partial,
+                "If true, produce output even if end state was not reached.");
+    po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
+                "iVectors as vectors (i.e. not estimated online); per utterance "
+                "by default, or per speaker if you provide the --utt2spk option.");
+    po.Register("utt2spk", &utt2spk_rspecifier, "Rspecifier for "
+                "utt2spk option used to get ivectors per speaker");
+    po.Register("online-ivectors", &online_ivector_rspecifier, "Rspecifier for "
+                "iVectors estimated online, as matrices.  If you supply this,"
+                " you must set the --online-ivector-period option.");
+    po.Register("online-ivector-period", &online_ivector_period, "Number of frames "
+                "between iVectors in matrices supplied to the --online-ivectors "
+                "option");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 6 || po.NumArgs() > 8) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        hcl_in_str = po.GetArg(2),
+        lm_rxfilename = po.GetArg(3),
+        disambig_rxfilename = po.GetArg(4),
+        feature_rspecifier = po.GetArg(5),
+        lattice_wspecifier = po.GetArg(6),
+        words_wspecifier = po.GetOptArg(7),
+        alignment_wspecifier = po.GetOptArg(8);
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(model_in_filename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    RandomAccessBaseFloatMatrixReader online_ivector_reader(
+        online_ivector_rspecifier);
+    RandomAccessBaseFloatVectorReaderMapped ivector_reader(
+        ivector_rspecifier, utt2spk_rspecifier);
+
+    Int32VectorWriter words_writer(words_wspecifier);
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    std::vector<int32> disambig_in;
+    if (!ReadIntegerVectorSimple(disambig_rxfilename, &disambig_in))
+      KALDI_ERR << "Could not read disambiguation symbols from "
+                << (disambig_rxfilename == "" ? "standard input" : disambig_rxfilename);
+
+    std::vector<int32> word_disambig;
+    if (word_disambig_rxfilename != "" &&
+        !ReadIntegerVectorSimple(word_disambig_rxfilename, &word_disambig))
+      KALDI_ERR << "Could not read word disambiguation symbols from "
+                << word_disambig_rxfilename;
+
+    if (ClassifyRspecifier(hcl_in_str, NULL, NULL) != kNoRspecifier)
+      KALDI_ERR << "Per-utterance FSTs are not supported by this program.";
+
+    fst::ConstFst<StdArc> *hcl_fst = NULL;
+    {
+      fst::Fst<StdArc> *fst = fst::ReadFstKaldiGeneric(hcl_in_str);
+      if (fst->Type() == "const") {
+        hcl_fst = static_cast<fst::ConstFst<StdArc>*>(fst);
+      } else {
+        hcl_fst = new fst::ConstFst<StdArc>(*fst);
+        delete fst;
+      }
+    }
+
+    ConstArpaLm const_arpa;
+    ReadKaldiObject(lm_rxfilename, &const_arpa);
+    ConstArpaLmDeterministicFst lm_fst(const_arpa);
+
+    // The unigram costs of the words on the output side of HCL.fst, for the
+    // LM lookahead.
+    std::vector<float> word_costs;
+    for (fst::StateIterator<fst::ConstFst<StdArc> > siter(*hcl_fst);
+         !siter.Done(); siter.Next()) {
+      for (fst::ArcIterator<fst::ConstFst<StdArc> > aiter(*hcl_fst,
+                                                          siter.Value());
+           !aiter.Done(); aiter.Next()) {
+        int32 word = aiter.Value().olabel;
+        if (word >= static_cast<int32>(word_costs.size()))
+          word_costs.resize(word + 1, 0.0);
+      }
+    }
+    std::vector<int32> empty_hist;
+    for (size_t w = 1; w < word_costs.size(); w++) {
+      if (std::find(word_disambig.begin(), word_disambig.end(),
+                    static_cast<int32>(w)) != word_disambig.end())
+        continue;  // Not a word; HclLmComposeFst treats it as epsilon.
+      float logprob = const_arpa.GetNgramLogprob(w, empty_hist);
+      word_costs[w] = (logprob == std::numeric_limits<float>::min() ?
+                       std::numeric_limits<float>::infinity() : -logprob);
+    }
+    fst::HclLmComposeFst decode_fst(compose_opts, *hcl_fst, &lm_fst,
+                                    disambig_in, word_disambig, word_costs);
+    KALDI_LOG << "Peak memory after loading the graph and LM is "
+              << PeakMemoryMb() << " MB.";
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int num_success = 0, num_fail = 0;
+    // this compiler object allows caching of computations across
+    // different utterances.
+    CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
+                                       decodable_opts.optimize_config);
+
+    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    timer.Reset();
+
+    {
+      LatticeFasterDecoderTpl<fst::HclLmComposeFst> decoder(decode_fst,
+                                                            config);
+
+      for (; !feature_reader.Done(); feature_reader.Next()) {
+        std::string utt = feature_reader.Key();
+        const Matrix<BaseFloat> &features (feature_reader.Value());
+        if (features.NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          num_fail++;
+          continue;
+        }
+        const Matrix<BaseFloat> *online_ivectors = NULL;
+        const Vector<BaseFloat> *ivector = NULL;
+        if (!ivector_rspecifier.empty()) {
+          if (!ivector_reader.HasKey(utt)) {
+            KALDI_WARN << "No iVector available for utterance " << utt;
+            num_fail++;
+            continue;
+          } else {
+            ivector = &ivector_reader.Value(utt);
+          }
+        }
+        if (!online_ivector_rspecifier.empty()) {
+          if (!online_ivector_reader.HasKey(utt)) {
+            KALDI_WARN << "No online iVector available for utterance " << utt;
+            num_fail++;
+            continue;
+          } else {
+            online_ivectors = &online_ivector_reader.Value(utt);
+          }
+        }
+
+        DecodableAmNnetSimple nnet_decodable(
+            decodable_opts, trans_model, am_nnet,
+            features, ivector, online_ivectors,
+            online_ivector_period, &compiler);
+
+        double like;
+        if (DecodeUtteranceLatticeFaster(
+                decoder, nnet_decodable, trans_model, word_syms, utt,
+                decodable_opts.acoustic_scale, determinize, allow_partial,
+                &alignment_writer, &words_writer, &compact_lattice_writer,
+                &lattice_writer,
+                &like)) {
+          tot_like += like;
+          frame_count += nnet_decodable.NumFramesReady();
+          num_success++;
+        } else num_fail++;
+      }
+    }
+
+    kaldi::int64 input_frame_count =
+        frame_count * decodable_opts.frame_subsampling_factor;
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor assuming 100 frames/sec is "
+              << (elapsed * 100.0 / input_frame_count);
+    decode_fst.PrintStats();
+    KALDI_LOG << "Peak memory was " << PeakMemoryMb() << " MB.";
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is "
+              << (tot_like / frame_count) << " over "
+              << frame_count << " frames.";
+
+    delete word_syms;
+    delete hcl_fst;  // delete this only after decode_fst is no longer used.
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
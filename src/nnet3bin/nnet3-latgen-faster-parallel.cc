@@ -22,6 +22,7 @@
 #include "base/timer.h"
 #include "base/kaldi-common.h"
 #include "decoder/decoder-wrappers.h"
+#include "decoder/decoding-result-cache.h"
 #include "fstext/fstext-lib.h"
 #include "hmm/transition-model.h"
 #include "nnet3/nnet-am-decodable-simple.h"
@@ -56,6 +57,7 @@ int main(int argc, char *argv[]) {
     bool allow_partial = false;
     TaskSequencerConfig sequencer_config; // has --num-threads option
     LatticeFasterDecoderConfig config;
+    DecodingResultCacheOptions cache_opts;
     NnetSimpleComputationOptions decodable_opts;
 
     std::string word_syms_filename;
@@ -66,6 +68,7 @@ int main(int argc, char *argv[]) {
     sequencer_config.Register(&po);
     config.Register(&po);
     decodable_opts.Register(&po);
+    cache_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
@@ -138,6 +141,11 @@ int main(int argc, char *argv[]) {
 
       // Input FST is just one FST, not a table of FSTs.
       Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+
+      DecodingResultCache cache(
+          cache_opts, GetDecodingResultCacheIdentity(
+              cache_opts, &po, trans_model, am_nnet, *decode_fst,
+              std::vector<std::string>()));
       timer.Reset();
 
       {
@@ -170,6 +178,21 @@ int main(int argc, char *argv[]) {
             }
           }
 
+          DecodingResultKey cache_key;
+          if (cache.Enabled()) {
+            cache_key = cache.Key(features, ivector, online_ivectors);
+            DecodingResult result;
+            if (cache.Lookup(cache_key, &result)) {
+              // Output the result via the sequencer so that the order of the
+              // output is preserved.
+              sequencer.Run(new DecodeUtteranceLatticeFasterClass(
+                  result, word_syms, utt, &alignment_writer, &words_writer,
+                  &compact_lattice_writer, &lattice_writer,
+                  &tot_like, &frame_count, &num_success));
+              continue;
+            }
+          }
+
           LatticeFasterDecoder *decoder =
               new LatticeFasterDecoder(*decode_fst, config);
 
@@ -185,13 +208,16 @@ int main(int argc, char *argv[]) {
                   trans_model, word_syms, utt, decodable_opts.acoustic_scale,
                   determinize, allow_partial, &alignment_writer, &words_writer,
                    &compact_lattice_writer, &lattice_writer,
-                   &tot_like, &frame_count, &num_success, &num_fail, NULL);
+                   &tot_like, &frame_count, &num_success, &num_fail, NULL,
+                   (cache.Enabled() ? &cache : NULL), cache_key);
 
           sequencer.Run(task); // takes ownership of "task",
                                // and will delete it when done.
         }
       }
       sequencer.Wait(); // Waits for all tasks to be done.
+      cache.PrintStats();
+      cache.Save();
       delete decode_fst;
     } else { // We have different FSTs for different utterances.
       SequentialTableReader<fst::VectorFstHolder> fst_reader(fst_in_str);
@@ -25,6 +25,7 @@
 #include "hmm/transition-model.h"
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
+#include "decoder/decoding-result-cache.h"
 #include "nnet3/nnet-am-decodable-simple.h"
 #include "nnet3/nnet-utils.h"
 #include "base/timer.h"
@@ -46,12 +47,16 @@ int main(int argc, char *argv[]) {
         "Generate lattices using nnet3 neural net model.\n"
         "Usage: nnet3-latgen-faster [options] <nnet-in> <fst-in|fsts-rspecifier> <features-rspecifier>"
         " <lattice-wspecifier> [ <words-wspecifier> [<alignments-wspecifier>] ]\n"
-        "See also: nnet3-latgen-faster-parallel, nnet3-latgen-faster-batch\n";
+        "See also: nnet3-latgen-faster-parallel, nnet3-latgen-faster-batch\n"
+        "With --result-cache-mb > 0, utterances with the same features (and\n"
+        "iVectors) as an earlier one are not decoded again; this is only\n"
+        "supported if <fst-in> is a single FST.\n";
     ParseOptions po(usage);
     Timer timer;
     bool allow_partial = false;
     LatticeFasterDecoderConfig config;
     NnetSimpleComputationOptions decodable_opts;
+    DecodingResultCacheOptions cache_opts;
 
     std::string word_syms_filename;
     std::string ivector_rspecifier,
@@ -60,6 +65,7 @@ int main(int argc, char *argv[]) {
     int32 online_ivector_period = 0;
     config.Register(&po);
     decodable_opts.Register(&po);
+    cache_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
@@ -137,6 +143,11 @@ int main(int argc, char *argv[]) {
 
       // Input FST is just one FST, not a table of FSTs.
       Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+
+      DecodingResultCache cache(
+          cache_opts, GetDecodingResultCacheIdentity(
+              cache_opts, &po, trans_model, am_nnet, *decode_fst,
+              std::vector<std::string>()));
       timer.Reset();
 
       {
@@ -171,6 +182,21 @@ int main(int argc, char *argv[]) {
             }
           }
 
+          DecodingResultKey cache_key;
+          DecodingResult result;
+          if (cache.Enabled()) {
+            cache_key = cache.Key(features, ivector, online_ivectors);
+            if (cache.Lookup(cache_key, &result)) {
+              OutputDecodingResult(utt, result, word_syms, &alignment_writer,
+                                   &words_writer, &compact_lattice_writer,
+                                   &lattice_writer);
+              tot_like += result.likelihood;
+              frame_count += result.alignment.size();
+              num_success++;
+              continue;
+            }
+          }
+
           DecodableAmNnetSimple nnet_decodable(
               decodable_opts, trans_model, am_nnet,
               features, ivector, online_ivectors,
@@ -182,13 +208,17 @@ int main(int argc, char *argv[]) {
                   decodable_opts.acoustic_scale, determinize, allow_partial,
                   &alignment_writer, &words_writer, &compact_lattice_writer,
                   &lattice_writer,
-                  &like)) {
+                  &like, (cache.Enabled() ? &result : NULL))) {
             tot_like += like;
             frame_count += nnet_decodable.NumFramesReady();
             num_success++;
+            if (cache.Enabled())
+              cache.Insert(cache_key, result);
           } else num_fail++;
         }
       }
+      cache.PrintStats();
+      cache.Save();
       delete decode_fst; // delete this only after decoder goes out of scope.
     } else { // We have different FSTs for different utterances.
       SequentialTableReader<fst::VectorFstHolder> fst_reader(fst_in_str);
@@ -60,6 +60,7 @@ int main(int argc, char *argv[]) {
         online_ivector_rspecifier,
         utt2spk_rspecifier;
     int32 online_ivector_period = 0;
+    BaseFloat grammar_precompute_mb = 0.0;
     config.Register(&po);
     decodable_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
@@ -77,6 +78,11 @@ int main(int argc, char *argv[]) {
     po.Register("online-ivector-period", &online_ivector_period, "Number of frames "
                 "between iVectors in matrices supplied to the --online-ivectors "
                 "option");
+    po.Register("grammar-precompute-mb", &grammar_precompute_mb,
+                "If >0, precompute the expanded states of the GrammarFst in "
+                "contiguous arrays at startup, using up to this many MB of "
+                "memory; this avoids hash lookups during decoding, which "
+                "helps speed with grammars that have many sub-FSTs.");
 
     po.Read(argc, argv);
 
@@ -138,6 +144,9 @@ int main(int argc, char *argv[]) {
 
     fst::GrammarFst fst;
     ReadKaldiObject(grammar_fst_rxfilename, &fst);
+    if (grammar_precompute_mb > 0.0)
+      fst.PrecomputeExpandedStates(
+          static_cast<size_t>(grammar_precompute_mb * 1048576));
     timer.Reset();
 
     {
@@ -20,6 +20,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-training.h"
+#include "nnet3/nnet-example-loader.h"
 #include "cudamatrix/cu-allocator.h"
 
 int main(int argc, char *argv[]) {
@@ -32,19 +33,29 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Train nnet3 neural network parameters with backprop and stochastic\n"
         "gradient descent.  Minibatches are to be created by nnet3-merge-egs in\n"
-        "the input pipeline.  This training program is single-threaded (best to\n"
+        "the input pipeline, or by this program if --merge=true.  The examples\n"
+        "are read, merged and decompressed in background threads (see\n"
+        "--loader-threads).  The training itself is single-threaded (best to\n"
         "use it with a GPU); see nnet3-train-parallel for multi-threaded training\n"
-        "that is better suited to CPUs.\n"
+        "that is better suited to CPUs.  Several copies of this program, e.g.\n"
+        "on several machines, can train one model together, averaging their\n"
+        "parameter changes after each minibatch (see the --allreduce.* options).\n"
         "\n"
         "Usage:  nnet3-train [options] <raw-model-in> <training-examples-in> <raw-model-out>\n"
         "\n"
         "e.g.:\n"
-        "nnet3-train 1.raw 'ark:nnet3-merge-egs 1.egs ark:-|' 2.raw\n";
+        "nnet3-train 1.raw 'ark:nnet3-merge-egs 1.egs ark:-|' 2.raw\n"
+        "or:\n"
+        "nnet3-train --merge=true --merge.minibatch-size=128 1.raw ark:1.egs 2.raw\n"
+        "or, for one of 4 workers on the same machine:\n"
+        "nnet3-train --allreduce.num-workers=4 --allreduce.rank=1 \\\n"
+        "   --allreduce.shm-prefix=/dev/shm/exp-iter1 1.raw ark:1.2.egs 2.1.raw\n";
 
     int32 srand_seed = 0;
     bool binary_write = true;
     std::string use_gpu = "yes";
     NnetTrainerOptions train_config;
+    ExampleLoaderOptions loader_config;
 
     ParseOptions po(usage);
     po.Register("srand", &srand_seed, "Seed for random number generator ");
@@ -53,6 +64,7 @@ int main(int argc, char *argv[]) {
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
 
     train_config.Register(&po);
+    loader_config.Register(&po);
     RegisterCuAllocatorOptions(&po);
 
     po.Read(argc, argv);
@@ -77,11 +89,12 @@ int main(int argc, char *argv[]) {
 
     NnetTrainer trainer(train_config, &nnet);
 
-    SequentialNnetExampleReader example_reader(examples_rspecifier);
+    NnetExampleLoader example_loader(loader_config, examples_rspecifier);
 
-    for (; !example_reader.Done(); example_reader.Next())
-      trainer.Train(example_reader.Value());
+    for (; !example_loader.Done(); example_loader.Next())
+      trainer.Train(example_loader.Value());
 
+    example_loader.PrintStats();
     bool ok = trainer.PrintTotalStats();
 
 #if HAVE_CUDA==1
@@ -0,0 +1,140 @@
+// online2/batched-threaded-nnet3-cpu-pipeline-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "online2/batched-threaded-nnet3-cpu-pipeline.h"
+#include "fstext/fstext-lib.h"
+#include "hmm/hmm-test-utils.h"
+#include "lat/kaldi-lattice.h"
+
+namespace kaldi {
+
+// Creates a decoding graph with a single state that allows any sequence of
+// transition-ids, with a few different words on the arcs.
+static void CreateLoopGraph(const TransitionModel &trans_model,
+                            fst::StdVectorFst *fst) {
+  fst->DeleteStates();
+  int32 s = fst->AddState();
+  fst->SetStart(s);
+  fst->SetFinal(s, fst::TropicalWeight::One());
+  for (int32 tid = 1; tid <= trans_model.NumTransitionIds(); tid++)
+    fst->AddArc(s, fst::StdArc(tid, 1 + tid % 5, RandUniform(), s));
+}
+
+// Creates a simple acoustic model for the pdfs of 'trans_model', whose input
+// is 13-dimensional MFCCs.
+static void CreateAmNnet(const TransitionModel &trans_model,
+                         nnet3::AmNnetSimple *am_nnet) {
+  std::ostringstream config;
+  config << "input-node name=input dim=13\n"
+         << "component name=affine type=NaturalGradientAffineComponent "
+         << "input-dim=39 output-dim=" << trans_model.NumPdfs() << "\n"
+         << "component name=logsoftmax type=LogSoftmaxComponent dim="
+         << trans_model.NumPdfs() << "\n"
+         << "component-node name=affine component=affine "
+         << "input=Append(Offset(input, -1), input, Offset(input, 1))\n"
+         << "component-node name=logsoftmax component=logsoftmax "
+         << "input=affine\n"
+         << "output-node name=output input=logsoftmax\n";
+  nnet3::Nnet nnet;
+  std::istringstream is(config.str());
+  nnet.ReadConfig(is);
+  *am_nnet = nnet3::AmNnetSimple(nnet);
+}
+
+// Decodes 'waves' and returns the lattices from GetLattice().
+static void DecodeWaves(const BatchedThreadedNnet3CpuPipelineConfig &config,
+                        const fst::StdVectorFst &fst,
+                        const nnet3::AmNnetSimple &am_nnet,
+                        const TransitionModel &trans_model,
+                        const std::vector<WaveData> &waves,
+                        std::vector<CompactLattice> *clats) {
+  BatchedThreadedNnet3CpuPipeline pipeline(config);
+  pipeline.Initialize(fst, am_nnet, trans_model);
+  for (size_t i = 0; i < waves.size(); i++) {
+    std::ostringstream key;
+    key << "utt" << i;
+    pipeline.OpenDecodeHandle(key.str(), waves[i]);
+  }
+  clats->resize(waves.size());
+  for (size_t i = 0; i < waves.size(); i++) {
+    std::ostringstream key;
+    key << "utt" << i;
+    if (!config.determinize_lattice) {
+      Lattice lat;
+      bool ans = pipeline.GetRawLattice(key.str(), &lat);
+      KALDI_ASSERT(ans && lat.NumStates() > 0);
+    }
+    bool ans = pipeline.GetLattice(key.str(), &((*clats)[i]));
+    KALDI_ASSERT(ans);
+    pipeline.CloseDecodeHandle(key.str());
+  }
+  pipeline.Finalize();
+}
+
+// Checks that GetLattice() gives the same lattices whether the workers
+// determinize them (--determinize-lattice=true) or GetLattice() does.
+void UnitTestGetLatticeDeterminize() {
+  ContextDependency *ctx_dep = NULL;
+  TransitionModel *trans_model = GenRandTransitionModel(&ctx_dep);
+  fst::StdVectorFst fst;
+  CreateLoopGraph(*trans_model, &fst);
+  nnet3::AmNnetSimple am_nnet;
+  CreateAmNnet(*trans_model, &am_nnet);
+
+  std::vector<WaveData> waves;
+  for (int32 i = 0; i < 3; i++) {
+    Matrix<BaseFloat> samples(1, RandInt(8000, 24000));
+    samples.SetRandn();
+    samples.Scale(1000.0);
+    waves.push_back(WaveData(16000.0, samples));
+  }
+
+  BatchedThreadedNnet3CpuPipelineConfig config;
+  config.num_worker_threads = 2;
+  config.feature_opts.mfcc_config = "";
+  // A small lattice beam, so that the lattices depend on the acoustic scale
+  // at which they are pruned.
+  config.decoder_opts.lattice_beam = 2.0;
+  config.compute_opts.acoustic_scale = 0.1;
+  config.compute_opts.frames_per_chunk = 20;
+
+  std::vector<CompactLattice> clats1, clats2;
+  config.determinize_lattice = true;
+  DecodeWaves(config, fst, am_nnet, *trans_model, waves, &clats1);
+  config.determinize_lattice = false;
+  DecodeWaves(config, fst, am_nnet, *trans_model, waves, &clats2);
+
+  for (size_t i = 0; i < waves.size(); i++) {
+    KALDI_ASSERT(clats1[i].NumStates() > 0);
+    KALDI_ASSERT(clats1[i].NumStates() == clats2[i].NumStates());
+    KALDI_ASSERT(fst::RandEquivalent(clats1[i], clats2[i], 5 /*paths*/,
+                                     0.01 /*delta*/, Rand() /*seed*/,
+                                     100 /*path length, max*/));
+  }
+  delete trans_model;
+  delete ctx_dep;
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 3; i++)
+    UnitTestGetLatticeDeterminize();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
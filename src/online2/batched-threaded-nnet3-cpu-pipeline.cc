@@ -0,0 +1,466 @@
+// online2/batched-threaded-nnet3-cpu-pipeline.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "online2/batched-threaded-nnet3-cpu-pipeline.h"
+#include "decoder/decodable-matrix.h"
+#include "lat/lattice-functions.h"
+
+namespace kaldi {
+
+BatchedThreadedNnet3CpuPipeline::BatchedThreadedNnet3CpuPipeline(
+    const BatchedThreadedNnet3CpuPipelineConfig &config):
+    config_(config), decode_fst_(NULL), trans_model_(NULL),
+    feature_info_(NULL), computer_(NULL), exit_(false),
+    priority_offset_(0.0), all_group_tasks_not_done_(0) {
+  KALDI_ASSERT(config_.num_worker_threads > 0 &&
+               config_.num_compute_threads > 0 &&
+               config_.max_pending_tasks > 0);
+}
+
+void BatchedThreadedNnet3CpuPipeline::Initialize(
+    const fst::Fst<fst::StdArc> &decode_fst,
+    const nnet3::AmNnetSimple &am_nnet,
+    const TransitionModel &trans_model) {
+  KALDI_LOG << "BatchedThreadedNnet3CpuPipeline Initialize with "
+            << config_.num_worker_threads << " worker threads and "
+            << config_.num_compute_threads << " compute threads, minibatch "
+            << "size " << config_.compute_opts.minibatch_size;
+  decode_fst_ = &decode_fst;
+  trans_model_ = &trans_model;
+  feature_info_ = new OnlineNnet2FeaturePipelineInfo(config_.feature_opts);
+  // Like the CUDA pipeline, we use one i-vector for the whole file, estimated
+  // from all of it.
+  feature_info_->ivector_extractor_info.use_most_recent_ivector = true;
+  feature_info_->ivector_extractor_info.greedy_ivector_extractor = true;
+  computer_ = new nnet3::NnetBatchComputer(config_.compute_opts,
+                                           am_nnet.GetNnet(),
+                                           am_nnet.Priors());
+  exit_ = false;
+  for (int32 i = 0; i < config_.num_compute_threads; i++)
+    compute_threads_.push_back(
+        std::thread(&BatchedThreadedNnet3CpuPipeline::ExecuteCompute, this));
+  for (int32 i = 0; i < config_.num_worker_threads; i++)
+    worker_threads_.push_back(
+        std::thread(&BatchedThreadedNnet3CpuPipeline::ExecuteWorker, this));
+}
+
+void BatchedThreadedNnet3CpuPipeline::Finalize() {
+  WaitForAllTasks();
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    exit_ = true;
+  }
+  pending_not_empty_cv_.notify_all();
+  for (size_t i = 0; i < worker_threads_.size(); i++)
+    worker_threads_[i].join();
+  worker_threads_.clear();
+  for (size_t i = 0; i < compute_threads_.size(); i++)
+    tasks_ready_semaphore_.Signal();
+  for (size_t i = 0; i < compute_threads_.size(); i++)
+    compute_threads_[i].join();
+  compute_threads_.clear();
+
+  delete computer_;
+  computer_ = NULL;
+  delete feature_info_;
+  feature_info_ = NULL;
+}
+
+BatchedThreadedNnet3CpuPipeline::~BatchedThreadedNnet3CpuPipeline() {
+  if (!worker_threads_.empty())
+    Finalize();
+}
+
+bool BatchedThreadedNnet3CpuPipeline::isFinished(const std::string &key) {
+  std::lock_guard<std::mutex> lock(tasks_lookup_mutex_);
+  auto it = tasks_lookup_.find(key);
+  KALDI_ASSERT(it != tasks_lookup_.end());
+  return it->second.finished;
+}
+
+BatchedThreadedNnet3CpuPipeline::TaskState*
+BatchedThreadedNnet3CpuPipeline::WaitForTask(const std::string &key) {
+  TaskState *task;
+  {
+    std::lock_guard<std::mutex> lock(tasks_lookup_mutex_);
+    auto it = tasks_lookup_.find(key);
+    KALDI_ASSERT(it != tasks_lookup_.end());
+    task = &it->second;
+  }
+  std::unique_lock<std::mutex> lk(group_tasks_mutex_);
+  group_done_cv_.wait(lk, [task] { return task->finished == true; });
+  return task;
+}
+
+void BatchedThreadedNnet3CpuPipeline::CloseDecodeHandle(
+    const std::string &key) {
+  TaskState *task = WaitForTask(key);
+  {
+    // Delete the group counter if necessary
+    std::lock_guard<std::mutex> lk(group_tasks_mutex_);
+    if (group_tasks_not_done_[task->group] == 0)
+      group_tasks_not_done_.erase(task->group);
+  }
+  std::lock_guard<std::mutex> lock(tasks_lookup_mutex_);
+  auto p = tasks_group_lookup_.equal_range(task->group);
+  bool found = false;
+  for (auto it = p.first; it != p.second; ++it) {
+    if (it->second == task) {
+      tasks_group_lookup_.erase(it);
+      found = true;
+      break;
+    }
+  }
+  KALDI_ASSERT(found);
+  tasks_lookup_.erase(key);
+}
+
+void BatchedThreadedNnet3CpuPipeline::WaitForAllTasks() {
+  std::unique_lock<std::mutex> lk(group_tasks_mutex_);
+  group_done_cv_.wait(lk, [this] { return all_group_tasks_not_done_ == 0; });
+}
+
+void BatchedThreadedNnet3CpuPipeline::WaitForGroup(const std::string &group) {
+  std::unique_lock<std::mutex> lk(group_tasks_mutex_);
+  group_done_cv_.wait(
+      lk, [this, &group] { return group_tasks_not_done_[group] == 0; });
+  // Safe to delete entry from the map now. If the user creates new task in
+  // that group, the entry will be created once more
+  group_tasks_not_done_.erase(group);
+}
+
+bool BatchedThreadedNnet3CpuPipeline::IsGroupCompleted(
+    const std::string &group) {
+  std::lock_guard<std::mutex> lk(group_tasks_mutex_);
+  return (group_tasks_not_done_[group] == 0);
+}
+
+std::string BatchedThreadedNnet3CpuPipeline::WaitForAnyGroup() {
+  std::unique_lock<std::mutex> lk(group_tasks_mutex_);
+  std::string group_done;
+  auto predicate = [this, &group_done] {
+    for (auto &it : group_tasks_not_done_) {
+      if (it.second == 0) {
+        group_done = it.first;
+        return true;
+      }
+    }
+    return false;
+  };
+  group_done_cv_.wait(lk, predicate);
+  return group_done;
+}
+
+bool BatchedThreadedNnet3CpuPipeline::IsAnyGroupCompleted(std::string *group) {
+  std::lock_guard<std::mutex> lk(group_tasks_mutex_);
+  for (auto &it : group_tasks_not_done_) {
+    if (it.second == 0) {
+      *group = it.first;
+      return true;
+    }
+  }
+  return false;
+}
+
+void BatchedThreadedNnet3CpuPipeline::CloseAllDecodeHandlesForGroup(
+    const std::string &group) {
+  WaitForGroup(group);
+  std::lock_guard<std::mutex> lk1(tasks_lookup_mutex_);
+  auto p = tasks_group_lookup_.equal_range(group);
+  for (auto it = p.first; it != p.second; ++it) {
+    KALDI_ASSERT(it->second->finished == true);
+    tasks_lookup_.erase(it->second->key);
+  }
+  tasks_group_lookup_.erase(p.first, p.second);
+  std::lock_guard<std::mutex> lk2(group_tasks_mutex_);
+  group_tasks_not_done_.erase(group);
+}
+
+void BatchedThreadedNnet3CpuPipeline::CloseAllDecodeHandles() {
+  WaitForAllTasks();
+  std::lock_guard<std::mutex> lk1(tasks_lookup_mutex_);
+  tasks_lookup_.clear();
+  tasks_group_lookup_.clear();
+  std::lock_guard<std::mutex> lk2(group_tasks_mutex_);
+  group_tasks_not_done_.clear();
+}
+
+int32 BatchedThreadedNnet3CpuPipeline::GetNumberOfTasksPending() {
+  std::lock_guard<std::mutex> lk(group_tasks_mutex_);
+  return all_group_tasks_not_done_;
+}
+
+BatchedThreadedNnet3CpuPipeline::TaskState*
+BatchedThreadedNnet3CpuPipeline::AddTask(const std::string &key,
+                                         const std::string &group) {
+  TaskState *task;
+  {
+    std::lock_guard<std::mutex> lock(tasks_lookup_mutex_);
+    // ensure key is unique
+    KALDI_ASSERT(tasks_lookup_.end() == tasks_lookup_.find(key));
+    task = &tasks_lookup_[key];
+    tasks_group_lookup_.insert({group, task});
+  }
+  task->key = key;
+  task->group = group;
+  {
+    std::lock_guard<std::mutex> lk(group_tasks_mutex_);
+    ++all_group_tasks_not_done_;
+    ++group_tasks_not_done_[group];
+  }
+  return task;
+}
+
+void BatchedThreadedNnet3CpuPipeline::OpenDecodeHandle(
+    const std::string &key, const WaveData &wave_data,
+    const std::string &group,
+    const std::function<void(CompactLattice &clat)> &callback) {
+  KALDI_ASSERT(computer_ != NULL && "You must call Initialize() first.");
+  TaskState *task = AddTask(key, group);
+  task->callback = callback;
+  // We only decode the first channel, as the CUDA pipeline does.
+  task->raw_data.Resize(wave_data.Data().NumCols(), kUndefined);
+  task->raw_data.CopyRowFromMat(wave_data.Data(), 0);
+  task->wave_samples.reset(new SubVector<BaseFloat>(task->raw_data, 0,
+                                                    task->raw_data.Dim()));
+  task->sample_frequency = wave_data.SampFreq();
+  AddTaskToPendingTaskQueue(task);
+}
+
+void BatchedThreadedNnet3CpuPipeline::OpenDecodeHandle(
+    const std::string &key, const VectorBase<BaseFloat> &wave_data,
+    BaseFloat sample_rate, const std::string &group,
+    const std::function<void(CompactLattice &clat)> &callback) {
+  KALDI_ASSERT(computer_ != NULL && "You must call Initialize() first.");
+  TaskState *task = AddTask(key, group);
+  task->callback = callback;
+  task->wave_samples.reset(new SubVector<BaseFloat>(wave_data, 0,
+                                                    wave_data.Dim()));
+  task->sample_frequency = sample_rate;
+  AddTaskToPendingTaskQueue(task);
+}
+
+void BatchedThreadedNnet3CpuPipeline::AddTaskToPendingTaskQueue(
+    TaskState *task) {
+  std::unique_lock<std::mutex> lock(pending_mutex_);
+  pending_not_full_cv_.wait(lock, [this] {
+      return pending_task_queue_.size() <
+          static_cast<size_t>(config_.max_pending_tasks); });
+  pending_task_queue_.push_back(task);
+  pending_not_empty_cv_.notify_one();
+}
+
+bool BatchedThreadedNnet3CpuPipeline::GetRawLattice(const std::string &key,
+                                                    Lattice *lat) {
+  TaskState *task = WaitForTask(key);
+  // GetRawLattice on a determinized lattice is not supported.
+  KALDI_ASSERT(task->determinized == false);
+  if (task->error)
+    return false;
+  *lat = task->lat;
+  return true;
+}
+
+bool BatchedThreadedNnet3CpuPipeline::GetLattice(const std::string &key,
+                                                 CompactLattice *clat) {
+  TaskState *task = WaitForTask(key);
+  if (task->error)
+    return false;
+  // if the user has not requested a determinized lattice from the workers
+  // then we must determinize it here.
+  if (!task->determinized)
+    DeterminizeOneLattice(task);
+  *clat = task->dlat;
+  return true;
+}
+
+bool BatchedThreadedNnet3CpuPipeline::ComputeFeatures(
+    TaskState *task, Matrix<BaseFloat> *input_features,
+    Vector<BaseFloat> *ivector) {
+  OnlineNnet2FeaturePipeline feature(*feature_info_);
+  feature.AcceptWaveform(task->sample_frequency, *(task->wave_samples));
+  feature.InputFinished();
+  int32 num_frames = feature.NumFramesReady();
+  if (num_frames == 0)
+    return false;
+  std::vector<int32> frames(num_frames);
+  for (int32 t = 0; t < num_frames; t++)
+    frames[t] = t;
+  input_features->Resize(num_frames, feature.InputFeature()->Dim(),
+                         kUndefined);
+  feature.InputFeature()->GetFrames(frames, input_features);
+  // Ivectors are optional, if they were not provided skip this step
+  if (feature.IvectorFeature() != NULL) {
+    ivector->Resize(feature.IvectorFeature()->Dim(), kUndefined);
+    feature.IvectorFeature()->GetFrame(num_frames - 1, ivector);
+  }
+  return true;
+}
+
+void BatchedThreadedNnet3CpuPipeline::SetPriorities(
+    std::vector<nnet3::NnetInferenceTask> *tasks) {
+  size_t num_tasks = tasks->size();
+  double priority_offset = priority_offset_;
+  for (size_t i = 0; i < num_tasks; i++)
+    (*tasks)[i].priority = priority_offset - (double)i;
+}
+
+void BatchedThreadedNnet3CpuPipeline::UpdatePriorityOffset(double priority) {
+  double new_weight = 1.0 / config_.num_worker_threads,
+      old_weight = 1.0 - new_weight;
+  // The next line is vulnerable to a race condition but if it happened it
+  // wouldn't matter.
+  priority_offset_ = priority_offset_ * old_weight + priority * new_weight;
+}
+
+void BatchedThreadedNnet3CpuPipeline::DecodeOneTask(
+    LatticeFasterDecoder *decoder, TaskState *task) {
+  Matrix<BaseFloat> input_features;
+  Vector<BaseFloat> ivector;
+  if (!ComputeFeatures(task, &input_features, &ivector)) {
+    KALDI_WARN << "No features for file " << task->key;
+    task->error = true;
+    return;
+  }
+  task->wave_samples.reset();
+  task->raw_data.Resize(0);
+
+  std::vector<nnet3::NnetInferenceTask> tasks;
+  bool output_to_cpu = true;
+  computer_->SplitUtteranceIntoTasks(output_to_cpu, input_features,
+                                     (ivector.Dim() > 0 ? &ivector : NULL),
+                                     NULL, 0, &tasks);
+  SetPriorities(&tasks);
+  for (size_t i = 0; i < tasks.size(); i++)
+    computer_->AcceptTask(&(tasks[i]));
+  tasks_ready_semaphore_.Signal();
+
+  // We decode each chunk as soon as it is ready, while the compute threads
+  // work on the later ones.
+  decoder->InitDecoding();
+  int32 frame_offset = 0;
+  size_t i = 0;
+  try {
+    for (; i < tasks.size(); i++) {
+      nnet3::NnetInferenceTask &task = tasks[i];
+      task.semaphore.Wait();
+      UpdatePriorityOffset(task.priority);
+      SubMatrix<BaseFloat> post(task.output_cpu,
+                                task.num_initial_unused_output_frames,
+                                task.num_used_output_frames,
+                                0, task.output_cpu.NumCols());
+      DecodableMatrixMapped decodable(*trans_model_, post, frame_offset);
+      frame_offset += post.NumRows();
+      decoder->AdvanceDecoding(&decodable);
+      task.output_cpu.Resize(0, 0);  // Free some memory.
+    }
+  } catch (...) {
+    // The computer still refers to the remaining chunks, so we must wait for
+    // them before they go out of scope.
+    for (i++; i < tasks.size(); i++)
+      tasks[i].semaphore.Wait();
+    throw;
+  }
+  decoder->FinalizeDecoding();
+
+  bool use_final_probs = true;
+  if (!decoder->ReachedFinal()) {
+    KALDI_WARN << "Outputting partial output for file " << task->key
+               << " since no final-state reached";
+    use_final_probs = false;
+  }
+  decoder->GetRawLattice(&task->lat, use_final_probs);
+
+  // The computer scaled the output by the acoustic scale; like the other
+  // decoders, we output unscaled lattices.
+  BaseFloat acoustic_scale = config_.compute_opts.acoustic_scale;
+  if (acoustic_scale != 0.0)
+    fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
+                      &task->lat);
+  if (config_.determinize_lattice)
+    DeterminizeOneLattice(task);
+}
+
+void BatchedThreadedNnet3CpuPipeline::DeterminizeOneLattice(TaskState *task) {
+  // task->lat is unscaled, but the pruning with lattice_beam must be done at
+  // the acoustic scale that was used in decoding.
+  BaseFloat acoustic_scale = config_.compute_opts.acoustic_scale;
+  if (acoustic_scale != 0.0)
+    fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &task->lat);
+  // Note this destroys the original raw lattice
+  DeterminizeLatticePhonePrunedWrapper(*trans_model_, &task->lat,
+                                       config_.decoder_opts.lattice_beam,
+                                       &(task->dlat),
+                                       config_.decoder_opts.det_opts);
+  if (acoustic_scale != 0.0)
+    fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
+                      &task->dlat);
+  task->determinized = true;
+}
+
+void BatchedThreadedNnet3CpuPipeline::TaskFinished(TaskState *task) {
+  if (!task->error && task->callback) {
+    if (!task->determinized) {
+      // As in the CUDA pipeline, the callback gets the raw lattice converted
+      // to compact form if we were not asked to determinize.
+      ConvertLattice(task->lat, &task->dlat);
+    }
+    task->callback(task->dlat);
+  }
+  std::lock_guard<std::mutex> lk(group_tasks_mutex_);
+  task->finished = true;
+  --all_group_tasks_not_done_;
+  --group_tasks_not_done_[task->group];
+  group_done_cv_.notify_all();
+}
+
+void BatchedThreadedNnet3CpuPipeline::ExecuteWorker() {
+  // Each worker reuses its decoder for all the files it decodes.
+  LatticeFasterDecoder decoder(*decode_fst_, config_.decoder_opts);
+  while (true) {
+    TaskState *task;
+    {
+      std::unique_lock<std::mutex> lock(pending_mutex_);
+      pending_not_empty_cv_.wait(lock, [this] {
+          return exit_ || !pending_task_queue_.empty(); });
+      if (pending_task_queue_.empty())
+        return;  // exit_ is true.
+      task = pending_task_queue_.front();
+      pending_task_queue_.pop_front();
+    }
+    pending_not_full_cv_.notify_one();
+    try {
+      DecodeOneTask(&decoder, task);
+    } catch (const std::exception &e) {
+      KALDI_WARN << "Error decoding file " << task->key << ": " << e.what();
+      task->error = true;
+    }
+    TaskFinished(task);
+  }
+}
+
+void BatchedThreadedNnet3CpuPipeline::ExecuteCompute() {
+  while (true) {
+    tasks_ready_semaphore_.Wait();
+    if (exit_)
+      return;
+    bool allow_partial_minibatch = true;
+    while (computer_->Compute(allow_partial_minibatch));
+  }
+}
+
+}  // namespace kaldi
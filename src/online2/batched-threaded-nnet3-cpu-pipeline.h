@@ -0,0 +1,253 @@
+// online2/batched-threaded-nnet3-cpu-pipeline.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_ONLINE2_BATCHED_THREADED_NNET3_CPU_PIPELINE_H_
+#define KALDI_ONLINE2_BATCHED_THREADED_NNET3_CPU_PIPELINE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "decoder/lattice-faster-decoder.h"
+#include "feat/wave-reader.h"
+#include "hmm/transition-model.h"
+#include "lat/determinize-lattice-pruned.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-batch-compute.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "util/kaldi-semaphore.h"
+
+namespace kaldi {
+
+/// Configuration for class BatchedThreadedNnet3CpuPipeline; the options are
+/// named as in BatchedThreadedNnet3CudaPipelineConfig where they have the same
+/// meaning.
+struct BatchedThreadedNnet3CpuPipelineConfig {
+  int32 num_worker_threads;
+  int32 num_compute_threads;
+  bool determinize_lattice;
+  int32 max_pending_tasks;
+
+  OnlineNnet2FeaturePipelineConfig feature_opts;
+  LatticeFasterDecoderConfig decoder_opts;
+  nnet3::NnetBatchComputerOptions compute_opts;
+
+  BatchedThreadedNnet3CpuPipelineConfig():
+      num_worker_threads(8), num_compute_threads(1),
+      determinize_lattice(true), max_pending_tasks(4000) { }
+
+  void Register(OptionsItf *po) {
+    po->Register("num-worker-threads", &num_worker_threads,
+                 "Number of threads that do feature extraction, decoding "
+                 "and lattice determinization.  Each has its own decoder.");
+    po->Register("num-compute-threads", &num_compute_threads,
+                 "Number of threads that do the (batched) neural net "
+                 "computation.");
+    po->Register("determinize-lattice", &determinize_lattice,
+                 "Determinize the lattice before output.");
+    po->Register("max-outstanding-queue-length", &max_pending_tasks,
+                 "Maximum number of files waiting for a worker thread; "
+                 "OpenDecodeHandle() blocks while the queue is full.");
+    feature_opts.Register(po);
+    decoder_opts.Register(po);
+    compute_opts.Register(po);
+  }
+};
+
+/**
+   BatchedThreadedNnet3CpuPipeline is the CPU counterpart of
+   BatchedThreadedNnet3CudaPipeline (cudadecoder/batched-threaded-nnet3-cuda-pipeline.h)
+   and has the same task API: you give it whole files with OpenDecodeHandle(),
+   and get the lattices back with GetLattice() or in a callback.
+
+   A pool of worker threads each take a file from the queue, extract its
+   features (and iVectors), split it into chunks and give them to a shared
+   NnetBatchComputer, and then decode the chunks' output with their own
+   LatticeFasterDecoder as soon as each chunk has been computed (as
+   NnetBatchDecoder does).  Separate compute threads evaluate the neural net
+   on minibatches of chunks from all the files in flight.  Finally the worker
+   determinizes the lattice and calls the callback.
+*/
+class BatchedThreadedNnet3CpuPipeline {
+ public:
+  BatchedThreadedNnet3CpuPipeline(
+      const BatchedThreadedNnet3CpuPipelineConfig &config);
+
+  // Starts the threads.  The arguments must outlive this object (or at
+  // least the call to Finalize()).  'am_nnet' should have been prepared for
+  // inference (e.g. with SetBatchnormTestMode() and CollapseModel()).
+  void Initialize(const fst::Fst<fst::StdArc> &decode_fst,
+                  const nnet3::AmNnetSimple &am_nnet,
+                  const TransitionModel &trans_model);
+
+  // Waits for all tasks and stops the threads.
+  void Finalize();
+
+  // query a specific key to see if compute on it is complete
+  bool isFinished(const std::string &key);
+
+  // remove an audio file from the decoding and clean up resources
+  void CloseDecodeHandle(const std::string &key);
+  void CloseAllDecodeHandlesForGroup(const std::string &group);
+  void CloseAllDecodeHandles();
+
+  // Adds a decoding task.  The wave data is copied.  'callback', if
+  // provided, is called from a worker thread with the final lattice (see
+  // BatchedThreadedNnet3CudaPipeline::OpenDecodeHandle()); it must be
+  // thread-safe.  This may block if max_pending_tasks files are already
+  // waiting for a worker thread.
+  void OpenDecodeHandle(
+      const std::string &key, const WaveData &wave_data,
+      const std::string &group = std::string(),
+      const std::function<void(CompactLattice &clat)> &callback =
+      std::function<void(CompactLattice &clat)>());
+  // As above, but the data is not copied; the caller must ensure it exists
+  // until CloseDecodeHandle() is called.
+  void OpenDecodeHandle(
+      const std::string &key, const VectorBase<BaseFloat> &wave_data,
+      BaseFloat sample_rate, const std::string &group = std::string(),
+      const std::function<void(CompactLattice &clat)> &callback =
+      std::function<void(CompactLattice &clat)>());
+
+  // Copies the raw lattice for decoded handle "key" into lat; only possible
+  // if --determinize-lattice=false.
+  bool GetRawLattice(const std::string &key, Lattice *lat);
+  // Determinizes raw lattice (if not already done) and returns a compact
+  // lattice
+  bool GetLattice(const std::string &key, CompactLattice *lat);
+
+  int32 GetNumberOfTasksPending();
+
+  // Wait for all tasks to complete
+  void WaitForAllTasks();
+  // Wait for all tasks in the group to complete
+  void WaitForGroup(const std::string &group);
+  // Check if a group is available. Returns if not.
+  bool IsGroupCompleted(const std::string &group);
+  // Wait for any group to complete, then returns which group completed
+  std::string WaitForAnyGroup();
+  // Check if any group is available. If one is available, set its name in
+  // *group
+  bool IsAnyGroupCompleted(std::string *group);
+
+  ~BatchedThreadedNnet3CpuPipeline();
+
+ private:
+  // State needed for each decode task.
+  struct TaskState {
+    std::string key;
+    std::string group;  // group for that task. "" is default
+    bool error;
+
+    Vector<BaseFloat> raw_data;  // Wave input data when a WaveData was
+                                 // passed.
+    std::unique_ptr<SubVector<BaseFloat> > wave_samples;  // points to
+                                 // raw_data or to the samples passed.
+    BaseFloat sample_frequency;
+
+    Lattice lat;                 // Raw lattice output
+    CompactLattice dlat;         // Determinized lattice output.
+    bool determinized;
+    std::atomic<bool> finished;  // Tells master thread if task has finished
+                                 // execution
+
+    std::function<void(CompactLattice &clat)> callback;
+
+    TaskState(): error(false), sample_frequency(0), determinized(false),
+                 finished(false) { }
+  };
+
+  // Creating a new task in the hashmaps
+  TaskState *AddTask(const std::string &key, const std::string &group);
+
+  // Adds task to the queue of tasks waiting for a worker thread.
+  void AddTaskToPendingTaskQueue(TaskState *task);
+
+  // Waits for the task with this key to finish and returns it.
+  TaskState *WaitForTask(const std::string &key);
+
+  // Computes the features and i-vector of the file.  Returns false if there
+  // were no frames.
+  bool ComputeFeatures(TaskState *task, Matrix<BaseFloat> *input_features,
+                       Vector<BaseFloat> *ivector);
+
+  // Does all the work for one task, using this worker's decoder.
+  void DecodeOneTask(LatticeFasterDecoder *decoder, TaskState *task);
+
+  // Determinizes task->lat (which is unscaled) into task->dlat, pruning at
+  // the acoustic scale used in decoding.  This destroys task->lat.
+  void DeterminizeOneLattice(TaskState *task);
+
+  // Marks the task as finished and updates the group counters.
+  void TaskFinished(TaskState *task);
+
+  // Sets the priorities of the chunks of a file so that those which will be
+  // needed first by the decoders are computed first; see
+  // NnetBatchDecoder::SetPriorities().
+  void SetPriorities(std::vector<nnet3::NnetInferenceTask> *tasks);
+  void UpdatePriorityOffset(double priority);
+
+  // The thread functions.
+  void ExecuteWorker();
+  void ExecuteCompute();
+
+  BatchedThreadedNnet3CpuPipelineConfig config_;
+
+  const fst::Fst<fst::StdArc> *decode_fst_;
+  const TransitionModel *trans_model_;
+  OnlineNnet2FeaturePipelineInfo *feature_info_;
+  nnet3::NnetBatchComputer *computer_;
+
+  // Tasks waiting for a worker thread, protected by pending_mutex_.
+  std::deque<TaskState*> pending_task_queue_;
+  std::mutex pending_mutex_;
+  std::condition_variable pending_not_empty_cv_;
+  std::condition_variable pending_not_full_cv_;
+
+  // Signaled by the worker threads when they have given new chunks to
+  // computer_, and by Finalize().
+  Semaphore tasks_ready_semaphore_;
+  std::atomic<bool> exit_;  // signals threads to exit
+  double priority_offset_;
+
+  std::map<std::string, int32> group_tasks_not_done_;
+  int32 all_group_tasks_not_done_;
+  std::mutex group_tasks_mutex_;
+  std::condition_variable group_done_cv_;
+
+  std::mutex tasks_lookup_mutex_;  // protects the two maps below.
+  std::unordered_multimap<std::string, TaskState *>
+      tasks_group_lookup_;  // group -> list of tasks
+  std::unordered_map<std::string, TaskState>
+      tasks_lookup_;  // Contains a map of utterance to TaskState
+
+  std::vector<std::thread> worker_threads_;
+  std::vector<std::thread> compute_threads_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_ONLINE2_BATCHED_THREADED_NNET3_CPU_PIPELINE_H_
@@ -277,6 +277,22 @@ void OnlineFeaturePipeline::AcceptWaveform(
     pitch_->AcceptWaveform(sampling_rate, waveform);
 }
 
+void OnlineFeaturePipeline::AcceptWaveform(
+    BaseFloat sampling_rate,
+    const int16 *samples, int32 num_samples) {
+  base_feature_->AcceptWaveform(sampling_rate, samples, num_samples);
+  if (pitch_)
+    pitch_->AcceptWaveform(sampling_rate, samples, num_samples);
+}
+
+void OnlineFeaturePipeline::AcceptWaveformMuLaw(
+    BaseFloat sampling_rate,
+    const uint8 *samples, int32 num_samples) {
+  base_feature_->AcceptWaveformMuLaw(sampling_rate, samples, num_samples);
+  if (pitch_)
+    pitch_->AcceptWaveformMuLaw(sampling_rate, samples, num_samples);
+}
+
 void OnlineFeaturePipeline::InputFinished() {
   base_feature_->InputFinished();
   if (pitch_)
@@ -241,7 +241,9 @@ void OnlineIvectorFeature::UpdateStatsForFrames(
   } else {
     lda_normalized_->GetFrames(frames, &feats); // get features with OnlineCmvn
   }
-  ivector_stats_.AccStats(info_.extractor, feats, posteriors);
+  // The projection of the stats into the iVector space is deferred until we
+  // actually need an iVector; see FlushDeferredStats() calls below.
+  ivector_stats_.AccStatsDeferred(info_.extractor, feats, posteriors);
 }
 
 
@@ -266,6 +268,7 @@ void OnlineIvectorFeature::UpdateStatsUntilFrame(int32 frame) {
       //  UpdateStatsForFrame(cur_start_frame + i, frame_weights[i])
       UpdateStatsForFrames(frame_weights);
       frame_weights.clear();
+      ivector_stats_.FlushDeferredStats(info_.extractor);
       ivector_stats_.GetIvector(num_cg_iters, &current_ivector_);
       if (!info_.use_most_recent_ivector) {  // need to cache iVectors.
         int32 ivec_index = t / ivector_period;
@@ -311,6 +314,7 @@ void OnlineIvectorFeature::UpdateStatsUntilFrameWeighted(int32 frame) {
         (info_.use_most_recent_ivector && t == frame)) {
       UpdateStatsForFrames(frame_weights);
       frame_weights.clear();
+      ivector_stats_.FlushDeferredStats(info_.extractor);
       ivector_stats_.GetIvector(num_cg_iters, &current_ivector_);
       if (!info_.use_most_recent_ivector) {  // need to cache iVectors.
         int32 ivec_index = t / ivector_period;
@@ -368,7 +372,7 @@ void OnlineIvectorFeature::PrintDiagnostics() const {
 
     KALDI_VLOG(2) << "By the end of the utterance, objf change/frame "
                   << "from estimating iVector (vs. default) was "
-                  << ivector_stats_.ObjfChange(current_ivector_)
+                  << ObjfImprPerFrame()
                   << " and iVector length was "
                   << temp_ivector.Norm(2.0);
   }
@@ -391,6 +395,7 @@ void OnlineIvectorFeature::GetAdaptationState(
   cmvn_->GetState(cmvn_->NumFramesReady() - 1,
                   &(adaptation_state->cmvn_state));
   adaptation_state->ivector_stats = ivector_stats_;
+  adaptation_state->ivector_stats.FlushDeferredStats(info_.extractor);
   adaptation_state->LimitFrames(info_.max_remembered_frames,
                                 info_.posterior_scale);
 }
@@ -458,7 +463,12 @@ BaseFloat OnlineIvectorFeature::UbmLogLikePerFrame() const {
 }
 
 BaseFloat OnlineIvectorFeature::ObjfImprPerFrame() const {
-  return ivector_stats_.ObjfChange(current_ivector_);
+  if (!ivector_stats_.HasDeferredStats())
+    return ivector_stats_.ObjfChange(current_ivector_);
+  // This is only used for diagnostics, so it's OK to copy the stats.
+  OnlineIvectorEstimationStats stats(ivector_stats_);
+  stats.FlushDeferredStats(info_.extractor);
+  return stats.ObjfChange(current_ivector_);
 }
 
 
@@ -222,6 +222,22 @@ void OnlineNnet2FeaturePipeline::AcceptWaveform(
     pitch_->AcceptWaveform(sampling_rate, waveform);
 }
 
+void OnlineNnet2FeaturePipeline::AcceptWaveform(
+    BaseFloat sampling_rate,
+    const int16 *samples, int32 num_samples) {
+  base_feature_->AcceptWaveform(sampling_rate, samples, num_samples);
+  if (pitch_)
+    pitch_->AcceptWaveform(sampling_rate, samples, num_samples);
+}
+
+void OnlineNnet2FeaturePipeline::AcceptWaveformMuLaw(
+    BaseFloat sampling_rate,
+    const uint8 *samples, int32 num_samples) {
+  base_feature_->AcceptWaveformMuLaw(sampling_rate, samples, num_samples);
+  if (pitch_)
+    pitch_->AcceptWaveformMuLaw(sampling_rate, samples, num_samples);
+}
+
 void OnlineNnet2FeaturePipeline::InputFinished() {
   base_feature_->InputFinished();
   if (pitch_)
@@ -257,6 +257,16 @@ class OnlineNnet2FeaturePipeline: public OnlineFeatureInterface {
   void AcceptWaveform(BaseFloat sampling_rate,
                       const VectorBase<BaseFloat> &waveform);
 
+  /// As above, but for 16-bit linear PCM samples (e.g. as read from a socket),
+  /// which are converted directly into the feature extractor's waveform
+  /// buffer without an intermediate Vector.
+  void AcceptWaveform(BaseFloat sampling_rate,
+                      const int16 *samples, int32 num_samples);
+
+  /// As above, but for 8-bit mu-law samples.
+  void AcceptWaveformMuLaw(BaseFloat sampling_rate,
+                           const uint8 *samples, int32 num_samples);
+
   BaseFloat FrameShiftInSeconds() const { return info_.FrameShiftInSeconds(); }
 
   /// If you call InputFinished(), it tells the class you won't be providing any
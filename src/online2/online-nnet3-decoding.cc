@@ -37,7 +37,8 @@ SingleUtteranceNnet3DecoderTpl<FST>::SingleUtteranceNnet3DecoderTpl(
     trans_model_(trans_model),
     decodable_(trans_model_, info,
                features->InputFeature(), features->IvectorFeature()),
-    decoder_(fst, decoder_opts_) {
+    decoder_(fst, decoder_opts_),
+    partial_lattice_state_(trans_model, decoder_opts_) {
   decoder_.InitDecoding();
 }
 
@@ -45,6 +46,9 @@ template <typename FST>
 void SingleUtteranceNnet3DecoderTpl<FST>::InitDecoding(int32 frame_offset) {
   decoder_.InitDecoding();
   decodable_.SetFrameOffset(frame_offset);
+  partial_lattice_state_.Init();
+  traceback_.clear();
+  partial_words_.clear();
 }
 
 template <typename FST>
@@ -84,6 +88,62 @@ void SingleUtteranceNnet3DecoderTpl<FST>::GetBestPath(bool end_of_utterance,
   decoder_.GetBestPath(best_path, end_of_utterance);
 }
 
+template <typename FST>
+const CompactLattice &SingleUtteranceNnet3DecoderTpl<FST>::GetPartialLattice(
+    bool end_of_utterance) {
+  if (NumFramesDecoded() == 0)
+    KALDI_ERR << "You cannot get a lattice if you decoded no frames.";
+  if (!decoder_opts_.determinize_lattice)
+    KALDI_ERR << "--determinize-lattice=false option is not supported at the moment";
+  return decoder_.GetLatticeIncremental(NumFramesDecoded(), end_of_utterance,
+                                        &partial_lattice_state_);
+}
+
+template <typename FST>
+const std::vector<int32> &SingleUtteranceNnet3DecoderTpl<FST>::GetPartialResult(
+    bool end_of_utterance) {
+  int32 num_frames = NumFramesDecoded();
+  KALDI_ASSERT(static_cast<int32>(traceback_.size()) <= num_frames);
+  if (num_frames == 0)
+    return partial_words_;
+  traceback_.resize(num_frames);
+
+  // Trace back until we reach a token that was on the previous best path;
+  // from there back the traceback is unchanged.  As in
+  // OnlineSilenceWeighting::ComputeCurrentTraceback(), comparing the
+  // addresses of the tokens is safe because tokens, once allocated on a
+  // frame, are only deleted, never reallocated for that frame.
+  typename LatticeFasterOnlineDecoderTpl<FST>::BestPathIterator iter =
+      decoder_.BestPathEnd(end_of_utterance);
+  std::vector<int32> &words = temp_words_;  // in reverse order.
+  words.clear();
+  int32 frame = num_frames - 1;
+  for (; frame >= 0; frame--) {
+    if (traceback_[frame].token == iter.tok)
+      break;
+    traceback_[frame].token = iter.tok;
+    size_t num_words = words.size();
+    LatticeArc arc;
+    do {
+      iter = decoder_.TraceBackBestPath(iter, &arc);
+      if (arc.olabel != 0)
+        words.push_back(arc.olabel);
+    } while (arc.ilabel == 0 || (frame == 0 && !iter.Done()));
+    KALDI_ASSERT(iter.frame == frame - 1);
+    // For now, store the number of words on this frame.
+    traceback_[frame].num_words = words.size() - num_words;
+  }
+  int32 tot_words = (frame >= 0 ? traceback_[frame].num_words : 0);
+  partial_words_.resize(tot_words);
+  partial_words_.insert(partial_words_.end(), words.rbegin(), words.rend());
+  for (frame++; frame < num_frames; frame++) {
+    tot_words += traceback_[frame].num_words;
+    traceback_[frame].num_words = tot_words;
+  }
+  KALDI_ASSERT(tot_words == static_cast<int32>(partial_words_.size()));
+  return partial_words_;
+}
+
 template <typename FST>
 bool SingleUtteranceNnet3DecoderTpl<FST>::EndpointDetected(
     const OnlineEndpointConfig &config) {
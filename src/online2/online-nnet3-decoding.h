@@ -91,6 +91,24 @@ class SingleUtteranceNnet3DecoderTpl {
   void GetBestPath(bool end_of_utterance,
                    Lattice *best_path) const;
 
+  /// Gets the lattice of the frames decoded so far, as GetLattice(), but
+  /// determinized incrementally (see LatticeIncrementalDecoderTpl): each call
+  /// only determinizes the frames decoded since the previous call, so if you
+  /// want partial lattices at regular intervals of a long stream the cost per
+  /// call does not grow with the length of the stream.  The lattice is not
+  /// minimized, so it may differ slightly from the output of GetLattice().
+  /// The returned reference is valid until the next call to this function or
+  /// to InitDecoding().
+  const CompactLattice &GetPartialLattice(bool end_of_utterance);
+
+  /// Returns the word sequence of the current best path.  The traceback is
+  /// cached between calls and is only redone back to the point where it
+  /// joins the previous best path, so the cost per call is proportional to
+  /// the number of new frames (plus however far back the best path changed)
+  /// rather than to the length of the utterance.  The returned reference is
+  /// valid until the next call to this function or to InitDecoding().
+  const std::vector<int32> &GetPartialResult(bool end_of_utterance);
+
 
   /// This function calls EndpointDetected from online-endpoint.h,
   /// with the required arguments.
@@ -115,6 +133,23 @@ class SingleUtteranceNnet3DecoderTpl {
 
   LatticeFasterOnlineDecoderTpl<FST> decoder_;
 
+  // The state of the incremental determinization done in
+  // GetPartialLattice().
+  LatticeFasterOnlineIncrementalState partial_lattice_state_;
+
+  // For GetPartialResult(): the cached traceback of the best path, indexed by
+  // frame.  'token' is the decoder's Token at the end of the frame (i.e. the
+  // one we traced back from), which tells us where the new best path joins
+  // the old one; 'num_words' is the number of words on the best path up to
+  // the end of this frame.
+  struct TracebackInfo {
+    void *token;
+    int32 num_words;
+    TracebackInfo(): token(NULL), num_words(0) { }
+  };
+  std::vector<TracebackInfo> traceback_;
+  std::vector<int32> partial_words_;
+  std::vector<int32> temp_words_;  // temporary used in GetPartialResult().
 };
 
 
@@ -0,0 +1,469 @@
+// online2/online-nnet3-multistream-decoding.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "online2/online-nnet3-multistream-decoding.h"
+#include "lat/lattice-functions.h"
+#include "lat/determinize-lattice-pruned.h"
+#include "nnet3/nnet-utils.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+
+MultiStreamNnet3Decoder::Stream::Stream(
+    const MultiStreamNnet3DecoderConfig &config,
+    const OnlineNnet2FeaturePipelineInfo &feature_info,
+    const TransitionModel &trans_model,
+    const fst::Fst<fst::StdArc> &fst):
+    features(feature_info),
+    silence_weighting(new OnlineSilenceWeighting(
+        trans_model, feature_info.silence_weighting_config,
+        config.compute_opts.frame_subsampling_factor)),
+    decodable(trans_model),
+    decodable_offset(&decodable),
+    decoder(fst, config.decoder_opts),
+    next_output_frame(0),
+    frame_offset(0),
+    input_finished(false),
+    all_chunks_prepared(false),
+    num_audio_seconds(0.0),
+    tot_latency(0.0),
+    max_latency(0.0),
+    num_latency_samples(0) {
+  decoder.InitDecoding();
+}
+
+MultiStreamNnet3Decoder::Stream::~Stream() {
+  delete silence_weighting;
+  for (size_t i = 0; i < tasks.size(); i++)
+    delete tasks[i];
+}
+
+
+class MultiStreamNnet3Decoder::PrepareTasksClass: public MultiThreadable {
+ public:
+  PrepareTasksClass(MultiStreamNnet3Decoder *decoder,
+                    const std::vector<Stream*> *streams):
+      decoder_(decoder), streams_(streams) { }
+  void operator () () {
+    for (size_t i = thread_id_; i < streams_->size(); i += num_threads_)
+      decoder_->PrepareTasks((*streams_)[i]);
+  }
+ private:
+  MultiStreamNnet3Decoder *decoder_;
+  const std::vector<Stream*> *streams_;
+};
+
+class MultiStreamNnet3Decoder::ComputeClass: public MultiThreadable {
+ public:
+  ComputeClass(nnet3::NnetBatchComputer *computer): computer_(computer) { }
+  void operator () () {
+    // All the tasks have already been given to the computer, so we allow
+    // partial minibatches; this returns false when there is nothing left.
+    while (computer_->Compute(true)) { }
+  }
+ private:
+  nnet3::NnetBatchComputer *computer_;
+};
+
+class MultiStreamNnet3Decoder::DecodeClass: public MultiThreadable {
+ public:
+  DecodeClass(MultiStreamNnet3Decoder *decoder,
+              const std::vector<Stream*> *streams,
+              double now):
+      decoder_(decoder), streams_(streams), now_(now) { }
+  void operator () () {
+    for (size_t i = thread_id_; i < streams_->size(); i += num_threads_)
+      decoder_->DecodeOutput((*streams_)[i], now_);
+  }
+ private:
+  MultiStreamNnet3Decoder *decoder_;
+  const std::vector<Stream*> *streams_;
+  double now_;
+};
+
+
+MultiStreamNnet3Decoder::MultiStreamNnet3Decoder(
+    const MultiStreamNnet3DecoderConfig &config,
+    const OnlineNnet2FeaturePipelineInfo &feature_info,
+    const TransitionModel &trans_model,
+    const nnet3::AmNnetSimple &am_nnet,
+    const fst::Fst<fst::StdArc> &fst):
+    config_(config),
+    feature_info_(feature_info),
+    trans_model_(trans_model),
+    fst_(fst),
+    computer_(config.compute_opts, am_nnet.GetNnet(), am_nnet.Priors()),
+    stream_counter_(0),
+    step_seconds_(0.0),
+    tot_audio_seconds_(0.0),
+    num_chunks_(0),
+    num_steps_(0),
+    num_removed_streams_(0),
+    tot_removed_stream_latency_(0.0) {
+  // The computer may have rounded frames_per_chunk up to a multiple of
+  // frame_subsampling_factor, so we get the options from there.
+  const nnet3::NnetBatchComputerOptions &opts = computer_.GetOptions();
+  frame_subsampling_factor_ = opts.frame_subsampling_factor;
+  frames_per_chunk_ = opts.frames_per_chunk;
+  int32 nnet_left_context, nnet_right_context;
+  nnet3::ComputeSimpleNnetContext(am_nnet.GetNnet(), &nnet_left_context,
+                                  &nnet_right_context);
+  left_context_ = nnet_left_context + opts.extra_left_context;
+  right_context_ = nnet_right_context + opts.extra_right_context;
+  if (nnet3::NnetIsRecurrent(am_nnet.GetNnet()))
+    KALDI_WARN << "The model is recurrent; MultiStreamNnet3Decoder computes "
+               << "each chunk independently, with --extra-left-context="
+               << opts.extra_left_context << " and --extra-right-context="
+               << opts.extra_right_context << ", so the output only "
+               << "approximates that of the looped computation in "
+               << "SingleUtteranceNnet3Decoder.";
+  if (am_nnet.GetNnet().OutputDim("output") != trans_model.NumPdfs())
+    KALDI_ERR << "Neural net output dimension "
+              << am_nnet.GetNnet().OutputDim("output")
+              << " does not match number of pdfs " << trans_model.NumPdfs();
+}
+
+MultiStreamNnet3Decoder::~MultiStreamNnet3Decoder() {
+  for (std::unordered_map<int32, Stream*>::iterator iter = streams_.begin();
+       iter != streams_.end(); ++iter)
+    delete iter->second;
+}
+
+MultiStreamNnet3Decoder::Stream* MultiStreamNnet3Decoder::GetStream(
+    int32 stream_id) const {
+  std::unordered_map<int32, Stream*>::const_iterator iter =
+      streams_.find(stream_id);
+  if (iter == streams_.end())
+    KALDI_ERR << "No such stream " << stream_id;
+  return iter->second;
+}
+
+int32 MultiStreamNnet3Decoder::AddStream() {
+  int32 stream_id = stream_counter_++;
+  streams_[stream_id] = new Stream(config_, feature_info_, trans_model_,
+                                   fst_);
+  return stream_id;
+}
+
+void MultiStreamNnet3Decoder::RemoveStream(int32 stream_id) {
+  Stream *stream = GetStream(stream_id);
+  if (stream->num_latency_samples > 0) {
+    num_removed_streams_++;
+    tot_removed_stream_latency_ +=
+        stream->tot_latency / stream->num_latency_samples;
+  }
+  delete stream;
+  streams_.erase(stream_id);
+}
+
+void MultiStreamNnet3Decoder::AcceptWaveform(
+    int32 stream_id, BaseFloat sampling_rate,
+    const VectorBase<BaseFloat> &waveform) {
+  Stream *stream = GetStream(stream_id);
+  KALDI_ASSERT(!stream->input_finished);
+  if (waveform.Dim() == 0)
+    return;
+  stream->features.AcceptWaveform(sampling_rate, waveform);
+  AudioAccepted(stream, sampling_rate, waveform.Dim());
+}
+
+void MultiStreamNnet3Decoder::AcceptWaveform(
+    int32 stream_id, BaseFloat sampling_rate,
+    const int16 *samples, int32 num_samples) {
+  Stream *stream = GetStream(stream_id);
+  KALDI_ASSERT(!stream->input_finished);
+  if (num_samples == 0)
+    return;
+  stream->features.AcceptWaveform(sampling_rate, samples, num_samples);
+  AudioAccepted(stream, sampling_rate, num_samples);
+}
+
+void MultiStreamNnet3Decoder::AudioAccepted(Stream *stream,
+                                            BaseFloat sampling_rate,
+                                            int32 num_samples) {
+  double seconds = num_samples / sampling_rate;
+  stream->num_audio_seconds += seconds;
+  tot_audio_seconds_ += seconds;
+  stream->pending_audio.push_back(
+      std::pair<double, double>(stream->num_audio_seconds,
+                                timer_.Elapsed()));
+}
+
+void MultiStreamNnet3Decoder::InputFinished(int32 stream_id) {
+  Stream *stream = GetStream(stream_id);
+  stream->features.InputFinished();
+  stream->input_finished = true;
+}
+
+void MultiStreamNnet3Decoder::PrepareTasks(Stream *stream) {
+  OnlineNnet2FeaturePipeline &features = stream->features;
+  int32 f = frame_subsampling_factor_;
+  if (stream->silence_weighting->Active() &&
+      features.IvectorFeature() != NULL) {
+    std::vector<std::pair<int32, BaseFloat> > delta_weights;
+    stream->silence_weighting->ComputeCurrentTraceback(stream->decoder);
+    stream->silence_weighting->GetDeltaWeights(features.NumFramesReady(),
+                                               stream->frame_offset * f,
+                                               &delta_weights);
+    features.UpdateFrameWeights(delta_weights);
+  }
+
+  OnlineFeatureInterface *input_features = features.InputFeature();
+  OnlineIvectorFeature *ivector_features = features.IvectorFeature();
+  int32 num_frames_ready = input_features->NumFramesReady(),
+      output_frames_per_chunk = frames_per_chunk_ / f,
+      num_output_frames = (num_frames_ready + f - 1) / f;
+
+  while (true) {
+    int32 begin_input_frame = stream->next_output_frame * f,
+        end_input_frame = begin_input_frame + frames_per_chunk_,
+        num_used_output_frames;
+    if (stream->input_finished) {
+      if (stream->next_output_frame >= num_output_frames) {
+        stream->all_chunks_prepared = true;
+        break;
+      }
+      num_used_output_frames = std::min(
+          output_frames_per_chunk,
+          num_output_frames - stream->next_output_frame);
+    } else {
+      if (end_input_frame + right_context_ > num_frames_ready)
+        break;
+      num_used_output_frames = output_frames_per_chunk;
+    }
+
+    nnet3::NnetInferenceTask *task = new nnet3::NnetInferenceTask();
+    // Frames before the start or past the end are padded with copies of the
+    // first or last frame, like the looped decodable does.
+    int32 begin_padded = begin_input_frame - left_context_,
+        end_padded = end_input_frame + right_context_;
+    std::vector<int32> frames(end_padded - begin_padded);
+    for (int32 t = begin_padded; t < end_padded; t++)
+      frames[t - begin_padded] = std::max(0, std::min(t,
+                                                      num_frames_ready - 1));
+    Matrix<BaseFloat> input(frames.size(), input_features->Dim(),
+                            kUndefined);
+    input_features->GetFrames(frames, &input);
+    task->input.Swap(&input);
+    task->first_input_t = -left_context_;
+    task->output_t_stride = f;
+    task->num_output_frames = output_frames_per_chunk;
+    task->num_initial_unused_output_frames = 0;
+    task->num_used_output_frames = num_used_output_frames;
+    task->first_used_output_frame_index = stream->next_output_frame;
+    task->is_edge = false;
+    task->is_irregular = false;
+    task->priority = 0.0;
+    task->output_to_cpu = true;
+    if (ivector_features != NULL) {
+      // As in the looped decodable, we use the iVector from the most recent
+      // frame available.
+      Vector<BaseFloat> ivector(ivector_features->Dim());
+      int32 num_ivector_frames_ready = ivector_features->NumFramesReady();
+      if (num_ivector_frames_ready > 0)
+        ivector_features->GetFrame(std::min(num_frames_ready,
+                                            num_ivector_frames_ready) - 1,
+                                   &ivector);
+      task->ivector.Resize(ivector.Dim(), kUndefined);
+      task->ivector.CopyFromVec(ivector);
+    }
+    stream->tasks.push_back(task);
+    stream->next_output_frame += output_frames_per_chunk;
+  }
+}
+
+void MultiStreamNnet3Decoder::DecodeOutput(Stream *stream, double now) {
+  if (!stream->tasks.empty()) {
+    int32 num_rows = 0;
+    for (size_t i = 0; i < stream->tasks.size(); i++) {
+      stream->tasks[i]->semaphore.Wait();  // won't block; they are done.
+      num_rows += stream->tasks[i]->num_used_output_frames;
+    }
+    Matrix<BaseFloat> loglikes(num_rows,
+                               stream->tasks[0]->output_cpu.NumCols(),
+                               kUndefined);
+    int32 row = 0;
+    for (size_t i = 0; i < stream->tasks.size(); i++) {
+      nnet3::NnetInferenceTask *task = stream->tasks[i];
+      int32 num_used = task->num_used_output_frames;
+      loglikes.RowRange(row, num_used).CopyFromMat(
+          task->output_cpu.RowRange(0, num_used));
+      row += num_used;
+      delete task;
+    }
+    stream->tasks.clear();
+    // We discard the frames that have already been decoded.
+    int32 frames_decoded = stream->frame_offset +
+        stream->decoder.NumFramesDecoded(),
+        frames_to_discard = frames_decoded -
+        stream->decodable.FirstAvailableFrame();
+    stream->decodable.AcceptLoglikes(&loglikes, frames_to_discard);
+  }
+  if (stream->all_chunks_prepared)
+    stream->decodable.InputIsFinished();
+  stream->decoder.AdvanceDecoding(&(stream->decodable_offset));
+
+  // Update the latency statistics for all the pieces of audio whose end has
+  // now been decoded.
+  double decoded_seconds;
+  if (stream->all_chunks_prepared &&
+      stream->frame_offset + stream->decoder.NumFramesDecoded() ==
+      stream->decodable.NumFramesReady())
+    decoded_seconds = stream->num_audio_seconds;
+  else
+    decoded_seconds = (stream->frame_offset +
+                       stream->decoder.NumFramesDecoded()) *
+        frame_subsampling_factor_ * feature_info_.FrameShiftInSeconds();
+  while (!stream->pending_audio.empty() &&
+         stream->pending_audio.front().first <= decoded_seconds) {
+    double latency = now - stream->pending_audio.front().second;
+    stream->tot_latency += latency;
+    stream->max_latency = std::max(stream->max_latency, latency);
+    stream->num_latency_samples++;
+    stream->pending_audio.pop_front();
+  }
+}
+
+void MultiStreamNnet3Decoder::Step() {
+  if (streams_.empty())
+    return;
+  Timer timer;
+  std::vector<Stream*> streams;
+  streams.reserve(streams_.size());
+  for (std::unordered_map<int32, Stream*>::iterator iter = streams_.begin();
+       iter != streams_.end(); ++iter)
+    streams.push_back(iter->second);
+  // With a single thread, MultiThreader runs the job in this thread.
+  int32 num_threads = (config_.num_threads > 1 ? config_.num_threads : 0);
+
+  {
+    MultiThreader<PrepareTasksClass> m(num_threads,
+                                       PrepareTasksClass(this, &streams));
+  }
+  int32 num_tasks = 0;
+  for (size_t i = 0; i < streams.size(); i++) {
+    for (size_t j = 0; j < streams[i]->tasks.size(); j++) {
+      computer_.AcceptTask(streams[i]->tasks[j]);
+      num_tasks++;
+    }
+  }
+  if (num_tasks > 0) {
+    MultiThreader<ComputeClass> m(num_threads, ComputeClass(&computer_));
+  }
+  {
+    MultiThreader<DecodeClass> m(num_threads,
+                                 DecodeClass(this, &streams,
+                                             timer_.Elapsed()));
+  }
+  num_chunks_ += num_tasks;
+  num_steps_++;
+  step_seconds_ += timer.Elapsed();
+}
+
+bool MultiStreamNnet3Decoder::IsFinished(int32 stream_id) const {
+  const Stream *stream = GetStream(stream_id);
+  return stream->all_chunks_prepared && stream->tasks.empty() &&
+      stream->frame_offset + stream->decoder.NumFramesDecoded() ==
+      stream->decodable.NumFramesReady();
+}
+
+int32 MultiStreamNnet3Decoder::NumFramesDecoded(int32 stream_id) const {
+  return GetStream(stream_id)->decoder.NumFramesDecoded();
+}
+
+int32 MultiStreamNnet3Decoder::FrameOffset(int32 stream_id) const {
+  return GetStream(stream_id)->frame_offset;
+}
+
+bool MultiStreamNnet3Decoder::EndpointDetected(
+    int32 stream_id, const OnlineEndpointConfig &config) {
+  BaseFloat output_frame_shift =
+      feature_info_.FrameShiftInSeconds() * frame_subsampling_factor_;
+  return kaldi::EndpointDetected(config, trans_model_, output_frame_shift,
+                                 GetStream(stream_id)->decoder);
+}
+
+void MultiStreamNnet3Decoder::FinalizeDecoding(int32 stream_id) {
+  GetStream(stream_id)->decoder.FinalizeDecoding();
+}
+
+void MultiStreamNnet3Decoder::RestartDecoding(int32 stream_id) {
+  Stream *stream = GetStream(stream_id);
+  stream->frame_offset += stream->decoder.NumFramesDecoded();
+  stream->decoder.InitDecoding();
+  stream->decodable_offset.SetFrameOffset(stream->frame_offset);
+  delete stream->silence_weighting;
+  stream->silence_weighting = new OnlineSilenceWeighting(
+      trans_model_, feature_info_.silence_weighting_config,
+      frame_subsampling_factor_);
+}
+
+void MultiStreamNnet3Decoder::GetBestPath(int32 stream_id,
+                                          bool end_of_utterance,
+                                          Lattice *best_path) const {
+  GetStream(stream_id)->decoder.GetBestPath(best_path, end_of_utterance);
+}
+
+void MultiStreamNnet3Decoder::GetLattice(int32 stream_id,
+                                         bool end_of_utterance,
+                                         CompactLattice *clat) const {
+  const Stream *stream = GetStream(stream_id);
+  if (stream->decoder.NumFramesDecoded() == 0)
+    KALDI_ERR << "You cannot get a lattice if you decoded no frames.";
+  Lattice raw_lat;
+  stream->decoder.GetRawLattice(&raw_lat, end_of_utterance);
+
+  if (!config_.decoder_opts.determinize_lattice)
+    KALDI_ERR << "--determinize-lattice=false option is not supported at the moment";
+
+  BaseFloat lat_beam = config_.decoder_opts.lattice_beam;
+  DeterminizeLatticePhonePrunedWrapper(
+      trans_model_, &raw_lat, lat_beam, clat, config_.decoder_opts.det_opts);
+}
+
+void MultiStreamNnet3Decoder::GetLatency(int32 stream_id, double *average,
+                                         double *max) const {
+  const Stream *stream = GetStream(stream_id);
+  *average = (stream->num_latency_samples > 0 ?
+              stream->tot_latency / stream->num_latency_samples : 0.0);
+  *max = stream->max_latency;
+}
+
+double MultiStreamNnet3Decoder::StreamsPerCore() const {
+  if (step_seconds_ == 0.0)
+    return 0.0;
+  return tot_audio_seconds_ /
+      (step_seconds_ * std::max<int32>(1, config_.num_threads));
+}
+
+void MultiStreamNnet3Decoder::PrintDiagnostics() const {
+  KALDI_LOG << "Processed " << tot_audio_seconds_ << " seconds of audio in "
+            << step_seconds_ << " seconds with " << config_.num_threads
+            << " thread(s): " << StreamsPerCore() << " streams per core.";
+  KALDI_LOG << "Computed " << num_chunks_ << " chunks in " << num_steps_
+            << " steps (" << (num_chunks_ / std::max<double>(1, num_steps_))
+            << " chunks per batch on average).";
+  if (num_removed_streams_ > 0)
+    KALDI_LOG << "Average latency over " << num_removed_streams_
+              << " finished streams was "
+              << (tot_removed_stream_latency_ / num_removed_streams_)
+              << " seconds.";
+}
+
+
+}  // namespace kaldi
@@ -0,0 +1,298 @@
+// online2/online-nnet3-multistream-decoding.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_ONLINE2_ONLINE_NNET3_MULTISTREAM_DECODING_H_
+#define KALDI_ONLINE2_ONLINE_NNET3_MULTISTREAM_DECODING_H_
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/lattice-faster-online-decoder.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-batch-compute.h"
+#include "online2/online-endpoint.h"
+#include "online2/online-ivector-feature.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+
+namespace kaldi {
+/// @addtogroup  onlinedecoding OnlineDecoding
+/// @{
+
+
+struct MultiStreamNnet3DecoderConfig {
+  // 'num_threads' is the number of threads used for feature extraction, the
+  // neural net computation and the graph search; all three phases of
+  // MultiStreamNnet3Decoder::Step() are parallelized over the same number of
+  // threads.
+  int32 num_threads;
+
+  nnet3::NnetBatchComputerOptions compute_opts;
+  LatticeFasterDecoderConfig decoder_opts;
+
+  MultiStreamNnet3DecoderConfig(): num_threads(1) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("num-threads", &num_threads, "Number of threads used "
+                   "for feature extraction, batched neural net computation "
+                   "and decoding of the streams.");
+    compute_opts.Register(opts);
+    decoder_opts.Register(opts);
+  }
+};
+
+
+/**
+   MultiStreamNnet3Decoder decodes many concurrent audio streams (e.g. the
+   connections to a server) in the same process.  Instead of each stream
+   running its own looped neural-net computation as SingleUtteranceNnet3Decoder
+   does, the chunks of all streams that are ready to be computed are
+   aggregated and given to a shared NnetBatchComputer, so that they are
+   computed in minibatches.  The graph search for the streams is spread over
+   a pool of threads.
+
+   This is a non-looped approximation of SingleUtteranceNnet3Decoder: each
+   chunk is computed with its own left and right context (as in
+   nnet3-latgen-faster-batch) rather than with a looped computation that
+   carries state over from previous chunks, since NnetBatchComputer has no
+   per-stream state.  For feedforward (e.g. TDNN) models the output is the
+   same as that of the looped computation.  For recurrent models (e.g.
+   LSTMs) each chunk only sees --extra-left-context frames of history (and
+   --extra-right-context frames of future, for bidirectional ones), so the
+   output only approximates the looped one; set these as you would for
+   nnet3-latgen-faster-batch.  All chunks are given the same structure
+   (padding with copies of the first or last frame at the edges) so that
+   they can all go in the same minibatch.
+
+   online2-wav-nnet3-multistream-compare measures the streams per core, and
+   the differences in the output, of this class versus
+   SingleUtteranceNnet3Decoder on the same audio.
+
+   The interface is not thread-safe: all the functions are expected to be
+   called from the same thread (e.g. the main loop of a server), and they
+   use threads internally in Step().
+ */
+class MultiStreamNnet3Decoder {
+ public:
+  /// All the references are retained by this class; they must outlive it.
+  /// 'am_nnet' should have been prepared for inference (e.g. with
+  /// SetBatchnormTestMode() and CollapseModel()).  If it is recurrent, a
+  /// warning is printed; see the class documentation.
+  MultiStreamNnet3Decoder(const MultiStreamNnet3DecoderConfig &config,
+                          const OnlineNnet2FeaturePipelineInfo &feature_info,
+                          const TransitionModel &trans_model,
+                          const nnet3::AmNnetSimple &am_nnet,
+                          const fst::Fst<fst::StdArc> &fst);
+
+  /// Creates a new stream and returns its id.
+  int32 AddStream();
+
+  /// Destroys a stream.  After this you must not use its id.
+  void RemoveStream(int32 stream_id);
+
+  /// Provides more audio for a stream; it will be processed by the next call
+  /// to Step().
+  void AcceptWaveform(int32 stream_id, BaseFloat sampling_rate,
+                      const VectorBase<BaseFloat> &waveform);
+  /// As above, but for 16-bit linear PCM samples.
+  void AcceptWaveform(int32 stream_id, BaseFloat sampling_rate,
+                      const int16 *samples, int32 num_samples);
+
+  /// Announces that there will be no more audio for this stream.
+  void InputFinished(int32 stream_id);
+
+  /// Processes all the pending input of all streams: it extracts features,
+  /// computes the neural net output for all the chunks that are complete
+  /// (in batches, across streams), and advances the decoding of each stream
+  /// as far as possible.
+  void Step();
+
+  /// Returns true if InputFinished() was called for this stream and all of
+  /// its audio has been decoded.
+  bool IsFinished(int32 stream_id) const;
+
+  /// Returns the number of frames decoded since the last call to
+  /// RestartDecoding() (or since the stream was created).
+  int32 NumFramesDecoded(int32 stream_id) const;
+
+  /// Returns the total number of frames decoded by this stream before the
+  /// last call to RestartDecoding(), i.e. the (subsampled) frame index at which
+  /// the current utterance started.
+  int32 FrameOffset(int32 stream_id) const;
+
+  /// Calls EndpointDetected() from online-endpoint.h for this stream.
+  bool EndpointDetected(int32 stream_id, const OnlineEndpointConfig &config);
+
+  /// Finalizes the decoding of the current utterance of this stream; see
+  /// LatticeFasterOnlineDecoder::FinalizeDecoding().
+  void FinalizeDecoding(int32 stream_id);
+
+  /// Starts a new utterance for this stream, e.g. after an endpoint; the
+  /// frames decoded so far are not decoded again.
+  void RestartDecoding(int32 stream_id);
+
+  /// Outputs the best path of the current utterance; see
+  /// SingleUtteranceNnet3Decoder::GetBestPath().
+  void GetBestPath(int32 stream_id, bool end_of_utterance,
+                   Lattice *best_path) const;
+
+  /// Outputs the determinized lattice of the current utterance; see
+  /// SingleUtteranceNnet3Decoder::GetLattice().
+  void GetLattice(int32 stream_id, bool end_of_utterance,
+                  CompactLattice *clat) const;
+
+  /// Gets the average and maximum latency, in seconds, of this stream: the
+  /// time from when each piece of audio was given to AcceptWaveform() until
+  /// the end of that audio was decoded.
+  void GetLatency(int32 stream_id, double *average, double *max) const;
+
+  /// Returns the number of seconds of audio processed per second of
+  /// processing time per thread, i.e. the number of real-time streams each
+  /// core could sustain at the current efficiency.
+  double StreamsPerCore() const;
+
+  /// Logs diagnostics: the streams-per-core figure, the average latency over
+  /// all removed streams, and the average number of chunks computed per
+  /// Step().
+  void PrintDiagnostics() const;
+
+  int32 NumStreams() const { return streams_.size(); }
+
+  ~MultiStreamNnet3Decoder();
+
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MultiStreamNnet3Decoder);
+
+  // Presents the frames of a DecodableMatrixMappedOffset starting from
+  // 'frame_offset' as frames 0, 1, ..., which is how the decoder numbers
+  // frames after RestartDecoding().
+  class DecodableOffset: public DecodableInterface {
+   public:
+    DecodableOffset(DecodableMatrixMappedOffset *decodable):
+        decodable_(decodable), frame_offset_(0) { }
+    void SetFrameOffset(int32 frame_offset) { frame_offset_ = frame_offset; }
+    virtual BaseFloat LogLikelihood(int32 frame, int32 index) {
+      return decodable_->LogLikelihood(frame + frame_offset_, index);
+    }
+    virtual int32 NumFramesReady() const {
+      return decodable_->NumFramesReady() - frame_offset_;
+    }
+    virtual bool IsLastFrame(int32 frame) const {
+      return decodable_->IsLastFrame(frame + frame_offset_);
+    }
+    virtual int32 NumIndices() const { return decodable_->NumIndices(); }
+   private:
+    DecodableMatrixMappedOffset *decodable_;
+    int32 frame_offset_;
+  };
+
+  struct Stream {
+    OnlineNnet2FeaturePipeline features;
+    // Recreated by RestartDecoding(), as it refers to the current utterance.
+    OnlineSilenceWeighting *silence_weighting;
+    DecodableMatrixMappedOffset decodable;
+    DecodableOffset decodable_offset;
+    LatticeFasterOnlineDecoder decoder;
+
+    // The subsampled index of the first output frame of the next chunk to
+    // be computed.
+    int32 next_output_frame;
+    // The number of output frames decoded before the last RestartDecoding().
+    int32 frame_offset;
+    bool input_finished;
+    // True once the tasks for all the chunks have been created (only
+    // possible after the input is finished).
+    bool all_chunks_prepared;
+    // Chunks that were given to the NnetBatchComputer in the current Step().
+    std::vector<nnet3::NnetInferenceTask*> tasks;
+
+    // For latency measurement: the (end time in seconds of the audio, time
+    // of arrival) for pieces of audio whose end has not been decoded yet.
+    std::deque<std::pair<double, double> > pending_audio;
+    double num_audio_seconds;
+    double tot_latency;
+    double max_latency;
+    int32 num_latency_samples;
+
+    Stream(const MultiStreamNnet3DecoderConfig &config,
+           const OnlineNnet2FeaturePipelineInfo &feature_info,
+           const TransitionModel &trans_model,
+           const fst::Fst<fst::StdArc> &fst);
+    ~Stream();
+  };
+
+  Stream *GetStream(int32 stream_id) const;
+
+  // Updates the statistics after 'num_samples' samples of audio were given
+  // to the stream.
+  void AudioAccepted(Stream *stream, BaseFloat sampling_rate,
+                     int32 num_samples);
+
+  // The following functions are called from the threads in Step().
+
+  // Updates the silence weighting of the i-vector estimation, and creates
+  // the tasks for all the chunks of the stream that can be computed.
+  void PrepareTasks(Stream *stream);
+  // Gives the output of the completed tasks to the decoder, advances the
+  // decoding and updates the latency statistics.
+  void DecodeOutput(Stream *stream, double now);
+
+  // These classes are used with MultiThreader to run the three phases of
+  // Step() in parallel.
+  class PrepareTasksClass;
+  class ComputeClass;
+  class DecodeClass;
+
+  const MultiStreamNnet3DecoderConfig &config_;
+  const OnlineNnet2FeaturePipelineInfo &feature_info_;
+  const TransitionModel &trans_model_;
+  const fst::Fst<fst::StdArc> &fst_;
+  nnet3::NnetBatchComputer computer_;
+
+  int32 frame_subsampling_factor_;
+  int32 frames_per_chunk_;  // in input frames; a multiple of
+                            // frame_subsampling_factor_.
+  int32 left_context_;  // including extra_left_context.
+  int32 right_context_;  // including extra_right_context.
+
+  int32 stream_counter_;
+  std::unordered_map<int32, Stream*> streams_;
+
+  // Diagnostics.
+  Timer timer_;
+  double step_seconds_;  // total wall-clock time spent in Step().
+  double tot_audio_seconds_;  // total audio decoded, over all streams.
+  int64 num_chunks_;
+  int64 num_steps_;
+  int64 num_removed_streams_;
+  double tot_removed_stream_latency_;  // sum of their average latencies.
+};
+
+
+/// @} End of "addtogroup onlinedecoding"
+
+}  // namespace kaldi
+
+
+
+#endif  // KALDI_ONLINE2_ONLINE_NNET3_MULTISTREAM_DECODING_H_
@@ -0,0 +1,242 @@
+// online2bin/batched-wav-nnet3-cpu.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sstream>
+#include "online2/batched-threaded-nnet3-cpu-pipeline.h"
+#include "fstext/fstext-lib.h"
+#include "lat/lattice-functions.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-utils.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Called when a task is complete.  It is called by the worker threads
+// concurrently, so it must be thread-safe.
+void FinishOneDecode(const std::string &utt, const std::string &key,
+                     const fst::SymbolTable *word_syms,
+                     int64 *tot_num_frames, double *tot_like,
+                     CompactLatticeWriter *clat_writer,
+                     std::mutex *clat_writer_mutex, std::mutex *stdout_mutex,
+                     bool write_lattice, CompactLattice &clat) {
+  if (clat.NumStates() == 0) {
+    KALDI_WARN << "Empty lattice for utterance " << utt;
+    return;
+  }
+  CompactLattice best_path_clat;
+  CompactLatticeShortestPath(clat, &best_path_clat);
+
+  Lattice best_path_lat;
+  ConvertLattice(best_path_clat, &best_path_lat);
+
+  LatticeWeight weight;
+  std::vector<int32> alignment;
+  std::vector<int32> words;
+  GetLinearSymbolSequence(best_path_lat, &alignment, &words, &weight);
+  int32 num_frames = alignment.size();
+  double likelihood = -(weight.Value1() + weight.Value2());
+  {
+    std::lock_guard<std::mutex> lk(*stdout_mutex);
+    *tot_num_frames += num_frames;
+    *tot_like += likelihood;
+    KALDI_VLOG(2) << "Likelihood per frame for utterance " << utt << " is "
+                  << (likelihood / num_frames) << " over " << num_frames
+                  << " frames.";
+    if (word_syms != NULL) {
+      std::ostringstream oss;
+      oss << utt << " ";
+      for (size_t i = 0; i < words.size(); i++) {
+        std::string s = word_syms->Find(words[i]);
+        if (s == "")
+          KALDI_ERR << "Word-id " << words[i] << " not in symbol table.";
+        oss << s << " ";
+      }
+      std::cerr << oss.str() << '\n';
+    }
+  }
+  if (write_lattice) {
+    std::lock_guard<std::mutex> lk(*clat_writer_mutex);
+    clat_writer->Write(key, clat);
+  }
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Reads in wav file(s) and decodes them with neural nets (nnet3\n"
+        "setup), with optional iVector-based speaker adaptation, using a\n"
+        "multi-threaded CPU pipeline in which the neural net is evaluated on\n"
+        "batches of chunks from many files.  This is the CPU counterpart of\n"
+        "batched-wav-nnet3-cuda and takes the same arguments.\n"
+        "Note: some configuration values and inputs are set via config files\n"
+        "whose filenames are passed as options\n"
+        "\n"
+        "Usage: batched-wav-nnet3-cpu [options] <nnet3-in> <fst-in> "
+        "<wav-rspecifier> <lattice-wspecifier>\n";
+
+    std::string word_syms_rxfilename;
+
+    bool write_lattice = true;
+    int num_todo = -1;
+    int iterations = 1;
+    ParseOptions po(usage);
+    std::mutex stdout_mutex;
+
+    po.Register("write-lattice", &write_lattice,
+                "Output lattice to a file. Setting to false is useful when "
+                "benchmarking");
+    po.Register("word-symbol-table", &word_syms_rxfilename,
+                "Symbol table for words [for debug output]");
+    po.Register("file-limit", &num_todo,
+                "Limits the number of files that are processed by this driver. "
+                "After N files are processed the remaining files are ignored. "
+                "Useful for profiling");
+    po.Register("iterations", &iterations,
+                "Number of times to decode the corpus.");
+
+    BatchedThreadedNnet3CpuPipelineConfig batched_decoder_config;
+    batched_decoder_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 4) {
+      po.PrintUsage();
+      return 1;
+    }
+
+    std::string nnet3_rxfilename = po.GetArg(1), fst_rxfilename = po.GetArg(2),
+        wav_rspecifier = po.GetArg(3), clat_wspecifier = po.GetArg(4);
+
+    TransitionModel trans_model;
+    nnet3::AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(nnet3_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      nnet3::CollapseModel(nnet3::CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    fst::Fst<fst::StdArc> *decode_fst =
+        fst::ReadFstKaldiGeneric(fst_rxfilename);
+
+    BatchedThreadedNnet3CpuPipeline pipeline(batched_decoder_config);
+    pipeline.Initialize(*decode_fst, am_nnet, trans_model);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_rxfilename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_rxfilename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                  << word_syms_rxfilename;
+
+    CompactLatticeWriter clat_writer(clat_wspecifier);
+    std::mutex clat_writer_mutex;
+
+    int32 num_task_submitted = 0;
+    double tot_like = 0.0;
+    int64 num_frames = 0;
+    double total_audio = 0;
+    int num_groups_done = 0;
+
+    Timer timer;
+    for (int iter = 0; iter < iterations; iter++) {
+      std::string task_group = std::to_string(iter);
+      num_task_submitted = 0;
+      SequentialTableReader<WaveHolder> wav_reader(wav_rspecifier);
+
+      for (; !wav_reader.Done(); wav_reader.Next()) {
+        std::string utt = wav_reader.Key();
+        std::string key = utt;
+        if (iterations > 1) {
+          // make key unique for each iteration
+          key = std::to_string(iter) + "-" + key;
+        }
+        const WaveData &wave_data = wav_reader.Value();
+        if (iter == 0)
+          total_audio += wave_data.Duration();
+
+        auto finish_one_decode_lambda =
+            [utt, key, word_syms, &num_frames, &tot_like, &clat_writer,
+             &clat_writer_mutex, &stdout_mutex, write_lattice]
+            (CompactLattice &clat_in) {
+              FinishOneDecode(utt, key, word_syms, &num_frames, &tot_like,
+                              &clat_writer, &clat_writer_mutex, &stdout_mutex,
+                              write_lattice, clat_in);
+            };
+        // This blocks if too many files are waiting for a worker thread.
+        pipeline.OpenDecodeHandle(key, wave_data, task_group,
+                                  finish_one_decode_lambda);
+        num_task_submitted++;
+        if (num_todo != -1 && num_task_submitted >= num_todo) break;
+      }
+
+      std::string group_done;
+      // Non-blocking way to check if a group is done
+      while (pipeline.IsAnyGroupCompleted(&group_done)) {
+        pipeline.CloseAllDecodeHandlesForGroup(group_done);
+        double total_time = timer.Elapsed();
+        int32 done_iter = std::atoi(group_done.c_str());
+        KALDI_LOG << "~Group " << group_done << " completed"
+                  << " Aggregate Total Time: " << total_time
+                  << " Audio: " << total_audio * (done_iter + 1)
+                  << " RealTimeX: " << total_audio * (done_iter + 1) / total_time;
+        num_groups_done++;
+      }
+    }
+
+    while (num_groups_done < iterations) {
+      // WaitForAnyGroup is blocking. It will hold until one group is ready
+      std::string group_done = pipeline.WaitForAnyGroup();
+      pipeline.CloseAllDecodeHandlesForGroup(group_done);
+      double total_time = timer.Elapsed();
+      int32 done_iter = std::atoi(group_done.c_str());
+      KALDI_LOG << "~Group " << group_done << " completed"
+                << " Aggregate Total Time: " << total_time
+                << " Audio: " << total_audio * (done_iter + 1)
+                << " RealTimeX: " << total_audio * (done_iter + 1) / total_time;
+      num_groups_done++;
+    }
+
+    double total_time = timer.Elapsed();
+    pipeline.Finalize();
+
+    KALDI_LOG << "Decoded " << num_task_submitted << " utterances.";
+    KALDI_LOG << "Overall likelihood per frame was " << (tot_like / num_frames)
+              << " per frame over " << num_frames << " frames.";
+    KALDI_LOG << "Overall: "
+              << " Aggregate Total Time: " << total_time
+              << " Total Audio: " << total_audio * iterations
+              << " RealTimeX: " << total_audio * iterations / total_time;
+
+    delete decode_fst;
+    delete word_syms;  // will delete if non-NULL.
+    return 0;
+  } catch (const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}  // main()
@@ -53,6 +53,9 @@ class TcpServer {
 
   Vector<BaseFloat> GetChunk(); // get the data read by above method
 
+  const int16 *ChunkData() const { return samp_buf_; } // the raw samples read
+  int32 ChunkSize() const { return has_read_; } // ... and their number
+
   bool Write(const std::string &msg); // write to accepted client
   bool WriteLn(const std::string &msg, const std::string &eol = "\n"); // write line to accepted client
 
@@ -275,8 +278,8 @@ int main(int argc, char *argv[]) {
             break;
           }
 
-          Vector<BaseFloat> wave_part = server.GetChunk();
-          feature_pipeline.AcceptWaveform(samp_freq, wave_part);
+          feature_pipeline.AcceptWaveform(samp_freq, server.ChunkData(),
+                                          server.ChunkSize());
           samp_count += chunk_len;
 
           if (silence_weighting.Active() &&
@@ -0,0 +1,557 @@
+// online2bin/online2-tcp-nnet3-decode-multistream.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "online2/online-nnet3-multistream-decoding.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "online2/onlinebin-util.h"
+#include "online2/online-endpoint.h"
+#include "fstext/fstext-lib.h"
+#include "lat/lattice-functions.h"
+#include "util/kaldi-thread.h"
+#include "nnet3/nnet-utils.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <map>
+#include <set>
+#include <string>
+
+namespace kaldi {
+
+std::string LatticeToString(const Lattice &lat, const fst::SymbolTable &word_syms) {
+  LatticeWeight weight;
+  std::vector<int32> alignment;
+  std::vector<int32> words;
+  GetLinearSymbolSequence(lat, &alignment, &words, &weight);
+
+  std::ostringstream msg;
+  for (size_t i = 0; i < words.size(); i++) {
+    std::string s = word_syms.Find(words[i]);
+    if (s.empty()) {
+      KALDI_WARN << "Word-id " << words[i] << " not in symbol table.";
+      msg << "<#" << std::to_string(i) << "> ";
+    } else
+      msg << s << " ";
+  }
+  return msg.str();
+}
+
+std::string GetTimeString(int32 t_beg, int32 t_end, BaseFloat time_unit) {
+  char buffer[100];
+  double t_beg2 = t_beg * time_unit;
+  double t_end2 = t_end * time_unit;
+  snprintf(buffer, 100, "%.2f %.2f", t_beg2, t_end2);
+  return std::string(buffer);
+}
+
+int32 GetLatticeTimeSpan(const Lattice& lat) {
+  std::vector<int32> times;
+  LatticeStateTimes(lat, &times);
+  return times.back();
+}
+
+std::string LatticeToString(const CompactLattice &clat, const fst::SymbolTable &word_syms) {
+  if (clat.NumStates() == 0) {
+    KALDI_WARN << "Empty lattice.";
+    return "";
+  }
+  CompactLattice best_path_clat;
+  CompactLatticeShortestPath(clat, &best_path_clat);
+
+  Lattice best_path_lat;
+  ConvertLattice(best_path_clat, &best_path_lat);
+  return LatticeToString(best_path_lat, word_syms);
+}
+
+// Accepts any number of clients on a TCP port or a Unix-domain socket, and
+// reads 16-bit linear audio from all of them without blocking.  The output to
+// each client is buffered and written as the client is ready for it, so a
+// client that is slow to read its results does not hold up the others.
+class MultiClientServer {
+ public:
+  MultiClientServer(): server_desc_(-1) { }
+  ~MultiClientServer();
+
+  // Starts listening on a TCP port (if 'unix_socket' is empty) or on a
+  // Unix-domain socket with that path.
+  void Listen(int32 port, const std::string &unix_socket);
+
+  // Waits up to 'timeout_ms' milliseconds for new connections or data, and
+  // writes any buffered output that the clients are ready for.  New
+  // connections are appended to 'new_clients'.  For each client with new
+  // data, the samples are appended to (*audio)[client]; clients whose
+  // connection was closed are appended to 'closed_clients'.
+  void Poll(int32 timeout_ms, std::vector<int32> *new_clients,
+            std::map<int32, std::vector<int16> > *audio,
+            std::vector<int32> *closed_clients);
+
+  // Sends a message to a client without blocking: what can't be written
+  // immediately is buffered and written from Poll().  Returns false if
+  // writing to this client has failed (its output is then discarded).
+  bool Write(int32 client, const std::string &msg);
+
+  // Stops reading from a client, and closes the connection once its buffered
+  // output has been written.
+  void Disconnect(int32 client);
+
+ private:
+  // Writes as much of the buffered output of 'client' as possible without
+  // blocking.
+  void FlushOutput(int32 client);
+
+  void CloseClient(int32 client);
+
+  // If a client has more than this much output waiting, we assume it has
+  // stopped reading and discard its output.
+  static const size_t kMaxPendingOutput = 1 << 20;
+
+  std::string unix_socket_;
+  int32 server_desc_;
+  // Maps the descriptor of each client that we are still reading from to the
+  // odd byte left over from its last read, if any (-1 if none).
+  std::map<int32, int32> clients_;
+  // The output that has not been written yet, for clients that have some.
+  std::map<int32, std::string> pending_output_;
+  // Clients for which writing failed.
+  std::set<int32> write_failed_;
+  // Clients for which Disconnect() was called while they had pending output.
+  std::set<int32> disconnecting_;
+};
+
+MultiClientServer::~MultiClientServer() {
+  for (std::map<int32, int32>::iterator iter = clients_.begin();
+       iter != clients_.end(); ++iter)
+    close(iter->first);
+  for (std::set<int32>::iterator iter = disconnecting_.begin();
+       iter != disconnecting_.end(); ++iter)
+    close(*iter);
+  if (server_desc_ != -1) {
+    close(server_desc_);
+    if (!unix_socket_.empty())
+      unlink(unix_socket_.c_str());
+  }
+}
+
+void MultiClientServer::Listen(int32 port, const std::string &unix_socket) {
+  unix_socket_ = unix_socket;
+  if (unix_socket.empty()) {
+    struct ::sockaddr_in h_addr;
+    memset(&h_addr, 0, sizeof(h_addr));
+    h_addr.sin_addr.s_addr = INADDR_ANY;
+    h_addr.sin_port = htons(port);
+    h_addr.sin_family = AF_INET;
+    server_desc_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_desc_ == -1)
+      KALDI_ERR << "Cannot create TCP socket!";
+    int32 flag = 1;
+    if (setsockopt(server_desc_, SOL_SOCKET, SO_REUSEADDR, &flag,
+                   sizeof(flag)) == -1)
+      KALDI_ERR << "Cannot set socket options!";
+    if (bind(server_desc_, (struct sockaddr *) &h_addr, sizeof(h_addr)) == -1)
+      KALDI_ERR << "Cannot bind to port: " << port << " (is it taken?)";
+  } else {
+    struct ::sockaddr_un u_addr;
+    memset(&u_addr, 0, sizeof(u_addr));
+    u_addr.sun_family = AF_UNIX;
+    if (unix_socket.size() >= sizeof(u_addr.sun_path))
+      KALDI_ERR << "Socket path is too long: " << unix_socket;
+    strncpy(u_addr.sun_path, unix_socket.c_str(), sizeof(u_addr.sun_path) - 1);
+    server_desc_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server_desc_ == -1)
+      KALDI_ERR << "Cannot create Unix-domain socket!";
+    unlink(unix_socket.c_str());
+    if (bind(server_desc_, (struct sockaddr *) &u_addr, sizeof(u_addr)) == -1)
+      KALDI_ERR << "Cannot bind to socket " << unix_socket;
+  }
+  if (listen(server_desc_, SOMAXCONN) == -1)
+    KALDI_ERR << "Cannot listen on socket!";
+  fcntl(server_desc_, F_SETFL, fcntl(server_desc_, F_GETFL) | O_NONBLOCK);
+  if (unix_socket.empty())
+    KALDI_LOG << "Listening on port: " << port;
+  else
+    KALDI_LOG << "Listening on socket: " << unix_socket;
+}
+
+void MultiClientServer::Poll(int32 timeout_ms,
+                             std::vector<int32> *new_clients,
+                             std::map<int32, std::vector<int16> > *audio,
+                             std::vector<int32> *closed_clients) {
+  std::vector<pollfd> fds(1);
+  fds[0].fd = server_desc_;
+  fds[0].events = POLLIN;
+  for (std::map<int32, int32>::iterator iter = clients_.begin();
+       iter != clients_.end(); ++iter) {
+    pollfd pfd;
+    pfd.fd = iter->first;
+    pfd.events = POLLIN;
+    if (pending_output_.count(iter->first) != 0)
+      pfd.events |= POLLOUT;
+    fds.push_back(pfd);
+  }
+  // Clients we no longer read from but that still have output to send.
+  for (std::map<int32, std::string>::iterator iter = pending_output_.begin();
+       iter != pending_output_.end(); ++iter) {
+    if (clients_.count(iter->first) == 0) {
+      pollfd pfd;
+      pfd.fd = iter->first;
+      pfd.events = POLLOUT;
+      fds.push_back(pfd);
+    }
+  }
+  int ret = poll(&(fds[0]), fds.size(), timeout_ms);
+  if (ret < 0) {
+    if (errno != EINTR)
+      KALDI_WARN << "Error in poll(): " << strerror(errno);
+    return;
+  }
+  std::vector<char> buf(65536);
+  for (size_t i = 1; i < fds.size(); i++) {
+    if (fds[i].revents == 0)
+      continue;
+    int32 fd = fds[i].fd;
+    if (pending_output_.count(fd) != 0)
+      FlushOutput(fd);
+    if (clients_.count(fd) == 0 ||
+        (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+      continue;
+    int32 &odd_byte = clients_[fd];
+    std::vector<int16> &samples = (*audio)[fd];
+    bool closed = false;
+    while (true) {
+      size_t offset = 0;
+      if (odd_byte != -1) {
+        buf[0] = static_cast<char>(odd_byte);
+        offset = 1;
+      }
+      ssize_t n = read(fd, &(buf[offset]), buf.size() - offset);
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        break;
+      if (n <= 0) {
+        closed = true;
+        break;
+      }
+      size_t num_bytes = offset + n, num_samples = num_bytes / 2;
+      odd_byte = (num_bytes % 2 == 1 ?
+                  static_cast<unsigned char>(buf[num_bytes - 1]) : -1);
+      size_t old_size = samples.size();
+      samples.resize(old_size + num_samples);
+      memcpy(&(samples[old_size]), &(buf[0]), num_samples * sizeof(int16));
+      if (static_cast<size_t>(n) < buf.size() - offset)
+        break;
+    }
+    if (closed) {
+      // We stop reading from it, but keep it open to send the results.
+      clients_.erase(fd);
+      closed_clients->push_back(fd);
+    }
+  }
+  if (fds[0].revents & POLLIN) {
+    while (true) {
+      int32 client = accept(server_desc_, NULL, NULL);
+      if (client == -1)
+        break;
+      fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+      clients_[client] = -1;
+      new_clients->push_back(client);
+    }
+  }
+}
+
+bool MultiClientServer::Write(int32 client, const std::string &msg) {
+  if (write_failed_.count(client) != 0)
+    return false;
+  std::string &output = pending_output_[client];
+  output += msg;
+  if (output.size() > kMaxPendingOutput) {
+    KALDI_WARN << "Connection " << client << " is not reading its output; "
+               << "discarding it.";
+    pending_output_.erase(client);
+    write_failed_.insert(client);
+    return false;
+  }
+  FlushOutput(client);
+  return write_failed_.count(client) == 0;
+}
+
+void MultiClientServer::FlushOutput(int32 client) {
+  std::map<int32, std::string>::iterator iter = pending_output_.find(client);
+  if (iter == pending_output_.end())
+    return;
+  std::string &output = iter->second;
+  size_t wrote = 0;
+  while (wrote < output.size()) {
+    ssize_t ret = write(client, output.data() + wrote, output.size() - wrote);
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;  // The rest is written when poll() says the client is ready.
+    if (ret <= 0) {
+      KALDI_WARN << "Error writing to connection " << client
+                 << "; discarding its output.";
+      write_failed_.insert(client);
+      wrote = output.size();
+      break;
+    }
+    wrote += ret;
+  }
+  output.erase(0, wrote);
+  if (output.empty()) {
+    pending_output_.erase(iter);
+    if (disconnecting_.erase(client) != 0)
+      CloseClient(client);
+  }
+}
+
+void MultiClientServer::Disconnect(int32 client) {
+  clients_.erase(client);
+  if (pending_output_.count(client) != 0)
+    disconnecting_.insert(client);  // FlushOutput() will close it.
+  else
+    CloseClient(client);
+}
+
+void MultiClientServer::CloseClient(int32 client) {
+  close(client);
+  write_failed_.erase(client);
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Reads in audio from any number of concurrent connections to a network\n"
+        "socket and performs online decoding with neural nets (nnet3 setup),\n"
+        "with iVector-based speaker adaptation and endpointing.  Unlike\n"
+        "online2-tcp-nnet3-decode-faster, the streams are decoded together:\n"
+        "the neural net is evaluated on batches of chunks from all streams,\n"
+        "and the decoding of the streams is spread over --num-threads threads.\n"
+        "The protocol is the same as online2-tcp-nnet3-decode-faster's.\n"
+        "The chunks are computed independently rather than looped, so for\n"
+        "recurrent models (e.g. LSTMs) the output is an approximation that\n"
+        "depends on --extra-left-context; see\n"
+        "online2-wav-nnet3-multistream-compare.\n"
+        "Note: some configuration values and inputs are set via config\n"
+        "files whose filenames are passed as options\n"
+        "\n"
+        "Usage: online2-tcp-nnet3-decode-multistream [options] <nnet3-in> "
+        "<fst-in> <word-symbol-table>\n";
+
+    ParseOptions po(usage);
+
+    // feature_opts includes configuration for the iVector adaptation,
+    // as well as the basic features.
+    OnlineNnet2FeaturePipelineConfig feature_opts;
+    MultiStreamNnet3DecoderConfig decoder_config;
+    OnlineEndpointConfig endpoint_opts;
+
+    BaseFloat chunk_length_secs = 0.18;
+    BaseFloat output_period = 1;
+    BaseFloat samp_freq = 16000.0;
+    BaseFloat stats_period = 60.0;
+    int port_num = 5050;
+    std::string unix_socket;
+    bool produce_time = false;
+
+    po.Register("samp-freq", &samp_freq,
+                "Sampling frequency of the input signal (coded as 16-bit slinear).");
+    po.Register("chunk-length", &chunk_length_secs,
+                "Maximum time in seconds that we wait for more audio before "
+                "decoding what we have.");
+    po.Register("output-period", &output_period,
+                "How often in seconds, do we check for changes in output.");
+    po.Register("stats-period", &stats_period,
+                "How often in seconds we print diagnostics (throughput and "
+                "latency); if <= 0, only at the end.");
+    po.Register("num-threads-startup", &g_num_threads,
+                "Number of threads used when initializing iVector extractor.");
+    po.Register("port-num", &port_num,
+                "Port number the server will listen on.");
+    po.Register("unix-socket", &unix_socket,
+                "If set, listen on a Unix-domain socket with this path "
+                "instead of on a TCP port.");
+    po.Register("produce-time", &produce_time,
+                "Prepend begin/end times between endpoints (e.g. '5.46 6.81 <text_output>', in seconds)");
+
+    feature_opts.Register(&po);
+    decoder_config.Register(&po);
+    endpoint_opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      return 1;
+    }
+
+    std::string nnet3_rxfilename = po.GetArg(1),
+        fst_rxfilename = po.GetArg(2),
+        word_syms_filename = po.GetArg(3);
+
+    OnlineNnet2FeaturePipelineInfo feature_info(feature_opts);
+
+    BaseFloat frame_shift = feature_info.FrameShiftInSeconds();
+    int32 frame_subsampling =
+        decoder_config.compute_opts.frame_subsampling_factor;
+
+    KALDI_VLOG(1) << "Loading AM...";
+
+    TransitionModel trans_model;
+    nnet3::AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(nnet3_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      nnet3::CollapseModel(nnet3::CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    KALDI_VLOG(1) << "Loading FST...";
+
+    fst::Fst<fst::StdArc> *decode_fst = ReadFstKaldiGeneric(fst_rxfilename);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+      KALDI_ERR << "Could not read symbol table from file "
+                << word_syms_filename;
+
+    signal(SIGPIPE, SIG_IGN); // ignore SIGPIPE to avoid crashing when socket forcefully disconnected
+
+    MultiStreamNnet3Decoder decoder(decoder_config, feature_info, trans_model,
+                                    am_nnet, *decode_fst);
+
+    MultiClientServer server;
+    server.Listen(port_num, unix_socket);
+
+    // Maps from the client's descriptor to the stream id, and to the number
+    // of samples received since we last sent a partial result.
+    std::map<int32, int32> client_to_stream;
+    std::map<int32, int64> samples_since_output;
+    int64 check_period = static_cast<int64>(samp_freq * output_period);
+    int32 timeout_ms = static_cast<int32>(chunk_length_secs * 1000);
+
+    Timer stats_timer;
+    while (true) {
+      std::vector<int32> new_clients, closed_clients;
+      std::map<int32, std::vector<int16> > audio;
+      server.Poll(timeout_ms, &new_clients, &audio, &closed_clients);
+
+      for (size_t i = 0; i < new_clients.size(); i++) {
+        client_to_stream[new_clients[i]] = decoder.AddStream();
+        samples_since_output[new_clients[i]] = 0;
+        KALDI_LOG << "Accepted connection " << new_clients[i];
+      }
+      for (std::map<int32, std::vector<int16> >::iterator iter = audio.begin();
+           iter != audio.end(); ++iter) {
+        const std::vector<int16> &samples = iter->second;
+        if (samples.empty())
+          continue;
+        decoder.AcceptWaveform(client_to_stream[iter->first], samp_freq,
+                               &(samples[0]), samples.size());
+        samples_since_output[iter->first] += samples.size();
+      }
+      for (size_t i = 0; i < closed_clients.size(); i++)
+        decoder.InputFinished(client_to_stream[closed_clients[i]]);
+
+      decoder.Step();
+
+      std::vector<int32> finished_clients;
+      for (std::map<int32, int32>::iterator iter = client_to_stream.begin();
+           iter != client_to_stream.end(); ++iter) {
+        int32 client = iter->first, stream = iter->second,
+            frame_offset = decoder.FrameOffset(stream),
+            num_frames = decoder.NumFramesDecoded(stream);
+        bool finished = decoder.IsFinished(stream);
+        if (finished || (num_frames > 0 &&
+                         decoder.EndpointDetected(stream, endpoint_opts))) {
+          std::string msg;
+          if (num_frames > 0) {
+            decoder.FinalizeDecoding(stream);
+            CompactLattice lat;
+            decoder.GetLattice(stream, true, &lat);
+            msg = LatticeToString(lat, *word_syms);
+            // get time-span between endpoints,
+            if (produce_time)
+              msg = GetTimeString(frame_offset, frame_offset + num_frames,
+                                  frame_shift * frame_subsampling) + " " + msg;
+          }
+          KALDI_VLOG(1) << (finished ? "EndOfAudio" : "Endpoint")
+                        << ", sending message: " << msg;
+          server.Write(client, msg + "\n");
+          if (finished)
+            finished_clients.push_back(client);
+          else
+            decoder.RestartDecoding(stream);
+          samples_since_output[client] = 0;
+        } else if (samples_since_output[client] > check_period) {
+          if (num_frames > 0) {
+            Lattice lat;
+            decoder.GetBestPath(stream, false, &lat);
+            TopSort(&lat); // for LatticeStateTimes(),
+            std::string msg = LatticeToString(lat, *word_syms);
+
+            // get time-span after previous endpoint,
+            if (produce_time) {
+              int32 t_beg = frame_offset;
+              int32 t_end = frame_offset + GetLatticeTimeSpan(lat);
+              msg = GetTimeString(t_beg, t_end, frame_shift * frame_subsampling) + " " + msg;
+            }
+
+            KALDI_VLOG(1) << "Temporary transcript: " << msg;
+            server.Write(client, msg + "\r");
+          }
+          samples_since_output[client] -= check_period;
+        }
+      }
+      for (size_t i = 0; i < finished_clients.size(); i++) {
+        int32 client = finished_clients[i], stream = client_to_stream[client];
+        double avg_latency, max_latency;
+        decoder.GetLatency(stream, &avg_latency, &max_latency);
+        KALDI_LOG << "Connection " << client << " finished; latency was "
+                  << avg_latency << " seconds on average, " << max_latency
+                  << " at most.";
+        decoder.RemoveStream(stream);
+        server.Disconnect(client);
+        client_to_stream.erase(client);
+        samples_since_output.erase(client);
+      }
+      if (stats_period > 0 && stats_timer.Elapsed() > stats_period) {
+        decoder.PrintDiagnostics();
+        stats_timer.Reset();
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+} // main()
@@ -18,6 +18,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include "decoder/decoding-result-cache.h"
 #include "feat/wave-reader.h"
 #include "online2/online-nnet3-decoding.h"
 #include "online2/online-nnet2-feature-pipeline.h"
@@ -92,7 +93,9 @@ int main(int argc, char *argv[]) {
         "Usage: online2-wav-nnet3-latgen-faster [options] <nnet3-in> <fst-in> "
         "<spk2utt-rspecifier> <wav-rspecifier> <lattice-wspecifier>\n"
         "The spk2utt-rspecifier can just be <utterance-id> <utterance-id> if\n"
-        "you want to decode utterance by utterance.\n";
+        "you want to decode utterance by utterance.\n"
+        "With --result-cache-mb > 0, utterances with the same audio (and\n"
+        "speaker-adaptation state) as an earlier one are not decoded again.\n";
 
     ParseOptions po(usage);
 
@@ -104,6 +107,7 @@ int main(int argc, char *argv[]) {
     nnet3::NnetSimpleLoopedComputationOptions decodable_opts;
     LatticeFasterDecoderConfig decoder_opts;
     OnlineEndpointConfig endpoint_opts;
+    DecodingResultCacheOptions cache_opts;
 
     BaseFloat chunk_length_secs = 0.18;
     bool do_endpointing = false;
@@ -132,6 +136,7 @@ int main(int argc, char *argv[]) {
     decodable_opts.Register(&po);
     decoder_opts.Register(&po);
     endpoint_opts.Register(&po);
+    cache_opts.Register(&po);
 
 
     po.Read(argc, argv);
@@ -180,6 +185,34 @@ int main(int argc, char *argv[]) {
 
     fst::Fst<fst::StdArc> *decode_fst = ReadFstKaldiGeneric(fst_rxfilename);
 
+    // The results also depend on the files named by the feature options,
+    // including those named in the iVector extraction config, so the cache
+    // identity covers their contents.
+    std::vector<std::string> cache_files;
+    if (cache_opts.cache_mb > 0) {
+      cache_files.push_back(feature_opts.mfcc_config);
+      cache_files.push_back(feature_opts.plp_config);
+      cache_files.push_back(feature_opts.fbank_config);
+      cache_files.push_back(feature_opts.cmvn_config);
+      cache_files.push_back(feature_opts.global_cmvn_stats_rxfilename);
+      cache_files.push_back(feature_opts.online_pitch_config);
+      cache_files.push_back(feature_opts.ivector_extraction_config);
+      if (feature_opts.ivector_extraction_config != "") {
+        OnlineIvectorExtractionConfig ivector_config;
+        ReadConfigFromFile(feature_opts.ivector_extraction_config,
+                           &ivector_config);
+        cache_files.push_back(ivector_config.lda_mat_rxfilename);
+        cache_files.push_back(ivector_config.global_cmvn_stats_rxfilename);
+        cache_files.push_back(ivector_config.splice_config_rxfilename);
+        cache_files.push_back(ivector_config.cmvn_config_rxfilename);
+        cache_files.push_back(ivector_config.diag_ubm_rxfilename);
+        cache_files.push_back(ivector_config.ivector_extractor_rxfilename);
+      }
+    }
+    DecodingResultCache cache(
+        cache_opts, GetDecodingResultCacheIdentity(
+            cache_opts, &po, trans_model, am_nnet, *decode_fst, cache_files));
+
     fst::SymbolTable *word_syms = NULL;
     if (word_syms_rxfilename != "")
       if (!(word_syms = fst::SymbolTable::ReadText(word_syms_rxfilename)))
@@ -216,6 +249,34 @@ int main(int argc, char *argv[]) {
         // take the first channel).
         SubVector<BaseFloat> data(wave_data.Data(), 0);
 
+        // The result also depends on the adaptation state from previous
+        // utterances of the speaker, so that is part of the key, and the
+        // state after the utterance is stored with the result.
+        DecodingResultKey cache_key;
+        if (cache.Enabled()) {
+          std::ostringstream state;
+          adaptation_state.Write(state, true);
+          cmvn_state.Write(state, true);
+          cache_key = cache.Key(data, wave_data.SampFreq(), state.str());
+          DecodingResult result;
+          if (cache.Lookup(cache_key, &result)) {
+            CompactLattice clat;
+            result.GetLattice(&clat);
+            GetDiagnosticsAndPrintOutput(utt, word_syms, clat,
+                                         &num_frames, &tot_like);
+            std::istringstream new_state(result.extra);
+            adaptation_state.Read(new_state, true);
+            cmvn_state.Read(new_state, true);
+            ScaleLattice(
+                AcousticLatticeScale(1.0 / decodable_opts.acoustic_scale),
+                &clat);
+            clat_writer.Write(utt, clat);
+            KALDI_LOG << "Decoded utterance " << utt << " (from result cache)";
+            num_done++;
+            continue;
+          }
+        }
+
         OnlineNnet2FeaturePipeline feature_pipeline(feature_info);
         feature_pipeline.SetAdaptationState(adaptation_state);
         feature_pipeline.SetCmvnState(cmvn_state);
@@ -287,6 +348,16 @@ int main(int argc, char *argv[]) {
         feature_pipeline.GetAdaptationState(&adaptation_state);
         feature_pipeline.GetCmvnState(&cmvn_state);
 
+        if (cache.Enabled()) {
+          DecodingResult result;
+          result.SetLattice(clat);
+          std::ostringstream new_state;
+          adaptation_state.Write(new_state, true);
+          cmvn_state.Write(new_state, true);
+          result.extra = new_state.str();
+          cache.Insert(cache_key, result);
+        }
+
         // we want to output the lattice with un-scaled acoustics.
         BaseFloat inv_acoustic_scale =
             1.0 / decodable_opts.acoustic_scale;
@@ -298,6 +369,8 @@ int main(int argc, char *argv[]) {
       }
     }
     timing_stats.Print(online);
+    cache.PrintStats();
+    cache.Save();
 
     KALDI_LOG << "Decoded " << num_done << " utterances, "
               << num_err << " with errors.";
@@ -110,6 +110,7 @@ int main(int argc, char *argv[]) {
     BaseFloat chunk_length_secs = 0.18;
     bool do_endpointing = false;
     bool online = true;
+    BaseFloat grammar_precompute_mb = 0.0;
 
     po.Register("chunk-length", &chunk_length_secs,
                 "Length of chunk size in seconds, that we process.  Set to <= 0 "
@@ -129,6 +130,11 @@ int main(int argc, char *argv[]) {
                 "--chunk-length=-1.");
     po.Register("num-threads-startup", &g_num_threads,
                 "Number of threads used when initializing iVector extractor.");
+    po.Register("grammar-precompute-mb", &grammar_precompute_mb,
+                "If >0, precompute the expanded states of the GrammarFst in "
+                "contiguous arrays at startup, using up to this many MB of "
+                "memory; this avoids hash lookups during decoding, which "
+                "helps speed with grammars that have many sub-FSTs.");
 
     feature_opts.Register(&po);
     decodable_opts.Register(&po);
@@ -182,6 +188,9 @@ int main(int argc, char *argv[]) {
 
     fst::GrammarFst fst;
     ReadKaldiObject(fst_rxfilename, &fst);
+    if (grammar_precompute_mb > 0.0)
+      fst.PrecomputeExpandedStates(
+          static_cast<size_t>(grammar_precompute_mb * 1048576));
 
     fst::SymbolTable *word_syms = NULL;
     if (word_syms_rxfilename != "")
@@ -17,6 +17,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include "base/timer.h"
 #include "feat/wave-reader.h"
 #include "online2/online-nnet3-incremental-decoding.h"
 #include "online2/online-nnet2-feature-pipeline.h"
@@ -185,6 +186,11 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_err = 0;
     double tot_like = 0.0;
+    // For the statistics of the time taken by AdvanceDecoding(), which
+    // includes the lattice determinization unless it is done in the
+    // background (--determinize-in-background).
+    double tot_advance_secs = 0.0, max_advance_secs = 0.0;
+    int64 num_advance_calls = 0;
     int64 num_frames = 0;
 
     SequentialTokenVectorReader spk2utt_reader(spk2utt_rspecifier);
@@ -258,7 +264,12 @@ int main(int argc, char *argv[]) {
             feature_pipeline.IvectorFeature()->UpdateFrameWeights(delta_weights);
           }
 
+          Timer advance_timer;
           decoder.AdvanceDecoding();
+          double advance_secs = advance_timer.Elapsed();
+          tot_advance_secs += advance_secs;
+          max_advance_secs = std::max(max_advance_secs, advance_secs);
+          num_advance_calls++;
 
           if (do_endpointing && decoder.EndpointDetected(endpoint_opts)) {
             break;
@@ -291,6 +302,11 @@ int main(int argc, char *argv[]) {
       }
     }
     timing_stats.Print(online);
+    if (num_advance_calls > 0)
+      KALDI_LOG << "Time per call to AdvanceDecoding() was "
+                << (1000.0 * tot_advance_secs / num_advance_calls)
+                << " ms on average, " << (1000.0 * max_advance_secs)
+                << " ms at most.";
 
     KALDI_LOG << "Decoded " << num_done << " utterances, "
               << num_err << " with errors.";
@@ -0,0 +1,285 @@
+// online2bin/online2-wav-nnet3-multistream-compare.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/timer.h"
+#include "feat/wave-reader.h"
+#include "online2/online-nnet3-decoding.h"
+#include "online2/online-nnet3-multistream-decoding.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "fstext/fstext-lib.h"
+#include "lat/lattice-functions.h"
+#include "util/edit-distance.h"
+#include "util/kaldi-thread.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+
+void GetWords(const Lattice &best_path, std::vector<int32> *words) {
+  std::vector<int32> alignment;
+  LatticeWeight weight;
+  fst::GetLinearSymbolSequence(best_path, &alignment, words, &weight);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Compares MultiStreamNnet3Decoder (as used by\n"
+        "online2-tcp-nnet3-decode-multistream) with SingleUtteranceNnet3Decoder\n"
+        "(as used by online2-wav-nnet3-latgen-faster) on the same audio.\n"
+        "Each utterance is decoded as a separate stream, with no speaker\n"
+        "adaptation carried over between utterances.  The audio is first\n"
+        "decoded one utterance at a time with SingleUtteranceNnet3Decoder,\n"
+        "using a looped computation, and then with --num-streams concurrent\n"
+        "streams in MultiStreamNnet3Decoder, which computes the chunks\n"
+        "independently in batches.  Both are run as fast as possible, and the\n"
+        "streams per core (seconds of audio per second of processing per\n"
+        "thread) are printed, together with the number of utterances whose\n"
+        "best paths differ and the word difference rate between them.  For\n"
+        "feedforward models the outputs should be the same; for recurrent\n"
+        "models the differences show the effect of --extra-left-context.\n"
+        "\n"
+        "Usage: online2-wav-nnet3-multistream-compare [options] <nnet3-in> "
+        "<fst-in> <wav-rspecifier>\n"
+        "e.g.: online2-wav-nnet3-multistream-compare --num-streams=50 \\\n"
+        "  --num-threads=4 --config=online.conf final.mdl HCLG.fst "
+        "scp:wav.scp\n";
+
+    ParseOptions po(usage);
+
+    OnlineNnet2FeaturePipelineConfig feature_opts;
+    MultiStreamNnet3DecoderConfig multistream_config;
+
+    BaseFloat chunk_length_secs = 0.18;
+    int32 num_streams = 20;
+
+    po.Register("chunk-length", &chunk_length_secs,
+                "Length of the pieces of audio, in seconds, that are given to "
+                "the decoders at a time.");
+    po.Register("num-streams", &num_streams,
+                "Number of utterances decoded concurrently by "
+                "MultiStreamNnet3Decoder.");
+    po.Register("num-threads-startup", &g_num_threads,
+                "Number of threads used when initializing iVector extractor.");
+
+    feature_opts.Register(&po);
+    multistream_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      return 1;
+    }
+    if (chunk_length_secs <= 0 || num_streams < 1)
+      KALDI_ERR << "Invalid options";
+
+    std::string nnet3_rxfilename = po.GetArg(1),
+        fst_rxfilename = po.GetArg(2),
+        wav_rspecifier = po.GetArg(3);
+
+    OnlineNnet2FeaturePipelineInfo feature_info(feature_opts);
+
+    TransitionModel trans_model;
+    nnet3::AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(nnet3_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      nnet3::CollapseModel(nnet3::CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    // The options that both decoders have are taken from those of
+    // MultiStreamNnet3Decoder, so that they are the same.
+    const nnet3::NnetBatchComputerOptions &compute_opts =
+        multistream_config.compute_opts;
+    nnet3::NnetSimpleLoopedComputationOptions decodable_opts;
+    decodable_opts.extra_left_context_initial =
+        compute_opts.extra_left_context_initial;
+    decodable_opts.frame_subsampling_factor =
+        compute_opts.frame_subsampling_factor;
+    decodable_opts.frames_per_chunk = compute_opts.frames_per_chunk;
+    decodable_opts.acoustic_scale = compute_opts.acoustic_scale;
+    // DecodableNnetSimpleLoopedInfo may modify the nnet, so it gets a copy.
+    nnet3::AmNnetSimple looped_am_nnet(am_nnet);
+    nnet3::DecodableNnetSimpleLoopedInfo decodable_info(decodable_opts,
+                                                        &looped_am_nnet);
+
+    fst::Fst<fst::StdArc> *decode_fst = ReadFstKaldiGeneric(fst_rxfilename);
+
+    std::vector<std::string> utts;
+    std::vector<Vector<BaseFloat> > waves;
+    std::vector<BaseFloat> samp_freqs;
+    double tot_audio_seconds = 0.0;
+    SequentialTableReader<WaveHolder> wav_reader(wav_rspecifier);
+    for (; !wav_reader.Done(); wav_reader.Next()) {
+      const WaveData &wave_data = wav_reader.Value();
+      if (wave_data.Data().NumCols() == 0) {
+        KALDI_WARN << "Empty audio for utterance " << wav_reader.Key();
+        continue;
+      }
+      utts.push_back(wav_reader.Key());
+      // We only take the first channel.
+      waves.push_back(Vector<BaseFloat>(wave_data.Data().Row(0)));
+      samp_freqs.push_back(wave_data.SampFreq());
+      tot_audio_seconds += wave_data.Duration();
+    }
+    int32 num_utts = utts.size();
+    if (num_utts == 0)
+      KALDI_ERR << "No audio was read from " << wav_rspecifier;
+
+    // Decode with SingleUtteranceNnet3Decoder, one utterance at a time.
+    std::vector<std::vector<int32> > single_words(num_utts);
+    Timer single_timer;
+    for (int32 u = 0; u < num_utts; u++) {
+      OnlineNnet2FeaturePipeline feature_pipeline(feature_info);
+      OnlineSilenceWeighting silence_weighting(
+          trans_model, feature_info.silence_weighting_config,
+          decodable_opts.frame_subsampling_factor);
+      SingleUtteranceNnet3Decoder decoder(multistream_config.decoder_opts,
+                                          trans_model, decodable_info,
+                                          *decode_fst, &feature_pipeline);
+      const Vector<BaseFloat> &data = waves[u];
+      BaseFloat samp_freq = samp_freqs[u];
+      int32 chunk_length = std::max<int32>(1, samp_freq * chunk_length_secs),
+          samp_offset = 0;
+      std::vector<std::pair<int32, BaseFloat> > delta_weights;
+      while (samp_offset < data.Dim()) {
+        int32 num_samp = std::min(chunk_length, data.Dim() - samp_offset);
+        feature_pipeline.AcceptWaveform(samp_freq,
+                                        data.Range(samp_offset, num_samp));
+        samp_offset += num_samp;
+        if (samp_offset == data.Dim())
+          feature_pipeline.InputFinished();
+        if (silence_weighting.Active() &&
+            feature_pipeline.IvectorFeature() != NULL) {
+          silence_weighting.ComputeCurrentTraceback(decoder.Decoder());
+          silence_weighting.GetDeltaWeights(feature_pipeline.NumFramesReady(),
+                                            &delta_weights);
+          feature_pipeline.IvectorFeature()->UpdateFrameWeights(delta_weights);
+        }
+        decoder.AdvanceDecoding();
+      }
+      decoder.FinalizeDecoding();
+      if (decoder.NumFramesDecoded() > 0) {
+        Lattice best_path;
+        decoder.GetBestPath(true, &best_path);
+        GetWords(best_path, &(single_words[u]));
+      }
+    }
+    double single_seconds = single_timer.Elapsed();
+
+    // Decode with MultiStreamNnet3Decoder, keeping --num-streams utterances
+    // in progress; each Step() gets the next piece of audio of every stream.
+    std::vector<std::vector<int32> > multistream_words(num_utts);
+    Timer multistream_timer;
+    {
+      MultiStreamNnet3Decoder decoder(multistream_config, feature_info,
+                                      trans_model, am_nnet, *decode_fst);
+      // Maps stream-id to (utterance index, samples given so far).
+      std::unordered_map<int32, std::pair<int32, int32> > active;
+      int32 next_utt = 0;
+      while (next_utt < num_utts || !active.empty()) {
+        while (static_cast<int32>(active.size()) < num_streams &&
+               next_utt < num_utts)
+          active[decoder.AddStream()] = std::make_pair(next_utt++, 0);
+        std::vector<int32> stream_ids;
+        for (std::unordered_map<int32, std::pair<int32, int32> >::iterator
+                 iter = active.begin(); iter != active.end(); ++iter) {
+          int32 stream_id = iter->first, u = iter->second.first,
+              &samp_offset = iter->second.second;
+          const Vector<BaseFloat> &data = waves[u];
+          stream_ids.push_back(stream_id);
+          if (samp_offset == data.Dim())
+            continue;
+          int32 chunk_length = std::max<int32>(
+              1, samp_freqs[u] * chunk_length_secs),
+              num_samp = std::min(chunk_length, data.Dim() - samp_offset);
+          decoder.AcceptWaveform(stream_id, samp_freqs[u],
+                                 data.Range(samp_offset, num_samp));
+          samp_offset += num_samp;
+          if (samp_offset == data.Dim())
+            decoder.InputFinished(stream_id);
+        }
+        decoder.Step();
+        for (size_t i = 0; i < stream_ids.size(); i++) {
+          int32 stream_id = stream_ids[i];
+          if (!decoder.IsFinished(stream_id))
+            continue;
+          decoder.FinalizeDecoding(stream_id);
+          if (decoder.NumFramesDecoded(stream_id) > 0) {
+            Lattice best_path;
+            decoder.GetBestPath(stream_id, true, &best_path);
+            GetWords(best_path, &(multistream_words[active[stream_id].first]));
+          }
+          decoder.RemoveStream(stream_id);
+          active.erase(stream_id);
+        }
+      }
+      decoder.PrintDiagnostics();
+    }
+    double multistream_seconds = multistream_timer.Elapsed();
+
+    int32 num_different = 0;
+    int64 num_words = 0, num_word_errors = 0;
+    for (int32 u = 0; u < num_utts; u++) {
+      if (single_words[u] != multistream_words[u]) {
+        num_different++;
+        KALDI_VLOG(1) << "The best paths differ for utterance " << utts[u];
+      }
+      num_words += single_words[u].size();
+      num_word_errors += LevenshteinEditDistance(single_words[u],
+                                                 multistream_words[u]);
+    }
+
+    int32 num_threads = std::max<int32>(1, multistream_config.num_threads);
+    double single_streams_per_core = tot_audio_seconds / single_seconds,
+        multistream_streams_per_core = tot_audio_seconds /
+        (multistream_seconds * num_threads);
+    KALDI_LOG << "Decoded " << num_utts << " utterances ("
+              << tot_audio_seconds << " seconds of audio).";
+    KALDI_LOG << "SingleUtteranceNnet3Decoder: " << single_seconds
+              << " seconds with 1 thread, " << single_streams_per_core
+              << " streams per core.";
+    KALDI_LOG << "MultiStreamNnet3Decoder: " << multistream_seconds
+              << " seconds with " << num_threads << " thread(s) and "
+              << num_streams << " concurrent streams, "
+              << multistream_streams_per_core << " streams per core ("
+              << (multistream_streams_per_core / single_streams_per_core)
+              << " times as many).";
+    KALDI_LOG << "The best paths differ for " << num_different << " out of "
+              << num_utts << " utterances; word difference rate (taking "
+              << "SingleUtteranceNnet3Decoder as the reference) is "
+              << (100.0 * num_word_errors / std::max<int64>(1, num_words))
+              << "% (" << num_word_errors << " / " << num_words << ").";
+    delete decode_fst;
+    return 0;
+  } catch(const std::exception& e) {
+    std::cerr << e.what();
+    return -1;
+  }
+} // main()
@@ -0,0 +1,337 @@
+// online2bin/online2-wav-nnet3-partial-latency.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iomanip>
+
+#include "base/timer.h"
+#include "feat/wave-reader.h"
+#include "online2/online-nnet3-decoding.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "online2/onlinebin-util.h"
+#include "fstext/fstext-lib.h"
+#include "lat/lattice-functions.h"
+#include "util/kaldi-thread.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+
+// Accumulates the time taken by the partial-result requests, binned by the
+// length of the stream (in seconds) at the time of the request.
+class PartialLatencyStats {
+ public:
+  PartialLatencyStats(BaseFloat bin_length): bin_length_(bin_length) { }
+
+  void Add(double stream_seconds, double result_seconds,
+           double partial_lattice_seconds, double full_lattice_seconds) {
+    size_t bin = static_cast<size_t>(stream_seconds / bin_length_);
+    if (bin >= bins_.size())
+      bins_.resize(bin + 1);
+    Bin &b = bins_[bin];
+    b.count++;
+    b.tot_result += result_seconds;
+    b.max_result = std::max(b.max_result, result_seconds);
+    b.tot_partial_lattice += partial_lattice_seconds;
+    b.max_partial_lattice = std::max(b.max_partial_lattice,
+                                     partial_lattice_seconds);
+    b.tot_full_lattice += full_lattice_seconds;
+  }
+
+  void Print(bool full_lattice) const {
+    std::ostringstream os;
+    os << "Latency of partial-result requests (ms) vs. stream length:\n"
+       << std::setw(16) << "stream-secs" << std::setw(10) << "count"
+       << std::setw(12) << "result" << std::setw(12) << "max"
+       << std::setw(12) << "lattice" << std::setw(12) << "max";
+    if (full_lattice)
+      os << std::setw(14) << "full-lattice";
+    os << '\n' << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < bins_.size(); i++) {
+      const Bin &b = bins_[i];
+      if (b.count == 0)
+        continue;
+      std::ostringstream range;
+      range << (i * bin_length_) << '-' << ((i + 1) * bin_length_);
+      os << std::setw(16) << range.str() << std::setw(10) << b.count
+         << std::setw(12) << (1000.0 * b.tot_result / b.count)
+         << std::setw(12) << (1000.0 * b.max_result)
+         << std::setw(12) << (1000.0 * b.tot_partial_lattice / b.count)
+         << std::setw(12) << (1000.0 * b.max_partial_lattice);
+      if (full_lattice)
+        os << std::setw(14) << (1000.0 * b.tot_full_lattice / b.count);
+      os << '\n';
+    }
+    KALDI_LOG << os.str();
+  }
+
+ private:
+  struct Bin {
+    int64 count;
+    double tot_result, max_result;
+    double tot_partial_lattice, max_partial_lattice;
+    double tot_full_lattice;
+    Bin(): count(0), tot_result(0.0), max_result(0.0),
+           tot_partial_lattice(0.0), max_partial_lattice(0.0),
+           tot_full_lattice(0.0) { }
+  };
+  BaseFloat bin_length_;
+  std::vector<Bin> bins_;
+};
+
+void PrintWords(const std::string &utt, const fst::SymbolTable *word_syms,
+                const std::vector<int32> &words) {
+  if (word_syms == NULL)
+    return;
+  std::cerr << utt << ' ';
+  for (size_t i = 0; i < words.size(); i++) {
+    std::string s = word_syms->Find(words[i]);
+    if (s == "")
+      KALDI_ERR << "Word-id " << words[i] << " not in symbol table.";
+    std::cerr << s << ' ';
+  }
+  std::cerr << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Benchmarks the latency of partial results in online decoding with\n"
+        "neural nets (nnet3 setup) as a function of the length of the stream.\n"
+        "The audio of each utterance is decoded (repeated --num-repeats times,\n"
+        "to simulate long streams) and every --partial-period seconds of audio\n"
+        "the partial word sequence and the incrementally determinized partial\n"
+        "lattice are requested and timed, and optionally (for comparison) the\n"
+        "lattice as given by GetLattice(), which re-determinizes everything.\n"
+        "The final lattices are written out.\n"
+        "\n"
+        "Usage: online2-wav-nnet3-partial-latency [options] <nnet3-in> <fst-in> "
+        "<spk2utt-rspecifier> <wav-rspecifier> <lattice-wspecifier>\n"
+        "e.g.: online2-wav-nnet3-partial-latency --num-repeats=20 \\\n"
+        "  --config=online.conf final.mdl HCLG.fst ark:spk2utt scp:wav.scp "
+        "ark:/dev/null\n";
+
+    ParseOptions po(usage);
+
+    std::string word_syms_rxfilename;
+
+    OnlineNnet2FeaturePipelineConfig feature_opts;
+    nnet3::NnetSimpleLoopedComputationOptions decodable_opts;
+    LatticeFasterDecoderConfig decoder_opts;
+
+    BaseFloat chunk_length_secs = 0.18,
+        partial_period_secs = 1.0,
+        bin_length_secs = 10.0;
+    int32 num_repeats = 1;
+    bool full_lattice = true;
+
+    po.Register("chunk-length", &chunk_length_secs,
+                "Length of chunk size in seconds, that we process.");
+    po.Register("partial-period", &partial_period_secs,
+                "Interval in seconds of audio between requests for partial "
+                "results.");
+    po.Register("bin-length", &bin_length_secs,
+                "The latencies are reported separately for each interval of "
+                "this many seconds of stream length.");
+    po.Register("num-repeats", &num_repeats,
+                "Number of times the audio of each utterance is repeated, to "
+                "simulate long streams.");
+    po.Register("full-lattice", &full_lattice,
+                "If true, also time the non-incremental GetLattice() at each "
+                "request, for comparison (this gets slow for long streams).");
+    po.Register("word-symbol-table", &word_syms_rxfilename,
+                "Symbol table for words [for debug output]");
+    po.Register("num-threads-startup", &g_num_threads,
+                "Number of threads used when initializing iVector extractor.");
+
+    feature_opts.Register(&po);
+    decodable_opts.Register(&po);
+    decoder_opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 5) {
+      po.PrintUsage();
+      return 1;
+    }
+    if (chunk_length_secs <= 0 || partial_period_secs <= 0 ||
+        bin_length_secs <= 0 || num_repeats < 1)
+      KALDI_ERR << "Invalid options";
+
+    std::string nnet3_rxfilename = po.GetArg(1),
+        fst_rxfilename = po.GetArg(2),
+        spk2utt_rspecifier = po.GetArg(3),
+        wav_rspecifier = po.GetArg(4),
+        clat_wspecifier = po.GetArg(5);
+
+    OnlineNnet2FeaturePipelineInfo feature_info(feature_opts);
+
+    Matrix<double> global_cmvn_stats;
+    if (feature_info.global_cmvn_stats_rxfilename != "")
+      ReadKaldiObject(feature_info.global_cmvn_stats_rxfilename,
+                      &global_cmvn_stats);
+
+    TransitionModel trans_model;
+    nnet3::AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(nnet3_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      nnet3::CollapseModel(nnet3::CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    nnet3::DecodableNnetSimpleLoopedInfo decodable_info(decodable_opts,
+                                                        &am_nnet);
+
+    fst::Fst<fst::StdArc> *decode_fst = ReadFstKaldiGeneric(fst_rxfilename);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_rxfilename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_rxfilename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                  << word_syms_rxfilename;
+
+    int32 num_done = 0, num_err = 0;
+    PartialLatencyStats stats(bin_length_secs);
+
+    SequentialTokenVectorReader spk2utt_reader(spk2utt_rspecifier);
+    RandomAccessTableReader<WaveHolder> wav_reader(wav_rspecifier);
+    CompactLatticeWriter clat_writer(clat_wspecifier);
+
+    for (; !spk2utt_reader.Done(); spk2utt_reader.Next()) {
+      std::string spk = spk2utt_reader.Key();
+      const std::vector<std::string> &uttlist = spk2utt_reader.Value();
+
+      OnlineIvectorExtractorAdaptationState adaptation_state(
+          feature_info.ivector_extractor_info);
+      OnlineCmvnState cmvn_state(global_cmvn_stats);
+
+      for (size_t i = 0; i < uttlist.size(); i++) {
+        std::string utt = uttlist[i];
+        if (!wav_reader.HasKey(utt)) {
+          KALDI_WARN << "Did not find audio for utterance " << utt;
+          num_err++;
+          continue;
+        }
+        const WaveData &wave_data = wav_reader.Value(utt);
+        SubVector<BaseFloat> data(wave_data.Data(), 0);
+
+        OnlineNnet2FeaturePipeline feature_pipeline(feature_info);
+        feature_pipeline.SetAdaptationState(adaptation_state);
+        feature_pipeline.SetCmvnState(cmvn_state);
+
+        OnlineSilenceWeighting silence_weighting(
+            trans_model,
+            feature_info.silence_weighting_config,
+            decodable_opts.frame_subsampling_factor);
+
+        SingleUtteranceNnet3Decoder decoder(decoder_opts, trans_model,
+                                            decodable_info,
+                                            *decode_fst, &feature_pipeline);
+
+        BaseFloat samp_freq = wave_data.SampFreq();
+        int32 chunk_length = std::max<int32>(1, samp_freq * chunk_length_secs);
+        int64 tot_samples = static_cast<int64>(data.Dim()) * num_repeats,
+            samp_offset = 0;
+        double next_partial_secs = partial_period_secs;
+        std::vector<std::pair<int32, BaseFloat> > delta_weights;
+
+        while (samp_offset < tot_samples) {
+          int32 pos = samp_offset % data.Dim(),
+              num_samp = std::min<int64>(chunk_length, data.Dim() - pos);
+          SubVector<BaseFloat> wave_part(data, pos, num_samp);
+          feature_pipeline.AcceptWaveform(samp_freq, wave_part);
+          samp_offset += num_samp;
+          if (samp_offset == tot_samples)
+            feature_pipeline.InputFinished();
+
+          if (silence_weighting.Active() &&
+              feature_pipeline.IvectorFeature() != NULL) {
+            silence_weighting.ComputeCurrentTraceback(decoder.Decoder());
+            silence_weighting.GetDeltaWeights(feature_pipeline.NumFramesReady(),
+                                              &delta_weights);
+            feature_pipeline.IvectorFeature()->UpdateFrameWeights(delta_weights);
+          }
+
+          decoder.AdvanceDecoding();
+
+          double stream_secs = samp_offset / samp_freq;
+          if (stream_secs >= next_partial_secs &&
+              decoder.NumFramesDecoded() > 0) {
+            next_partial_secs += partial_period_secs;
+            bool end_of_utterance = false;
+            Timer timer;
+            decoder.GetPartialResult(end_of_utterance);
+            double result_secs = timer.Elapsed();
+            timer.Reset();
+            decoder.GetPartialLattice(end_of_utterance);
+            double partial_lattice_secs = timer.Elapsed(),
+                full_lattice_secs = 0.0;
+            if (full_lattice) {
+              timer.Reset();
+              CompactLattice clat;
+              decoder.GetLattice(end_of_utterance, &clat);
+              full_lattice_secs = timer.Elapsed();
+            }
+            stats.Add(stream_secs, result_secs, partial_lattice_secs,
+                      full_lattice_secs);
+          }
+        }
+        if (decoder.NumFramesDecoded() == 0) {
+          KALDI_WARN << "No frames decoded for utterance " << utt;
+          num_err++;
+          continue;
+        }
+        decoder.FinalizeDecoding();
+
+        bool end_of_utterance = true;
+        PrintWords(utt, word_syms, decoder.GetPartialResult(end_of_utterance));
+        CompactLattice clat(decoder.GetPartialLattice(end_of_utterance));
+
+        feature_pipeline.GetAdaptationState(&adaptation_state);
+        feature_pipeline.GetCmvnState(&cmvn_state);
+
+        BaseFloat inv_acoustic_scale =
+            1.0 / decodable_opts.acoustic_scale;
+        ScaleLattice(AcousticLatticeScale(inv_acoustic_scale), &clat);
+
+        clat_writer.Write(utt, clat);
+        KALDI_LOG << "Decoded utterance " << utt;
+        num_done++;
+      }
+    }
+    stats.Print(full_lattice);
+
+    KALDI_LOG << "Decoded " << num_done << " utterances, "
+              << num_err << " with errors.";
+    delete decode_fst;
+    delete word_syms; // will delete if non-NULL.
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception& e) {
+    std::cerr << e.what();
+    return -1;
+  }
+} // main()
@@ -76,15 +76,22 @@ RnnlmComputeState::RnnlmComputeState(const RnnlmComputeStateInfo &info,
     computer_(info_.opts.compute_config, info_.computation,
               info_.rnnlm, NULL),  // NULL is 'nnet_to_update'
     previous_word_(-1),
-    normalization_factor_(0.0) {
+    normalization_factor_(0.0),
+    predicted_word_embedding_(NULL) {
   AddWord(bos_index);
 }
 
 RnnlmComputeState::RnnlmComputeState(const RnnlmComputeState &other):
   info_(other.info_), computer_(other.computer_),
   previous_word_(other.previous_word_),
-  normalization_factor_(other.normalization_factor_)
-{}
+  normalization_factor_(other.normalization_factor_),
+  predicted_word_embedding_(NULL) {
+  // The output matrix now lives in our own copy of the computer; we need
+  // this so that a copied state (e.g. one returned from RnnlmStateCache) can
+  // be queried directly without first calling AddWord().
+  if (other.predicted_word_embedding_ != NULL)
+    predicted_word_embedding_ = &computer_.GetOutput("output");
+}
 
 RnnlmComputeState* RnnlmComputeState::GetSuccessorState(int32 next_word) const {
   RnnlmComputeState *ans = new RnnlmComputeState(*this);
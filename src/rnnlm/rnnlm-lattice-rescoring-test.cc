@@ -0,0 +1,143 @@
+// rnnlm/rnnlm-lattice-rescoring-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rnnlm/rnnlm-lattice-rescoring.h"
+#include "nnet3/nnet-nnet.h"
+
+namespace kaldi {
+namespace rnnlm {
+
+// Word 1 is <s> and word 2 is </s>; the other words are 3 .. kNumWords - 1.
+static const int32 kNumWords = 6, kEmbeddingDim = 8;
+
+// Gets a small recurrent neural net, so that the RNNLM state depends on the
+// whole history.
+static nnet3::Nnet *GetRecurrentNnet() {
+  std::ostringstream config_os;
+  config_os << "input-node name=input dim=" << kEmbeddingDim << std::endl;
+  config_os << "component name=affine1 type=AffineComponent input-dim="
+            << (2 * kEmbeddingDim) << " output-dim=" << kEmbeddingDim
+            << std::endl;
+  config_os << "component-node name=affine1 component=affine1 "
+            << "input=Append(input, IfDefined(Offset(tanh1, -1)))\n";
+  config_os << "component name=tanh1 type=TanhComponent dim="
+            << kEmbeddingDim << std::endl;
+  config_os << "component-node name=tanh1 component=tanh1 input=affine1\n";
+  config_os << "component name=affine2 type=AffineComponent input-dim="
+            << kEmbeddingDim << " output-dim=" << kEmbeddingDim << std::endl;
+  config_os << "component-node name=affine2 component=affine2 input=tanh1\n";
+  config_os << "output-node name=output input=affine2\n";
+  std::istringstream config_is(config_os.str());
+  nnet3::Nnet *nnet = new nnet3::Nnet();
+  nnet->ReadConfig(config_is);
+  return nnet;
+}
+
+// A 'lattice' here is just the list of its word sequences; we rescore it by
+// following them through 'rnnlm_fst' in order, as composition would, and get
+// the LM cost of each one.
+typedef std::vector<std::vector<int32> > TestLattice;
+
+static void RescoreLattice(const TestLattice &lat,
+                           KaldiRnnlmDeterministicFst *rnnlm_fst,
+                           std::vector<BaseFloat> *costs) {
+  costs->clear();
+  for (size_t i = 0; i < lat.size(); i++) {
+    fst::StdArc::StateId s = rnnlm_fst->Start();
+    BaseFloat cost = 0.0;
+    for (size_t j = 0; j < lat[i].size(); j++) {
+      fst::StdArc arc;
+      KALDI_ASSERT(rnnlm_fst->GetArc(s, lat[i][j], &arc));
+      cost += arc.weight.Value();
+      s = arc.nextstate;
+    }
+    cost += rnnlm_fst->Final(s).Value();
+    costs->push_back(cost);
+  }
+  rnnlm_fst->Clear();
+}
+
+// Tests that with an RnnlmStateCache, rescoring a set of lattices gives the
+// same scores in any order, and the same scores as without the cache, even
+// with max-ngram-order truncation.  The vocabulary is small so that many
+// truncated histories are reached from different longer ones.
+void UnitTestRnnlmStateCache() {
+  nnet3::Nnet *nnet = GetRecurrentNnet();
+  CuMatrix<BaseFloat> word_embedding_mat(kNumWords, kEmbeddingDim);
+  word_embedding_mat.SetRandn();
+  RnnlmComputeStateComputationOptions opts;
+  opts.bos_index = 1;
+  opts.eos_index = 2;
+  opts.normalize_probs = (RandInt(0, 1) == 0);
+  RnnlmComputeStateInfo info(opts, *nnet, word_embedding_mat);
+
+  std::vector<TestLattice> lats(RandInt(2, 6));
+  for (size_t i = 0; i < lats.size(); i++) {
+    lats[i].resize(RandInt(1, 5));
+    for (size_t j = 0; j < lats[i].size(); j++) {
+      lats[i][j].resize(RandInt(0, 8));
+      for (size_t k = 0; k < lats[i][j].size(); k++)
+        lats[i][j][k] = RandInt(3, kNumWords - 1);
+    }
+  }
+
+  int32 max_ngram_order = RandInt(0, 5);
+  RnnlmStateCacheOptions cache_opts;
+  cache_opts.cache_size = RandInt(1, 20);
+
+  // The scores without a cache.
+  std::vector<std::vector<BaseFloat> > ref_costs(lats.size());
+  {
+    KaldiRnnlmDeterministicFst rnnlm_fst(max_ngram_order, info);
+    for (size_t i = 0; i < lats.size(); i++)
+      RescoreLattice(lats[i], &rnnlm_fst, &(ref_costs[i]));
+  }
+
+  // With a cache, in the original order.
+  {
+    RnnlmStateCache cache(cache_opts);
+    KaldiRnnlmDeterministicFst rnnlm_fst(max_ngram_order, info, &cache);
+    for (size_t i = 0; i < lats.size(); i++) {
+      std::vector<BaseFloat> costs;
+      RescoreLattice(lats[i], &rnnlm_fst, &costs);
+      KALDI_ASSERT(costs == ref_costs[i]);
+    }
+  }
+
+  // With a cache, in reverse order.
+  {
+    RnnlmStateCache cache(cache_opts);
+    KaldiRnnlmDeterministicFst rnnlm_fst(max_ngram_order, info, &cache);
+    for (size_t i = lats.size(); i > 0; i--) {
+      std::vector<BaseFloat> costs;
+      RescoreLattice(lats[i - 1], &rnnlm_fst, &costs);
+      KALDI_ASSERT(costs == ref_costs[i - 1]);
+    }
+  }
+  delete nnet;
+}
+
+}  // namespace rnnlm
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++)
+    kaldi::rnnlm::UnitTestRnnlmStateCache();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -28,6 +28,55 @@
 namespace kaldi {
 namespace rnnlm {
 
+RnnlmStateCache::RnnlmStateCache(const RnnlmStateCacheOptions &opts):
+    opts_(opts), num_lookups_(0), num_hits_(0), num_evictions_(0) {
+  KALDI_ASSERT(opts_.cache_size > 0);
+}
+
+RnnlmStateCache::~RnnlmStateCache() {
+  for (ListType::iterator iter = lru_list_.begin();
+       iter != lru_list_.end(); ++iter)
+    delete iter->second;
+}
+
+RnnlmComputeState *RnnlmStateCache::Lookup(const std::vector<Label> &wseq) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  num_lookups_++;
+  MapType::iterator iter = map_.find(wseq);
+  if (iter == map_.end())
+    return NULL;
+  num_hits_++;
+  // Move the entry to the front of the LRU list; this does not invalidate the
+  // iterator stored in the map.
+  lru_list_.splice(lru_list_.begin(), lru_list_, iter->second);
+  return new RnnlmComputeState(*(iter->second->second));
+}
+
+void RnnlmStateCache::Insert(const std::vector<Label> &wseq,
+                             const RnnlmComputeState &state) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (map_.count(wseq) != 0)
+    return;  // Another thread may have inserted it in the meantime.
+  if (static_cast<int32>(lru_list_.size()) >= opts_.cache_size) {
+    map_.erase(lru_list_.back().first);
+    delete lru_list_.back().second;
+    lru_list_.pop_back();
+    num_evictions_++;
+  }
+  lru_list_.push_front(std::make_pair(wseq, new RnnlmComputeState(state)));
+  map_[wseq] = lru_list_.begin();
+}
+
+void RnnlmStateCache::PrintStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  KALDI_LOG << "RNNLM state cache: " << num_hits_ << " hits out of "
+            << num_lookups_ << " lookups (hit rate "
+            << (num_lookups_ == 0 ? 0.0 :
+                static_cast<double>(num_hits_) / num_lookups_)
+            << "), " << lru_list_.size() << " states cached (max "
+            << opts_.cache_size << "), " << num_evictions_ << " evictions.";
+}
+
 KaldiRnnlmDeterministicFst::~KaldiRnnlmDeterministicFst() {
   int32 size = state_to_rnnlm_state_.size();
   for (int32 i = 0; i < size; i++)
@@ -52,7 +101,8 @@ void KaldiRnnlmDeterministicFst::Clear() {
 }
 
 KaldiRnnlmDeterministicFst::KaldiRnnlmDeterministicFst(int32 max_ngram_order,
-    const RnnlmComputeStateInfo &info) {
+    const RnnlmComputeStateInfo &info, RnnlmStateCache *cache):
+    cache_(cache) {
   max_ngram_order_ = max_ngram_order;
   bos_index_ = info.opts.bos_index;
   eos_index_ = info.opts.eos_index;
@@ -103,7 +153,23 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
 
   // If the pair was just inserted, then also add it to state_to_* structures.
   if (result.second == true) {
-    RnnlmComputeState *rnnlm2 = rnnlm->GetSuccessorState(ilabel);
+    // A history of max_ngram_order_ - 1 words may have been truncated, and
+    // then its RNNLM state depends on which of the longer histories reached it
+    // first, i.e. on the order in which the lattices are rescored; so we only
+    // use the cache for shorter histories, which always start with <s> and
+    // whose states are therefore a function of the history alone.
+    bool use_cache = (cache_ != NULL &&
+                      (max_ngram_order_ <= 0 ||
+                       static_cast<int32>(word_seq.size()) + 1 <
+                       max_ngram_order_));
+    RnnlmComputeState *rnnlm2 = NULL;
+    if (use_cache)
+      rnnlm2 = cache_->Lookup(word_seq);
+    if (rnnlm2 == NULL) {
+      rnnlm2 = rnnlm->GetSuccessorState(ilabel);
+      if (use_cache)
+        cache_->Insert(word_seq, *rnnlm2);
+    }
     state_to_wseq_.push_back(word_seq);
     state_to_rnnlm_state_.push_back(rnnlm2);
   }
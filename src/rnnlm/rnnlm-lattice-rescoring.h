@@ -22,7 +22,10 @@
 #ifndef KALDI_RNNLM_RNNLM_LATTICE_RESCORING_H_
 #define KALDI_RNNLM_RNNLM_LATTICE_RESCORING_H_
 
+#include <list>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "base/kaldi-common.h"
@@ -33,6 +36,71 @@
 namespace kaldi {
 namespace rnnlm {
 
+struct RnnlmStateCacheOptions {
+  int32 cache_size;
+
+  RnnlmStateCacheOptions(): cache_size(0) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("state-cache-size", &cache_size, "If positive, the maximum "
+                   "number of RNNLM history states that are cached across "
+                   "lattices, keyed by the word history; lattices that share "
+                   "history prefixes then reuse the cached hidden states "
+                   "instead of recomputing them.  Only histories shorter than "
+                   "max-ngram-order - 1 words are cached.  If zero, no "
+                   "caching.");
+  }
+};
+
+/**
+   RnnlmStateCache is a bounded cache of RnnlmComputeState objects keyed by
+   word-history, intended to be shared by KaldiRnnlmDeterministicFst objects
+   across lattices (e.g. utterances that all start with BOS + a common
+   opener).  The keys are the word histories, starting with <s>.  If
+   max-ngram-order is positive, KaldiRnnlmDeterministicFst only caches
+   histories of fewer than max-ngram-order - 1 words: longer ones may have
+   been truncated, and the state stored for them would depend on the order in
+   which the lattices were rescored.  So using the cache does not change the
+   scores.
+
+   When full, the least recently used entry is evicted.  It is safe to call
+   Lookup() and Insert() from multiple threads.
+ */
+class RnnlmStateCache {
+ public:
+  typedef fst::StdArc::Label Label;
+
+  explicit RnnlmStateCache(const RnnlmStateCacheOptions &opts);
+  ~RnnlmStateCache();
+
+  /// If the history 'wseq' is in the cache, returns a newly allocated copy
+  /// of the cached state (owned by the caller); otherwise returns NULL.
+  RnnlmComputeState *Lookup(const std::vector<Label> &wseq);
+
+  /// Stores a copy of 'state' as the state for history 'wseq', unless it is
+  /// already present.  May evict the least recently used entry.
+  void Insert(const std::vector<Label> &wseq, const RnnlmComputeState &state);
+
+  /// Prints the hit rate and cache occupancy to the log.
+  void PrintStats() const;
+
+ private:
+  typedef std::list<std::pair<std::vector<Label>, RnnlmComputeState*> > ListType;
+  typedef unordered_map<std::vector<Label>, ListType::iterator,
+                        VectorHasher<Label> > MapType;
+
+  RnnlmStateCacheOptions opts_;
+  // Most recently used entries are at the front.  The pointers are owned here.
+  ListType lru_list_;
+  MapType map_;
+  int64 num_lookups_;
+  int64 num_hits_;
+  int64 num_evictions_;
+  mutable std::mutex mutex_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RnnlmStateCache);
+};
+
 class KaldiRnnlmDeterministicFst
     : public fst::DeterministicOnDemandFst<fst::StdArc> {
  public:
@@ -40,9 +108,12 @@ class KaldiRnnlmDeterministicFst
   typedef fst::StdArc::StateId StateId;
   typedef fst::StdArc::Label Label;
 
-  // Does not take ownership.
+  // Does not take ownership of 'info' or 'cache'.  If 'cache' is non-NULL, new
+  // history states are looked up in it before being computed, and stored in
+  // it afterwards; it persists across calls to Clear().
   KaldiRnnlmDeterministicFst(int32 max_ngram_order,
-      const RnnlmComputeStateInfo &info);
+      const RnnlmComputeStateInfo &info,
+      RnnlmStateCache *cache = NULL);
   ~KaldiRnnlmDeterministicFst();
 
   void Clear();
@@ -64,6 +135,7 @@ class KaldiRnnlmDeterministicFst
   int32 max_ngram_order_;
   int32 bos_index_;
   int32 eos_index_;
+  RnnlmStateCache *cache_;
 
   MapType wseq_to_state_;
 
@@ -21,6 +21,7 @@
 #include <numeric>
 #include "rnnlm/sampler.h"
 #include "util/stl-utils.h"
+#include "base/timer.h"
 
 namespace kaldi {
 namespace rnnlm {
@@ -182,7 +183,71 @@ void NormalizeProbs(int32 num_words_to_sample,
   }
 }
 
-void UnitTestSampleWords() {
+void UnitTestAliasTable() {
+  int32 num_tries = 20;
+  for (int32 t = 0; t < num_tries; t++) {
+    int32 n = RandInt(1, 200);
+    std::vector<double> probs(n);
+    for (int32 i = 0; i < n; i++)
+      probs[i] = (WithProb(0.2) ? RandInt(0, 1) : RandUniform());
+    probs[RandInt(0, n - 1)] += 0.1;  // make sure the total is nonzero.
+    std::vector<double> accept_probs;
+    std::vector<int32> alias;
+    BuildAliasTable(probs, &accept_probs, &alias);
+    KALDI_ASSERT(accept_probs.size() == size_t(n) && alias.size() == size_t(n));
+
+    // Check that the table represents exactly the distribution 'probs'.
+    std::vector<double> table_probs(n, 0.0);
+    for (int32 i = 0; i < n; i++) {
+      KALDI_ASSERT(accept_probs[i] >= 0.0 && accept_probs[i] <= 1.0 &&
+                   alias[i] >= 0 && alias[i] < n);
+      table_probs[i] += accept_probs[i];
+      table_probs[alias[i]] += 1.0 - accept_probs[i];
+    }
+    KALDI_ASSERT(NormalizedSquaredDiffLessThanThreshold(probs, table_probs,
+                                                        1.0e-05));
+
+    std::vector<double> sample_total(n);
+    size_t l = 0;
+    while (true) {
+      // this will loop forever if the samples don't approach 'probs'.
+      int32 i = SampleFromAliasTable(accept_probs, alias);
+      KALDI_ASSERT(probs[i] > 0.0);
+      sample_total[i] += 1.0;
+      if (l % 100 == 0 &&
+          NormalizedSquaredDiffLessThanThreshold(probs, sample_total, 0.05)) {
+        KALDI_LOG << "Converged after " << l << " iterations.";
+        break;
+      }
+      l++;
+    }
+  }
+}
+
+void UnitTestMergeDistributions() {
+  for (int32 t = 0; t < 100; t++) {
+    Distribution d1, d2;
+    for (int32 i = RandInt(0, 20); i > 0; i--)
+      d1.push_back(std::pair<int32, BaseFloat>(RandInt(0, 30),
+                                               0.01 + RandUniform()));
+    for (int32 i = RandInt(0, 20); i > 0; i--)
+      d2.push_back(std::pair<int32, BaseFloat>(RandInt(0, 30),
+                                               0.01 + RandUniform()));
+    MergePairVectorSumming(&d1);
+    MergePairVectorSumming(&d2);
+    Distribution d, d_ref(d1);
+    d_ref.insert(d_ref.end(), d2.begin(), d2.end());
+    MergePairVectorSumming(&d_ref);
+    MergeDistributions(d1, d2, &d);
+    KALDI_ASSERT(d.size() == d_ref.size());
+    for (size_t i = 0; i < d.size(); i++) {
+      KALDI_ASSERT(d[i].first == d_ref[i].first);
+      AssertEqual(d[i].second, d_ref[i].second);
+    }
+  }
+}
+
+void UnitTestSampleWords(bool use_alias_table) {
   int32 num_tries = 50;
   for (int32 t = 0; t < num_tries; t++) {
     int32 vocab_size = RandInt(200, 300);
@@ -245,7 +310,7 @@ void UnitTestSampleWords() {
     NormalizeProbs(num_words_to_sample,
                    &full_distribution);
 
-    Sampler sampler(unigram_probs);
+    Sampler sampler(unigram_probs, use_alias_table);
     std::vector<double> sample_total(vocab_size);
     size_t l = 0;
     while (true) {
@@ -274,6 +339,41 @@ void UnitTestSampleWords() {
   }
 }
 
+// Compares the speed of SampleWords() with and without the alias table, with
+// a Zipfian unigram distribution of a realistic vocabulary size.
+void UnitTestSampleWordsSpeed() {
+  int32 vocab_size = 100000, num_words_to_sample = 512,
+      num_minibatches = 200;
+  std::vector<BaseFloat> unigram_probs(vocab_size);
+  double total = 0.0;
+  for (int32 i = 0; i < vocab_size; i++)
+    total += (unigram_probs[i] = 1.0 / (i + 10));
+  for (int32 i = 0; i < vocab_size; i++)
+    unigram_probs[i] /= total;
+  std::vector<std::vector<std::pair<int32, BaseFloat> > > higher_order_probs(
+      num_minibatches);
+  for (int32 m = 0; m < num_minibatches; m++) {
+    for (int32 i = 0; i < 200; i++)
+      higher_order_probs[m].push_back(std::pair<int32, BaseFloat>(
+          RandInt(0, vocab_size - 1), 0.01 * RandUniform() + 1.0e-04));
+    MergePairVectorSumming(&(higher_order_probs[m]));
+  }
+  for (int32 use_alias_table = 0; use_alias_table <= 1; use_alias_table++) {
+    Sampler sampler(unigram_probs, use_alias_table != 0);
+    std::vector<std::pair<int32, BaseFloat> > sample;
+    Timer timer;
+    for (int32 m = 0; m < num_minibatches; m++)
+      sampler.SampleWords(num_words_to_sample, 0.5, higher_order_probs[m],
+                          &sample);
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "For use-alias-table=" << (use_alias_table != 0 ? "true" : "false")
+              << ", sampled " << (num_minibatches * num_words_to_sample)
+              << " words in " << elapsed << " seconds ("
+              << (num_minibatches * num_words_to_sample / elapsed)
+              << " words per second).";
+  }
+}
+
 
 }  // end namespace rnnlm.
 }  // end namespace kaldi.
@@ -283,5 +383,10 @@ int main() {
   using namespace kaldi::rnnlm;
   UnitTestSampleWithoutReplacement();
   UnitTestSampleFromCdf();
-  UnitTestSampleWords();
+  UnitTestAliasTable();
+  UnitTestMergeDistributions();
+  UnitTestSampleWords(false);
+  UnitTestSampleWords(true);
+  kaldi::SetVerboseLevel(0);  // don't time the extra testing code.
+  UnitTestSampleWordsSpeed();
 }
@@ -142,10 +142,11 @@ BaseFloat TotalOfDistribution(const Distribution &d) {
 
 
 const double* SampleFromCdf(const double *cdf_start,
-                            const double *cdf_end) {
+                            const double *cdf_end,
+                            struct RandomState *state) {
   double tot_prob = *cdf_end - *cdf_start;
   KALDI_ASSERT(cdf_end > cdf_start && tot_prob > 0.0);
-  double cutoff = *cdf_start + tot_prob * RandUniform();
+  double cutoff = *cdf_start + tot_prob * RandUniform(state);
   if (cutoff >= *cdf_end) {
     // Mathematically speaking this should not happen; if it happens it is due
     // to roundoff.  It should be extremely rare in any case.
@@ -181,16 +182,87 @@ void MergeDistributions(const Distribution &d1,
     CheckDistribution(d1);
     CheckDistribution(d2);
   }
+  // Since both inputs are sorted and unique, we can merge them and sum
+  // duplicates in one pass; this avoids the sort that
+  // MergePairVectorSumming() would do.
   d->resize(d1.size() + d2.size());
-  // we could write a single function that does the jobs of the
-  // two things below, which might improve speed slightly, if
-  // this becomes a bottleneck.
-  std::merge(d1.begin(), d1.end(), d2.begin(), d2.end(), d->begin());
-  MergePairVectorSumming(d);
+  Distribution::const_iterator iter1 = d1.begin(), end1 = d1.end(),
+      iter2 = d2.begin(), end2 = d2.end();
+  Distribution::iterator out = d->begin();
+  while (iter1 != end1 && iter2 != end2) {
+    if (iter1->first < iter2->first) {
+      *(out++) = *(iter1++);
+    } else if (iter2->first < iter1->first) {
+      *(out++) = *(iter2++);
+    } else {
+      out->first = iter1->first;
+      out->second = iter1->second + iter2->second;
+      ++out;
+      ++iter1;
+      ++iter2;
+    }
+  }
+  out = std::copy(iter1, end1, out);
+  out = std::copy(iter2, end2, out);
+  d->erase(out, d->end());
   if (GetVerboseLevel() >= 2) {
     CheckDistribution(*d);
   }
+}
+
 
+void BuildAliasTable(const std::vector<double> &probs,
+                     std::vector<double> *accept_probs,
+                     std::vector<int32> *alias) {
+  int32 n = probs.size();
+  KALDI_ASSERT(n > 0);
+  double total = std::accumulate(probs.begin(), probs.end(), 0.0);
+  KALDI_ASSERT(total > 0.0);
+  accept_probs->resize(n);
+  alias->resize(n);
+  // 'scaled' is probs * n / total, so the average element is 1.0.  Elements
+  // below 1.0 go in 'small' and the rest in 'large'; we repeatedly fill up a
+  // small element's column with mass from a large element.
+  std::vector<double> scaled(n);
+  std::vector<int32> small, large;
+  small.reserve(n);
+  large.reserve(n);
+  double scale = n / total;
+  for (int32 i = 0; i < n; i++) {
+    KALDI_ASSERT(probs[i] >= 0.0);
+    scaled[i] = probs[i] * scale;
+    (*alias)[i] = i;
+    if (scaled[i] < 1.0) small.push_back(i);
+    else large.push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    int32 s = small.back(), l = large.back();
+    small.pop_back();
+    (*accept_probs)[s] = scaled[s];
+    (*alias)[s] = l;
+    scaled[l] -= (1.0 - scaled[s]);
+    if (scaled[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // Anything left over is 1.0 up to roundoff.
+  for (size_t i = 0; i < large.size(); i++)
+    (*accept_probs)[large[i]] = 1.0;
+  for (size_t i = 0; i < small.size(); i++)
+    (*accept_probs)[small[i]] = 1.0;
+}
+
+
+int32 SampleFromAliasTable(const std::vector<double> &accept_probs,
+                           const std::vector<int32> &alias,
+                           struct RandomState *state) {
+  int32 n = accept_probs.size();
+  int32 i = RandInt(0, n - 1, state);
+  if (RandUniform(state) < accept_probs[i])
+    return i;
+  else
+    return alias[i];
 }
 
 
@@ -265,7 +337,8 @@ void Sampler::SampleWords(
   }
 }
 
-Sampler::Sampler(const std::vector<BaseFloat> &unigram_probs) {
+Sampler::Sampler(const std::vector<BaseFloat> &unigram_probs,
+                 bool use_alias_table) {
   KALDI_ASSERT(!unigram_probs.empty());
   double total = std::accumulate(unigram_probs.begin(),
                                  unigram_probs.end(),
@@ -281,6 +354,34 @@ Sampler::Sampler(const std::vector<BaseFloat> &unigram_probs) {
     sum += unigram_probs[i];
     unigram_cdf_[i + 1] = sum * inv_total;
   }
+  if (use_alias_table) {
+    std::vector<double> probs(unigram_probs.begin(), unigram_probs.end());
+    BuildAliasTable(probs, &unigram_accept_probs_, &unigram_alias_);
+  }
+}
+
+
+const double* Sampler::SampleFromUnigramInterval(
+    const double *start, const double *end, struct RandomState *state) const {
+  // We only use rejection sampling if the interval covers at least this much
+  // of the unigram mass, and give up after this many tries.  Since each try
+  // that is accepted gives a word with exactly the right (renormalized)
+  // probability, falling back to SampleFromCdf() does not bias the result.
+  const double kMinAliasMass = 0.1;
+  const int32 kMaxTries = 16;
+  if (!unigram_alias_.empty() && *end - *start >= kMinAliasMass) {
+    const double *cdf = &(unigram_cdf_[0]);
+    int32 start_i = start - cdf, end_i = end - cdf;
+    for (int32 t = 0; t < kMaxTries; t++) {
+      int32 w = SampleFromAliasTable(unigram_accept_probs_, unigram_alias_,
+                                     state);
+      // The check on the cdf excludes words whose probability is zero; the
+      // alias table can return them only due to roundoff.
+      if (w >= start_i && w < end_i && cdf[w + 1] > cdf[w])
+        return cdf + w;
+    }
+  }
+  return SampleFromCdf(start, end, state);
 }
 
 
@@ -458,6 +559,9 @@ void Sampler::SampleFromIntervals(const std::vector<Interval> &intervals,
   size_t num_samples = raw_samples.size();
   samples->resize(num_samples);
   const double *cdf_start = &(unigram_cdf_[0]);
+  // Using our own random-number state avoids taking the global lock that
+  // Rand() would take for every sampled word.
+  RandomState random_state;
   for (size_t i = 0; i < num_samples; i++) {
     int32 j = raw_samples[i];  // j is interval index.
     const Interval &interval = intervals[j];
@@ -469,8 +573,9 @@ void Sampler::SampleFromIntervals(const std::vector<Interval> &intervals,
       (*samples)[i].first = word;
       (*samples)[i].second = interval.prob;
     } else {
-      const double *word_ptr = SampleFromCdf(interval.start,
-                                             interval.end);
+      const double *word_ptr = SampleFromUnigramInterval(interval.start,
+                                                         interval.end,
+                                                         &random_state);
       int32 word = word_ptr - cdf_start;
       // the probability with which this word was sampled is: the probability of
       // sampling from this interval of the unigram, times the probability of
@@ -70,11 +70,37 @@ void SampleWithoutReplacement(const std::vector<double> &probs,
                             example, so we'd return 'cdf_start' with proability 0.25,
                             'cdf_start + 1' with probability 0.5, and
                             'cdf_start + 2' with probability 0.25.
+     @param [in] state      If non-NULL, the random number generator state to
+                            use (this avoids locking in multi-threaded use).
      @return                Returns a pointer cdf_start <= p < cdf_end, with probability
                             proportional to p[1] - p[0].
 */
 const double* SampleFromCdf(const double *cdf_start,
-                            const double *cdf_end);
+                            const double *cdf_end,
+                            struct RandomState *state = NULL);
+
+
+/**
+   Builds an alias table (Walker's alias method, using Vose's O(n)
+   construction) for the distribution 'probs', which must be nonempty with
+   nonnegative elements and a positive sum (it need not be normalized).  After
+   this call, 'accept_probs' and 'alias' both have the same dimension as
+   'probs'.  To sample, pick i uniformly from [0, n); return i with probability
+   accept_probs[i] and otherwise alias[i].  See SampleFromAliasTable().
+ */
+void BuildAliasTable(const std::vector<double> &probs,
+                     std::vector<double> *accept_probs,
+                     std::vector<int32> *alias);
+
+/**
+   Samples from the distribution represented by an alias table that was
+   created by BuildAliasTable(), in constant time.  It is a utility function
+   used in class Sampler; it is a namespace function so that we can test it.
+   If 'state' is non-NULL it is used as the random number generator state.
+ */
+int32 SampleFromAliasTable(const std::vector<double> &accept_probs,
+                           const std::vector<int32> &alias,
+                           struct RandomState *state = NULL);
 
 
 /**
@@ -92,7 +118,13 @@ class Sampler {
   // a value close to 1.
   // This class does not retain a reference to 'unigram_probs' after
   // the constructor exits.
-  explicit Sampler(const std::vector<BaseFloat> &unigram_probs);
+  // If 'use_alias_table' is true (the default), we also build an alias table
+  // for the unigram distribution and use it (via rejection sampling) to pick
+  // words from large unigram intervals in constant expected time, instead of
+  // by binary search in the cdf.  This does not change the distribution of
+  // the samples; the option exists only so the two paths can be compared.
+  explicit Sampler(const std::vector<BaseFloat> &unigram_probs,
+                   bool use_alias_table = true);
 
 
   /// Sample words from the supplied distribution, appropriately scaled.
@@ -225,6 +257,16 @@ class Sampler {
                              const std::vector<std::pair<int32, BaseFloat> > &higher_order_probs,
                              std::vector<Interval> *intervals) const;
 
+  // Samples a word from the interval [start, end) of unigram_cdf_, with
+  // probability proportional to its unigram probability (i.e. the same
+  // distribution as SampleFromCdf(start, end)), and returns a pointer into
+  // unigram_cdf_ as SampleFromCdf() does.  If the interval holds a large
+  // enough part of the unigram mass, it does this by rejection sampling
+  // from the alias table; otherwise it falls back to SampleFromCdf().
+  const double* SampleFromUnigramInterval(const double *start,
+                                          const double *end,
+                                          struct RandomState *state) const;
+
 
 
   // the cdf (cumulative density function) of the unigram distribution, indexed
@@ -233,6 +275,11 @@ class Sampler {
   // distribution is normalized, so unigram_cdf_[0] == 0.0 and
   // unigram_cdf_.back() == 1.0
   std::vector<double> unigram_cdf_;
+
+  // The alias table for the unigram distribution (see BuildAliasTable()).
+  // These are empty if 'use_alias_table' was false in the constructor.
+  std::vector<double> unigram_accept_probs_;
+  std::vector<int32> unigram_alias_;
 };
 
 
@@ -261,7 +308,8 @@ BaseFloat TotalOfDistribution(const Distribution &d);
 
 
 // Merges two distributions, summing the probabilities of any elements that
-// occur in both.
+// occur in both.  This is done in a single linear pass over the two sorted
+// inputs.
 void MergeDistributions(const Distribution &d1,
                         const Distribution &d2,
                         Distribution *d);
@@ -28,6 +28,7 @@
 
 #include "base/kaldi-common.h"
 #include "itf/options-itf.h"
+#include "matrix/simd-math.h"
 
 namespace kaldi {
 
@@ -48,6 +49,10 @@ class ParseOptions : public OptionsItf {
     RegisterStandard("help", &help_, "Print out usage message");
     RegisterStandard("verbose", &g_kaldi_verbose_level,
                      "Verbose level (higher->more logging)");
+    RegisterStandard("fast-math", &g_kaldi_fast_math,
+                     "If true, use fast vectorized approximations of exp(), "
+                     "log(), sigmoid and tanh for single-precision data on "
+                     "CPU; if false, use the C library");
   }
 
   /**